@@ -0,0 +1,33 @@
+#version 330 core
+
+// Classification of the cells - level 0 of the histogram pyramid
+//  The texel (i,j) corresponds to the cell i + pyramid_size * j (cells numbered along x, then y, then z),
+//  and receives the number of vertices generated by the cell.
+
+layout(location=0) out uint count;
+
+uniform sampler3D field;    // Samples of the field
+uniform usampler2D table;   // Edges of each configuration (row), and their number in the column 31
+uniform ivec3 cells;        // Number of cells along each axis
+uniform int pyramid_size;
+uniform float isovalue;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int index = texel.x + pyramid_size * texel.y;
+	if (index >= cells.x * cells.y * cells.z) {
+		count = 0u;
+		return;
+	}
+	ivec3 cell = ivec3(index % cells.x, (index / cells.x) % cells.y, index / (cells.x * cells.y));
+
+	// Corner c of the cell is at (c&1, (c>>1)&1, (c>>2)&1), and is inside when its value is above the isovalue
+	int configuration = 0;
+	for (int c = 0; c < 8; ++c) {
+		float value = texelFetch(field, cell + ivec3(c & 1, (c >> 1) & 1, (c >> 2) & 1), 0).r;
+		if (value > isovalue)
+			configuration |= 1 << c;
+	}
+	count = texelFetch(table, ivec2(31, configuration), 0).r;
+}
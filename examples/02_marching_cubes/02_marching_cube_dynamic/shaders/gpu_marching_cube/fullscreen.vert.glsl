@@ -0,0 +1,10 @@
+#version 330 core
+
+// Vertex shader of the passes of the histogram pyramid
+//  A single triangle covers the viewport: one fragment per texel of the level of the pyramid that is written.
+
+void main()
+{
+	vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(2.0 * p - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,95 @@
+#version 330 core
+
+// Generation of the vertices (captured by transform feedback, without rasterization)
+//  The vertex gl_VertexID descends the histogram pyramid from its top: at each level, the key is compared with the
+//  counts of the 4 children (in the order of their sum in reduce.frag.glsl). At level 0, the texel gives the cell
+//  and the remaining key is the rank of the vertex in the cell.
+
+uniform usampler2D pyramid;
+uniform usampler2D table;
+uniform sampler3D field;
+uniform int pyramid_levels;
+uniform int pyramid_size;
+uniform ivec3 cells;
+uniform float isovalue;
+uniform vec3 p0;                 // Position of the sample (0,0,0)
+uniform vec3 step;               // Distance between two samples along each axis
+uniform ivec2 edge_corners[12];  // The two corners of each edge (the edges 4a to 4a+3 are along the axis a)
+
+out vec3 vertex_position;
+out vec3 vertex_normal;
+flat out uint vertex_edge;       // 3 * (index of the lower sample of the edge) + axis of the edge
+
+float value(ivec3 k)
+{
+	return texelFetch(field, k, 0).r;
+}
+
+// Finite differences of the field (forward, and backward on the last sample)
+vec3 gradient(ivec3 k)
+{
+	ivec3 last = cells;
+	float f = value(k);
+	return vec3(
+		k.x != last.x ? value(k + ivec3(1, 0, 0)) - f : f - value(k - ivec3(1, 0, 0)),
+		k.y != last.y ? value(k + ivec3(0, 1, 0)) - f : f - value(k - ivec3(0, 1, 0)),
+		k.z != last.z ? value(k + ivec3(0, 0, 1)) - f : f - value(k - ivec3(0, 0, 1)));
+}
+
+ivec3 corner(int c)
+{
+	return ivec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+}
+
+void main()
+{
+	uint key = uint(gl_VertexID);
+	ivec2 p = ivec2(0, 0);
+	for (int level = pyramid_levels - 2; level >= 0; --level) {
+		p *= 2;
+		uint c00 = texelFetch(pyramid, p, level).r;
+		if (key < c00)
+			continue;
+		key -= c00;
+		uint c10 = texelFetch(pyramid, p + ivec2(1, 0), level).r;
+		if (key < c10) {
+			p.x += 1;
+			continue;
+		}
+		key -= c10;
+		uint c01 = texelFetch(pyramid, p + ivec2(0, 1), level).r;
+		if (key < c01) {
+			p.y += 1;
+			continue;
+		}
+		key -= c01;
+		p += ivec2(1, 1);
+	}
+
+	int index = p.x + pyramid_size * p.y;
+	ivec3 cell = ivec3(index % cells.x, (index / cells.x) % cells.y, index / (cells.x * cells.y));
+	int configuration = 0;
+	for (int c = 0; c < 8; ++c) {
+		if (value(cell + corner(c)) > isovalue)
+			configuration |= 1 << c;
+	}
+
+	int edge = int(texelFetch(table, ivec2(int(key), configuration), 0).r);
+	ivec3 k0 = cell + corner(edge_corners[edge].x);
+	ivec3 k1 = cell + corner(edge_corners[edge].y);
+	float v0 = value(k0);
+	float v1 = value(k1);
+	float alpha = (isovalue - v0) / (v1 - v0);
+
+	vec3 q0 = p0 + step * vec3(k0);
+	vec3 q1 = p0 + step * vec3(k1);
+	vertex_position = q0 + alpha * (q1 - q0);
+
+	vec3 n = (1.0 - alpha) * gradient(k0) + alpha * gradient(k1);
+	vertex_normal = length(n) > 0.0 ? -normalize(n) : vec3(1.0, 0.0, 0.0);
+
+	ivec3 samples = cells + ivec3(1);
+	vertex_edge = uint(3 * (k0.x + samples.x * (k0.y + samples.y * k0.z)) + edge / 4);
+
+	gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
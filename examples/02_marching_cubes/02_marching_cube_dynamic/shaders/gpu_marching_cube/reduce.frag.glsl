@@ -0,0 +1,15 @@
+#version 330 core
+
+// Reduction of the histogram pyramid
+//  Each texel is the sum of the 2x2 texels of the previous level (the only level accessible in the texture during the pass).
+
+layout(location=0) out uint count;
+
+uniform usampler2D pyramid;
+
+void main()
+{
+	ivec2 p = 2 * ivec2(gl_FragCoord.xy);
+	count = texelFetch(pyramid, p, 0).r + texelFetch(pyramid, p + ivec2(1, 0), 0).r
+		+ texelFetch(pyramid, p + ivec2(0, 1), 0).r + texelFetch(pyramid, p + ivec2(1, 1), 0).r;
+}
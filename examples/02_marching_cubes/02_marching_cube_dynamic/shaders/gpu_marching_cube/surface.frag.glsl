@@ -0,0 +1,42 @@
+#version 330 core
+
+// Fragment shader of the surface generated by the GPU marching cube
+//  Two-sided Phong illumination with the same coefficients as the default material of mesh_drawable.
+
+in struct fragment_data
+{
+	vec3 position;
+	vec3 normal;
+} fragment;
+
+layout(location=0) out vec4 FragColor;
+
+uniform mat4 view;
+uniform vec3 light;
+uniform vec3 color;
+uniform bool wireframe; // Uniform color without illumination
+
+void main()
+{
+	if (wireframe) {
+		FragColor = vec4(color, 1.0);
+		return;
+	}
+
+	mat3 O = transpose(mat3(view));
+	vec3 last_col = vec3(view * vec4(0.0, 0.0, 0.0, 1.0));
+	vec3 camera_position = -O * last_col;
+
+	vec3 N = normalize(fragment.normal);
+	if (gl_FrontFacing == false)
+		N = -N;
+
+	vec3 L = normalize(light - fragment.position);
+	float diffuse = max(dot(N, L), 0.0);
+	vec3 R = reflect(-L, N);
+	vec3 V = normalize(camera_position - fragment.position);
+	float specular = diffuse > 0.0 ? pow(max(dot(R, V), 0.0), 64.0) : 0.0;
+
+	vec3 c = (0.3 + 0.6 * diffuse) * color + 0.1 * specular * vec3(1.0, 1.0, 1.0);
+	FragColor = vec4(c, 1.0);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+// Vertex shader of the surface generated by the GPU marching cube (positions and normals in world space)
+
+layout (location = 0) in vec3 vertex_position;
+layout (location = 1) in vec3 vertex_normal;
+
+out struct fragment_data
+{
+	vec3 position;
+	vec3 normal;
+} fragment;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	fragment.position = vertex_position;
+	fragment.normal = vertex_normal;
+	gl_Position = projection * view * vec4(vertex_position, 1.0);
+}
@@ -0,0 +1,382 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../noise_cache/noise_cache.hpp"
+#include <memory>
+
+// Implicit fields written as compositions of expressions
+// ********************************************** //
+//  The nodes are combined at compile time into a single type, such that the evaluation of a field such as
+//     blend(sphere(a, 0.5f), sphere(b, 0.5f), 0.2f) + 0.3f * noise(0.5f)
+//  is one inlined function of the position, without loop over the terms nor branch on their types.
+//  Each node provides
+//   - value(p): value of the field at position p
+//   - value(p, gradient): value and analytic gradient (only the nodes with has_gradient == true)
+//   - bounds(p_min, p_max, value_min, value_max): conservative range of the field over a box
+//  evaluate_box fills the samples of a grid row by row: the loop over the samples of a row only contains the inlined
+//  expression, and can be vectorized by the compiler when the functions of the nodes allow it.
+//  make_kernel hides the type of an expression behind a virtual interface called once per box of samples.
+
+namespace field_expression {
+
+	// Base of the nodes (used to restrict the operators to the expressions)
+	template <typename E> struct node {
+		E const& derived() const { return static_cast<E const&>(*this); }
+	};
+
+
+	// ***************************//
+	// Primitives
+	// ***************************//
+
+	struct constant_node : node<constant_node> {
+		static constexpr bool has_gradient = true;
+		float c;
+
+		explicit constant_node(float c_arg) : c(c_arg) {}
+		float value(cgp::vec3 const&) const { return c; }
+		float value(cgp::vec3 const&, cgp::vec3& gradient) const { gradient = { 0, 0, 0 }; return c; }
+		void bounds(cgp::vec3 const&, cgp::vec3 const&, float& value_min, float& value_max) const { value_min = value_max = c; }
+	};
+
+	// Smallest and largest squared distances between the point c and the box [p_min, p_max]
+	inline void distance_squared_range(cgp::vec3 const& c, cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& d2_min, float& d2_max)
+	{
+		d2_min = 0.0f;
+		d2_max = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			float const a = p_min[k] - c[k];
+			float const b = c[k] - p_max[k];
+			float const closest = std::max(0.0f, std::max(a, b));
+			float const farthest = std::max(std::abs(a), std::abs(b));
+			d2_min += closest * closest;
+			d2_max += farthest * farthest;
+		}
+	}
+
+	// magnitude exp(-||p-center||^2/radius^2)
+	struct gaussian_node : node<gaussian_node> {
+		static constexpr bool has_gradient = true;
+		cgp::vec3 center;
+		float inv_r2;
+		float magnitude;
+
+		gaussian_node(cgp::vec3 const& center_arg, float radius, float magnitude_arg) : center(center_arg), inv_r2(1.0f / (radius * radius)), magnitude(magnitude_arg) {}
+		float value(cgp::vec3 const& p) const {
+			cgp::vec3 const d = p - center;
+			return magnitude * std::exp(-(d.x * d.x + d.y * d.y + d.z * d.z) * inv_r2);
+		}
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 const d = p - center;
+			float const v = magnitude * std::exp(-(d.x * d.x + d.y * d.y + d.z * d.z) * inv_r2);
+			gradient = (-2 * v * inv_r2) * d;
+			return v;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float d2_min, d2_max;
+			distance_squared_range(center, p_min, p_max, d2_min, d2_max);
+			float const a = magnitude * std::exp(-d2_min * inv_r2), b = magnitude * std::exp(-d2_max * inv_r2);
+			value_min = std::min(a, b);
+			value_max = std::max(a, b);
+		}
+	};
+
+	// Metaball magnitude (1 - ||p-center||^2/radius^2)^3 inside the sphere, 0 outside
+	struct sphere_node : node<sphere_node> {
+		static constexpr bool has_gradient = true;
+		cgp::vec3 center;
+		float inv_r2;
+		float magnitude;
+
+		sphere_node(cgp::vec3 const& center_arg, float radius, float magnitude_arg) : center(center_arg), inv_r2(1.0f / (radius * radius)), magnitude(magnitude_arg) {}
+		float kernel(float d2) const {
+			float const u = std::max(1 - d2 * inv_r2, 0.0f);
+			return magnitude * u * u * u;
+		}
+		float value(cgp::vec3 const& p) const {
+			cgp::vec3 const d = p - center;
+			return kernel(d.x * d.x + d.y * d.y + d.z * d.z);
+		}
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 const d = p - center;
+			float const u = std::max(1 - (d.x * d.x + d.y * d.y + d.z * d.z) * inv_r2, 0.0f);
+			gradient = (-6 * magnitude * u * u * inv_r2) * d;
+			return magnitude * u * u * u;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float d2_min, d2_max;
+			distance_squared_range(center, p_min, p_max, d2_min, d2_max);
+			float const a = kernel(d2_min), b = kernel(d2_max);
+			value_min = std::min(a, b);
+			value_max = std::max(a, b);
+		}
+	};
+
+	// Noise magnitude noise_perlin(scale p + offset)  (no analytic gradient)
+	struct noise_node : node<noise_node> {
+		static constexpr bool has_gradient = false;
+		float magnitude;
+		float scale;
+		cgp::vec3 offset;
+		int octave;
+		float persistance;
+
+		noise_node(float magnitude_arg, float scale_arg, cgp::vec3 const& offset_arg, int octave_arg, float persistance_arg)
+			: magnitude(magnitude_arg), scale(scale_arg), offset(offset_arg), octave(octave_arg), persistance(persistance_arg) {}
+		float value(cgp::vec3 const& p) const { return magnitude * cgp::noise_perlin(scale * p + offset, octave, persistance); }
+		void bounds(cgp::vec3 const&, cgp::vec3 const&, float& value_min, float& value_max) const {
+			// Each octave is in [0,1] (with a small margin as the gradient noise can slightly exceed its nominal range)
+			float amplitude = 0.0f, a = 1.0f;
+			for (int k = 0; k < octave; ++k) {
+				amplitude += a;
+				a *= persistance;
+			}
+			value_min = std::min(-0.1f * magnitude * amplitude, 1.1f * magnitude * amplitude);
+			value_max = std::max(-0.1f * magnitude * amplitude, 1.1f * magnitude * amplitude);
+		}
+	};
+
+	// Same as noise_node using a precomputed table (the table must outlive the node)
+	struct noise_cache_node : node<noise_cache_node> {
+		static constexpr bool has_gradient = false;
+		float magnitude;
+		float scale;
+		cgp::vec3 offset;
+		noise_cache_3D const* cache;
+
+		noise_cache_node(float magnitude_arg, float scale_arg, cgp::vec3 const& offset_arg, noise_cache_3D const& cache_arg)
+			: magnitude(magnitude_arg), scale(scale_arg), offset(offset_arg), cache(&cache_arg) {}
+		float value(cgp::vec3 const& p) const { return magnitude * (*cache)(scale * p + offset); }
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			noise_node(magnitude, scale, offset, cache->parameters.octave, cache->parameters.persistency).bounds(p_min, p_max, value_min, value_max);
+		}
+	};
+
+
+	// ***************************//
+	// Compositions
+	// ***************************//
+
+	template <typename A, typename B> struct sum_node : node<sum_node<A, B>> {
+		static constexpr bool has_gradient = A::has_gradient && B::has_gradient;
+		A a;
+		B b;
+
+		sum_node(A const& a_arg, B const& b_arg) : a(a_arg), b(b_arg) {}
+		float value(cgp::vec3 const& p) const { return a.value(p) + b.value(p); }
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 ga, gb;
+			float const v = a.value(p, ga) + b.value(p, gb);
+			gradient = ga + gb;
+			return v;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float a_min, a_max, b_min, b_max;
+			a.bounds(p_min, p_max, a_min, a_max);
+			b.bounds(p_min, p_max, b_min, b_max);
+			value_min = a_min + b_min;
+			value_max = a_max + b_max;
+		}
+	};
+
+	template <typename A, typename B> struct difference_node : node<difference_node<A, B>> {
+		static constexpr bool has_gradient = A::has_gradient && B::has_gradient;
+		A a;
+		B b;
+
+		difference_node(A const& a_arg, B const& b_arg) : a(a_arg), b(b_arg) {}
+		float value(cgp::vec3 const& p) const { return a.value(p) - b.value(p); }
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 ga, gb;
+			float const v = a.value(p, ga) - b.value(p, gb);
+			gradient = ga - gb;
+			return v;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float a_min, a_max, b_min, b_max;
+			a.bounds(p_min, p_max, a_min, a_max);
+			b.bounds(p_min, p_max, b_min, b_max);
+			value_min = a_min - b_max;
+			value_max = a_max - b_min;
+		}
+	};
+
+	template <typename A> struct scale_node : node<scale_node<A>> {
+		static constexpr bool has_gradient = A::has_gradient;
+		float s;
+		A a;
+
+		scale_node(float s_arg, A const& a_arg) : s(s_arg), a(a_arg) {}
+		float value(cgp::vec3 const& p) const { return s * a.value(p); }
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			float const v = s * a.value(p, gradient);
+			gradient = s * gradient;
+			return v;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float a_min, a_max;
+			a.bounds(p_min, p_max, a_min, a_max);
+			value_min = std::min(s * a_min, s * a_max);
+			value_max = std::max(s * a_min, s * a_max);
+		}
+	};
+
+	// Union (maximum) and intersection (minimum) of two fields
+	template <typename A, typename B, bool maximum> struct select_node : node<select_node<A, B, maximum>> {
+		static constexpr bool has_gradient = A::has_gradient && B::has_gradient;
+		A a;
+		B b;
+
+		select_node(A const& a_arg, B const& b_arg) : a(a_arg), b(b_arg) {}
+		float value(cgp::vec3 const& p) const {
+			float const va = a.value(p), vb = b.value(p);
+			return maximum ? std::max(va, vb) : std::min(va, vb);
+		}
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 ga, gb;
+			float const va = a.value(p, ga), vb = b.value(p, gb);
+			bool const first = maximum ? va >= vb : va <= vb;
+			gradient = first ? ga : gb;
+			return first ? va : vb;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float a_min, a_max, b_min, b_max;
+			a.bounds(p_min, p_max, a_min, a_max);
+			b.bounds(p_min, p_max, b_min, b_max);
+			value_min = maximum ? std::max(a_min, b_min) : std::min(a_min, b_min);
+			value_max = maximum ? std::max(a_max, b_max) : std::min(a_max, b_max);
+		}
+	};
+
+	// Smooth maximum of two fields (polynomial, the transition has a width k)
+	//  blend(a,b) = mix(b, a, h) + k h (1-h)  with h = clamp(1/2 + (a-b)/(2k), 0, 1), and its gradient is mix(grad b, grad a, h)
+	template <typename A, typename B> struct blend_node : node<blend_node<A, B>> {
+		static constexpr bool has_gradient = A::has_gradient && B::has_gradient;
+		A a;
+		B b;
+		float k;
+
+		blend_node(A const& a_arg, B const& b_arg, float k_arg) : a(a_arg), b(b_arg), k(k_arg) {}
+		float combine(float va, float vb, float& h) const {
+			h = std::min(std::max(0.5f + 0.5f * (va - vb) / k, 0.0f), 1.0f);
+			return vb + h * (va - vb) + k * h * (1 - h);
+		}
+		float value(cgp::vec3 const& p) const {
+			float h;
+			return combine(a.value(p), b.value(p), h);
+		}
+		float value(cgp::vec3 const& p, cgp::vec3& gradient) const {
+			cgp::vec3 ga, gb;
+			float h;
+			float const v = combine(a.value(p, ga), b.value(p, gb), h);
+			gradient = gb + h * (ga - gb);
+			return v;
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const {
+			float a_min, a_max, b_min, b_max;
+			a.bounds(p_min, p_max, a_min, a_max);
+			b.bounds(p_min, p_max, b_min, b_max);
+			// max(a,b) <= blend(a,b) <= max(a,b) + k/4
+			value_min = std::max(a_min, b_min);
+			value_max = std::max(a_max, b_max) + k / 4;
+		}
+	};
+
+
+	// ***************************//
+	// Construction
+	// ***************************//
+
+	inline constant_node constant(float c) { return constant_node(c); }
+	inline gaussian_node gaussian(cgp::vec3 const& center, float radius = 1.0f, float magnitude = 1.0f) { return gaussian_node(center, radius, magnitude); }
+	inline sphere_node sphere(cgp::vec3 const& center, float radius = 1.0f, float magnitude = 1.0f) { return sphere_node(center, radius, magnitude); }
+	inline noise_node noise(float magnitude, float scale = 1.0f, cgp::vec3 const& offset = { 0, 0, 0 }, int octave = 5, float persistance = 0.3f) { return noise_node(magnitude, scale, offset, octave, persistance); }
+	inline noise_cache_node noise(float magnitude, float scale, cgp::vec3 const& offset, noise_cache_3D const& cache) { return noise_cache_node(magnitude, scale, offset, cache); }
+
+	template <typename A, typename B> sum_node<A, B> operator+(node<A> const& a, node<B> const& b) { return sum_node<A, B>(a.derived(), b.derived()); }
+	template <typename A> sum_node<A, constant_node> operator+(node<A> const& a, float c) { return sum_node<A, constant_node>(a.derived(), constant_node(c)); }
+	template <typename A> sum_node<constant_node, A> operator+(float c, node<A> const& a) { return sum_node<constant_node, A>(constant_node(c), a.derived()); }
+	template <typename A, typename B> difference_node<A, B> operator-(node<A> const& a, node<B> const& b) { return difference_node<A, B>(a.derived(), b.derived()); }
+	template <typename A> difference_node<A, constant_node> operator-(node<A> const& a, float c) { return difference_node<A, constant_node>(a.derived(), constant_node(c)); }
+	template <typename A> difference_node<constant_node, A> operator-(float c, node<A> const& a) { return difference_node<constant_node, A>(constant_node(c), a.derived()); }
+	template <typename A> scale_node<A> operator*(float s, node<A> const& a) { return scale_node<A>(s, a.derived()); }
+	template <typename A> scale_node<A> operator*(node<A> const& a, float s) { return scale_node<A>(s, a.derived()); }
+	template <typename A> scale_node<A> operator-(node<A> const& a) { return scale_node<A>(-1.0f, a.derived()); }
+
+	template <typename A, typename B> select_node<A, B, true> unite(node<A> const& a, node<B> const& b) { return select_node<A, B, true>(a.derived(), b.derived()); }
+	template <typename A, typename B> select_node<A, B, false> intersect(node<A> const& a, node<B> const& b) { return select_node<A, B, false>(a.derived(), b.derived()); }
+	template <typename A, typename B> blend_node<A, B> blend(node<A> const& a, node<B> const& b, float k = 0.2f) { return blend_node<A, B>(a.derived(), b.derived(), k); }
+
+
+	// ***************************//
+	// Evaluation on a grid
+	// ***************************//
+
+	// Rows of samples, with the gradient only for the expressions providing it
+	template <typename E, bool has_gradient = E::has_gradient> struct row_evaluation {
+		static void run(E const& e, cgp::vec3 const& p, float step_x, int n, float* values, cgp::vec3* gradients) {
+			if (gradients != nullptr) {
+				for (int kx = 0; kx < n; ++kx)
+					values[kx] = e.value({ p.x + kx * step_x, p.y, p.z }, gradients[kx]);
+			}
+			else {
+				for (int kx = 0; kx < n; ++kx)
+					values[kx] = e.value({ p.x + kx * step_x, p.y, p.z });
+			}
+		}
+	};
+	template <typename E> struct row_evaluation<E, false> {
+		static void run(E const& e, cgp::vec3 const& p, float step_x, int n, float* values, cgp::vec3*) {
+			for (int kx = 0; kx < n; ++kx)
+				values[kx] = e.value({ p.x + kx * step_x, p.y, p.z });
+		}
+	};
+
+	// Fill values[kx + Nx*(ky + Ny*kz)] for the samples k_begin <= k < k_end of the domain
+	//  gradients is only filled when the expression has an analytic gradient (it is ignored otherwise)
+	template <typename E> void evaluate_box(node<E> const& expression, cgp::spatial_domain_grid_3D const& domain, cgp::int3 const& k_begin, cgp::int3 const& k_end, float* values, cgp::vec3* gradients = nullptr)
+	{
+		// Local copy: the parameters of the nodes stay in registers as they cannot alias the values written
+		E const e = expression.derived();
+		int const Nx = domain.samples.x;
+		int const Ny = domain.samples.y;
+		cgp::vec3 const p0 = domain.position({ 0, 0, 0 });
+		cgp::vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+		for (int kz = k_begin.z; kz < k_end.z; ++kz) {
+			for (int ky = k_begin.y; ky < k_end.y; ++ky) {
+				size_t const offset = k_begin.x + Nx * (ky + size_t(Ny) * kz);
+				cgp::vec3 const p = { p0.x + k_begin.x * step.x, p0.y + ky * step.y, p0.z + kz * step.z };
+				row_evaluation<E>::run(e, p, step.x, k_end.x - k_begin.x, values + offset, gradients != nullptr ? gradients + offset : nullptr);
+			}
+		}
+	}
+
+
+	// Expression behind a virtual interface (one virtual call per box of samples)
+	struct kernel {
+		virtual ~kernel() = default;
+		virtual bool analytic_gradient() const = 0;
+		virtual float value(cgp::vec3 const& p) const = 0;
+		virtual void evaluate_box(cgp::spatial_domain_grid_3D const& domain, cgp::int3 const& k_begin, cgp::int3 const& k_end, float* values, cgp::vec3* gradients) const = 0;
+		virtual void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const = 0;
+	};
+
+	template <typename E> struct kernel_expression : kernel {
+		E expression;
+
+		explicit kernel_expression(E const& e) : expression(e) {}
+		bool analytic_gradient() const override { return E::has_gradient; }
+		float value(cgp::vec3 const& p) const override { return expression.value(p); }
+		void evaluate_box(cgp::spatial_domain_grid_3D const& domain, cgp::int3 const& k_begin, cgp::int3 const& k_end, float* values, cgp::vec3* gradients) const override {
+			field_expression::evaluate_box(expression, domain, k_begin, k_end, values, gradients);
+		}
+		void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const override {
+			expression.bounds(p_min, p_max, value_min, value_max);
+		}
+	};
+
+	template <typename E> std::shared_ptr<kernel const> make_kernel(node<E> const& expression)
+	{
+		return std::make_shared<kernel_expression<E>>(expression.derived());
+	}
+}
@@ -0,0 +1,274 @@
+#include "field_primitives.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+using namespace cgp;
+
+
+float field_gaussian_structure::support(float epsilon) const
+{
+	float const m = std::abs(magnitude);
+	if (m <= epsilon)
+		return 0.0f;
+	return radius * std::sqrt(std::log(m / epsilon));
+}
+
+// Closest point of the core of a metaball to p
+static vec3 closest_core_point(field_primitive_structure const& primitive, vec3 const& p)
+{
+	switch (primitive.type) {
+	case field_primitive_type::capsule: {
+		vec3 const ab = primitive.extent - primitive.center;
+		float const L2 = dot(ab, ab);
+		float const t = L2 > 0 ? std::min(std::max(dot(p - primitive.center, ab) / L2, 0.0f), 1.0f) : 0.0f;
+		return primitive.center + t * ab;
+	}
+	case field_primitive_type::box: {
+		vec3 q;
+		for (int c = 0; c < 3; ++c)
+			q[c] = std::min(std::max(p[c], primitive.center[c] - primitive.extent[c]), primitive.center[c] + primitive.extent[c]);
+		return q;
+	}
+	default:
+		return primitive.center;
+	}
+}
+
+// Value of the primitive at the squared distance d2 of its core
+static float kernel(field_primitive_structure const& primitive, float d2)
+{
+	float const r2 = primitive.radius * primitive.radius;
+	if (primitive.type == field_primitive_type::gaussian) {
+		float const R = field_gaussian_structure{ primitive.center, primitive.magnitude, primitive.radius }.support();
+		return d2 <= R * R ? primitive.magnitude * std::exp(-d2 / r2) : 0.0f;
+	}
+	if (d2 >= r2)
+		return 0.0f;
+	float const u = 1 - d2 / r2;
+	return primitive.magnitude * u * u * u;
+}
+
+void field_primitive_structure::support_box(vec3& box_min, vec3& box_max) const
+{
+	switch (type) {
+	case field_primitive_type::gaussian: {
+		float const R = field_gaussian_structure{ center, magnitude, radius }.support();
+		box_min = center - vec3(R, R, R);
+		box_max = center + vec3(R, R, R);
+		break;
+	}
+	case field_primitive_type::capsule:
+		for (int c = 0; c < 3; ++c) {
+			box_min[c] = std::min(center[c], extent[c]) - radius;
+			box_max[c] = std::max(center[c], extent[c]) + radius;
+		}
+		break;
+	case field_primitive_type::box:
+		box_min = center - extent - vec3(radius, radius, radius);
+		box_max = center + extent + vec3(radius, radius, radius);
+		break;
+	default:
+		box_min = center - vec3(radius, radius, radius);
+		box_max = center + vec3(radius, radius, radius);
+	}
+}
+
+float field_primitive_structure::value(vec3 const& p, vec3* gradient) const
+{
+	vec3 const d = p - closest_core_point(*this, p);
+	float const d2 = dot(d, d);
+	float const r2 = radius * radius;
+	float const v = kernel(*this, d2);
+	if (gradient != nullptr) {
+		// Gaussian: -2 d/r^2 v,  metaball: -6 d/r^2 magnitude (1 - d^2/r^2)^2
+		if (type == field_primitive_type::gaussian)
+			*gradient = (-2 * v / r2) * d;
+		else {
+			float const u = d2 < r2 ? 1 - d2 / r2 : 0.0f;
+			*gradient = (-6 * magnitude * u * u / r2) * d;
+		}
+	}
+	return v;
+}
+
+void field_primitive_structure::bounds(vec3 const& p_min, vec3 const& p_max, float& value_min, float& value_max) const
+{
+	// Smallest squared distance between the box and the core (the core of a capsule is replaced by its bounding box)
+	vec3 core_min = center, core_max = center;
+	if (type == field_primitive_type::capsule) {
+		for (int c = 0; c < 3; ++c) {
+			core_min[c] = std::min(center[c], extent[c]);
+			core_max[c] = std::max(center[c], extent[c]);
+		}
+	}
+	else if (type == field_primitive_type::box) {
+		core_min = center - extent;
+		core_max = center + extent;
+	}
+	float d2_min = 0.0f;
+	for (int c = 0; c < 3; ++c) {
+		float const d = std::max(0.0f, std::max(p_min[c] - core_max[c], core_min[c] - p_max[c]));
+		d2_min += d * d;
+	}
+
+	// The distance to a convex core is a convex function: its maximum over the box is reached at a corner
+	float d2_max = 0.0f;
+	for (int k = 0; k < 8; ++k) {
+		vec3 const p = { (k & 1) ? p_max.x : p_min.x, (k & 2) ? p_max.y : p_min.y, (k & 4) ? p_max.z : p_min.z };
+		vec3 const d = p - closest_core_point(*this, p);
+		d2_max = std::max(d2_max, dot(d, d));
+	}
+
+	float const v_near = kernel(*this, d2_min);
+	float const v_far = kernel(*this, d2_max);
+	value_min = std::min(v_near, v_far);
+	value_max = std::max(v_near, v_far);
+}
+
+
+// Node covering the primitives order[begin, end[, followed by its children
+//  The node at the given depth is a leaf when its children would not fit in the traversal stack.
+static void build_node(field_primitive_bvh_structure& bvh, std::vector<uint32_t>& order, std::vector<vec3> const& box_min, std::vector<vec3> const& box_max,
+	uint32_t begin, uint32_t end, uint32_t leaf_size, int depth)
+{
+	uint32_t const index = uint32_t(bvh.nodes.size());
+	bvh.nodes.push_back(field_primitive_bvh_structure::node());
+
+	vec3 node_min = box_min[order[begin]], node_max = box_max[order[begin]];
+	vec3 centroid_min = (node_min + node_max) / 2.0f, centroid_max = centroid_min;
+	for (uint32_t i = begin + 1; i < end; ++i) {
+		vec3 const centroid = (box_min[order[i]] + box_max[order[i]]) / 2.0f;
+		for (int c = 0; c < 3; ++c) {
+			node_min[c] = std::min(node_min[c], box_min[order[i]][c]);
+			node_max[c] = std::max(node_max[c], box_max[order[i]][c]);
+			centroid_min[c] = std::min(centroid_min[c], centroid[c]);
+			centroid_max[c] = std::max(centroid_max[c], centroid[c]);
+		}
+	}
+	bvh.nodes[index].box_min = node_min;
+	bvh.nodes[index].box_max = node_max;
+
+	if (end - begin <= leaf_size || depth + 2 >= field_primitive_bvh_structure::stack_size) {
+		bvh.nodes[index].first = begin;
+		bvh.nodes[index].count = end - begin;
+		return;
+	}
+
+	// Median split along the largest extent of the centers
+	vec3 const extent = centroid_max - centroid_min;
+	int const axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	uint32_t const middle = begin + (end - begin) / 2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+		return box_min[a][axis] + box_max[a][axis] < box_min[b][axis] + box_max[b][axis];
+	});
+
+	build_node(bvh, order, box_min, box_max, begin, middle, leaf_size, depth + 1);
+	bvh.nodes[index].first = uint32_t(bvh.nodes.size());
+	build_node(bvh, order, box_min, box_max, middle, end, leaf_size, depth + 1);
+}
+
+void field_primitive_bvh_structure::build(std::vector<field_primitive_structure> const& primitives_arg, int leaf_size)
+{
+	size_t const N = primitives_arg.size();
+	nodes.clear();
+	primitives.clear();
+	support_min.clear();
+	support_max.clear();
+	if (N == 0)
+		return;
+
+	std::vector<vec3> box_min(N), box_max(N);
+	for (size_t i = 0; i < N; ++i)
+		primitives_arg[i].support_box(box_min[i], box_max[i]);
+
+	std::vector<uint32_t> order(N);
+	for (size_t i = 0; i < N; ++i)
+		order[i] = uint32_t(i);
+	nodes.reserve(2 * N / std::max(leaf_size, 1) + 1);
+	build_node(*this, order, box_min, box_max, 0, uint32_t(N), uint32_t(std::max(leaf_size, 1)), 0);
+
+	// The primitives of each leaf are contiguous
+	primitives.resize(N);
+	support_min.resize(N);
+	support_max.resize(N);
+	for (size_t i = 0; i < N; ++i) {
+		primitives[i] = primitives_arg[order[i]];
+		support_min[i] = box_min[order[i]];
+		support_max[i] = box_max[order[i]];
+	}
+}
+
+
+std::vector<field_primitive_structure> field_primitives_random(size_t count, field_primitive_type type, float radius, vec3 const& box_min, vec3 const& box_max, unsigned int seed)
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	std::vector<field_primitive_structure> primitives(count);
+	for (field_primitive_structure& primitive : primitives) {
+		primitive.type = type;
+		primitive.radius = radius;
+		for (int c = 0; c < 3; ++c)
+			primitive.center[c] = box_min[c] + uniform(generator) * (box_max[c] - box_min[c]);
+
+		if (type == field_primitive_type::capsule) {
+			vec3 const direction = { uniform(generator) - 0.5f, uniform(generator) - 0.5f, uniform(generator) - 0.5f };
+			primitive.extent = primitive.center + 1.5f * radius * normalize(direction, vec3(1, 0, 0));
+		}
+		else if (type == field_primitive_type::box) {
+			for (int c = 0; c < 3; ++c)
+				primitive.extent[c] = (0.25f + 0.5f * uniform(generator)) * radius;
+		}
+	}
+	return primitives;
+}
+
+bool field_primitives_load(std::string const& filename, float radius, std::vector<field_primitive_structure>& primitives)
+{
+	std::ifstream stream(filename);
+	if (!stream.is_open()) {
+		std::cout << "Cannot read the particles file " << filename << std::endl;
+		return false;
+	}
+
+	if (!(radius > 0)) {
+		std::cout << "The default radius of the particles must be positive (" << radius << ")" << std::endl;
+		return false;
+	}
+
+	primitives.clear();
+	std::string line;
+	int line_number = 0;
+	size_t skipped = 0;
+	while (std::getline(stream, line)) {
+		++line_number;
+		size_t const first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue; // Empty line or comment
+
+		std::istringstream values(line);
+		field_primitive_structure primitive;
+		if (!(values >> primitive.center.x >> primitive.center.y >> primitive.center.z)) {
+			std::cout << filename << ":" << line_number << ": cannot read the position \"x y z\" of the particle" << std::endl;
+			++skipped;
+			continue;
+		}
+		if (!(values >> primitive.radius))
+			primitive.radius = radius;
+		else if (!(primitive.radius > 0)) {
+			std::cout << filename << ":" << line_number << ": the radius of the particle must be positive (" << primitive.radius << ")" << std::endl;
+			++skipped;
+			continue;
+		}
+		primitives.push_back(primitive);
+	}
+
+	std::cout << "Read " << primitives.size() << " particles from " << filename;
+	if (skipped > 0)
+		std::cout << " (" << skipped << " lines skipped)";
+	std::cout << std::endl;
+	return true;
+}
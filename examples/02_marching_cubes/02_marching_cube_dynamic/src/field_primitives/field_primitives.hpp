@@ -0,0 +1,109 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+// Primitives of the field with a finite support, and their BVH
+// ********************************************** //
+//  The spheres, capsules and boxes are metaballs: magnitude (1 - d^2/radius^2)^3 with d the distance to their core
+//  (a point, a segment, a box), which vanishes with its derivative at d = radius. The Gaussians are truncated where
+//  their magnitude is below 1e-5 (as field_gaussian_structure::support).
+//  The BVH stores the primitives sorted such that each leaf is a contiguous range, and returns the primitives whose
+//  support overlaps a box: a block of samples only evaluates the few primitives around it, whatever their total number.
+
+// Gaussian primitive  magnitude exp(-||p-center||^2/radius^2)
+struct field_gaussian_structure {
+	cgp::vec3 center;
+	float magnitude = 1.0f;
+	float radius = 1.0f;
+
+	// Distance to the center beyond which the magnitude of the primitive is below epsilon (0 if it is never above)
+	//  The evaluation of the field ignores the primitives whose support doesn't reach the evaluated samples.
+	float support(float epsilon = 1e-5f) const;
+};
+
+enum class field_primitive_type { gaussian, sphere, capsule, box };
+
+struct field_primitive_structure {
+	field_primitive_type type = field_primitive_type::sphere;
+	cgp::vec3 center;        // Center (first end of the segment for a capsule)
+	cgp::vec3 extent;        // Second end of the segment (capsule), half dimensions of the core (box), unused otherwise
+	float magnitude = 1.0f;  // Value at the core (negative to remove matter)
+	float radius = 0.2f;     // Distance to the core at which the metaball vanishes (radius of the Gaussian)
+
+	// Bounding box of the support
+	void support_box(cgp::vec3& box_min, cgp::vec3& box_max) const;
+
+	// Value (and gradient if not null) at position p
+	float value(cgp::vec3 const& p, cgp::vec3* gradient = nullptr) const;
+
+	// Conservative range [value_min, value_max] over the box [p_min, p_max]
+	void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const;
+};
+
+
+struct field_primitive_bvh_structure {
+
+	struct node {
+		cgp::vec3 box_min;
+		uint32_t first = 0;  // Leaf: first primitive. Inner node: index of the second child (the first one is the next node)
+		cgp::vec3 box_max;
+		uint32_t count = 0;  // Number of primitives of a leaf (0 for an inner node)
+	};
+
+	std::vector<field_primitive_structure> primitives; // Sorted by leaf
+	std::vector<cgp::vec3> support_min;                 // Support boxes of the primitives
+	std::vector<cgp::vec3> support_max;
+	std::vector<node> nodes;                            // Depth-first order, nodes[0] is the root
+
+	// Size of the stack of the traversal: the nodes deeper than stack_size - 2 are leaves (whatever their number of primitives)
+	static int const stack_size = 64;
+
+	// Sort the primitives and build the hierarchy of their support boxes (median split along the largest axis)
+	void build(std::vector<field_primitive_structure> const& primitives, int leaf_size = 4);
+
+	// Call f(primitive) for each primitive whose support box overlaps the box [box_min, box_max]
+	template <typename F> void for_each_overlap(cgp::vec3 const& box_min, cgp::vec3 const& box_max, F const& f) const;
+
+	size_t size() const { return primitives.size(); }
+};
+
+
+// Random metaballs of the given type inside the box [box_min, box_max] (type gaussian gives Gaussians of the given radius)
+std::vector<field_primitive_structure> field_primitives_random(size_t count, field_primitive_type type, float radius, cgp::vec3 const& box_min, cgp::vec3 const& box_max, unsigned int seed = 0);
+
+// Read spheres from a text file of particles: one "x y z [radius]" per line (radius is used when it is not given)
+//  The empty lines and the lines starting with # are skipped. The lines that cannot be read and the radii that are not
+//  positive are reported with their line number and skipped. Return false if the file cannot be read or radius is not positive.
+bool field_primitives_load(std::string const& filename, float radius, std::vector<field_primitive_structure>& primitives);
+
+
+
+
+template <typename F> void field_primitive_bvh_structure::for_each_overlap(cgp::vec3 const& box_min, cgp::vec3 const& box_max, F const& f) const
+{
+	if (nodes.empty())
+		return;
+
+	auto const overlap = [&](cgp::vec3 const& a_min, cgp::vec3 const& a_max) {
+		return a_min.x <= box_max.x && box_min.x <= a_max.x && a_min.y <= box_max.y && box_min.y <= a_max.y && a_min.z <= box_max.z && box_min.z <= a_max.z;
+	};
+
+	uint32_t stack[stack_size];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		node const& n = nodes[stack[--top]];
+		if (!overlap(n.box_min, n.box_max))
+			continue;
+		if (n.count > 0) {
+			for (uint32_t i = n.first; i < n.first + n.count; ++i)
+				if (overlap(support_min[i], support_max[i]))
+					f(primitives[i]);
+		}
+		else {
+			assert_cgp(top + 2 <= stack_size, "BVH deeper than its traversal stack");
+			stack[top++] = n.first;
+			stack[top++] = uint32_t(&n - nodes.data()) + 1;
+		}
+	}
+}
@@ -0,0 +1,511 @@
+#include "gpu_marching_cube.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+using namespace cgp;
+
+
+namespace {
+	// Vertex of the buffer filled by the transform feedback
+	struct gpu_vertex {
+		vec3 position;
+		vec3 normal;
+		uint32_t edge;
+	};
+}
+
+static bool compile_shader(GLuint shader, std::string const& filename)
+{
+	std::ifstream stream(filename);
+	if (!stream.is_open()) {
+		std::cout << "Cannot read the shader " << filename << std::endl;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << stream.rdbuf();
+	std::string const source = buffer.str();
+	char const* text = source.c_str();
+	glShaderSource(shader, 1, &text, nullptr);
+	glCompileShader(shader);
+
+	GLint valid = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &valid);
+	if (!valid) {
+		char log[2048];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		std::cout << "Error compiling " << filename << ":\n" << log << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Program of a vertex shader and an optional fragment shader, with the varyings captured by transform feedback
+static GLuint create_program(std::string const& vertex_file, std::string const& fragment_file, std::vector<char const*> const& varyings = {})
+{
+	GLuint const program = glCreateProgram();
+	GLuint const vertex = glCreateShader(GL_VERTEX_SHADER);
+	bool valid = compile_shader(vertex, vertex_file);
+	glAttachShader(program, vertex);
+	GLuint fragment = 0;
+	if (!fragment_file.empty()) {
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		valid = compile_shader(fragment, fragment_file) && valid;
+		glAttachShader(program, fragment);
+	}
+	if (!varyings.empty())
+		glTransformFeedbackVaryings(program, GLsizei(varyings.size()), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+
+	if (valid) {
+		glLinkProgram(program);
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked) {
+			char log[2048];
+			glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+			std::cout << "Error linking " << vertex_file << ":\n" << log << std::endl;
+			valid = false;
+		}
+	}
+
+	glDeleteShader(vertex);
+	if (fragment != 0)
+		glDeleteShader(fragment);
+	if (!valid) {
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+static void set_texture_parameters(GLenum target, GLint filter)
+{
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+bool gpu_marching_cube_structure::initialize(std::string const& shader_directory_arg)
+{
+	clear();
+	shader_directory = shader_directory_arg;
+	program_classify = create_program(shader_directory + "fullscreen.vert.glsl", shader_directory + "classify.frag.glsl");
+	program_reduce = create_program(shader_directory + "fullscreen.vert.glsl", shader_directory + "reduce.frag.glsl");
+	program_generate = create_program(shader_directory + "generate.vert.glsl", "", { "vertex_position", "vertex_normal", "vertex_edge" });
+	shader_surface.load(shader_directory + "surface.vert.glsl", shader_directory + "surface.frag.glsl");
+	if (program_classify == 0 || program_reduce == 0 || program_generate == 0)
+		return false;
+
+	// Table of the marching cube: one row per configuration, 255 after the last edge, and the number of edges in column 31
+	marching_cube_table_structure const& table = marching_cube_table();
+	std::vector<unsigned char> table_texels(32 * 256, 255);
+	for (int configuration = 0; configuration < 256; ++configuration) {
+		int count = 0;
+		for (signed char const* e = table.triangles[configuration]; *e != -1; ++e)
+			table_texels[32 * configuration + count++] = (unsigned char)(*e);
+		table_texels[32 * configuration + 31] = (unsigned char)(count);
+	}
+	glGenTextures(1, &table_texture);
+	glBindTexture(GL_TEXTURE_2D, table_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 32, 256, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, table_texels.data());
+	set_texture_parameters(GL_TEXTURE_2D, GL_NEAREST);
+
+	// The corners of the edges are shared by all the extractions
+	glUseProgram(program_generate);
+	glUniform2iv(glGetUniformLocation(program_generate, "edge_corners"), 12, &table.corners[0][0]);
+	glUseProgram(0);
+
+	glGenTextures(1, &field_texture);
+	glBindTexture(GL_TEXTURE_3D, field_texture);
+	set_texture_parameters(GL_TEXTURE_3D, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glGenTextures(1, &pyramid_texture);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_3D, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glGenVertexArrays(1, &vao_empty);
+	glGenQueries(1, &query_time);
+
+	// Interleaved position, normal and edge
+	glGenBuffers(1, &vbo_vertex);
+	glGenVertexArrays(1, &vao_surface);
+	glBindVertexArray(vao_surface);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_vertex);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(gpu_vertex), (void*)offsetof(gpu_vertex, position));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(gpu_vertex), (void*)offsetof(gpu_vertex, normal));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return true;
+}
+
+void gpu_marching_cube_structure::upload_field(grid_3D<float> const& field)
+{
+	int3 const N = field.dimension;
+	glBindTexture(GL_TEXTURE_3D, field_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (N.x != samples.x || N.y != samples.y || N.z != samples.z) {
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, N.x, N.y, N.z, 0, GL_RED, GL_FLOAT, field.data.data.data());
+		samples = N;
+	}
+	else
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, N.x, N.y, N.z, GL_RED, GL_FLOAT, field.data.data.data());
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void gpu_marching_cube_structure::upload_field(grid_3D<float> const& field, int3 const& k_begin, int3 const& k_end)
+{
+	int3 const N = field.dimension;
+	if (N.x != samples.x || N.y != samples.y || N.z != samples.z) {
+		upload_field(field);
+		return;
+	}
+
+	// The sub-box is read in place in the grid
+	glBindTexture(GL_TEXTURE_3D, field_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, N.x);
+	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, N.y);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, k_begin.x);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, k_begin.y);
+	glPixelStorei(GL_UNPACK_SKIP_IMAGES, k_begin.z);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, k_begin.x, k_begin.y, k_begin.z, k_end.x - k_begin.x, k_end.y - k_begin.y, k_end.z - k_begin.z, GL_RED, GL_FLOAT, field.data.data.data());
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_IMAGES, 0);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+// Draw a triangle covering the viewport in the given level of the pyramid
+static void render_pyramid_level(GLuint pyramid_texture, int level, int size)
+{
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramid_texture, level);
+	glViewport(0, 0, size, size);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+bool gpu_marching_cube_structure::extract(spatial_domain_grid_3D const& domain, float isovalue)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+	number_of_vertices = 0;
+	int3 const N = samples;
+	if (N.x < 2 || N.y < 2 || N.z < 2 || program_generate == 0)
+		return false;
+
+	// Level 0 of the pyramid: the smallest power of two with a texel per cell
+	int3 const cells = { N.x - 1, N.y - 1, N.z - 1 };
+	size_t const number_of_cells = size_t(cells.x) * cells.y * cells.z;
+	int size = 1, levels = 1;
+	while (size_t(size) * size < number_of_cells) {
+		size *= 2;
+		++levels;
+	}
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (size > max_size) {
+		std::cout << "The grid has too many cells for the histogram pyramid (" << size << "^2 texels, the limit is " << max_size << "^2)" << std::endl;
+		return false;
+	}
+	if (size != pyramid_size) {
+		glBindTexture(GL_TEXTURE_2D, pyramid_texture);
+		for (int level = 0; level < levels; ++level)
+			glTexImage2D(GL_TEXTURE_2D, level, GL_R32UI, size >> level, size >> level, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		set_texture_parameters(GL_TEXTURE_2D, GL_NEAREST_MIPMAP_NEAREST);
+		pyramid_size = size;
+		pyramid_levels = levels;
+	}
+
+	// The passes replace the current viewport and framebuffer
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint framebuffer_previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer_previous);
+	GLboolean const depth_test = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean const blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glBindVertexArray(vao_empty);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+#ifndef __EMSCRIPTEN__
+	glBeginQuery(GL_TIME_ELAPSED, query_time);
+#endif
+
+	// Classification of the cells
+	glUseProgram(program_classify);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, field_texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, table_texture);
+	glUniform1i(glGetUniformLocation(program_classify, "field"), 0);
+	glUniform1i(glGetUniformLocation(program_classify, "table"), 1);
+	glUniform3i(glGetUniformLocation(program_classify, "cells"), cells.x, cells.y, cells.z);
+	glUniform1i(glGetUniformLocation(program_classify, "pyramid_size"), pyramid_size);
+	glUniform1f(glGetUniformLocation(program_classify, "isovalue"), isovalue);
+	render_pyramid_level(pyramid_texture, 0, pyramid_size);
+
+	// Reduction: the level read is the only one accessible from the shader, such that it is distinct from the level written
+	glUseProgram(program_reduce);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pyramid_texture);
+	glUniform1i(glGetUniformLocation(program_reduce, "pyramid"), 0);
+	for (int level = 1; level < pyramid_levels; ++level) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+		render_pyramid_level(pyramid_texture, level, pyramid_size >> level);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, pyramid_levels - 1);
+
+	// Total number of vertices (top of the pyramid)
+	GLuint total = 0;
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0, 0, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, &total);
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(framebuffer_previous));
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	// Generation of the vertices
+	number_of_vertices = total;
+	if (number_of_vertices > capacity) {
+		capacity = number_of_vertices + number_of_vertices / 2;
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_vertex);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(capacity * sizeof(gpu_vertex)), nullptr, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	if (number_of_vertices > 0) {
+		vec3 const p0 = domain.position({ 0, 0, 0 });
+		vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+		glUseProgram(program_generate);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, pyramid_texture);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, table_texture);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_3D, field_texture);
+		glUniform1i(glGetUniformLocation(program_generate, "pyramid"), 0);
+		glUniform1i(glGetUniformLocation(program_generate, "table"), 1);
+		glUniform1i(glGetUniformLocation(program_generate, "field"), 2);
+		glUniform1i(glGetUniformLocation(program_generate, "pyramid_levels"), pyramid_levels);
+		glUniform1i(glGetUniformLocation(program_generate, "pyramid_size"), pyramid_size);
+		glUniform3i(glGetUniformLocation(program_generate, "cells"), cells.x, cells.y, cells.z);
+		glUniform1f(glGetUniformLocation(program_generate, "isovalue"), isovalue);
+		glUniform3f(glGetUniformLocation(program_generate, "p0"), p0.x, p0.y, p0.z);
+		glUniform3f(glGetUniformLocation(program_generate, "step"), step.x, step.y, step.z);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vbo_vertex);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, GLsizei(number_of_vertices));
+		glEndTransformFeedback();
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+		glDisable(GL_RASTERIZER_DISCARD);
+	}
+#ifndef __EMSCRIPTEN__
+	glEndQuery(GL_TIME_ELAPSED);
+#endif
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+	for (int unit = 2; unit >= 0; --unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindTexture(GL_TEXTURE_3D, 0);
+	}
+	if (depth_test)
+		glEnable(GL_DEPTH_TEST);
+	if (blend)
+		glEnable(GL_BLEND);
+
+	// Waits for the end of the passes (the GPU duration is bounded by the total one: llvmpipe reports a wrong duration for its first query)
+#ifndef __EMSCRIPTEN__
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(query_time, GL_QUERY_RESULT, &elapsed);
+	timing.total = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	timing.gpu = std::min(float(elapsed / 1.0e6), timing.total);
+#else
+	glFinish();
+	timing.total = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	timing.gpu = timing.total;
+#endif
+	return true;
+}
+
+// Copy of the vertices of the last extraction
+static std::vector<gpu_vertex> read_vertices(gpu_marching_cube_structure const& surface)
+{
+	std::vector<gpu_vertex> vertices(surface.number_of_vertices);
+	if (vertices.empty())
+		return vertices;
+	size_t const size = vertices.size() * sizeof(gpu_vertex);
+	glBindBuffer(GL_ARRAY_BUFFER, surface.vbo_vertex);
+	void const* data = glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(size), GL_MAP_READ_BIT);
+	if (data != nullptr)
+		std::memcpy(vertices.data(), data, size);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return vertices;
+}
+
+mesh gpu_marching_cube_structure::read_mesh() const
+{
+	std::vector<gpu_vertex> const vertices = read_vertices(*this);
+
+	mesh m;
+	std::unordered_map<uint32_t, unsigned int> index_of_edge;
+	index_of_edge.reserve(number_of_vertices / 4);
+	std::vector<unsigned int> indices(number_of_vertices);
+	for (size_t k = 0; k < number_of_vertices; ++k) {
+		auto const inserted = index_of_edge.insert({ vertices[k].edge, (unsigned int)(m.position.size()) });
+		if (inserted.second) {
+			m.position.push_back(vertices[k].position);
+			m.normal.push_back(vertices[k].normal);
+		}
+		indices[k] = inserted.first->second;
+	}
+	for (size_t k = 0; k + 2 < number_of_vertices; k += 3) {
+		if (indices[k] != indices[k + 1] && indices[k + 1] != indices[k + 2] && indices[k + 2] != indices[k])
+			m.connectivity.push_back({ indices[k], indices[k + 1], indices[k + 2] });
+	}
+	m.fill_empty_field();
+	return m;
+}
+
+void gpu_marching_cube_structure::clear()
+{
+	glDeleteProgram(program_classify);
+	glDeleteProgram(program_reduce);
+	glDeleteProgram(program_generate);
+	glDeleteProgram(shader_surface.id);
+	glDeleteTextures(1, &field_texture);
+	glDeleteTextures(1, &table_texture);
+	glDeleteTextures(1, &pyramid_texture);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteVertexArrays(1, &vao_empty);
+	glDeleteVertexArrays(1, &vao_surface);
+	glDeleteBuffers(1, &vbo_vertex);
+	glDeleteQueries(1, &query_time);
+
+	program_classify = program_reduce = program_generate = 0;
+	shader_surface.id = 0;
+	field_texture = table_texture = pyramid_texture = 0;
+	framebuffer = vao_empty = vao_surface = vbo_vertex = query_time = 0;
+	samples = { 0,0,0 };
+	pyramid_size = pyramid_levels = 0;
+	capacity = number_of_vertices = 0;
+}
+
+
+static void draw_surface(gpu_marching_cube_structure const& surface, environment_generic_structure const& environment, bool wireframe, vec3 const& color)
+{
+	if (surface.number_of_vertices == 0 || surface.shader_surface.id == 0)
+		return;
+
+	glUseProgram(surface.shader_surface.id);
+	environment.send_opengl_uniform(surface.shader_surface, true);
+	opengl_uniform(surface.shader_surface, "color", color);
+	opengl_uniform(surface.shader_surface, "wireframe", int(wireframe));
+
+#ifndef __EMSCRIPTEN__
+	if (wireframe) {
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		glEnable(GL_POLYGON_OFFSET_LINE);
+		glPolygonOffset(-1.0f, -1.0f);
+	}
+#endif
+	glBindVertexArray(surface.vao_surface);
+	glDrawArrays(GL_TRIANGLES, 0, GLsizei(surface.number_of_vertices));
+	glBindVertexArray(0);
+#ifndef __EMSCRIPTEN__
+	if (wireframe) {
+		glDisable(GL_POLYGON_OFFSET_LINE);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	}
+#endif
+	glUseProgram(0);
+}
+
+void draw(gpu_marching_cube_structure const& surface, environment_generic_structure const& environment)
+{
+	draw_surface(surface, environment, false, surface.color);
+}
+
+void draw_wireframe(gpu_marching_cube_structure const& surface, environment_generic_structure const& environment, vec3 const& color)
+{
+	draw_surface(surface, environment, true, color);
+}
+
+
+// Triangle as its three edges, starting from the smallest one (the orientation is kept)
+static std::array<uint32_t, 3> canonical_triangle(uint32_t a, uint32_t b, uint32_t c)
+{
+	if (b < a && b < c)
+		return { b, c, a };
+	if (c < a && c < b)
+		return { c, a, b };
+	return { a, b, c };
+}
+
+bool gpu_marching_cube_compare(gpu_marching_cube_structure& gpu, grid_3D<float> const& field, spatial_domain_grid_3D const& domain,
+	field_block_summary_structure const& summary, float isovalue, thread_pool_structure& thread_pool)
+{
+	// Triangle soup on the CPU
+	auto const time_start = std::chrono::steady_clock::now();
+	std::vector<vec3> position;
+	std::vector<marching_cube_relative_coordinates> relative;
+	marching_cube_blocks(position, relative, field, domain, summary, isovalue, thread_pool);
+	float const time_cpu = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+
+	gpu.upload_field(field);
+	if (!gpu.extract(domain, isovalue))
+		return false;
+	std::vector<gpu_vertex> const vertices = read_vertices(gpu);
+
+	// Edges of the CPU vertices, with the same numbering as the shader
+	size_t const Nx = size_t(field.dimension.x);
+	std::vector<uint32_t> edge_cpu(relative.size());
+	std::unordered_map<uint32_t, vec3> position_cpu;
+	for (size_t k = 0; k < relative.size(); ++k) {
+		size_t const k0 = std::min(relative[k].k0, relative[k].k1);
+		size_t const delta = std::max(relative[k].k0, relative[k].k1) - k0;
+		edge_cpu[k] = uint32_t(3 * k0 + (delta == 1 ? 0 : (delta == Nx ? 1 : 2)));
+		position_cpu[edge_cpu[k]] = position[k];
+	}
+
+	std::vector<std::array<uint32_t, 3> > triangles_cpu, triangles_gpu;
+	for (size_t k = 0; k + 2 < edge_cpu.size(); k += 3)
+		triangles_cpu.push_back(canonical_triangle(edge_cpu[k], edge_cpu[k + 1], edge_cpu[k + 2]));
+	for (size_t k = 0; k + 2 < vertices.size(); k += 3)
+		triangles_gpu.push_back(canonical_triangle(vertices[k].edge, vertices[k + 1].edge, vertices[k + 2].edge));
+	std::sort(triangles_cpu.begin(), triangles_cpu.end());
+	std::sort(triangles_gpu.begin(), triangles_gpu.end());
+	bool const same_triangles = triangles_cpu == triangles_gpu;
+
+	float distance = 0.0f;
+	size_t unmatched = 0;
+	for (gpu_vertex const& v : vertices) {
+		auto const it = position_cpu.find(v.edge);
+		if (it == position_cpu.end())
+			++unmatched;
+		else
+			distance = std::max(distance, norm(it->second - v.position));
+	}
+
+	std::cout << "Marching cube CPU: " << triangles_cpu.size() << " triangles in " << time_cpu << " ms" << std::endl;
+	std::cout << "Marching cube GPU: " << triangles_gpu.size() << " triangles in " << gpu.timing.gpu << " ms (" << gpu.timing.total << " ms with the synchronization)" << std::endl;
+	std::cout << (same_triangles ? "Same triangles" : "Different triangles") << ", largest distance between the vertices of an edge: " << distance;
+	if (unmatched > 0)
+		std::cout << " (" << unmatched << " GPU vertices on edges without CPU vertex)";
+	std::cout << std::endl;
+	return same_triangles;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include "../marching_cube_blocks/marching_cube_blocks.hpp"
+
+// Marching cube computed on the GPU (OpenGL 3.3), drawn from the buffer where it is generated
+// ********************************************** //
+//  The field is a 3D texture. The surface is extracted in three passes without any compute shader:
+//   - Classification: a fragment per cell writes its number of vertices (from the configuration of its 8 corners) in the
+//     level 0 of a histogram pyramid. The pyramid is a 2D integer texture of S x S texels, the cells being numbered row by row.
+//   - Reduction: each level of the pyramid is the sum of the 2x2 texels of the previous one, up to a single texel
+//     that contains the total number of vertices (the only value read back on the CPU).
+//   - Generation: a point per vertex descends the pyramid to find its cell and its rank in the cell (stream compaction),
+//     and computes its position and normal. They are captured by transform feedback in the vertex buffer that is drawn.
+//  The vertices of each triangle are consecutive (no index buffer). Each vertex also stores the edge of the grid where it
+//  lies (3 * index of its lower sample + axis), which allows to merge the vertices shared by the triangles on readback.
+//  The edges and triangles are the ones of marching_cube_table(), such that the triangles are the same as on the CPU.
+//  The normals are the opposite of the finite differences of the field (as compute_gradient), interpolated along the edge.
+
+struct gpu_marching_cube_structure {
+
+	GLuint program_classify = 0;   // Passes of the extraction (see shaders/gpu_marching_cube/)
+	GLuint program_reduce = 0;
+	GLuint program_generate = 0;
+	cgp::opengl_shader_structure shader_surface; // Display of the vertex buffer
+	std::string shader_directory;  // Directory of the programs (kept by clear, such that the structure can be initialized again)
+
+	GLuint field_texture = 0;      // Samples of the field (3D, R32F)
+	GLuint table_texture = 0;      // Edges of the vertices of each configuration (32 x 256, R8UI), and their number in the last column
+	GLuint pyramid_texture = 0;    // Histogram pyramid (2D, R32UI, with all its mipmap levels)
+	GLuint framebuffer = 0;
+	GLuint vao_empty = 0;          // The passes only use gl_VertexID
+	GLuint vbo_vertex = 0;         // Output of the transform feedback: position, normal and edge of each vertex
+	GLuint vao_surface = 0;
+	GLuint query_time = 0;
+
+	cgp::int3 samples = { 0,0,0 }; // Dimension of the field texture
+	int pyramid_size = 0;          // Size of the level 0 of the pyramid (power of two)
+	int pyramid_levels = 0;
+	size_t capacity = 0;           // Number of vertices that fit in vbo_vertex
+	size_t number_of_vertices = 0; // Vertices of the last extraction
+
+	cgp::vec3 color = { 1,1,1 };
+
+	struct { // Duration of the last extraction (ms)
+		float gpu = 0.0f;          // Passes measured on the GPU (timer query)
+		float total = 0.0f;        // Including the read back of the number of vertices and the synchronization
+	} timing;
+
+	// Compile the programs in shader_directory (shaders/gpu_marching_cube/) and create the textures. Return false on error.
+	bool initialize(std::string const& shader_directory);
+	bool is_initialized() const { return program_generate != 0; }
+
+	// Send the field to the GPU: the whole grid, or the samples [k_begin, k_end[ when the grid has not been resized
+	void upload_field(cgp::grid_3D<float> const& field);
+	void upload_field(cgp::grid_3D<float> const& field, cgp::int3 const& k_begin, cgp::int3 const& k_end);
+
+	// Extract the surface of the uploaded field in the vertex buffer. Return false if the grid exceeds the texture limits.
+	bool extract(cgp::spatial_domain_grid_3D const& domain, float isovalue);
+
+	// Read back the vertex buffer as an indexed mesh (the vertices on the same edge are merged)
+	cgp::mesh read_mesh() const;
+
+	size_t number_of_triangles() const { return number_of_vertices / 3; }
+	// Release the programs, textures and buffers (requires the OpenGL context)
+	void clear();
+};
+
+void draw(gpu_marching_cube_structure const& surface, cgp::environment_generic_structure const& environment);
+void draw_wireframe(gpu_marching_cube_structure const& surface, cgp::environment_generic_structure const& environment, cgp::vec3 const& color = { 0,0,1 });
+
+// Compare the surface extracted on the GPU with marching_cube_blocks on the same field: the triangles (as triplets of
+//  edges), the distance between the vertices of the same edge, and the extraction times are written on the command line.
+//  Return true if both surfaces have the same triangles.
+bool gpu_marching_cube_compare(gpu_marching_cube_structure& gpu, cgp::grid_3D<float> const& field, cgp::spatial_domain_grid_3D const& domain,
+	field_block_summary_structure const& summary, float isovalue, thread_pool_structure& thread_pool);
@@ -0,0 +1,135 @@
+#include "grid_layout.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+
+using namespace cgp;
+
+
+// Call f(x, y, z) on the samples [0, N[ by blocks of 8^3 (the z-layers of blocks are shared by the threads)
+template <typename F>
+static void for_each_sample_by_block(int3 const& N, thread_pool_structure& thread_pool, F const& f)
+{
+	int const B = 8;
+	thread_pool.parallel_for((N.z + B - 1) / B, 1, [&](int bz_begin, int bz_end) {
+		for (int z0 = bz_begin * B; z0 < std::min(bz_end * B, N.z); z0 += B)
+			for (int y0 = 0; y0 < N.y; y0 += B)
+				for (int x0 = 0; x0 < N.x; x0 += B)
+					for (int z = z0; z < std::min(z0 + B, N.z); ++z)
+						for (int y = y0; y < std::min(y0 + B, N.y); ++y)
+							for (int x = x0; x < std::min(x0 + B, N.x); ++x)
+								f(x, y, z);
+	});
+}
+
+// Cheap analytic field, such that the time of the pass is the time of the stores
+template <typename G>
+static void benchmark_field(G& field, thread_pool_structure& thread_pool)
+{
+	int3 const N = field.dimension;
+	vec3 const step = { 2.0f / (N.x - 1), 2.0f / (N.y - 1), 2.0f / (N.z - 1) };
+	for_each_sample_by_block(N, thread_pool, [&](int x, int y, int z) {
+		vec3 const p = vec3(-1, -1, -1) + step * vec3(float(x), float(y), float(z));
+		field.at_unsafe(x, y, z) = 1.0f / (1.0f + 4.0f * dot(p, p)) + 0.05f * p.x * p.y;
+	});
+}
+
+// Finite differences as compute_gradient
+template <typename G, typename GV>
+static void benchmark_gradient(GV& gradient, G const& field, thread_pool_structure& thread_pool)
+{
+	int3 const N = field.dimension;
+	for_each_sample_by_block(N, thread_pool, [&](int x, int y, int z) {
+		float const f = field.at_unsafe(x, y, z);
+		vec3& g = gradient.at_unsafe(x, y, z);
+		g.x = x != N.x - 1 ? field.at_unsafe(x + 1, y, z) - f : f - field.at_unsafe(x - 1, y, z);
+		g.y = y != N.y - 1 ? field.at_unsafe(x, y + 1, z) - f : f - field.at_unsafe(x, y - 1, z);
+		g.z = z != N.z - 1 ? field.at_unsafe(x, y, z + 1) - f : f - field.at_unsafe(x, y, z - 1);
+	});
+}
+
+// Number of cells crossed by the isovalue (configuration of the 8 corners as the marching cube)
+template <typename G>
+static size_t benchmark_classification(G const& field, float isovalue, thread_pool_structure& thread_pool)
+{
+	int3 const N = field.dimension;
+	std::atomic<size_t> crossed{ 0 };
+	int const B = 8;
+	thread_pool.parallel_for((N.z - 1 + B - 1) / B, 1, [&](int bz_begin, int bz_end) {
+		size_t count = 0;
+		for (int z0 = bz_begin * B; z0 < std::min(bz_end * B, N.z - 1); z0 += B)
+			for (int y0 = 0; y0 < N.y - 1; y0 += B)
+				for (int x0 = 0; x0 < N.x - 1; x0 += B)
+					for (int z = z0; z < std::min(z0 + B, N.z - 1); ++z)
+						for (int y = y0; y < std::min(y0 + B, N.y - 1); ++y)
+							for (int x = x0; x < std::min(x0 + B, N.x - 1); ++x) {
+								int configuration = 0;
+								for (int c = 0; c < 8; ++c)
+									configuration |= (float(field.at_unsafe(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1))) > isovalue) << c;
+								count += configuration != 0 && configuration != 255;
+							}
+		crossed += count;
+	});
+	return crossed;
+}
+
+// Best time of a few runs (ms)
+template <typename F>
+static float best_time(F const& f)
+{
+	float best = 0.0f;
+	for (int run = 0; run < 3; ++run) {
+		auto const time_start = std::chrono::steady_clock::now();
+		f();
+		float const time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+		best = run == 0 ? time : std::min(best, time);
+	}
+	return best;
+}
+
+template <typename G, typename GV>
+static void benchmark_grid(std::string const& name, G& field, GV& gradient, size_t memory, thread_pool_structure& thread_pool)
+{
+	size_t crossed = 0;
+	float const time_field = best_time([&]() { benchmark_field(field, thread_pool); });
+	float const time_gradient = best_time([&]() { benchmark_gradient(gradient, field, thread_pool); });
+	float const time_classification = best_time([&]() { crossed = benchmark_classification(field, 0.5f, thread_pool); });
+
+	std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(12) << memory / (1024 * 1024.0f) << std::setw(12) << time_field << std::setw(12) << time_gradient
+		<< std::setw(16) << time_classification << std::setw(16) << crossed << std::endl;
+}
+
+template <typename T>
+static void benchmark_layout(std::string const& name, grid_layout_type layout, int3 const& N, thread_pool_structure& thread_pool)
+{
+	grid_3D_layout<T> field;
+	grid_3D_layout<vec3> gradient;
+	field.resize(N, layout);
+	gradient.resize(N, layout);
+	benchmark_grid(name, field, gradient, field.memory(), thread_pool);
+}
+
+void grid_layout_benchmark(int samples, thread_pool_structure& thread_pool)
+{
+	thread_pool.initialize();
+	int3 const N = { samples, samples, samples };
+
+	std::cout << "Grid layouts: " << samples << "^3 samples, " << thread_pool.size() << " threads, best of 3 runs" << std::endl;
+	std::cout << std::left << std::setw(24) << "Layout" << std::right << std::setw(12) << "Field (MB)" << std::setw(12) << "Field (ms)"
+		<< std::setw(12) << "Gradient" << std::setw(16) << "Classification" << std::setw(16) << "Crossed cells" << std::endl;
+	{
+		grid_3D<float> field;
+		grid_3D<vec3> gradient;
+		field.resize(N);
+		gradient.resize(N);
+		benchmark_grid("grid_3D (float)", field, gradient, field.size() * sizeof(float), thread_pool);
+	}
+	benchmark_layout<float>("linear (float)", grid_layout_type::linear, N, thread_pool);
+	benchmark_layout<float>("bricked 8^3 (float)", grid_layout_type::bricked, N, thread_pool);
+	benchmark_layout<float>("morton (float)", grid_layout_type::morton, N, thread_pool);
+	benchmark_layout<half_float>("linear (half)", grid_layout_type::linear, N, thread_pool);
+	benchmark_layout<half_float>("bricked 8^3 (half)", grid_layout_type::bricked, N, thread_pool);
+	benchmark_layout<half_float>("morton (half)", grid_layout_type::morton, N, thread_pool);
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+
+#include <cstring>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Grids of samples stored by bricks or along a Morton curve, with optional half precision
+// ********************************************** //
+//  cgp::grid_3D stores the samples along x, then y, then z: the neighbors along y and z of a sample are Nx and Nx*Ny
+//  elements away, and a block of 8^3 samples is spread over 64 distant rows of memory. grid_3D_layout stores the samples
+//  in other orders, for the measures of grid_layout_benchmark only (it is not a storage of the field of the marching cube,
+//  and only has the (x,y,z) accessors of grid_3D):
+//   - bricked: bricks of 8^3 samples stored contiguously (2 kB of floats), the bricks being ordered along x, then y, then z.
+//     The dimensions are padded to multiples of 8.
+//   - morton: the bits of x, y and z are interleaved (Z-order curve). Each dimension is padded to a power of two.
+//  The index of a sample is the sum of an offset per axis (offset_x[x] + offset_y[y] + offset_z[z]), tabulated by resize:
+//  the three layouts share the same code.
+//  half_float stores a value on 16 bits (IEEE binary16: 11 bits of precision, values up to 65504) and converts to float,
+//  such that grid_3D_layout<half_float> is a field of half the memory of a grid of floats.
+
+enum class grid_layout_type { linear, bricked, morton };
+
+// Conversions between float and binary16 (round to nearest even)
+inline uint16_t float_to_half(float value);
+inline float half_to_float(uint16_t bits);
+
+struct half_float {
+	uint16_t bits = 0;
+
+	half_float() = default;
+	half_float(float value) : bits(float_to_half(value)) {}
+	operator float() const { return half_to_float(bits); }
+};
+
+template <typename T>
+struct grid_3D_layout {
+	cgp::int3 dimension = { 0,0,0 };
+	grid_layout_type layout = grid_layout_type::bricked;
+	std::vector<T> data;                  // Samples, including the padding
+	std::vector<uint32_t> offset_x;       // Offset of the samples along each axis (the grid has less than 2^32 samples)
+	std::vector<uint32_t> offset_y;
+	std::vector<uint32_t> offset_z;
+
+	// Allocate the samples (their values are reset) and the tables of offsets
+	void resize(cgp::int3 const& dimension, grid_layout_type layout);
+	void resize(cgp::int3 const& dimension) { resize(dimension, layout); }
+	void resize(int Nx, int Ny, int Nz) { resize({ Nx, Ny, Nz }, layout); }
+
+	size_t index(int x, int y, int z) const { return size_t(offset_x[x]) + offset_y[y] + offset_z[z]; }
+
+	T& at_unsafe(int x, int y, int z) { return data[index(x, y, z)]; }
+	T const& at_unsafe(int x, int y, int z) const { return data[index(x, y, z)]; }
+	T& operator()(int x, int y, int z);
+	T const& operator()(int x, int y, int z) const;
+
+	size_t size() const { return size_t(dimension.x) * dimension.y * dimension.z; }
+	size_t memory() const { return data.size() * sizeof(T) + (offset_x.size() + offset_y.size() + offset_z.size()) * sizeof(uint32_t); }
+};
+
+// Field, gradient and classification of the cells on a grid of samples^3 for each layout and precision (and cgp::grid_3D<float>),
+//  traversed by blocks of 8^3 samples as the marching cube. The times and the memory are written on the command line.
+void grid_layout_benchmark(int samples, thread_pool_structure& thread_pool);
+
+
+
+
+inline uint16_t float_to_half(float value)
+{
+#if defined(__F16C__)
+	return uint16_t(_cvtss_sh(value, 0));
+#else
+	uint32_t x;
+	std::memcpy(&x, &value, sizeof(float));
+	uint32_t const sign = (x >> 16) & 0x8000u;
+	uint32_t const magnitude = x & 0x7fffffffu;
+
+	// Infinity, NaN (quiet, with the high bits of its payload), or above the largest half after rounding
+	if (magnitude >= 0x47800000u)
+		return uint16_t(sign | (magnitude > 0x7f800000u ? 0x7e00u | ((magnitude >> 13) & 0x3ffu) : 0x7c00u));
+
+	// Subnormal half: value = m 2^-24
+	if (magnitude < 0x38800000u) {
+		if (magnitude < 0x33000000u)
+			return uint16_t(sign);
+		uint32_t const shift = 126 - (magnitude >> 23);
+		uint32_t const mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+		uint32_t result = mantissa >> shift;
+		uint32_t const remainder = mantissa & ((1u << shift) - 1);
+		uint32_t const halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (result & 1)))
+			++result;
+		return uint16_t(sign | result);
+	}
+
+	// Normal half: exponent rebiased from 127 to 15, 13 bits of mantissa rounded without branch (a carry increments the exponent)
+	uint32_t const odd = (magnitude >> 13) & 1;
+	return uint16_t(sign | ((magnitude - 0x38000000u + 0xfffu + odd) >> 13));
+#endif
+}
+
+inline float half_to_float(uint16_t bits)
+{
+#if defined(__F16C__)
+	return _cvtsh_ss(bits);
+#else
+	// The exponent is rebiased by a product with 2^112, which also normalizes the subnormals
+	uint32_t x = uint32_t(bits & 0x7fffu) << 13;
+	float value;
+	std::memcpy(&value, &x, sizeof(float));
+	value *= 5.192296858534828e+33f;
+	std::memcpy(&x, &value, sizeof(float));
+	if (value >= 65536.0f)
+		x |= 0x7f800000u; // Infinity and NaN
+	x |= uint32_t(bits & 0x8000u) << 16;
+	std::memcpy(&value, &x, sizeof(float));
+	return value;
+#endif
+}
+
+
+template <typename T>
+void grid_3D_layout<T>::resize(cgp::int3 const& dimension_arg, grid_layout_type layout_arg)
+{
+	dimension = dimension_arg;
+	layout = layout_arg;
+	offset_x.resize(dimension.x);
+	offset_y.resize(dimension.y);
+	offset_z.resize(dimension.z);
+	std::vector<uint32_t>* offsets[3] = { &offset_x, &offset_y, &offset_z };
+
+	size_t samples = 0;
+	if (layout == grid_layout_type::linear) {
+		uint32_t stride = 1;
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int k = 0; k < dimension[axis]; ++k)
+				(*offsets[axis])[k] = uint32_t(k) * stride;
+			stride *= uint32_t(dimension[axis]);
+		}
+		samples = stride;
+	}
+	else if (layout == grid_layout_type::bricked) {
+		// Offset of a sample in its brick, plus offset of the brick
+		int const B = 8;
+		uint32_t stride_brick = B * B * B;
+		uint32_t stride_sample = 1;
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int k = 0; k < dimension[axis]; ++k)
+				(*offsets[axis])[k] = uint32_t(k / B) * stride_brick + uint32_t(k % B) * stride_sample;
+			stride_brick *= uint32_t((dimension[axis] + B - 1) / B);
+			stride_sample *= B;
+		}
+		samples = stride_brick;
+	}
+	else {
+		// The bits of the coordinates are interleaved as long as the three axes have some, then the remaining ones follow
+		int bits[3] = { 0,0,0 };
+		for (int axis = 0; axis < 3; ++axis)
+			while ((1 << bits[axis]) < dimension[axis])
+				++bits[axis];
+		int position[3][32];
+		int next = 0;
+		for (int level = 0; level < 32; ++level)
+			for (int axis = 0; axis < 3; ++axis)
+				if (level < bits[axis])
+					position[axis][level] = next++;
+		for (int axis = 0; axis < 3; ++axis) {
+			for (int k = 0; k < dimension[axis]; ++k) {
+				uint32_t offset = 0;
+				for (int level = 0; level < bits[axis]; ++level)
+					offset |= uint32_t((k >> level) & 1) << position[axis][level];
+				(*offsets[axis])[k] = offset;
+			}
+		}
+		samples = size_t(1) << next;
+	}
+
+	data.assign(samples, T());
+}
+
+template <typename T>
+T& grid_3D_layout<T>::operator()(int x, int y, int z)
+{
+	assert_cgp(x >= 0 && y >= 0 && z >= 0 && x < dimension.x && y < dimension.y && z < dimension.z, "Index out of the grid");
+	return at_unsafe(x, y, z);
+}
+
+template <typename T>
+T const& grid_3D_layout<T>::operator()(int x, int y, int z) const
+{
+	assert_cgp(x >= 0 && y >= 0 && z >= 0 && x < dimension.x && y < dimension.y && z < dimension.z, "Index out of the grid");
+	return at_unsafe(x, y, z);
+}
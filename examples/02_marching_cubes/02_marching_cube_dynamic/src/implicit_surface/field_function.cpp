@@ -1,27 +1,464 @@
 #include "field_function.hpp"
 
+#include <algorithm>
+
 using namespace cgp;
 
-// Parameterization Gaussian centered at point p0
-static float gaussian(vec3 const& p, vec3 const& p0, float sigma)
+std::vector<field_gaussian_structure> field_function_structure::gaussians() const
 {
-	float const d = norm(p - p0);
-	float const value = std::exp(-(d * d) / (sigma * sigma));
-	return value;
+	std::vector<field_gaussian_structure> primitives = { {pa, sa, 1.0f}, {pb, sb, 1.0f}, {pc, sc, 1.0f} };
+	primitives.insert(primitives.end(), sculpt.begin(), sculpt.end());
+	return primitives;
 }
 
 float field_function_structure::operator()(cgp::vec3 const& p) const
 {
 	float value = 0.0f;
-	value += sa * gaussian(p, pa, 1.0f);
-	value += sb * gaussian(p, pb, 1.0f);
-	value += sc * gaussian(p, pc, 1.0f);
+	for_each_gaussian([&](field_gaussian_structure const& g) {
+		float const d = norm(p - g.center);
+		value += g.magnitude * std::exp(-(d * d) / (g.radius * g.radius));
+	});
+	if (primitives != nullptr)
+		primitives->for_each_overlap(p, p, [&](field_primitive_structure const& primitive) { value += primitive.value(p); });
+	if (sculpt_baked != nullptr)
+		sculpt_baked->for_each_overlap(p, p, [&](field_primitive_structure const& primitive) { value += primitive.value(p); });
+	if (expression != nullptr)
+		return value + expression->value(p);
 
 	if (noise_magnitude > 0) {
 		vec3 const offset = vec3{ noise_offset + 1000, 1000, 1000 };
 		vec3 const p_noise = noise_scale * p + offset;
-		value += noise_magnitude * noise_perlin(p_noise, noise_octave, noise_persistance);
+		if (use_noise_cache && noise_cache != nullptr)
+			value += noise_magnitude * (*noise_cache)(p_noise);
+		else
+			value += noise_magnitude * noise_perlin(p_noise, noise_octave, noise_persistance);
 	}
 
 	return value;
 }
+
+void field_function_structure::evaluate_slabs(spatial_domain_grid_3D const& domain, int kz_begin, int kz_end, float* values) const
+{
+	evaluate_box(domain, { 0, 0, kz_begin }, { domain.samples.x, domain.samples.y, kz_end }, values);
+}
+
+// Squared distance from p to the box [p_min, p_max]
+static float distance_squared_to_box(vec3 const& p, vec3 const& p_min, vec3 const& p_max)
+{
+	float d2 = 0.0f;
+	for (int c = 0; c < 3; ++c) {
+		float const d = std::max(0.0f, std::max(p_min[c] - p[c], p[c] - p_max[c]));
+		d2 += d * d;
+	}
+	return d2;
+}
+
+namespace {
+	// Primitives overlapping a tile of samples (the buffers are reused by the tiles of all the boxes evaluated by a thread)
+	struct tile_primitives {
+		std::vector<field_gaussian_structure> gaussians;
+		std::vector<float> support;
+		std::vector<int> x_begin, x_end;  // Samples of the tile along x inside the support of each Gaussian
+		std::vector<field_primitive_structure const*> metaballs;
+		std::vector<float> factor_x, derivative_x;
+	};
+}
+
+// Fill the samples k_begin <= k < k_end (or add to them the sculpt and the metaballs when the function has an expression)
+//  The Gaussians are evaluated as products of 1D factors, the other primitives sample by sample.
+static void evaluate_tile(field_function_structure const& function, spatial_domain_grid_3D const& domain, int3 const& k_begin, int3 const& k_end, float* values, vec3* gradients, tile_primitives& tile)
+{
+	int const Nx = domain.samples.x;
+	int const Ny = domain.samples.y;
+	int const nx = k_end.x - k_begin.x;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	// Only keep the primitives whose support reaches the box
+	vec3 const box_min = p0 + step * vec3(float(k_begin.x), float(k_begin.y), float(k_begin.z));
+	vec3 const box_max = p0 + step * vec3(float(k_end.x - 1), float(k_end.y - 1), float(k_end.z - 1));
+	std::vector<field_gaussian_structure>& primitives = tile.gaussians;
+	std::vector<float>& support = tile.support;
+	primitives.clear();
+	support.clear();
+	tile.metaballs.clear();
+	function.for_each_gaussian([&](field_gaussian_structure const& g) {
+		float const R = g.support();
+		if (R > 0 && distance_squared_to_box(g.center, box_min, box_max) <= R * R) {
+			primitives.push_back(g);
+			support.push_back(R);
+		}
+	});
+	auto const add_primitive = [&](field_primitive_structure const& primitive) {
+		if (primitive.type == field_primitive_type::gaussian) {
+			field_gaussian_structure const g = { primitive.center, primitive.magnitude, primitive.radius };
+			primitives.push_back(g);
+			support.push_back(g.support());
+		}
+		else
+			tile.metaballs.push_back(&primitive);
+	};
+	if (function.primitives != nullptr)
+		function.primitives->for_each_overlap(box_min, box_max, add_primitive);
+	if (function.sculpt_baked != nullptr)
+		function.sculpt_baked->for_each_overlap(box_min, box_max, add_primitive);
+	size_t const count = primitives.size();
+	bool const accumulate = function.expression != nullptr;
+	tile.x_begin.resize(count);
+	tile.x_end.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		tile.x_begin[i] = std::max(0, int(std::ceil((primitives[i].center.x - support[i] - p0.x) / step.x)) - k_begin.x);
+		tile.x_end[i] = std::min(nx, int(std::floor((primitives[i].center.x + support[i] - p0.x) / step.x)) + 1 - k_begin.x);
+	}
+
+	// exp(-||p-c||^2/r^2) = exp(-(x-cx)^2/r^2) exp(-(y-cy)^2/r^2) exp(-(z-cz)^2/r^2)
+	//  The factors along x are shared by all the rows, the factors along y,z are constant on a row.
+	//  The derivative along x uses the derivative of the x factor: -2(x-cx)/r^2 exp(-(x-cx)^2/r^2)
+	//  Only the samples inside the support along x are evaluated.
+	std::vector<float>& factor_x = tile.factor_x;
+	std::vector<float>& derivative_x = tile.derivative_x;
+	factor_x.resize(count * nx);
+	derivative_x.resize(gradients != nullptr ? count * nx : 0);
+	for (size_t i = 0; i < count; ++i) {
+		float const inv_r2 = 1.0f / (primitives[i].radius * primitives[i].radius);
+		for (int kx = tile.x_begin[i]; kx < tile.x_end[i]; ++kx) {
+			float const dx = p0.x + (k_begin.x + kx) * step.x - primitives[i].center.x;
+			factor_x[kx + i * size_t(nx)] = std::exp(-dx * dx * inv_r2);
+			if (gradients != nullptr)
+				derivative_x[kx + i * size_t(nx)] = -2 * dx * inv_r2 * factor_x[kx + i * size_t(nx)];
+		}
+	}
+
+	for (int kz = k_begin.z; kz < k_end.z; ++kz) {
+		float const z = p0.z + kz * step.z;
+		for (int ky = k_begin.y; ky < k_end.y; ++ky) {
+			float const y = p0.y + ky * step.y;
+			size_t const offset_row = k_begin.x + Nx * (ky + size_t(Ny) * kz);
+			float* row = values + offset_row;
+
+			if (!accumulate) {
+				for (int kx = 0; kx < nx; ++kx)
+					row[kx] = 0.0f;
+				if (gradients != nullptr)
+					for (int kx = 0; kx < nx; ++kx)
+						gradients[offset_row + kx] = { 0, 0, 0 };
+			}
+
+			for (size_t i = 0; i < count; ++i) {
+				float const dy = y - primitives[i].center.y;
+				float const dz = z - primitives[i].center.z;
+				if (dy * dy + dz * dz > support[i] * support[i])
+					continue; // The row is outside the support
+				float const inv_r2 = 1.0f / (primitives[i].radius * primitives[i].radius);
+				float const factor_yz = primitives[i].magnitude * std::exp(-(dy * dy + dz * dz) * inv_r2);
+				float const* fx = &factor_x[i * size_t(nx)];
+				int const x_begin = tile.x_begin[i], x_end = tile.x_end[i];
+				for (int kx = x_begin; kx < x_end; ++kx)
+					row[kx] += factor_yz * fx[kx];
+
+				if (gradients != nullptr) {
+					float const* dfx = &derivative_x[i * size_t(nx)];
+					float const dfy = -2 * dy * inv_r2 * factor_yz;
+					float const dfz = -2 * dz * inv_r2 * factor_yz;
+					vec3* g = gradients + offset_row;
+					for (int kx = x_begin; kx < x_end; ++kx) {
+						g[kx].x += factor_yz * dfx[kx];
+						g[kx].y += dfy * fx[kx];
+						g[kx].z += dfz * fx[kx];
+					}
+				}
+			}
+
+			if (function.noise_magnitude > 0 && !accumulate) {
+				vec3 const offset = vec3{ function.noise_offset + 1000, 1000, 1000 };
+				for (int kx = 0; kx < nx; ++kx) {
+					vec3 const p_noise = function.noise_scale * vec3{ p0.x + (k_begin.x + kx) * step.x, y, z } + offset;
+					if (function.use_noise_cache && function.noise_cache != nullptr)
+						row[kx] += function.noise_magnitude * (*function.noise_cache)(p_noise);
+					else
+						row[kx] += function.noise_magnitude * noise_perlin(p_noise, function.noise_octave, function.noise_persistance);
+				}
+			}
+		}
+	}
+
+	// Metaballs: only the samples inside their support box
+	for (field_primitive_structure const* primitive : tile.metaballs) {
+		vec3 support_min, support_max;
+		primitive->support_box(support_min, support_max);
+		int3 s_begin, s_end;
+		for (int c = 0; c < 3; ++c) {
+			s_begin[c] = std::max(k_begin[c], int(std::ceil((support_min[c] - p0[c]) / step[c])));
+			s_end[c] = std::min(k_end[c], int(std::floor((support_max[c] - p0[c]) / step[c])) + 1);
+		}
+		for (int kz = s_begin.z; kz < s_end.z; ++kz) {
+			for (int ky = s_begin.y; ky < s_end.y; ++ky) {
+				size_t const offset_row = Nx * (ky + size_t(Ny) * kz);
+				for (int kx = s_begin.x; kx < s_end.x; ++kx) {
+					vec3 const p = p0 + step * vec3(float(kx), float(ky), float(kz));
+					if (gradients != nullptr) {
+						vec3 g;
+						values[offset_row + kx] += primitive->value(p, &g);
+						gradients[offset_row + kx] += g;
+					}
+					else
+						values[offset_row + kx] += primitive->value(p);
+				}
+			}
+		}
+	}
+}
+
+void field_function_structure::evaluate_box(spatial_domain_grid_3D const& domain, int3 const& k_begin, int3 const& k_end, float* values, vec3* gradients) const
+{
+	int const tile_size = 16;
+
+	// The expression replaces the blobs and the noise, the tiles add the other primitives to it
+	if (expression != nullptr)
+		expression->evaluate_box(domain, k_begin, k_end, values, gradients);
+
+	// Scratch buffers of the thread: they keep their capacity from one box to the next
+	thread_local tile_primitives tile;
+	for (int tz = k_begin.z; tz < k_end.z; tz += tile_size) {
+		for (int ty = k_begin.y; ty < k_end.y; ty += tile_size) {
+			for (int tx = k_begin.x; tx < k_end.x; tx += tile_size) {
+				int3 const tile_begin = { tx, ty, tz };
+				int3 const tile_end = { std::min(tx + tile_size, k_end.x), std::min(ty + tile_size, k_end.y), std::min(tz + tile_size, k_end.z) };
+				evaluate_tile(*this, domain, tile_begin, tile_end, values, gradients, tile);
+			}
+		}
+	}
+}
+
+void field_function_structure::bounds(vec3 const& p_min, vec3 const& p_max, float& value_min, float& value_max) const
+{
+	value_min = 0.0f;
+	value_max = 0.0f;
+	if (expression != nullptr)
+		expression->bounds(p_min, p_max, value_min, value_max);
+
+	for_each_gaussian([&](field_gaussian_structure const& g) {
+		if (g.magnitude == 0.0f)
+			return;
+
+		// Squared distances from the center to the closest and to the farthest points of the box
+		float d2_min = 0.0f, d2_max = 0.0f;
+		for (int c = 0; c < 3; ++c) {
+			float const a = p_min[c] - g.center[c];
+			float const b = g.center[c] - p_max[c];
+			float const closest = std::max(0.0f, std::max(a, b));
+			float const farthest = std::max(std::abs(a), std::abs(b));
+			d2_min += closest * closest;
+			d2_max += farthest * farthest;
+		}
+
+		float const inv_r2 = 1.0f / (g.radius * g.radius);
+		float const g_max = g.magnitude * std::exp(-d2_min * inv_r2);
+		float const g_min = g.magnitude * std::exp(-d2_max * inv_r2);
+		value_min += std::min(g_min, g_max);
+		value_max += std::max(g_min, g_max);
+	});
+
+	auto const add_bounds = [&](field_primitive_structure const& primitive) {
+		float primitive_min, primitive_max;
+		primitive.bounds(p_min, p_max, primitive_min, primitive_max);
+		value_min += primitive_min;
+		value_max += primitive_max;
+	};
+	if (primitives != nullptr)
+		primitives->for_each_overlap(p_min, p_max, add_bounds);
+	if (sculpt_baked != nullptr)
+		sculpt_baked->for_each_overlap(p_min, p_max, add_bounds);
+
+	if (noise_magnitude > 0 && expression == nullptr) {
+		// Each octave is in [0,1] (with a small margin as the gradient noise can slightly exceed its nominal range)
+		float amplitude = 0.0f, a = 1.0f;
+		int const octave = (use_noise_cache && noise_cache != nullptr) ? noise_cache->parameters.octave : noise_octave;
+		for (int k = 0; k < octave; ++k) {
+			amplitude += a;
+			a *= noise_persistance;
+		}
+		value_min -= 0.1f * noise_magnitude * amplitude;
+		value_max += 1.1f * noise_magnitude * amplitude;
+	}
+}
+
+void field_function_structure::set_primitives(std::vector<field_primitive_structure> const& primitives_arg)
+{
+	if (primitives_arg.empty()) {
+		primitives = nullptr;
+		return;
+	}
+	std::shared_ptr<field_primitive_bvh_structure> bvh = std::make_shared<field_primitive_bvh_structure>();
+	bvh->build(primitives_arg);
+	primitives = bvh;
+}
+
+void field_function_structure::bake_sculpt()
+{
+	if (int(sculpt.size()) <= sculpt_size_max)
+		return;
+
+	// The BVH is rebuilt with the previous baked Gaussians: the copies of the function made before keep the previous one
+	std::vector<field_primitive_structure> baked;
+	if (sculpt_baked != nullptr)
+		baked = sculpt_baked->primitives;
+	size_t const count = sculpt.size() / 2;
+	for (size_t k = 0; k < count; ++k) {
+		field_primitive_structure primitive;
+		primitive.type = field_primitive_type::gaussian;
+		primitive.center = sculpt[k].center;
+		primitive.magnitude = sculpt[k].magnitude;
+		primitive.radius = sculpt[k].radius;
+		baked.push_back(primitive);
+	}
+	sculpt.erase(sculpt.begin(), sculpt.begin() + count);
+
+	std::shared_ptr<field_primitive_bvh_structure> bvh = std::make_shared<field_primitive_bvh_structure>();
+	bvh->build(baked);
+	sculpt_baked = bvh;
+}
+
+void field_function_structure::clear_sculpt()
+{
+	sculpt.clear();
+	sculpt_baked = nullptr;
+}
+
+template <typename A, typename B>
+static bool same_noise(A const& a, B const& b)
+{
+	if (a.noise_magnitude == 0 && b.noise_magnitude == 0)
+		return true;
+	return a.noise_magnitude == b.noise_magnitude && a.noise_offset == b.noise_offset && a.noise_scale == b.noise_scale
+		&& a.noise_octave == b.noise_octave && a.noise_persistance == b.noise_persistance
+		&& a.use_noise_cache == b.use_noise_cache && a.noise_cache == b.noise_cache;
+}
+
+static bool same_gaussian(field_gaussian_structure const& a, field_gaussian_structure const& b)
+{
+	return a.center.x == b.center.x && a.center.y == b.center.y && a.center.z == b.center.z && a.magnitude == b.magnitude && a.radius == b.radius;
+}
+
+void field_function_structure::update_expression()
+{
+	if (use_expression == false) {
+		expression = nullptr;
+		return;
+	}
+
+	// The expression is kept while the blobs and the noise it was built from don't change
+	field_gaussian_structure const blobs_source[3] = { {pa, sa, 1.0f}, {pb, sb, 1.0f}, {pc, sc, 1.0f} };
+	if (expression != nullptr && same_noise(expression_source, *this)) {
+		bool same_blobs = true;
+		for (int k = 0; k < 3; ++k)
+			same_blobs = same_blobs && same_gaussian(expression_source.blobs[k], blobs_source[k]);
+		if (same_blobs)
+			return;
+	}
+
+	using namespace field_expression;
+	auto const blobs = gaussian(pa, 1.0f, sa) + gaussian(pb, 1.0f, sb) + gaussian(pc, 1.0f, sc);
+	vec3 const offset = { noise_offset + 1000, 1000, 1000 };
+	if (noise_magnitude <= 0)
+		expression = make_kernel(blobs);
+	else if (use_noise_cache && noise_cache != nullptr)
+		expression = make_kernel(blobs + noise(noise_magnitude, noise_scale, offset, *noise_cache));
+	else
+		expression = make_kernel(blobs + noise(noise_magnitude, noise_scale, offset, noise_octave, noise_persistance));
+
+	for (int k = 0; k < 3; ++k)
+		expression_source.blobs[k] = blobs_source[k];
+	expression_source.noise_magnitude = noise_magnitude;
+	expression_source.noise_offset = noise_offset;
+	expression_source.noise_scale = noise_scale;
+	expression_source.noise_octave = noise_octave;
+	expression_source.noise_persistance = noise_persistance;
+	expression_source.use_noise_cache = use_noise_cache;
+	expression_source.noise_cache = noise_cache;
+}
+
+void field_function_structure::update_noise_cache(vec3 const& p_min, vec3 const& p_max, thread_pool_structure& thread_pool)
+{
+	if (use_noise_cache == false)
+		return;
+
+	// Box of the noise coordinates of the domain
+	vec3 const offset = vec3{ noise_offset + 1000, 1000, 1000 };
+	vec3 const noise_min = noise_scale * p_min + offset;
+	vec3 const noise_max = noise_scale * p_max + offset;
+
+	// The current table is kept if it has the same octaves and covers the box
+	if (noise_cache != nullptr && noise_cache->parameters.persistency == noise_persistance && noise_cache->parameters.octave <= noise_octave) {
+		bool const covered = noise_cache->corner.x <= noise_min.x && noise_cache->corner.y <= noise_min.y && noise_cache->corner.z <= noise_min.z
+			&& noise_max.x <= noise_cache->corner.x + noise_cache->length.x && noise_max.y <= noise_cache->corner.y + noise_cache->length.y && noise_max.z <= noise_cache->corner.z + noise_cache->length.z;
+		bool const same_octave = noise_cache->parameters.octave == noise_octave || noise_cache->parameters.octave == noise_cache_octave_max(std::max({ noise_cache->length.x, noise_cache->length.y, noise_cache->length.z }), noise_cache_size_max);
+		if (covered && same_octave)
+			return;
+	}
+
+	// The table covers twice the box, such that small changes of the domain, scale or offset don't need a new one
+	vec3 const center = 0.5f * (noise_min + noise_max);
+	vec3 const length = 2.0f * (noise_max - noise_min) + vec3{ 1e-3f, 1e-3f, 1e-3f };
+
+	// The octaves are clamped to the ones the largest table can represent
+	noise_cache_parameters parameters;
+	parameters.octave = std::min(noise_octave, noise_cache_octave_max(std::max({ length.x, length.y, length.z }), noise_cache_size_max));
+	parameters.persistency = noise_persistance;
+	int3 const N = { noise_cache_size(length.x, parameters), noise_cache_size(length.y, parameters), noise_cache_size(length.z, parameters) };
+
+	// A new table is allocated: copies of the function made before keep a valid table
+	std::shared_ptr<noise_cache_3D> cache = std::make_shared<noise_cache_3D>();
+	cache->initialize(parameters, center - 0.5f * length, length, N, &thread_pool);
+	noise_cache_measure(*cache, noise_octave);
+	noise_cache = cache;
+}
+
+
+bool field_function_modified_box(field_function_structure const& previous, field_function_structure const& current, spatial_domain_grid_3D const& domain, int3& k_begin, int3& k_end)
+{
+	if (same_noise(previous, current) == false || previous.primitives != current.primitives || previous.sculpt_baked != current.sculpt_baked
+		|| (previous.expression == nullptr) != (current.expression == nullptr))
+		return false;
+
+	// The expression only differs by the blobs and the noise, which are compared here
+	// Union of the supports of the primitives that differ
+	std::vector<field_gaussian_structure> const a = previous.gaussians();
+	std::vector<field_gaussian_structure> const b = current.gaussians();
+	vec3 box_min = { 1e30f, 1e30f, 1e30f };
+	vec3 box_max = { -1e30f, -1e30f, -1e30f };
+	auto extend = [&](field_gaussian_structure const& g) {
+		float const R = g.support();
+		if (R == 0)
+			return;
+		for (int c = 0; c < 3; ++c) {
+			box_min[c] = std::min(box_min[c], g.center[c] - R);
+			box_max[c] = std::max(box_max[c], g.center[c] + R);
+		}
+	};
+	for (size_t i = 0; i < std::max(a.size(), b.size()); ++i) {
+		if (i < a.size() && i < b.size() && same_gaussian(a[i], b[i]))
+			continue;
+		if (i < a.size())
+			extend(a[i]);
+		if (i < b.size())
+			extend(b[i]);
+	}
+
+	// Samples inside the box
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+	for (int c = 0; c < 3; ++c) {
+		k_begin[c] = 0;
+		k_end[c] = 0;
+		if (box_min[c] > box_max[c])
+			continue;
+		float const N = float(domain.samples[c]);
+		k_begin[c] = int(std::min(N, std::max(0.0f, std::ceil((box_min[c] - p0[c]) / step[c]))));
+		k_end[c] = int(std::min(N, std::max(0.0f, std::floor((box_max[c] - p0[c]) / step[c]) + 1)));
+	}
+	if (k_begin.x >= k_end.x || k_begin.y >= k_end.y || k_begin.z >= k_end.z)
+		k_begin = k_end = int3{ 0, 0, 0 };
+
+	return true;
+}
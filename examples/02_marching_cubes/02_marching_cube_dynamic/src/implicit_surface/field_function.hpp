@@ -1,16 +1,37 @@
 #pragma once
 
 #include "cgp/cgp.hpp"
+#include "../noise_cache/noise_cache.hpp"
+#include "../field_primitives/field_primitives.hpp"
+#include "../field_expression/field_expression.hpp"
+#include <memory>
 
 // Parametric function defined as a sum of blobs-like primitives
-//  f(p) = sa exp(-||p-pa||^2) + sb exp(-||p-pb||^2) + sc exp(-||p-pc||^2) + noise(p)
-//   with noise: a Perlin noise
+//  f(p) = sa exp(-||p-pa||^2) + sb exp(-||p-pb||^2) + sc exp(-||p-pc||^2) + sum_sculpt(p) + sum_primitives(p) + noise(p)
+//   with noise: a Perlin noise (or its interpolation in a precomputed table when use_noise_cache is set)
+//   sum_sculpt: the Gaussians added (or removed) by the sculpting brush (the older ones in a BVH)
+//   and sum_primitives: an arbitrary number of metaballs (spheres, capsules, boxes, Gaussians) stored in a BVH
 // The operator()(vec3 p) allows to query a value of the function at arbitrary point in space
 struct field_function_structure {
 
 	// Query the value of the function at any point p
 	float operator()(cgp::vec3 const& p) const;
 
+	// Fill values[kx + Nx*(ky + Ny*kz)] with the function at the samples of the domain, for the slabs kz in [kz_begin, kz_end[
+	//  Same values as operator(), but the Gaussians are evaluated as products of 1D factors (no exponential per sample)
+	void evaluate_slabs(cgp::spatial_domain_grid_3D const& domain, int kz_begin, int kz_end, float* values) const;
+	// Same as evaluate_slabs for the samples k_begin <= k < k_end (componentwise) only
+	//  The box is processed by blocks of 16^3 samples, each one evaluating only the primitives whose support reaches it.
+	//  gradients (if not null) receives the analytic gradient of the Gaussians at the same samples (computed in the same traversal)
+	void evaluate_box(cgp::spatial_domain_grid_3D const& domain, cgp::int3 const& k_begin, cgp::int3 const& k_end, float* values, cgp::vec3* gradients = nullptr) const;
+
+	// The gradient is known analytically when the function has no noise
+	bool analytic_gradient() const { return expression != nullptr ? expression->analytic_gradient() : noise_magnitude <= 0; }
+
+	// Conservative range [value_min, value_max] of the function over the box [p_min, p_max]
+	//  Each primitive is bounded using the closest and farthest points of the box to its core, and the noise by the sum of its octave magnitudes.
+	void bounds(cgp::vec3 const& p_min, cgp::vec3 const& p_max, float& value_min, float& value_max) const;
+
 
 	// ***************************//
 	// Parameters
@@ -26,11 +47,83 @@ struct field_function_structure {
 	float sb = 1.0f;
 	float sc = 0.0f; // note: The third blob is not visible initially has its magnitude is 0
 
+	// Gaussians added by the sculpting brush (negative magnitude to remove matter)
+	std::vector<field_gaussian_structure> sculpt;
+	// Older Gaussians of the sculpt, moved to a BVH by bake_sculpt (shared between the copies of the function, null if there is none)
+	std::shared_ptr<field_primitive_bvh_structure const> sculpt_baked;
+
+	// Largest number of Gaussians in the sculpt list, which is traversed entirely by each evaluation
+	static int const sculpt_size_max = 256;
+	// Move the oldest half of the sculpt to sculpt_baked once the list exceeds sculpt_size_max (the next update is then not local)
+	void bake_sculpt();
+	void clear_sculpt();
+
+	// All the Gaussian primitives: the 3 blobs followed by the sculpt
+	std::vector<field_gaussian_structure> gaussians() const;
+	// Call f(g) for the Gaussians evaluated one by one, without copying them: the 3 blobs (unless the expression contains them) and the sculpt
+	template <typename F> void for_each_gaussian(F const& f) const;
+
+	// Metaballs with a finite support, in a BVH (shared between the copies of the function, null if there is none)
+	std::shared_ptr<field_primitive_bvh_structure const> primitives;
+	// Replace the metaballs (a new BVH is built: the copies of the function made before keep the previous one)
+	void set_primitives(std::vector<field_primitive_structure> const& primitives);
+
 	// The parameters of the Perlin noise
 	float noise_magnitude   = 0.0f; // Magnitude of the noise
 	float noise_offset      = 0.0f; // An offset in the parametric domain (get a different value of noise with same parameters)
 	float noise_scale       = 1.0f; // Scale in the parametric domain
 	int noise_octave        = 5;    // Maximum number of octave
 	float noise_persistance = 0.3f; // Persistence of Perlin noise
+
+	// Precomputed noise table used instead of noise_perlin (shared between the copies of the function)
+	bool use_noise_cache = false;
+	std::shared_ptr<noise_cache_3D> noise_cache;
+
+	// Largest number of samples of the table along each direction (256^3 floats: 64 MB). The octaves it cannot represent are ignored by the cache.
+	static int const noise_cache_size_max = 256;
+
+	// Bake the noise table over the box [p_min, p_max] if the current one doesn't cover it or doesn't match the octave and persistance
+	void update_noise_cache(cgp::vec3 const& p_min, cgp::vec3 const& p_max, thread_pool_structure& thread_pool);
+
+	// The blobs and the noise compiled into a single fused expression (field_expression), evaluated instead of term by term
+	//  The sculpt and the metaballs are still added to it. The expression refers to the noise_cache of the function.
+	bool use_expression = false;
+	std::shared_ptr<field_expression::kernel const> expression;
+
+	// Build the expression of the current blobs and noise parameters (or remove it if use_expression is false)
+	//  The current expression is kept if its blobs and noise parameters didn't change.
+	void update_expression();
+
+	// Blobs and noise parameters the current expression was built from (it also keeps alive the noise table the expression reads)
+	struct {
+		field_gaussian_structure blobs[3];
+		float noise_magnitude = 0.0f;
+		float noise_offset = 0.0f;
+		float noise_scale = 0.0f;
+		int noise_octave = 0;
+		float noise_persistance = 0.0f;
+		bool use_noise_cache = false;
+		std::shared_ptr<noise_cache_3D> noise_cache;
+	} expression_source;
 };
 
+
+
+// Box of samples of the domain whose value differs between the two functions (k_begin <= k < k_end, empty if nothing changed)
+//  The box covers the supports of the primitives that have been modified, added or removed.
+//  Return false if the modification is not local (noise parameters, set of metaballs, expression), in which case the whole field must be computed again.
+bool field_function_modified_box(field_function_structure const& previous, field_function_structure const& current, cgp::spatial_domain_grid_3D const& domain, cgp::int3& k_begin, cgp::int3& k_end);
+
+
+
+template <typename F>
+void field_function_structure::for_each_gaussian(F const& f) const
+{
+	if (expression == nullptr) {
+		f(field_gaussian_structure{ pa, sa, 1.0f });
+		f(field_gaussian_structure{ pb, sb, 1.0f });
+		f(field_gaussian_structure{ pc, sc, 1.0f });
+	}
+	for (field_gaussian_structure const& g : sculpt)
+		f(g);
+}
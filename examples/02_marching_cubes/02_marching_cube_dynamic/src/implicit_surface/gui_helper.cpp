@@ -2,7 +2,7 @@
 
 using namespace cgp;
 
-void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marching_cube, bool& is_save_obj, gui_parameters& gui, field_function_structure& field_function)
+void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marching_cube, bool& is_save_mesh, bool& is_stream_mesh, bool& is_write_volume, bool& is_decimate, bool& is_save_lod, bool& is_benchmark_layout, gui_parameters& gui, field_function_structure& field_function)
 {
 	if (ImGui::CollapsingHeader("Display"))
 	{
@@ -14,11 +14,32 @@ void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marchin
 
 	if (ImGui::CollapsingHeader("Domain"))
 	{
-		is_update_field |= ImGui::SliderInt("Samples", &gui.domain.samples, 8, 100);
+		is_update_field |= ImGui::SliderInt("Samples", &gui.domain.samples, 8, 256);
 
 		is_update_field |= ImGui::SliderFloat("Lx", &gui.domain.length.x, 0.5f, 10.0f);
 		is_update_field |= ImGui::SliderFloat("Ly", &gui.domain.length.y, 0.5f, 10.0f);
 		is_update_field |= ImGui::SliderFloat("Lz", &gui.domain.length.z, 0.5f, 10.0f);
+		is_update_field |= ImGui::Checkbox("Narrow band", &gui.narrow_band);
+		ImGui::Checkbox("Local update", &gui.local_update);
+		ImGui::Checkbox("Background computation", &gui.background);
+		if (gui.background)
+			ImGui::SliderInt("Preview samples", &gui.preview_samples, 8, 80);
+
+		is_benchmark_layout = ImGui::Button("Benchmark grid layouts");
+
+		is_update_field |= ImGui::Checkbox("Adaptive octree", &gui.octree.active);
+		if (gui.octree.active) {
+			is_update_field |= ImGui::SliderInt("Octree depth", &gui.octree.max_depth, 6, 12);
+			is_update_field |= ImGui::SliderInt("Surface depth", &gui.octree.surface_depth, 3, 8);
+			is_update_field |= ImGui::SliderFloat("Flatness", &gui.octree.flatness, 0.005f, 0.1f, "%.3f");
+		}
+		else {
+			is_update_field |= ImGui::Checkbox("Sparse volume", &gui.sparse_volume);
+#ifndef __EMSCRIPTEN__
+			if (!gui.sparse_volume)
+				is_update_field |= ImGui::Checkbox("GPU extraction", &gui.gpu_extraction);
+#endif
+		}
 	}
 
 	if (ImGui::CollapsingHeader("Field Function"))
@@ -44,12 +65,86 @@ void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marchin
 		is_update_field |= ImGui::SliderFloat("Noise offset", &field_function.noise_offset, -3, 3);
 		is_update_field |= ImGui::SliderInt("Noise Octave", &field_function.noise_octave, 1, 8);
 		is_update_field |= ImGui::SliderFloat("Noise Persistance", &field_function.noise_persistance, 0.1f, 0.5f);
+		is_update_field |= ImGui::Checkbox("Noise cache", &field_function.use_noise_cache);
+		if (field_function.use_noise_cache && field_function.noise_cache != nullptr) {
+			ImGui::Text("Cache %dx%dx%d (%.1f MB)", field_function.noise_cache->N.x, field_function.noise_cache->N.y, field_function.noise_cache->N.z, field_function.noise_cache->memory() / (1024 * 1024.0f));
+			if (field_function.noise_cache->parameters.octave < field_function.noise_octave)
+				ImGui::Text("Octaves clamped to %d by the cache", field_function.noise_cache->parameters.octave);
+		}
+		ImGui::Spacing();
+		is_update_field |= ImGui::Checkbox("Fused expression", &field_function.use_expression);
+	}
+
+	if (ImGui::CollapsingHeader("Sculpt"))
+	{
+		ImGui::Text("Shift + left drag: add, Shift + right drag: remove");
+		ImGui::SliderFloat("Brush radius", &gui.sculpt.radius, 0.05f, 1.0f);
+		ImGui::SliderFloat("Brush strength", &gui.sculpt.strength, 0.05f, 1.0f);
+		if (ImGui::Button("Clear sculpt")) {
+			field_function.clear_sculpt();
+			is_update_field = true;
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Metaballs"))
+	{
+		ImGui::SliderInt("Count", &gui.metaballs.count, 100, 50000);
+		char const* types[4] = { "Gaussians", "Spheres", "Capsules", "Boxes" };
+		ImGui::Combo("Type", &gui.metaballs.type, types, 4);
+		ImGui::SliderFloat("Radius", &gui.metaballs.radius, 0.02f, 0.5f);
+		if (ImGui::Button("Generate")) {
+			vec3 const half_length = 0.45f * gui.domain.length;
+			field_function.set_primitives(field_primitives_random(size_t(gui.metaballs.count), field_primitive_type(gui.metaballs.type), gui.metaballs.radius, -half_length, half_length));
+			is_update_field = true;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Load particles.txt")) {
+			std::vector<field_primitive_structure> particles;
+			if (field_primitives_load("particles.txt", gui.metaballs.radius, particles)) {
+				field_function.set_primitives(particles);
+				is_update_field = true;
+			}
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Clear")) {
+			field_function.set_primitives({});
+			is_update_field = true;
+		}
+		if (field_function.primitives != nullptr)
+			ImGui::Text("%d primitives, %d BVH nodes", int(field_function.primitives->size()), int(field_function.primitives->nodes.size()));
+	}
+
+	if (ImGui::CollapsingHeader("Decimation"))
+	{
+		ImGui::SliderFloat("Triangles kept", &gui.decimation.ratio, 0.01f, 1.0f);
+		ImGui::SliderFloat("Max error", &gui.decimation.max_error, 0.0f, 0.05f, "%.4f");
+		is_decimate = ImGui::Button("Decimate");
+		ImGui::Checkbox("Display decimated surface", &gui.decimation.display);
+		ImGui::SliderInt("LOD levels", &gui.decimation.lod_levels, 2, 8);
+		is_save_lod = ImGui::Button("Export LOD chain");
+	}
+
+	if (ImGui::CollapsingHeader("Out-of-core extraction"))
+	{
+		ImGui::SliderInt("Streamed samples", &gui.streaming.samples, 64, 2048);
+		ImGui::Checkbox("Read volume.raw", &gui.streaming.raw_volume);
+		is_write_volume = ImGui::Button("Write volume.raw");
+		is_stream_mesh = ImGui::Button("Stream mesh to mesh_streamed.ply");
 	}
 
 	ImGui::Spacing();
 	is_update_marching_cube |= ImGui::SliderFloat("Isovalue", &gui.isovalue, 0.0f, 1.0f);
 
 	ImGui::Spacing();
-	is_save_obj = ImGui::Button("Export mesh as obj");
+	ImGui::Text("Export mesh as");
+	mesh_file_format const formats[3] = { mesh_file_format::obj, mesh_file_format::ply, mesh_file_format::raw };
+	char const* labels[3] = { "obj", "ply (binary)", "raw" };
+	for (int k = 0; k < 3; ++k) {
+		ImGui::SameLine();
+		if (ImGui::Button(labels[k])) {
+			is_save_mesh = true;
+			gui.export_format = formats[k];
+		}
+	}
 
 }
\ No newline at end of file
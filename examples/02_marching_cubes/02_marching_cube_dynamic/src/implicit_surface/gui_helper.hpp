@@ -2,6 +2,7 @@
 
 #include "cgp/cgp.hpp"
 #include "field_function.hpp"
+#include "../mesh_export/mesh_export.hpp"
 
 // Element of the GUI that are not already stored in other structures
 struct gui_parameters {
@@ -20,7 +21,57 @@ struct gui_parameters {
 
 	// Isovalue used during the marching cube
 	float isovalue = 0.5f;
+
+	// Evaluate the field exactly only in the blocks that can contain the isovalue
+	bool narrow_band = false;
+
+	// Recompute the field and the surface only around the modified primitives
+	bool local_update = true;
+
+	// Compute the surface in a background thread (the GUI stays responsive), with a preview of preview_samples samples
+	//  when the domain has more than twice as many samples
+	bool background = true;
+	int preview_samples = 40;
+
+	struct { // Adaptive octree used instead of the uniform grid
+		bool active = false;
+		int max_depth = 10;
+		int surface_depth = 6;
+		float flatness = 0.02f;
+	} octree;
+
+	// Store the field only in leaves of 8^3 samples around the surface instead of the uniform grid
+	bool sparse_volume = false;
+
+	// Extract the surface on the GPU (histogram pyramid and transform feedback) instead of the CPU marching cube
+	bool gpu_extraction = false;
+
+	// Format of the last exported mesh
+	mesh_file_format export_format = mesh_file_format::ply;
+
+	struct { // Decimation of the surface (quadric error metric)
+		float ratio = 0.1f;      // Fraction of the triangles that are kept
+		float max_error = 0.0f;  // Largest displacement of the surface (0: only the ratio is used)
+		int lod_levels = 4;      // Number of levels of the exported LOD chain (each one has half the triangles of the previous one)
+		bool display = false;    // Display the decimated surface instead of the full resolution one
+	} decimation;
+
+	struct { // Out-of-core extraction in mesh_streamed.ply (the grid is never stored entirely)
+		int samples = 512;
+		bool raw_volume = false; // Read the samples from volume.raw instead of evaluating the function
+	} streaming;
+
+	struct { // Metaballs generated randomly in the domain, or read from particles.txt
+		int count = 10000;
+		int type = 1;            // Index in field_primitive_type (gaussian, sphere, capsule, box)
+		float radius = 0.12f;
+	} metaballs;
+
+	struct { // Sculpting brush (shift + left drag to add matter, shift + right drag to remove it)
+		float radius = 0.3f;
+		float strength = 0.4f;
+	} sculpt;
 };
 
 
-void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marching_cube, bool& is_save_obj, gui_parameters& gui, field_function_structure& field_function);
\ No newline at end of file
+void display_gui_implicit_surface(bool& is_update_field, bool& is_update_marching_cube, bool& is_save_mesh, bool& is_stream_mesh, bool& is_write_volume, bool& is_decimate, bool& is_save_lod, bool& is_benchmark_layout, gui_parameters& gui, field_function_structure& field_function);
\ No newline at end of file
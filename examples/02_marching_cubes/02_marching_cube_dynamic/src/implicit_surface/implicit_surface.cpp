@@ -1,147 +1,388 @@
 #include "implicit_surface.hpp"
 
+#include <chrono>
+#include <atomic>
+
 
 using namespace cgp;
 
 
 
 
-static void update_normals(std::vector<vec3>& normals, int number_of_vertex, grid_3D<vec3> const& gradient, std::vector<marching_cube_relative_coordinates> const& relative_coords)
+void implicit_surface_structure::update_marching_cube(float isovalue)
 {
-	// Compute the normal using linear interpolation of the gradients
-	for (int k = 0; k < number_of_vertex; ++k)
-	{
-		size_t const idx0 = relative_coords[k].k0;
-		size_t const idx1 = relative_coords[k].k1;
-
-		vec3 const& n0 = gradient.at_unsafe(idx0);
-		vec3 const& n1 = gradient.at_unsafe(idx1);
-
-		float const alpha = relative_coords[k].alpha;
-		normals[k] = -normalize((1 - alpha) * n0 + alpha * n1, { 1,0,0 });
-	}
+	compute_marching_cube(isovalue);
+	update_drawable();
 }
 
-void implicit_surface_structure::update_marching_cube(float isovalue)
+void implicit_surface_structure::compute_marching_cube(float isovalue)
 {
-	// Variable shortcut
-	std::vector<vec3>& position = data_param.position;
-	std::vector<vec3>& normal = data_param.normal;
-	size_t& number_of_vertex = data_param.number_of_vertex;
-	spatial_domain_grid_3D const& domain = field_param.domain;
-	std::vector<cgp::marching_cube_relative_coordinates> relative_coord = data_param.relative;
-	grid_3D<float> const& field = field_param.field;
-	grid_3D<vec3> const& gradient = field_param.gradient;
+	// The surface is extracted elsewhere, the CPU surface is released
+	computed_settings.extract_surface = extract_surface;
+	if (!extract_surface) {
+		data_param.mesh = marching_cube_block_mesh_structure();
+		data_param.mesh.isovalue = isovalue;
+		return;
+	}
 
-	// Store the size of the previous position buffer
-	size_t const previous_size = position.size();
+	// Compute the Marching Cube (each vertex is shared by the triangles around it)
+	auto const time_start = std::chrono::steady_clock::now();
+	data_param.mesh.build(field_param.field, field_param.gradient, field_param.domain, field_param.block_summary, isovalue, *thread_pool, &visited_blocks);
+	timing.marching_cube = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+}
 
-	// Compute the Marching Cube
-	number_of_vertex = marching_cube(position, field.data.data, domain, isovalue, &relative_coord);
+void implicit_surface_structure::update_drawable()
+{
+	if (!extract_surface)
+		return;
 
-	// Resize the vector of normals if needed
-	if (normal.size() < position.size())
-		normal.resize(position.size());
+	marching_cube_block_mesh_structure const& m = data_param.mesh;
 
-	update_normals(normal, number_of_vertex, gradient, relative_coord);
+	if (m.reallocated || drawable_param.shape.vbo_position.id == 0) {
+		mesh surface;
+		surface.position.data = m.position;
+		surface.normal.data = m.normal;
+		surface.connectivity.data = m.triangles;
+		surface.fill_empty_field();
 
-	// Update the display of the mesh
-	if (position.size() > previous_size) {
-		// If there is more position than allocated - perform a full clear and reallocation from scratch
 		drawable_param.shape.clear();
-		drawable_param.shape.initialize_data_on_gpu(position, normal);
-	}
-	else {
-		// Otherwise simply update the new relevant values re-using the allocated buffers
-		drawable_param.shape.vbo_position.update(position, number_of_vertex);
-		drawable_param.shape.vbo_normal.update(normal, number_of_vertex);
-		drawable_param.shape.vertex_number = number_of_vertex;
+		drawable_param.shape.initialize_data_on_gpu(surface);
+		return;
 	}
 
+	// Patch the modified ranges of the buffers
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, drawable_param.shape.vbo_position.id);
+	for (auto const& range : m.modified_vertices)
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(range.first * sizeof(vec3)), GLsizeiptr((range.second - range.first) * sizeof(vec3)), &m.position[range.first]);
+	glBindBuffer(GL_ARRAY_BUFFER, drawable_param.shape.vbo_normal.id);
+	for (auto const& range : m.modified_vertices)
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(range.first * sizeof(vec3)), GLsizeiptr((range.second - range.first) * sizeof(vec3)), &m.normal[range.first]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, drawable_param.shape.ebo_connectivity.id);
+	for (auto const& range : m.modified_triangles)
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(range.first * sizeof(uint3)), GLsizeiptr((range.second - range.first) * sizeof(uint3)), &m.triangles[range.first]);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void implicit_surface_structure::upload_surface()
+{
+	// Full upload of the buffers
+	drawable_param.shape.clear();
+	update_drawable();
+
+	// Reset the domain visualization (lightweight - can be cleared at each call)
+	drawable_param.domain_box.clear();
+	drawable_param.domain_box.initialize_data_on_gpu(field_param.domain.export_segments_for_drawable_border());
+}
+
+void implicit_surface_structure::swap_data(implicit_surface_structure& other)
+{
+	std::swap(field_param, other.field_param);
+	std::swap(data_param, other.data_param);
+	std::swap(narrow_band, other.narrow_band);
+	std::swap(extract_surface, other.extract_surface);
+	std::swap(evaluated_samples, other.evaluated_samples);
+	std::swap(visited_blocks, other.visited_blocks);
+	std::swap(updated_blocks, other.updated_blocks);
+	std::swap(timing, other.timing);
+	std::swap(computed_settings, other.computed_settings);
 }
 
+implicit_surface_settings implicit_surface_structure::current_settings() const
+{
+	implicit_surface_settings settings;
+	settings.narrow_band = narrow_band;
+	settings.extract_surface = extract_surface;
+	settings.samples = field_param.domain.samples;
+	return settings;
+}
 
+static bool same_settings(implicit_surface_settings const& a, implicit_surface_settings const& b)
+{
+	return a.narrow_band == b.narrow_band && a.extract_surface == b.extract_surface
+		&& a.samples.x == b.samples.x && a.samples.y == b.samples.y && a.samples.z == b.samples.z;
+}
 
 void implicit_surface_structure::update_field(field_function_structure const& field_function, float isovalue)
+{
+	compute_field(field_function, isovalue);
+	upload_surface();
+}
+
+void implicit_surface_structure::compute_field(field_function_structure const& field_function, float isovalue)
 {
 	// Variable shortcut
 	grid_3D<float>& field = field_param.field;
 	grid_3D<vec3>& gradient = field_param.gradient;
 	spatial_domain_grid_3D& domain = field_param.domain;
 
-	// Compute the scalar field
-	field = compute_discrete_scalar_field(domain, field_function);
+	assert_cgp(thread_pool != nullptr, "The thread pool of the implicit surface is not set");
 
-	// Compute the gradient of the scalar field
-	gradient = compute_gradient(field);
+	// Compute the scalar field (the grids are only reallocated when the number of samples changes)
+	auto const time_start = std::chrono::steady_clock::now();
+	field.resize(domain.samples);
+	gradient.resize(domain.samples);
+	bool const fused = !narrow_band && field_function.analytic_gradient();
+	if (narrow_band)
+		compute_discrete_scalar_field_narrow_band(field, domain, field_function, isovalue, *thread_pool, &evaluated_samples);
+	else {
+		compute_discrete_scalar_field(field, fused ? &gradient : nullptr, domain, field_function, *thread_pool, cancel);
+		evaluated_samples = field.size();
+	}
+	auto const time_field = std::chrono::steady_clock::now();
+	if (is_cancelled())
+		return;
+
+	// Compute the gradient of the scalar field (if it is not already computed with the field)
+	if (!fused)
+		compute_gradient(gradient, field, { 0, 0, 0 }, field.dimension, *thread_pool);
+	field_param.block_summary.build(field, *thread_pool);
+	auto const time_gradient = std::chrono::steady_clock::now();
+	if (is_cancelled())
+		return;
+
+	timing.field = std::chrono::duration<float, std::milli>(time_field - time_start).count();
+	timing.gradient = std::chrono::duration<float, std::milli>(time_gradient - time_field).count();
+
+	field_param.function = field_function;
 
 	// Recompute the marching cube
-	update_marching_cube(isovalue);
+	compute_marching_cube(isovalue);
+	if (!is_cancelled())
+		computed_settings = current_settings();
+}
 
-	// Reset the domain visualization (lightweight - can be cleared at each call)
-	drawable_param.domain_box.clear();
-	drawable_param.domain_box.initialize_data_on_gpu(domain.export_segments_for_drawable_border());
+void implicit_surface_structure::update_field_local(field_function_structure const& field_function, float isovalue)
+{
+	if (!try_update_field_local(field_function, isovalue))
+		update_field(field_function, isovalue);
 }
 
-void implicit_surface_structure::set_domain(int samples, cgp::vec3 const& length)
+bool implicit_surface_structure::try_update_field_local(field_function_structure const& field_function, float isovalue)
 {
-	field_param.domain = spatial_domain_grid_3D::from_center_length({ 0,0,0 }, length, samples * int3{ 1,1,1 });
+	grid_3D<float>& field = field_param.field;
+	spatial_domain_grid_3D const& domain = field_param.domain;
+	int3 const N = domain.samples;
+
+	// The local update requires a field and a surface computed with the current settings (an extraction setting changed
+	//  without any modification of the function is not a local update), on the same grid, without the approximations of the narrow band
+	int3 k_begin, k_end;
+	modified_begin = modified_end = { 0, 0, 0 };
+	bool const is_local = same_settings(computed_settings, current_settings()) && !narrow_band && isovalue == data_param.mesh.isovalue
+		&& field.dimension.x == N.x && field.dimension.y == N.y && field.dimension.z == N.z
+		&& field_function_modified_box(field_param.function, field_function, domain, k_begin, k_end);
+	if (!is_local)
+		return false;
+	size_t const modified_samples = size_t(k_end.x - k_begin.x) * (k_end.y - k_begin.y) * (k_end.z - k_begin.z);
+	if (modified_samples > field.size() / 2)
+		return false;
+	field_param.function = field_function;
+	if (modified_samples == 0)
+		return true;
+
+	// Field and summary of the modified samples
+	auto const time_start = std::chrono::steady_clock::now();
+	float* values = field.data.data.data();
+	vec3* gradients = field_function.analytic_gradient() ? field_param.gradient.data.data.data() : nullptr;
+	thread_pool->parallel_for(k_end.z - k_begin.z, 1, [&](int z_begin, int z_end) {
+		field_function.evaluate_box(domain, { k_begin.x, k_begin.y, k_begin.z + z_begin }, { k_end.x, k_end.y, k_begin.z + z_end }, values, gradients);
+	});
+	field_param.block_summary.update(field, k_begin, k_end);
+	auto const time_field = std::chrono::steady_clock::now();
+
+	// The finite differences of the neighboring samples use the modified values
+	if (gradients == nullptr) {
+		int3 const g_begin = { std::max(k_begin.x - 1, 0), std::max(k_begin.y - 1, 0), std::max(k_begin.z - 1, 0) };
+		int3 const g_end = { std::min(k_end.x + 1, N.x), std::min(k_end.y + 1, N.y), std::min(k_end.z + 1, N.z) };
+		compute_gradient(field_param.gradient, field, g_begin, g_end, *thread_pool);
+	}
+	auto const time_gradient = std::chrono::steady_clock::now();
+
+	// Extract again the blocks around the modified samples
+	if (extract_surface)
+		updated_blocks = data_param.mesh.update(field, field_param.gradient, domain, field_param.block_summary, k_begin, k_end, *thread_pool);
+	update_drawable();
+	modified_begin = k_begin;
+	modified_end = k_end;
+	auto const time_marching_cube = std::chrono::steady_clock::now();
+
+	evaluated_samples = modified_samples;
+	timing.field = std::chrono::duration<float, std::milli>(time_field - time_start).count();
+	timing.gradient = std::chrono::duration<float, std::milli>(time_gradient - time_field).count();
+	timing.marching_cube = std::chrono::duration<float, std::milli>(time_marching_cube - time_gradient).count();
+	return true;
 }
 
+// Trilinear interpolation of the field at the (continuous) grid coordinates u
+static float interpolate_field(grid_3D<float> const& field, vec3 const& u)
+{
+	int3 const N = field.dimension;
+	int const x = std::min(std::max(int(u.x), 0), N.x - 2);
+	int const y = std::min(std::max(int(u.y), 0), N.y - 2);
+	int const z = std::min(std::max(int(u.z), 0), N.z - 2);
+	float const a = u.x - x, b = u.y - y, c = u.z - z;
+
+	float const v00 = (1 - a) * field.at_unsafe(x, y, z) + a * field.at_unsafe(x + 1, y, z);
+	float const v10 = (1 - a) * field.at_unsafe(x, y + 1, z) + a * field.at_unsafe(x + 1, y + 1, z);
+	float const v01 = (1 - a) * field.at_unsafe(x, y, z + 1) + a * field.at_unsafe(x + 1, y, z + 1);
+	float const v11 = (1 - a) * field.at_unsafe(x, y + 1, z + 1) + a * field.at_unsafe(x + 1, y + 1, z + 1);
+	return (1 - c) * ((1 - b) * v00 + b * v10) + c * ((1 - b) * v01 + b * v11);
+}
 
+bool implicit_surface_structure::intersect(vec3 const& origin, vec3 const& direction, float isovalue, vec3& intersection) const
+{
+	grid_3D<float> const& field = field_param.field;
+	spatial_domain_grid_3D const& domain = field_param.domain;
+	if (domain.samples.x < 2 || domain.samples.y < 2 || domain.samples.z < 2)
+		return false;
+
+	// Without the grid, the function itself is evaluated along the ray
+	auto const value = [&](vec3 const& u) {
+		if (field.size() == 0)
+			return field_param.function(domain.position({ 0, 0, 0 }) + u * (domain.position({ 1, 1, 1 }) - domain.position({ 0, 0, 0 })));
+		return interpolate_field(field, u);
+	};
+
+	// Ray expressed in grid coordinates, clipped by the domain
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+	vec3 const o = (origin - p0) / step;
+	vec3 const d = direction / step;
+	float t_min = 0.0f, t_max = 1e30f;
+	for (int c = 0; c < 3; ++c) {
+		float const upper = float(domain.samples[c] - 1);
+		if (std::abs(d[c]) < 1e-12f) {
+			if (o[c] < 0 || o[c] > upper)
+				return false;
+			continue;
+		}
+		float const t0 = (0 - o[c]) / d[c];
+		float const t1 = (upper - o[c]) / d[c];
+		t_min = std::max(t_min, std::min(t0, t1));
+		t_max = std::min(t_max, std::max(t0, t1));
+	}
+	if (t_min > t_max)
+		return false;
+
+	// March by half a cell until the field crosses the isovalue, then interpolate linearly on the last step
+	float const dt = 0.5f / norm(d);
+	float t = t_min;
+	float v = value(o + t * d);
+	bool const inside = v > isovalue;
+	while (t < t_max) {
+		float const t_next = std::min(t + dt, t_max);
+		float const v_next = value(o + t_next * d);
+		if ((v_next > isovalue) != inside) {
+			float const alpha = (isovalue - v) / (v_next - v);
+			intersection = origin + (t + alpha * (t_next - t)) * direction;
+			return true;
+		}
+		t = t_next;
+		v = v_next;
+	}
+	return false;
+}
 
-void implicit_surface_structure::gui_update(gui_parameters& gui, field_function_structure& field_function)
+void implicit_surface_structure::set_domain(int samples, cgp::vec3 const& length)
 {
-	bool is_update_marching_cube = false;
-	bool is_update_field = false;
-	bool is_save_obj = false;
+	field_param.domain = spatial_domain_grid_3D::from_center_length({ 0,0,0 }, length, samples * int3{ 1,1,1 });
+}
 
-	display_gui_implicit_surface(is_update_field, is_update_marching_cube, is_save_obj, gui, field_function);
 
-	if (is_update_marching_cube) 
-		update_marching_cube(gui.isovalue);
-	if (is_update_field) {
-		set_domain(gui.domain.samples, gui.domain.length);
-		update_field(field_function, gui.isovalue);
-	}
 
-	if (is_save_obj) {
-		data_param.position.resize(data_param.number_of_vertex);
-		data_param.normal.resize(data_param.number_of_vertex);
-		save_file_obj("mesh.obj", data_param.position, data_param.normal);
-	}
-		
+mesh implicit_surface_structure::surface_mesh() const
+{
+	mesh surface;
+	data_param.mesh.export_compact(surface.position.data, surface.normal.data, surface.connectivity.data);
+	surface.fill_empty_field();
+	return surface;
 }
 
 
-
-grid_3D<float> compute_discrete_scalar_field(spatial_domain_grid_3D const& domain, field_function_structure const& func)
+grid_3D<float> compute_discrete_scalar_field(spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool)
 {
 	grid_3D<float> field;
 	field.resize(domain.samples);
+	compute_discrete_scalar_field(field, nullptr, domain, func, thread_pool);
+	return field;
+}
+
+void compute_discrete_scalar_field(grid_3D<float>& field, grid_3D<vec3>* gradient, spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool, std::atomic<bool> const* cancel)
+{
+	field.resize(domain.samples);
 
-	// Fill the discrete field values
-	for (int kz = 0; kz < domain.samples.z; kz++) {
-		for (int ky = 0; ky < domain.samples.y; ky++) {
-			for (int kx = 0; kx < domain.samples.x; kx++) {
+	// Fill the discrete field values (and gradients), each task handles a few z-slabs
+	float* values = field.data.data.data();
+	vec3* gradients = gradient != nullptr ? gradient->data.data.data() : nullptr;
+	thread_pool.parallel_for(domain.samples.z, 2, [&](int kz_begin, int kz_end) {
+		if (cancel != nullptr && cancel->load())
+			return;
+		func.evaluate_box(domain, { 0, 0, kz_begin }, { domain.samples.x, domain.samples.y, kz_end }, values, gradients);
+	});
+}
 
-				vec3 const p = domain.position({ kx, ky, kz });
-				field(kx, ky, kz) = func(p);
 
+
+void compute_discrete_scalar_field_narrow_band(grid_3D<float>& field, spatial_domain_grid_3D const& domain, field_function_structure const& func, float isovalue, thread_pool_structure& thread_pool, size_t* evaluated_samples)
+{
+	int const block_size = 4;
+	int const margin = 2;
+	int3 const N = domain.samples;
+	int3 const blocks = { (N.x + block_size - 1) / block_size, (N.y + block_size - 1) / block_size, (N.z + block_size - 1) / block_size };
+
+	field.resize(N);
+	float* values = field.data.data.data();
+
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	std::atomic<size_t> evaluated(0);
+	thread_pool.parallel_for(blocks.z, 1, [&](int bz_begin, int bz_end) {
+		size_t evaluated_local = 0;
+		for (int bz = bz_begin; bz < bz_end; ++bz) {
+			for (int by = 0; by < blocks.y; ++by) {
+				for (int bx = 0; bx < blocks.x; ++bx) {
+					int3 const k_begin = { bx * block_size, by * block_size, bz * block_size };
+					int3 const k_end = { std::min(k_begin.x + block_size, N.x), std::min(k_begin.y + block_size, N.y), std::min(k_begin.z + block_size, N.z) };
+
+					// Bounds of the field on the block extended by the margin
+					vec3 const p_min = p0 + step * vec3(float(k_begin.x - margin), float(k_begin.y - margin), float(k_begin.z - margin));
+					vec3 const p_max = p0 + step * vec3(float(k_end.x - 1 + margin), float(k_end.y - 1 + margin), float(k_end.z - 1 + margin));
+					float value_min, value_max;
+					func.bounds(p_min, p_max, value_min, value_max);
+
+					if (value_min <= isovalue && isovalue <= value_max) {
+						func.evaluate_box(domain, k_begin, k_end, values);
+						evaluated_local += size_t(k_end.x - k_begin.x) * (k_end.y - k_begin.y) * (k_end.z - k_begin.z);
+					}
+					else {
+						float const value = value_max < isovalue ? value_max : value_min;
+						for (int kz = k_begin.z; kz < k_end.z; ++kz)
+							for (int ky = k_begin.y; ky < k_end.y; ++ky)
+								std::fill(values + k_begin.x + N.x * (ky + size_t(N.y) * kz), values + k_end.x + N.x * (ky + size_t(N.y) * kz), value);
+					}
+				}
 			}
 		}
-	}
+		evaluated += evaluated_local;
+	});
 
-	return field;
+	if (evaluated_samples != nullptr)
+		*evaluated_samples = evaluated;
 }
 
-
-
-grid_3D<vec3> compute_gradient(grid_3D<float> const& field)
+grid_3D<vec3> compute_gradient(grid_3D<float> const& field, thread_pool_structure& thread_pool)
 {
 	grid_3D<vec3> gradient;
 	gradient.resize(field.dimension);
+	compute_gradient(gradient, field, { 0, 0, 0 }, field.dimension, thread_pool);
+	return gradient;
+}
 
+void compute_gradient(grid_3D<vec3>& gradient, grid_3D<float> const& field, int3 const& k_begin, int3 const& k_end, thread_pool_structure& thread_pool)
+{
 	int const Nx = field.dimension.x;
 	int const Ny = field.dimension.y;
 	int const Nz = field.dimension.z;
@@ -150,20 +391,20 @@ grid_3D<vec3> compute_gradient(grid_3D<float> const& field)
 	//  g(k) = g(k+1)-g(k) // for k<N-1
 	//  otherwise g(k) = g(k)-g(k-1)
 
-	for (int kz = 0; kz < Nz; ++kz) {
-		for (int ky = 0; ky < Ny; ++ky) {
-			for (int kx = 0; kx < Nx; ++kx) {
+	thread_pool.parallel_for(k_end.z - k_begin.z, 2, [&](int z_begin, int z_end) {
+		for (int kz = k_begin.z + z_begin; kz < k_begin.z + z_end; ++kz) {
+			for (int ky = k_begin.y; ky < k_end.y; ++ky) {
+				for (int kx = k_begin.x; kx < k_end.x; ++kx) {
 
-				vec3& g = gradient.at_unsafe(kx, ky, kz);
-				float const f = field.at_unsafe(kx, ky, kz);
+					vec3& g = gradient.at_unsafe(kx, ky, kz);
+					float const f = field.at_unsafe(kx, ky, kz);
 
-				g.x = kx != Nx - 1 ? field.at_unsafe(kx + 1, ky, kz) - f : f - field.at_unsafe(kx - 1, ky, kz);
-				g.y = ky != Ny - 1 ? field.at_unsafe(kx, ky + 1, kz) - f : f - field.at_unsafe(kx, ky - 1, kz);
-				g.z = kz != Nz - 1 ? field.at_unsafe(kx, ky, kz + 1) - f : f - field.at_unsafe(kx, ky, kz - 1);
+					g.x = kx != Nx - 1 ? field.at_unsafe(kx + 1, ky, kz) - f : f - field.at_unsafe(kx - 1, ky, kz);
+					g.y = ky != Ny - 1 ? field.at_unsafe(kx, ky + 1, kz) - f : f - field.at_unsafe(kx, ky - 1, kz);
+					g.z = kz != Nz - 1 ? field.at_unsafe(kx, ky, kz + 1) - f : f - field.at_unsafe(kx, ky, kz - 1);
 
+				}
 			}
 		}
-	}
-
-	return gradient;
+	});
 }
@@ -2,35 +2,48 @@
 
 #include "cgp/cgp.hpp"
 #include "field_function.hpp"
-#include "gui_helper.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include "../marching_cube_blocks/marching_cube_blocks.hpp"
+#include <atomic>
 
 
 
 // All the data used for the Implicit Surface 
 // ********************************************** //
+//  The field is sampled on a uniform grid and the surface is extracted by the marching cube on the CPU.
+//  The other ways to compute and to use the surface (octree, sparse volume, GPU extraction, background computation,
+//  decimation, out-of-core extraction) are in implicit_surface_backends.hpp.
 
 // Sub-structure that contains the discrete field data
 struct implicit_surface_field_structure {
 	cgp::spatial_domain_grid_3D domain;   // The domain where the discrete field is defined
 	cgp::grid_3D<float> field;            // The grid storing the value of the field
 	cgp::grid_3D<cgp::vec3> gradient;     // The discrete gradient of the field
+	field_block_summary_structure block_summary; // Range of the field on blocks of cells (used to skip the blocks that don't contain the isovalue)
+	field_function_structure function;    // The function sampled in the field (used to find the samples modified by a new function)
 };
 
 // Sub-structure that contains the data of the surface
+//  The surface is an indexed mesh: each vertex comes from a single edge of the grid and is shared by its triangles.
+//  The vertices and triangles are stored per block of the grid, such that a local modification only rewrites a few blocks.
 struct implicit_surface_data {
-	size_t number_of_vertex;              // The valid number of vertex of the surface
-	std::vector<cgp::vec3> position;      // Positions of the mesh
-	std::vector<cgp::vec3> normal;        // Normals of the mesh
-	std::vector<cgp::marching_cube_relative_coordinates> relative; // Relative coordinates of the vertices expressed as an edge in the discrete grid 
+	marching_cube_block_mesh_structure mesh; // Positions, normals and triangles of the surface
 };
 
 // Sub-structure that contains the elements that are displayed
 struct implicit_surface_drawable_structure {
-	cgp::triangles_drawable shape;     // Structure used to display the geometry
+	cgp::mesh_drawable shape;          // Structure used to display the geometry
 	cgp::curve_drawable domain_box;    // Structure used to display the box
 };
 
 
+// Settings with which the field and the surface have been computed (a local update requires the same settings)
+struct implicit_surface_settings {
+	bool narrow_band = false;
+	bool extract_surface = true;
+	cgp::int3 samples = { 0,0,0 };
+};
+
 // Global structure 
 struct implicit_surface_structure 
 {	
@@ -38,6 +51,26 @@ struct implicit_surface_structure
 	implicit_surface_drawable_structure drawable_param;
 	implicit_surface_field_structure field_param;	
 
+	thread_pool_structure* thread_pool = nullptr; // Threads used to evaluate the field and the surface (owned by the scene, must be set before any computation)
+
+	bool narrow_band = false;             // Evaluate the field exactly only in the blocks that can contain the isovalue
+	bool extract_surface = true;          // Extract the surface with the marching cube (false: only the field is computed, the surface comes from elsewhere)
+	size_t evaluated_samples = 0;         // Number of samples evaluated exactly during the last update of the field
+	size_t visited_blocks = 0;            // Number of blocks visited by the last marching cube
+	size_t updated_blocks = 0;            // Number of blocks extracted again by the last local update
+	cgp::int3 modified_begin = { 0,0,0 }; // Samples modified by the last local update (modified_begin <= k < modified_end)
+	cgp::int3 modified_end = { 0,0,0 };
+
+	implicit_surface_settings computed_settings; // Settings of the current field and surface
+
+	std::atomic<bool> const* cancel = nullptr; // When set to true, the computations stop at the next stage (their result is incomplete)
+
+	struct { // Duration of the last updates (ms)
+		float field = 0.0f;
+		float gradient = 0.0f;
+		float marching_cube = 0.0f;
+	} timing;
+
 
 	// Helpers functions that should be called in the scene
 	// *************************************************** //
@@ -45,19 +78,65 @@ struct implicit_surface_structure
 	//   Recompute from scratch the field and the marching cube
 	void update_field(field_function_structure const& field_function, float isovalue);
 
+	//   Recompute the field, its gradient and the surface only around the primitives that differ from the previous function
+	//    The modified blocks of the surface are patched in place in the GPU buffers.
+	//    Call update_field when the modification is not local (noise, domain, isovalue or narrow band).
+	void update_field_local(field_function_structure const& field_function, float isovalue);
+
+	//   Local update of update_field_local. Return false (without any modification) when the modification is not local.
+	bool try_update_field_local(field_function_structure const& field_function, float isovalue);
+
 	//   Recompute only the marching cube for a different isovalue (while minimize re-allocations)
 	void update_marching_cube(float isovalue);
 
+	//   Same as update_field and update_marching_cube without any OpenGL call (can be run in another thread)
+	void compute_field(field_function_structure const& field_function, float isovalue);
+	void compute_marching_cube(float isovalue);
+
+	//   Send the whole surface and the domain box to the GPU
+	void upload_surface();
+
+	//   Exchange the computed data (domain, field, surface, settings and measures) with another structure
+	//    The GPU buffers are not exchanged: call upload_surface to display the new surface.
+	void swap_data(implicit_surface_structure& other);
+
+	//   Copy of the surface extracted from the grid
+	cgp::mesh surface_mesh() const;
+
+	//   First intersection of the ray with the surface (using the discrete field), return false if there is none
+	//    Without the grid (released when the field is stored elsewhere), the function itself is evaluated along the ray.
+	bool intersect(cgp::vec3 const& origin, cgp::vec3 const& direction, float isovalue, cgp::vec3& intersection) const;
+
 	//   Helper function to quickly set the domain (number of samples, and dimensions)
 	void set_domain(int samples, cgp::vec3 const& length);
-	
-	//   Helper function to update the gui and call the associated update functions
-	void gui_update(gui_parameters& gui, field_function_structure& field_function);
+
+private:
+	//   Send the mesh to the GPU (only the modified ranges when the buffers have not been reallocated)
+	void update_drawable();
+	//   Current value of the settings (to be compared with computed_settings)
+	implicit_surface_settings current_settings() const;
+	bool is_cancelled() const { return cancel != nullptr && cancel->load(); }
 };
 
 
 // Compute a grid filled with the value of some scalar function - the size of the grid is given by the domain
-cgp::grid_3D<float> compute_discrete_scalar_field(cgp::spatial_domain_grid_3D const& domain, field_function_structure const& func);
+//  The z-slabs of the grid are evaluated in parallel
+cgp::grid_3D<float> compute_discrete_scalar_field(cgp::spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool);
+
+// Same as compute_discrete_scalar_field, in a grid that is only reallocated when the size of the domain changes
+//  gradient (if not null, and of the same size) receives the analytic gradient of the function, computed in the same traversal.
+//  This requires func.analytic_gradient(), otherwise the gradient must be computed from the field (compute_gradient).
+//  When cancel is set to true, the remaining slabs are skipped.
+void compute_discrete_scalar_field(cgp::grid_3D<float>& field, cgp::grid_3D<cgp::vec3>* gradient, cgp::spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool, std::atomic<bool> const* cancel = nullptr);
+
+// Same as compute_discrete_scalar_field, but only the blocks of samples that may contain the isovalue are evaluated exactly
+//  The other blocks are filled with a bound of the field that is on the same side of the isovalue.
+//  The blocks are tested with a margin of 2 samples, such that the edges crossed by the surface and the finite differences
+//  used for their normals only involve exact values. The number of exact evaluations is stored in evaluated_samples (if not null).
+void compute_discrete_scalar_field_narrow_band(cgp::grid_3D<float>& field, cgp::spatial_domain_grid_3D const& domain, field_function_structure const& func, float isovalue, thread_pool_structure& thread_pool, size_t* evaluated_samples = nullptr);
 
 // Compute the gradient of the scalar field using finite differences on the voxels
-cgp::grid_3D<cgp::vec3> compute_gradient(cgp::grid_3D<float> const& field);
+cgp::grid_3D<cgp::vec3> compute_gradient(cgp::grid_3D<float> const& field, thread_pool_structure& thread_pool);
+
+// Update the gradient of the samples k_begin <= k < k_end (the finite differences use the neighboring samples of the field)
+void compute_gradient(cgp::grid_3D<cgp::vec3>& gradient, cgp::grid_3D<float> const& field, cgp::int3 const& k_begin, cgp::int3 const& k_end, thread_pool_structure& thread_pool);
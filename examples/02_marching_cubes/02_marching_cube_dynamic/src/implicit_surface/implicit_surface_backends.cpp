@@ -0,0 +1,398 @@
+#include "implicit_surface_backends.hpp"
+#include "implicit_surface_worker.hpp"
+#include "../grid_layout/grid_layout.hpp"
+
+#include <chrono>
+
+
+using namespace cgp;
+
+
+
+void implicit_surface_adaptive_structure::compute(implicit_surface_structure& surface, field_function_structure const& function, float isovalue)
+{
+	spatial_domain_grid_3D const& domain = surface.field_param.domain;
+	thread_pool_structure& thread_pool = *surface.thread_pool;
+
+	// The grid is replaced by the octree or the sparse volume (released when switching to them)
+	if (surface.field_param.field.size() > 0 || surface.field_param.gradient.size() > 0) {
+		surface.field_param.field = grid_3D<float>();
+		surface.field_param.gradient = grid_3D<vec3>();
+		surface.field_param.block_summary = field_block_summary_structure();
+	}
+	surface.field_param.function = function;
+	surface.data_param.mesh = marching_cube_block_mesh_structure();
+	surface.data_param.mesh.isovalue = isovalue;
+
+	if (use_octree) {
+		int3 const last = { domain.samples.x - 1, domain.samples.y - 1, domain.samples.z - 1 };
+		auto const time_start = std::chrono::steady_clock::now();
+		octree.build(function, domain.position({ 0, 0, 0 }), domain.position(last), isovalue, octree_parameters, thread_pool);
+		auto const time_build = std::chrono::steady_clock::now();
+		if (surface.cancel != nullptr && surface.cancel->load())
+			return;
+
+		mesh& m = octree_mesh;
+		octree.extract(m.position.data, m.normal.data, m.connectivity.data, function, isovalue, thread_pool);
+		m.color.clear();
+		m.uv.clear();
+		m.fill_empty_field();
+		auto const time_extract = std::chrono::steady_clock::now();
+
+		surface.timing.field = std::chrono::duration<float, std::milli>(time_build - time_start).count();
+		surface.timing.gradient = 0.0f;
+		surface.timing.marching_cube = std::chrono::duration<float, std::milli>(time_extract - time_build).count();
+		return;
+	}
+
+	// The leaves of the sparse volume keep their capacity from one computation to the next
+	auto const time_start = std::chrono::steady_clock::now();
+	sparse_volume_structure<vec3>* analytic_gradient = function.analytic_gradient() ? &sparse_gradient : nullptr;
+	compute_sparse_field(sparse_field, analytic_gradient, domain, function, isovalue, thread_pool);
+	surface.evaluated_samples = sparse_field.pool.size();
+	auto const time_field = std::chrono::steady_clock::now();
+	if (surface.cancel != nullptr && surface.cancel->load())
+		return;
+
+	if (analytic_gradient == nullptr)
+		compute_sparse_gradient(sparse_gradient, sparse_field, thread_pool);
+	auto const time_gradient = std::chrono::steady_clock::now();
+	if (surface.cancel != nullptr && surface.cancel->load())
+		return;
+
+	mesh& m = sparse_mesh;
+	sparse_marching_cube(m.position.data, m.normal.data, m.connectivity.data, sparse_field, sparse_gradient, domain, isovalue, thread_pool);
+	m.color.clear();
+	m.uv.clear();
+	m.fill_empty_field();
+	auto const time_marching_cube = std::chrono::steady_clock::now();
+
+	surface.timing.field = std::chrono::duration<float, std::milli>(time_field - time_start).count();
+	surface.timing.gradient = std::chrono::duration<float, std::milli>(time_gradient - time_field).count();
+	surface.timing.marching_cube = std::chrono::duration<float, std::milli>(time_marching_cube - time_gradient).count();
+}
+
+void implicit_surface_adaptive_structure::upload(implicit_surface_structure& surface) const
+{
+	surface.drawable_param.shape.clear();
+	surface.drawable_param.shape.initialize_data_on_gpu(surface_mesh());
+}
+
+void implicit_surface_adaptive_structure::release()
+{
+	// Only released when switching from them
+	if (!octree.leaves.empty())
+		octree = octree_surface_structure();
+	if (!sparse_field.slots.empty()) {
+		sparse_field = sparse_volume_structure<float>();
+		sparse_gradient = sparse_volume_structure<vec3>();
+	}
+	octree_mesh = mesh();
+	sparse_mesh = mesh();
+}
+
+void implicit_surface_adaptive_structure::swap_data(implicit_surface_adaptive_structure& other)
+{
+	std::swap(use_octree, other.use_octree);
+	std::swap(octree_parameters, other.octree_parameters);
+	std::swap(octree, other.octree);
+	std::swap(octree_mesh, other.octree_mesh);
+	std::swap(use_sparse, other.use_sparse);
+	std::swap(sparse_field, other.sparse_field);
+	std::swap(sparse_gradient, other.sparse_gradient);
+	std::swap(sparse_mesh, other.sparse_mesh);
+}
+
+
+
+// Defined here where the worker is a complete type. The OpenGL data is not released here as the context of the scene
+//  is destroyed before it: see clear().
+implicit_surface_backends_structure::~implicit_surface_backends_structure()
+{
+}
+
+void implicit_surface_backends_structure::clear()
+{
+	gpu_surface.clear();
+}
+
+void implicit_surface_backends_structure::update_gpu_surface_state(implicit_surface_structure const& surface)
+{
+	if (gpu_active(surface) && !gpu_surface.is_initialized() && !gpu_surface.shader_directory.empty())
+		gpu_surface.initialize(gpu_surface.shader_directory);
+	else if (!gpu_active(surface) && gpu_surface.is_initialized())
+		gpu_surface.clear();
+}
+
+void implicit_surface_backends_structure::extract_gpu_surface(implicit_surface_structure& surface)
+{
+	gpu_surface.extract(surface.field_param.domain, surface.data_param.mesh.isovalue);
+	surface.timing.marching_cube = gpu_surface.timing.total;
+}
+
+void implicit_surface_backends_structure::upload_surface(implicit_surface_structure& surface)
+{
+	update_gpu_surface_state(surface);
+
+	// Domain box (and surface of the grid when it is extracted on the CPU)
+	surface.upload_surface();
+	if (adaptive.active())
+		adaptive.upload(surface);
+	else if (gpu_active(surface)) {
+		gpu_surface.upload_field(surface.field_param.field);
+		extract_gpu_surface(surface);
+	}
+}
+
+// Two domains are the same if they have the same samples at the same positions
+static bool same_domain(spatial_domain_grid_3D const& a, spatial_domain_grid_3D const& b)
+{
+	int3 const last = { a.samples.x - 1, a.samples.y - 1, a.samples.z - 1 };
+	return a.samples.x == b.samples.x && a.samples.y == b.samples.y && a.samples.z == b.samples.z
+		&& norm(a.position({ 0,0,0 }) - b.position({ 0,0,0 })) == 0 && norm(a.position(last) - b.position(last)) == 0;
+}
+
+void implicit_surface_backends_structure::request_update(implicit_surface_structure& surface, field_function_structure const& field_function, gui_parameters const& gui, bool is_update_field)
+{
+	octree_surface_parameters octree_parameters_gui = adaptive.octree_parameters;
+	octree_parameters_gui.max_depth = gui.octree.max_depth;
+	octree_parameters_gui.surface_depth = std::min(gui.octree.surface_depth, gui.octree.max_depth);
+	octree_parameters_gui.flatness = gui.octree.flatness;
+	// The narrow band and the leaves of the sparse volume depend on the isovalue: a new isovalue requires to evaluate the field again
+	is_update_field = is_update_field || gui.narrow_band || (gui.sparse_volume && !gui.octree.active);
+	// The grid only extracts the surface when it is not extracted on the GPU or from an adaptive storage
+	bool const extract_surface = !gui.gpu_extraction && !gui.octree.active && !gui.sparse_volume;
+
+	// Updates of the GPU surface after a local update or a new isovalue (the other ones upload the whole field)
+	auto const update_gpu = [&](bool local_update) {
+		if (!gpu_active(surface))
+			return;
+		update_gpu_surface_state(surface);
+		int3 const& k_begin = surface.modified_begin;
+		int3 const& k_end = surface.modified_end;
+		if (local_update && k_begin.x < k_end.x && k_begin.y < k_end.y && k_begin.z < k_end.z)
+			gpu_surface.upload_field(surface.field_param.field, k_begin, k_end);
+		extract_gpu_surface(surface);
+	};
+
+	if (!gui.background) {
+		adaptive.use_octree = gui.octree.active;
+		adaptive.use_sparse = gui.sparse_volume;
+		adaptive.octree_parameters = octree_parameters_gui;
+		surface.narrow_band = gui.narrow_band;
+		surface.extract_surface = extract_surface;
+
+		spatial_domain_grid_3D const domain_previous = surface.field_param.domain;
+		if (is_update_field)
+			surface.set_domain(gui.domain.samples, gui.domain.length);
+
+		if (adaptive.active()) {
+			field_function_structure const function = is_update_field ? field_function : surface.field_param.function;
+			adaptive.compute(surface, function, gui.isovalue);
+			upload_surface(surface);
+		}
+		else if (!is_update_field) {
+			surface.update_marching_cube(gui.isovalue);
+			update_gpu(false);
+		}
+		else if (gui.local_update && same_domain(domain_previous, surface.field_param.domain) && surface.try_update_field_local(field_function, gui.isovalue))
+			update_gpu(true);
+		else {
+			adaptive.release();
+			surface.compute_field(field_function, gui.isovalue);
+			upload_surface(surface);
+		}
+		return;
+	}
+
+	// Cheap updates of the current grid are done immediately, unless a surface computed in the background would replace them
+	spatial_domain_grid_3D const domain = spatial_domain_grid_3D::from_center_length({ 0,0,0 }, gui.domain.length, gui.domain.samples * int3{ 1,1,1 });
+	bool const same_settings = same_domain(surface.field_param.domain, domain) && surface.extract_surface == extract_surface && surface.narrow_band == gui.narrow_band
+		&& adaptive.use_octree == gui.octree.active && adaptive.use_sparse == gui.sparse_volume;
+	if (same_settings && !adaptive.active() && (worker == nullptr || !worker->busy())) {
+		if (!is_update_field) {
+			surface.update_marching_cube(gui.isovalue);
+			update_gpu(false);
+			return;
+		}
+		if (gui.local_update && surface.try_update_field_local(field_function, gui.isovalue)) {
+			update_gpu(true);
+			return;
+		}
+	}
+
+	// The other updates supersede the surface in progress
+	implicit_surface_request request;
+	request.function = field_function;
+	request.samples = gui.domain.samples;
+	request.length = gui.domain.length;
+	request.isovalue = gui.isovalue;
+	request.narrow_band = gui.narrow_band;
+	request.use_octree = gui.octree.active;
+	request.use_sparse = gui.sparse_volume;
+	request.use_gpu = gui.gpu_extraction;
+	request.octree_parameters = octree_parameters_gui;
+	request.preview_samples = gui.preview_samples;
+	if (worker == nullptr)
+		worker.reset(new implicit_surface_worker_structure(*surface.thread_pool));
+	worker->submit(request);
+}
+
+void implicit_surface_backends_structure::gui_update(implicit_surface_structure& surface, gui_parameters& gui, field_function_structure& field_function)
+{
+	bool is_update_marching_cube = false;
+	bool is_update_field = false;
+	bool is_save_mesh = false;
+	bool is_stream_mesh = false;
+	bool is_write_volume = false;
+	bool is_decimate = false;
+	bool is_save_lod = false;
+	bool is_benchmark_layout = false;
+
+	display_gui_implicit_surface(is_update_field, is_update_marching_cube, is_save_mesh, is_stream_mesh, is_write_volume, is_decimate, is_save_lod, is_benchmark_layout, gui, field_function);
+
+	// A surface finished in the background replaces the displayed one
+	if (worker != nullptr && worker->poll(surface, adaptive))
+		upload_surface(surface);
+
+	thread_pool_structure& thread_pool = *surface.thread_pool;
+	implicit_surface_field_structure const& field_param = surface.field_param;
+	if (adaptive.use_octree) {
+		// Memory of a uniform grid with the same resolution (field and gradient)
+		double uniform_samples = 1.0;
+		for (int k = 0; k < 3; ++k)
+			uniform_samples *= double(gui.domain.length[k] / adaptive.octree.unit + 1);
+		ImGui::Text("Octree %.1f ms, surface extraction %.1f ms", surface.timing.field, surface.timing.marching_cube);
+		ImGui::Text("Octree: %d leaves, %.1f MB (uniform grid of the same resolution: %.0f MB)", int(adaptive.octree.leaves.size()), adaptive.octree.memory() / (1024 * 1024.0f), uniform_samples * (sizeof(float) + sizeof(vec3)) / (1024 * 1024.0));
+		ImGui::Text("Mesh: %d vertices, %d triangles", int(adaptive.octree_mesh.position.size()), int(adaptive.octree_mesh.connectivity.size()));
+	}
+	else if (adaptive.use_sparse) {
+		sparse_volume_structure<float> const& sparse = adaptive.sparse_field;
+		size_t const grid_samples = size_t(field_param.domain.samples.x) * field_param.domain.samples.y * field_param.domain.samples.z;
+		ImGui::Text("Field %.1f ms, gradient %.1f ms, marching cube %.1f ms", surface.timing.field, surface.timing.gradient, surface.timing.marching_cube);
+		ImGui::Text("Sparse volume: %d leaves of 8^3 samples (%.1f%% of the slots)", int(sparse.number_of_leaves()), 100.0f * sparse.number_of_leaves() / std::max(size_t(1), sparse.slots.size()));
+		ImGui::Text("Memory: %.1f MB (uniform grid: %.1f MB)", (sparse.memory() + adaptive.sparse_gradient.memory()) / (1024 * 1024.0f), grid_samples * (sizeof(float) + sizeof(vec3)) / (1024 * 1024.0f));
+		ImGui::Text("Mesh: %d vertices, %d triangles", int(adaptive.sparse_mesh.position.size()), int(adaptive.sparse_mesh.connectivity.size()));
+	}
+	else if (gpu_active(surface)) {
+		ImGui::Text("Field %.1f ms, gradient %.1f ms, GPU marching cube %.1f ms (%.1f ms with the synchronization)", surface.timing.field, surface.timing.gradient, gpu_surface.timing.gpu, gpu_surface.timing.total);
+		ImGui::Text("Mesh: %d vertices (not shared), %d triangles", int(gpu_surface.number_of_vertices), int(gpu_surface.number_of_triangles()));
+		if (ImGui::Button("Compare with the CPU marching cube"))
+			gpu_marching_cube_compare(gpu_surface, field_param.field, field_param.domain, field_param.block_summary, surface.data_param.mesh.isovalue, thread_pool);
+	}
+	else {
+		ImGui::Text("Field %.1f ms, gradient %.1f ms, marching cube %.1f ms", surface.timing.field, surface.timing.gradient, surface.timing.marching_cube);
+		ImGui::Text("Exact field evaluations: %.1f%%", 100.0f * surface.evaluated_samples / std::max(size_t(1), field_param.field.size()));
+		ImGui::Text("Marching cube blocks skipped: %.1f%%", 100.0f * (1.0f - surface.visited_blocks / float(std::max(size_t(1), field_param.block_summary.size()))));
+		ImGui::Text("Mesh: %d vertices, %d triangles", int(surface.data_param.mesh.number_of_vertices()), int(surface.data_param.mesh.number_of_triangles()));
+		if (gui.local_update)
+			ImGui::Text("Blocks of the last local update: %d", int(surface.updated_blocks));
+	}
+	if (worker != nullptr && worker->busy())
+		ImGui::Text(worker->preview_displayed() ? "Computing the surface in the background (preview displayed)" : "Computing the surface in the background");
+
+	if (is_update_field) {
+		field_function.update_noise_cache(-0.5f * gui.domain.length, 0.5f * gui.domain.length, thread_pool);
+		field_function.update_expression();
+	}
+	if (is_update_field || is_update_marching_cube)
+		request_update(surface, field_function, gui, is_update_field);
+
+	// Storage of the grid by bricks or along a Morton curve, in single or half precision (times on the command line)
+	if (is_benchmark_layout)
+		grid_layout_benchmark(gui.domain.samples, thread_pool);
+
+	std::string const extension = mesh_file_extension(gui.export_format);
+	if (is_save_mesh)
+		mesh_save("mesh." + extension, surface_mesh(surface), gui.export_format, thread_pool);
+
+	// Decimated surface (displayed instead of the full resolution one), and chain of levels of detail
+	if (is_decimate) {
+		mesh const full = surface_mesh(surface);
+		mesh_decimation_parameters parameters;
+		parameters.target_triangles = size_t(gui.decimation.ratio * full.connectivity.size());
+		parameters.max_error = gui.decimation.max_error;
+		mesh const decimated_mesh = mesh_decimate(full, parameters, thread_pool, &decimation);
+		decimated.clear();
+		decimated.initialize_data_on_gpu(decimated_mesh);
+		gui.decimation.display = true;
+		std::cout << "Surface decimated from " << full.connectivity.size() << " to " << decimated_mesh.connectivity.size() << " triangles in " << decimation.time << " ms" << std::endl;
+	}
+	if (is_save_lod) {
+		std::vector<mesh> const chain = mesh_decimate_lod_chain(surface_mesh(surface), gui.decimation.lod_levels, thread_pool);
+		for (size_t level = 0; level < chain.size(); ++level)
+			mesh_save("mesh_lod" + str(level) + "." + extension, chain[level], gui.export_format, thread_pool);
+	}
+	if (decimation.time > 0)
+		ImGui::Text("Decimation: %d collapses in %.1f ms, error %.4f", int(decimation.collapses), decimation.time, decimation.error);
+
+	// Out-of-core extraction of the current function (or of the raw volume) at a resolution that doesn't need to fit in memory
+	//  It runs on the thread of the streaming job with a copy of the function: the GUI displays its progress and can cancel it.
+	spatial_domain_grid_3D const domain_streamed = spatial_domain_grid_3D::from_center_length({ 0,0,0 }, gui.domain.length, gui.streaming.samples * int3{ 1,1,1 });
+	thread_pool_structure* const pool = surface.thread_pool;
+	if ((is_write_volume || is_stream_mesh) && streaming.busy())
+		std::cout << "An out-of-core extraction is already running" << std::endl;
+	else if (is_write_volume) {
+		field_function_structure const function = field_function;
+		streaming.start(domain_streamed.samples.z, [this, pool, function, domain_streamed]() {
+			raw_volume_file_write("volume.raw", domain_streamed, function, *pool, &streaming.progress);
+		});
+	}
+	else if (is_stream_mesh) {
+		field_function_structure const function = field_function;
+		bool const raw_volume = gui.streaming.raw_volume;
+		float const isovalue = gui.isovalue;
+		streaming.start(domain_streamed.samples.z, [this, pool, function, domain_streamed, raw_volume, isovalue]() {
+			if (raw_volume) {
+				raw_volume_file_structure volume;
+				if (volume.open("volume.raw", domain_streamed.samples))
+					slab_mesher_run("mesh_streamed.ply", domain_streamed, slab_mesher_source_raw(volume), isovalue, *pool, &streaming.statistics, &streaming.progress);
+				else
+					std::cout << "Cannot read volume.raw with " << domain_streamed.samples.x << "^3 samples" << std::endl;
+			}
+			else
+				slab_mesher_run("mesh_streamed.ply", domain_streamed, slab_mesher_source_function(function, domain_streamed, *pool), isovalue, *pool, &streaming.statistics, &streaming.progress);
+		});
+	}
+	if (streaming.busy()) {
+		ImGui::Text("Out-of-core extraction: %d/%d slices", streaming.progress.slices.load(), streaming.slices);
+		if (ImGui::Button("Cancel extraction"))
+			streaming.cancel();
+	}
+	else if (streaming.statistics.time_total > 0) {
+		slab_mesher_statistics const& statistics = streaming.statistics;
+		ImGui::Text("Streamed mesh: %d triangles in %.1f s, %.1f MB", int(statistics.triangles), statistics.time_total / 1000.0f, statistics.memory / (1024 * 1024.0f));
+	}
+}
+
+void implicit_surface_backends_structure::draw_surface(implicit_surface_structure const& surface, environment_generic_structure const& environment, gui_parameters const& gui) const
+{
+	// The decimated surface replaces the full resolution one when it is displayed
+	mesh_drawable const& shape = gui.decimation.display && decimated.vbo_position.id != 0 ? decimated : surface.drawable_param.shape;
+
+	// The surface extracted on the GPU is drawn from the buffer where it has been generated
+	bool const gpu_shape = gpu_active(surface) && &shape == &surface.drawable_param.shape;
+
+	if (gui.display.surface) {
+		if (gpu_shape)
+			draw(gpu_surface, environment);
+		else
+			draw(shape, environment);
+	}
+
+	if (gui.display.wireframe) {
+		if (gpu_shape)
+			draw_wireframe(gpu_surface, environment, { 0,0,0 });
+		else
+			draw_wireframe(shape, environment, { 0,0,0 });
+	}
+}
+
+mesh implicit_surface_backends_structure::surface_mesh(implicit_surface_structure const& surface) const
+{
+	if (adaptive.active())
+		return adaptive.surface_mesh();
+	if (gpu_active(surface))
+		return gpu_surface.read_mesh();
+	return surface.surface_mesh();
+}
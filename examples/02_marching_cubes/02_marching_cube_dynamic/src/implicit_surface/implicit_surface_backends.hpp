@@ -0,0 +1,98 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "implicit_surface.hpp"
+#include "gui_helper.hpp"
+#include "../octree_surface/octree_surface.hpp"
+#include "../sparse_volume/sparse_volume.hpp"
+#include "../gpu_marching_cube/gpu_marching_cube.hpp"
+#include "../slab_mesher/slab_mesher.hpp"
+#include "../mesh_decimation/mesh_decimation.hpp"
+#include <memory>
+
+
+// Optional computations of the implicit surface
+// ********************************************** //
+//  implicit_surface_structure samples the field on a uniform grid and extracts the surface on the CPU. The structures
+//  below replace or complete it: they use its domain, its thread pool, its measures and its drawable.
+
+// Adaptive storages of the field that replace the uniform grid (the grid of the implicit surface is then released)
+struct implicit_surface_adaptive_structure {
+
+	bool use_octree = false;              // Extract the surface from an adaptive octree instead of the uniform grid
+	octree_surface_parameters octree_parameters;
+	octree_surface_structure octree;
+	cgp::mesh octree_mesh;                // Surface extracted from the octree
+
+	bool use_sparse = false;              // Store the field in a sparse volume around the surface instead of the uniform grid (not with the octree)
+	sparse_volume_structure<float> sparse_field;         // Field and gradient in the leaves around the surface
+	sparse_volume_structure<cgp::vec3> sparse_gradient;
+	cgp::mesh sparse_mesh;                // Surface extracted from the sparse volume
+
+	bool active() const { return use_octree || use_sparse; }
+
+	//   Compute the octree or the sparse volume of the function on the domain of the surface, and its surface (without any OpenGL call)
+	//    The measures, the cancellation and the thread pool are the ones of the surface.
+	void compute(implicit_surface_structure& surface, field_function_structure const& function, float isovalue);
+
+	//   Send the surface to the shape of the implicit surface
+	void upload(implicit_surface_structure& surface) const;
+
+	//   Release the octree and the sparse volume (when the uniform grid is used)
+	void release();
+
+	//   Exchange the computed data with another structure
+	void swap_data(implicit_surface_adaptive_structure& other);
+
+	cgp::mesh const& surface_mesh() const { return use_octree ? octree_mesh : sparse_mesh; }
+};
+
+
+struct implicit_surface_worker_structure;
+
+// Extractions and processing of the surface that are not part of the basic marching cube: adaptive storages, GPU
+//  extraction, background computation, decimation and out-of-core extraction
+struct implicit_surface_backends_structure {
+
+	implicit_surface_adaptive_structure adaptive;
+
+	gpu_marching_cube_structure gpu_surface;   // Surface extracted and drawn on the GPU (the implicit surface only computes the field)
+
+	cgp::mesh_drawable decimated;              // Last decimated surface
+	mesh_decimation_statistics decimation;     // Measures of the last decimation
+
+	slab_mesher_job_structure streaming;       // Out-of-core extraction running on its own thread (with the measures of the last one)
+
+	std::unique_ptr<implicit_surface_worker_structure> worker; // Background computation of the surface (created on first use)
+
+
+	implicit_surface_backends_structure() = default;
+	~implicit_surface_backends_structure();
+
+	//   Update the surface after a modification of the function (is_update_field) or of the isovalue
+	//    The local modifications are applied immediately. With gui.background, the other ones are computed by the background
+	//    worker, and the displayed surface is replaced once they are finished (the GUI stays responsive in the meantime).
+	void request_update(implicit_surface_structure& surface, field_function_structure const& field_function, gui_parameters const& gui, bool is_update_field);
+
+	//   Helper function to update the gui and call the associated update functions
+	void gui_update(implicit_surface_structure& surface, gui_parameters& gui, field_function_structure& field_function);
+
+	//   Display the surface (the decimated one, the one of the GPU or the shape of the implicit surface) and its wireframe
+	void draw_surface(implicit_surface_structure const& surface, cgp::environment_generic_structure const& environment, gui_parameters const& gui) const;
+
+	//   Copy of the current surface (from the grid, the octree, the sparse volume or the GPU)
+	cgp::mesh surface_mesh(implicit_surface_structure const& surface) const;
+
+	//   Delete the GPU data that is not released by cgp (to be called while the OpenGL context exists)
+	void clear();
+
+private:
+	//   The surface is extracted on the GPU
+	bool gpu_active(implicit_surface_structure const& surface) const { return !surface.extract_surface && !adaptive.active(); }
+	//   Send the whole surface to the GPU (or the field for the GPU extraction)
+	void upload_surface(implicit_surface_structure& surface);
+	//   Extract the surface on the GPU from the field already uploaded
+	void extract_gpu_surface(implicit_surface_structure& surface);
+	//   Initialize the GPU extraction when it is used, and release it when the surface is extracted on the CPU
+	void update_gpu_surface_state(implicit_surface_structure const& surface);
+};
@@ -0,0 +1,129 @@
+#include "implicit_surface_worker.hpp"
+
+using namespace cgp;
+
+implicit_surface_worker_structure::implicit_surface_worker_structure(thread_pool_structure& thread_pool)
+{
+	computing.thread_pool = &thread_pool;
+}
+
+implicit_surface_worker_structure::~implicit_surface_worker_structure()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+		cancel = true;
+	}
+	condition.notify_all();
+	if (thread.joinable())
+		thread.join();
+}
+
+void implicit_surface_worker_structure::submit(implicit_surface_request const& request)
+{
+#ifdef __EMSCRIPTEN__
+	compute(request);
+#else
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.reset(new implicit_surface_request(request));
+		if (working)
+			cancel = true;
+		if (!thread.joinable())
+			thread = std::thread(&implicit_surface_worker_structure::worker_loop, this);
+	}
+	condition.notify_all();
+#endif
+}
+
+bool implicit_surface_worker_structure::busy()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return working || pending != nullptr;
+}
+
+bool implicit_surface_worker_structure::poll(implicit_surface_structure& target, implicit_surface_adaptive_structure& target_adaptive)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!has_finished)
+		return false;
+	finished.swap_data(target);
+	finished_adaptive.swap_data(target_adaptive);
+	preview_polled = finished_preview;
+	has_finished = false;
+
+	// The previous surface is no longer needed
+	finished.field_param = implicit_surface_field_structure();
+	finished.data_param = implicit_surface_data();
+	finished_adaptive.release();
+	return true;
+}
+
+void implicit_surface_worker_structure::worker_loop()
+{
+	computing.cancel = &cancel;
+	while (true) {
+		implicit_surface_request request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return stop || pending != nullptr; });
+			if (stop)
+				return;
+			request = *pending;
+			pending.reset();
+			cancel = false;
+			working = true;
+		}
+
+		compute(request);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			working = false;
+		}
+	}
+}
+
+void implicit_surface_worker_structure::compute(implicit_surface_request const& request)
+{
+	// The preview is only useful when the full resolution is significantly more expensive
+	bool const preview = request.use_octree ?
+		request.preview_samples > 0 && request.octree_parameters.max_depth > 8 :
+		request.preview_samples > 0 && request.samples > 2 * request.preview_samples;
+	if (preview)
+		compute_surface(request, true);
+	compute_surface(request, false);
+}
+
+void implicit_surface_worker_structure::compute_surface(implicit_surface_request const& request, bool preview)
+{
+	if (cancel)
+		return;
+
+	computing.narrow_band = request.narrow_band;
+	computing.extract_surface = !request.use_gpu && !request.use_octree && !request.use_sparse;
+	computing_adaptive.use_octree = request.use_octree;
+	computing_adaptive.use_sparse = request.use_sparse;
+	computing_adaptive.octree_parameters = request.octree_parameters;
+	int samples = request.samples;
+	if (preview) {
+		samples = request.preview_samples;
+		computing_adaptive.octree_parameters.max_depth = std::max(request.octree_parameters.max_depth - 2, request.octree_parameters.surface_depth);
+	}
+	computing.set_domain(samples, request.length);
+	if (computing_adaptive.active())
+		computing_adaptive.compute(computing, request.function, request.isovalue);
+	else {
+		computing_adaptive.release();
+		computing.compute_field(request.function, request.isovalue);
+	}
+
+	// The result of a cancelled computation is incomplete
+	std::lock_guard<std::mutex> lock(mutex);
+	if (cancel)
+		return;
+	computing.swap_data(finished);
+	computing_adaptive.swap_data(finished_adaptive);
+	has_finished = true;
+	finished_preview = preview;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "implicit_surface.hpp"
+#include "implicit_surface_backends.hpp"
+
+// Computation of the implicit surface in a background thread
+// ********************************************** //
+//  The latest request supersedes the previous ones: a request that is not started yet is replaced, and the computation
+//  in progress is cancelled at its next stage (field, gradient, marching cube).
+//  A finished surface is exchanged with the displayed one in a single swap by poll(), called on the thread owning the
+//  OpenGL context. When the full resolution is expected to be slow, a preview at a reduced resolution is finished first.
+//  The worker uses the thread pool of its owner: a loop started while the other thread is running one is run sequentially.
+//  With emscripten (no threads), the requests are computed immediately.
+
+// Parameters of a surface to compute
+struct implicit_surface_request {
+	field_function_structure function;
+	int samples = 30;                 // Number of samples along each direction of the domain
+	cgp::vec3 length = { 5,3,3 };     // Dimensions of the domain
+	float isovalue = 0.5f;
+	bool narrow_band = false;
+	bool use_octree = false;
+	bool use_sparse = false;
+	bool use_gpu = false;             // Only the field is computed, the surface is extracted on the GPU once it is displayed
+	octree_surface_parameters octree_parameters;
+	int preview_samples = 0;          // Samples of the preview, computed when samples > 2 preview_samples (0: no preview)
+};
+
+struct implicit_surface_worker_structure {
+
+	// The computations use the threads of thread_pool, which must outlive the worker
+	explicit implicit_surface_worker_structure(thread_pool_structure& thread_pool);
+	~implicit_surface_worker_structure();
+	implicit_surface_worker_structure(implicit_surface_worker_structure const&) = delete;
+	implicit_surface_worker_structure& operator=(implicit_surface_worker_structure const&) = delete;
+
+	// Compute the surface of the request (the thread is started on the first call)
+	void submit(implicit_surface_request const& request);
+
+	// Exchange the last finished surface with the data of target (and of its adaptive storage)
+	//  Return false if no new surface is finished. The new surface is not sent to the GPU.
+	bool poll(implicit_surface_structure& target, implicit_surface_adaptive_structure& target_adaptive);
+
+	// A request is waiting or in progress
+	bool busy();
+	// The last surface given by poll is a preview
+	bool preview_displayed() const { return preview_polled; }
+
+private:
+	void worker_loop();
+	void compute(implicit_surface_request const& request);
+	void compute_surface(implicit_surface_request const& request, bool preview);
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::unique_ptr<implicit_surface_request> pending; // Latest request, not started yet
+	std::atomic<bool> cancel{ false };                 // Set when the request in progress is superseded
+	bool working = false;
+	bool stop = false;
+
+	implicit_surface_structure computing;  // Surface in progress (only used by the worker thread)
+	implicit_surface_adaptive_structure computing_adaptive;
+	implicit_surface_structure finished;   // Last finished surface, waiting for poll()
+	implicit_surface_adaptive_structure finished_adaptive;
+	bool has_finished = false;
+	bool finished_preview = false;
+	bool preview_polled = false;
+};
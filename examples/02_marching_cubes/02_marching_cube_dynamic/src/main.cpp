@@ -89,6 +89,7 @@ int main(int, char* argv[])
 	std::cout << "\nAnimation loop stopped" << std::endl;
 
 	// Cleanup
+	scene.clear();
 	cgp::imgui_cleanup();
 	glfwDestroyWindow(scene.window.glfw_window);
 	glfwTerminate();
@@ -0,0 +1,715 @@
+#include "marching_cube_blocks.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+
+// Generation of the table
+// ********************************************** //
+//  On each face of the cube, the crossed edges are linked by segments separating the inside corners from the outside ones.
+//  Walking around a face counterclockwise (seen from outside the cube), a segment goes from an edge where the walk enters
+//  the inside region to the next edge where it exits. On ambiguous faces (two opposite inside corners), this separates the
+//  two inside corners. The rule only depends on the face, so that two neighboring cubes always agree on their common face.
+//  Each crossed edge is entered on one face and exited on the other one: the segments form closed loops, triangulated as fans.
+//  With this orientation, the triangles face the outside region (lower values).
+
+static marching_cube_table_structure generate_marching_cube_table()
+{
+	marching_cube_table_structure table;
+
+	// Edges: 4 along each axis
+	int edge_of_corners[8][8];
+	int e = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int c = 0; c < 8; ++c) {
+			if ((c & (1 << axis)) == 0) {
+				int const c1 = c | (1 << axis);
+				table.corners[e][0] = c;
+				table.corners[e][1] = c1;
+				edge_of_corners[c][c1] = e;
+				edge_of_corners[c1][c] = e;
+				e++;
+			}
+		}
+	}
+
+	// Faces: corners ordered counterclockwise around the outward normal
+	int faces[6][4];
+	for (int axis = 0; axis < 3; ++axis) {
+		int const axis_u = (axis + 1) % 3;
+		int const axis_v = (axis + 2) % 3;
+		int const uv_positive[4][2] = { {0,0}, {1,0}, {1,1}, {0,1} }; // counterclockwise around +axis (u x v = axis)
+		for (int side = 0; side < 2; ++side) {
+			for (int k = 0; k < 4; ++k) {
+				int const kk = side == 1 ? k : (4 - k) % 4; // reversed order for the normal -axis
+				int const u = uv_positive[kk][0], v = uv_positive[kk][1];
+				faces[2 * axis + side][k] = (side << axis) | (u << axis_u) | (v << axis_v);
+			}
+		}
+	}
+
+	for (int configuration = 0; configuration < 256; ++configuration) {
+		auto inside = [configuration](int c) { return (configuration >> c) & 1; };
+
+		// Segments on the faces: next[e] is the edge following e in its loop
+		int next[12];
+		for (int k = 0; k < 12; ++k)
+			next[k] = -1;
+		for (int f = 0; f < 6; ++f) {
+			for (int k = 0; k < 4; ++k) {
+				int const a = faces[f][k], b = faces[f][(k + 1) % 4];
+				if (inside(a) || !inside(b))
+					continue; // not an entering edge
+				for (int j = 1; j < 4; ++j) {
+					int const c = faces[f][(k + j) % 4], d = faces[f][(k + j + 1) % 4];
+					if (inside(c) && !inside(d)) {
+						next[edge_of_corners[a][b]] = edge_of_corners[c][d];
+						break;
+					}
+				}
+			}
+		}
+
+		// Follow the loops and triangulate them
+		int count = 0;
+		bool visited[12] = { false };
+		for (int start = 0; start < 12; ++start) {
+			if (next[start] == -1 || visited[start])
+				continue;
+			int loop[12];
+			int loop_size = 0;
+			for (int k = start; !visited[k]; k = next[k]) {
+				visited[k] = true;
+				loop[loop_size++] = k;
+			}
+			for (int k = 1; k + 1 < loop_size; ++k) {
+				table.triangles[configuration][count++] = (signed char)loop[0];
+				table.triangles[configuration][count++] = (signed char)loop[k];
+				table.triangles[configuration][count++] = (signed char)loop[k + 1];
+			}
+		}
+		table.triangles[configuration][count] = -1;
+	}
+
+	return table;
+}
+
+marching_cube_table_structure const& marching_cube_table()
+{
+	static marching_cube_table_structure const table = generate_marching_cube_table();
+	return table;
+}
+
+
+// Block summary
+// ********************************************** //
+
+// Range of the samples of the block (bx,by,bz), including its upper boundary
+static void block_range(grid_3D<float> const& field, int block_size, int bx, int by, int bz, float& value_min, float& value_max)
+{
+	int3 const N = field.dimension;
+	int const x_end = std::min((bx + 1) * block_size, N.x - 1);
+	int const y_end = std::min((by + 1) * block_size, N.y - 1);
+	int const z_end = std::min((bz + 1) * block_size, N.z - 1);
+
+	value_min = field.at_unsafe(bx * block_size, by * block_size, bz * block_size);
+	value_max = value_min;
+	for (int z = bz * block_size; z <= z_end; ++z) {
+		for (int y = by * block_size; y <= y_end; ++y) {
+			float const* row = &field.at_unsafe(0, y, z);
+			for (int x = bx * block_size; x <= x_end; ++x) {
+				value_min = std::min(value_min, row[x]);
+				value_max = std::max(value_max, row[x]);
+			}
+		}
+	}
+}
+
+void field_block_summary_structure::build(grid_3D<float> const& field, thread_pool_structure& thread_pool)
+{
+	int3 const N = field.dimension;
+	blocks = { (N.x - 1 + block_size - 1) / block_size, (N.y - 1 + block_size - 1) / block_size, (N.z - 1 + block_size - 1) / block_size };
+	size_t const count = size_t(blocks.x) * blocks.y * blocks.z;
+	value_min.resize(count);
+	value_max.resize(count);
+
+	thread_pool.parallel_for(blocks.z, 1, [&](int bz_begin, int bz_end) {
+		for (int bz = bz_begin; bz < bz_end; ++bz)
+			for (int by = 0; by < blocks.y; ++by)
+				for (int bx = 0; bx < blocks.x; ++bx) {
+					size_t const b = bx + blocks.x * (by + size_t(blocks.y) * bz);
+					block_range(field, block_size, bx, by, bz, value_min[b], value_max[b]);
+				}
+	});
+}
+
+void field_block_summary_structure::update(grid_3D<float> const& field, int3 const& k_begin, int3 const& k_end)
+{
+	// A sample on the lower boundary of a block also belongs to the previous block
+	int3 const b_begin = { std::max(k_begin.x - 1, 0) / block_size, std::max(k_begin.y - 1, 0) / block_size, std::max(k_begin.z - 1, 0) / block_size };
+	int3 const b_end = { std::min((k_end.x - 1) / block_size + 1, blocks.x), std::min((k_end.y - 1) / block_size + 1, blocks.y), std::min((k_end.z - 1) / block_size + 1, blocks.z) };
+
+	for (int bz = b_begin.z; bz < b_end.z; ++bz)
+		for (int by = b_begin.y; by < b_end.y; ++by)
+			for (int bx = b_begin.x; bx < b_end.x; ++bx) {
+				size_t const b = bx + blocks.x * (by + size_t(blocks.y) * bz);
+				block_range(field, block_size, bx, by, bz, value_min[b], value_max[b]);
+			}
+}
+
+
+// Extraction
+// ********************************************** //
+
+namespace {
+	// Triangles generated by a group of blocks
+	struct block_output {
+		std::vector<vec3> position;
+		std::vector<marching_cube_relative_coordinates> relative;
+	};
+}
+
+// Marching cube on the cells of the block (bx,by,bz)
+static void marching_cube_block(block_output& output, grid_3D<float> const& field, vec3 const& p0, vec3 const& step, int block_size, int bx, int by, int bz, float isovalue)
+{
+	marching_cube_table_structure const& table = marching_cube_table();
+	int3 const N = field.dimension;
+	size_t const Nxy = size_t(N.x) * N.y;
+	float const* values = field.data.data.data();
+
+	size_t offset[8];
+	for (int c = 0; c < 8; ++c)
+		offset[c] = (c & 1) + N.x * ((c >> 1) & 1) + Nxy * ((c >> 2) & 1);
+
+	int const x_end = std::min((bx + 1) * block_size, N.x - 1);
+	int const y_end = std::min((by + 1) * block_size, N.y - 1);
+	int const z_end = std::min((bz + 1) * block_size, N.z - 1);
+	for (int z = bz * block_size; z < z_end; ++z) {
+		for (int y = by * block_size; y < y_end; ++y) {
+			for (int x = bx * block_size; x < x_end; ++x) {
+				size_t const k = x + N.x * y + Nxy * z;
+
+				float v[8];
+				int configuration = 0;
+				for (int c = 0; c < 8; ++c) {
+					v[c] = values[k + offset[c]];
+					configuration |= (v[c] > isovalue) << c;
+				}
+				if (configuration == 0 || configuration == 255)
+					continue;
+
+				vec3 const p_cell = p0 + step * vec3(float(x), float(y), float(z));
+				for (signed char const* e = table.triangles[configuration]; *e != -1; ++e) {
+					int const c0 = table.corners[*e][0];
+					int const c1 = table.corners[*e][1];
+					float const alpha = (isovalue - v[c0]) / (v[c1] - v[c0]);
+
+					vec3 const q0 = p_cell + step * vec3(float(c0 & 1), float((c0 >> 1) & 1), float((c0 >> 2) & 1));
+					vec3 const q1 = p_cell + step * vec3(float(c1 & 1), float((c1 >> 1) & 1), float((c1 >> 2) & 1));
+					output.position.push_back(q0 + alpha * (q1 - q0));
+					output.relative.push_back({ k + offset[c0], k + offset[c1], alpha });
+				}
+			}
+		}
+	}
+}
+
+// Blocks whose range contains the isovalue (at least one sample above, and one below or equal)
+static std::vector<int> active_blocks(field_block_summary_structure const& summary, float isovalue, size_t* visited_blocks)
+{
+	std::vector<int> active;
+	for (size_t b = 0; b < summary.size(); ++b)
+		if (summary.value_min[b] <= isovalue && summary.value_max[b] > isovalue)
+			active.push_back(int(b));
+	if (visited_blocks != nullptr)
+		*visited_blocks = active.size();
+	return active;
+}
+
+size_t marching_cube_blocks(std::vector<vec3>& position, std::vector<marching_cube_relative_coordinates>& relative,
+	grid_3D<float> const& field, spatial_domain_grid_3D const& domain, field_block_summary_structure const& summary,
+	float isovalue, thread_pool_structure& thread_pool, size_t* visited_blocks)
+{
+	std::vector<int> const active = active_blocks(summary, isovalue, visited_blocks);
+
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	// Each task handles a group of blocks in its own output
+	int const group_size = 4;
+	int const groups = int((active.size() + group_size - 1) / group_size);
+	std::vector<block_output> outputs(groups);
+	thread_pool.parallel_for(groups, 1, [&](int g_begin, int g_end) {
+		for (int g = g_begin; g < g_end; ++g) {
+			int const end = std::min(int(active.size()), (g + 1) * group_size);
+			for (int k = g * group_size; k < end; ++k) {
+				int const b = active[k];
+				int const bx = b % summary.blocks.x;
+				int const by = (b / summary.blocks.x) % summary.blocks.y;
+				int const bz = b / (summary.blocks.x * summary.blocks.y);
+				marching_cube_block(outputs[g], field, p0, step, summary.block_size, bx, by, bz, isovalue);
+			}
+		}
+	});
+
+	// Concatenate the outputs in the order of the blocks
+	size_t number_of_vertex = 0;
+	for (block_output const& output : outputs)
+		number_of_vertex += output.position.size();
+	if (position.size() < number_of_vertex)
+		position.resize(number_of_vertex);
+	if (relative.size() < number_of_vertex)
+		relative.resize(number_of_vertex);
+
+	size_t offset = 0;
+	for (block_output const& output : outputs) {
+		std::copy(output.position.begin(), output.position.end(), position.begin() + offset);
+		std::copy(output.relative.begin(), output.relative.end(), relative.begin() + offset);
+		offset += output.position.size();
+	}
+
+	return number_of_vertex;
+}
+
+
+// Coordinates of the block of index b
+static int3 block_coordinates(int3 const& blocks, int b)
+{
+	return { b % blocks.x, (b / blocks.x) % blocks.y, b / (blocks.x * blocks.y) };
+}
+
+// Index of the block owning the edges whose lower sample is s (the last block along an axis also owns the last samples)
+static int owner_block(int3 const& s, int block_size, int3 const& blocks)
+{
+	int3 const owner = { std::min(s.x / block_size, blocks.x - 1), std::min(s.y / block_size, blocks.y - 1), std::min(s.z / block_size, blocks.z - 1) };
+	return owner.x + blocks.x * (owner.y + blocks.y * owner.z);
+}
+
+// Vertices of the crossed edges owned by the block b
+//  edge_vertex[3*local+axis] receives the index in position of the vertex of the edge starting on the local sample along axis (-1 if not crossed)
+static void extract_block_vertices(std::vector<int>& edge_vertex, std::vector<vec3>& position, std::vector<marching_cube_relative_coordinates>& relative,
+	grid_3D<float> const& field, vec3 const& p0, vec3 const& step, field_block_summary_structure const& summary, int b, float isovalue)
+{
+	int3 const N = field.dimension;
+	size_t const Nxy = size_t(N.x) * N.y;
+	float const* values = field.data.data.data();
+	size_t const axis_offset[3] = { 1, size_t(N.x), Nxy };
+
+	int const B = summary.block_size;
+	int const S = B + 1;
+	int3 const blocks = summary.blocks;
+	int3 const bk = block_coordinates(blocks, b);
+	int3 const s_begin = { bk.x * B, bk.y * B, bk.z * B };
+	int3 const s_end = { bk.x == blocks.x - 1 ? N.x : s_begin.x + B, bk.y == blocks.y - 1 ? N.y : s_begin.y + B, bk.z == blocks.z - 1 ? N.z : s_begin.z + B };
+
+	position.clear();
+	relative.clear();
+	edge_vertex.assign(3 * size_t(S) * S * S, -1);
+	for (int z = s_begin.z; z < s_end.z; ++z) {
+		for (int y = s_begin.y; y < s_end.y; ++y) {
+			for (int x = s_begin.x; x < s_end.x; ++x) {
+				size_t const k0 = x + N.x * y + Nxy * z;
+				float const v0 = values[k0];
+				int const s[3] = { x, y, z };
+				for (int axis = 0; axis < 3; ++axis) {
+					if (s[axis] + 1 >= N[axis])
+						continue;
+					size_t const k1 = k0 + axis_offset[axis];
+					float const v1 = values[k1];
+					if ((v0 > isovalue) == (v1 > isovalue))
+						continue;
+
+					float const alpha = (isovalue - v0) / (v1 - v0);
+					vec3 const q0 = p0 + step * vec3(float(x), float(y), float(z));
+					vec3 q1 = q0;
+					q1[axis] += step[axis];
+
+					size_t const local = (x - s_begin.x) + S * ((y - s_begin.y) + size_t(S) * (z - s_begin.z));
+					edge_vertex[3 * local + axis] = int(position.size());
+					position.push_back(q0 + alpha * (q1 - q0));
+					relative.push_back({ k0, k1, alpha });
+				}
+			}
+		}
+	}
+}
+
+// Triangles of the cells of the block b, appended to triangles
+//  vertex_index(owner, slot) returns the index of the vertex of the edge slot (3*local+axis) owned by the block owner (-1 if unknown)
+template <typename VERTEX_INDEX>
+static void extract_block_triangles(std::vector<uint3>& triangles, grid_3D<float> const& field, field_block_summary_structure const& summary, int b, float isovalue, VERTEX_INDEX const& vertex_index)
+{
+	marching_cube_table_structure const& table = marching_cube_table();
+	int3 const N = field.dimension;
+	size_t const Nxy = size_t(N.x) * N.y;
+	float const* values = field.data.data.data();
+
+	int const B = summary.block_size;
+	int const S = B + 1;
+	int3 const blocks = summary.blocks;
+	int3 const bk = block_coordinates(blocks, b);
+	int const x_end = std::min((bk.x + 1) * B, N.x - 1);
+	int const y_end = std::min((bk.y + 1) * B, N.y - 1);
+	int const z_end = std::min((bk.z + 1) * B, N.z - 1);
+
+	for (int z = bk.z * B; z < z_end; ++z) {
+		for (int y = bk.y * B; y < y_end; ++y) {
+			for (int x = bk.x * B; x < x_end; ++x) {
+				size_t const k0 = x + N.x * y + Nxy * z;
+
+				int configuration = 0;
+				for (int c = 0; c < 8; ++c) {
+					size_t const kc = k0 + (c & 1) + N.x * ((c >> 1) & 1) + Nxy * ((c >> 2) & 1);
+					configuration |= (values[kc] > isovalue) << c;
+				}
+				if (configuration == 0 || configuration == 255)
+					continue;
+
+				int vertex[3];
+				int n = 0;
+				for (signed char const* e = table.triangles[configuration]; *e != -1; ++e) {
+					// Lower sample of the edge and the block owning it
+					int const c0 = table.corners[*e][0];
+					int3 const s = { x + (c0 & 1), y + ((c0 >> 1) & 1), z + ((c0 >> 2) & 1) };
+					int const owner = owner_block(s, B, blocks);
+					int3 const ok = block_coordinates(blocks, owner);
+					size_t const local = (s.x - ok.x * B) + S * ((s.y - ok.y * B) + size_t(S) * (s.z - ok.z * B));
+					vertex[n++] = vertex_index(owner, 3 * local + *e / 4);
+					if (n == 3) {
+						if (vertex[0] >= 0 && vertex[1] >= 0 && vertex[2] >= 0)
+							triangles.push_back({ unsigned(vertex[0]), unsigned(vertex[1]), unsigned(vertex[2]) });
+						n = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+
+namespace {
+	// Vertices and triangles generated by one block for the indexed extraction
+	struct block_indexed_output {
+		std::vector<int> edge_vertex;   // Local index of the vertex of each edge owned by the block (-1 if the edge is not crossed)
+		std::vector<vec3> position;
+		std::vector<marching_cube_relative_coordinates> relative;
+		std::vector<uint3> triangles;
+		size_t vertex_offset = 0;       // Index of the first vertex of the block in the final mesh
+	};
+}
+
+size_t marching_cube_blocks_indexed(std::vector<vec3>& position, std::vector<marching_cube_relative_coordinates>& relative, std::vector<uint3>& triangles,
+	grid_3D<float> const& field, spatial_domain_grid_3D const& domain, field_block_summary_structure const& summary,
+	float isovalue, thread_pool_structure& thread_pool, size_t* visited_blocks)
+{
+	std::vector<int> const active = active_blocks(summary, isovalue, visited_blocks);
+
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	std::vector<int> slot_of_block(summary.size(), -1);
+	for (size_t k = 0; k < active.size(); ++k)
+		slot_of_block[active[k]] = int(k);
+	std::vector<block_indexed_output> outputs(active.size());
+
+	// Pass 1: one vertex per crossed edge, created by the block owning its lower sample
+	thread_pool.parallel_for(int(active.size()), 4, [&](int k_begin, int k_end) {
+		for (int k = k_begin; k < k_end; ++k)
+			extract_block_vertices(outputs[k].edge_vertex, outputs[k].position, outputs[k].relative, field, p0, step, summary, active[k], isovalue);
+	});
+
+	size_t number_of_vertex = 0;
+	for (block_indexed_output& output : outputs) {
+		output.vertex_offset = number_of_vertex;
+		number_of_vertex += output.position.size();
+	}
+
+	// Pass 2: triangles of the cells, referring to the vertices of the edges (possibly owned by a neighboring block)
+	auto const vertex_index = [&](int owner, size_t slot) {
+		block_indexed_output const& owner_output = outputs[slot_of_block[owner]];
+		int const local = owner_output.edge_vertex[slot];
+		return local == -1 ? -1 : int(owner_output.vertex_offset) + local;
+	};
+	thread_pool.parallel_for(int(active.size()), 4, [&](int k_begin, int k_end) {
+		for (int k = k_begin; k < k_end; ++k)
+			extract_block_triangles(outputs[k].triangles, field, summary, active[k], isovalue, vertex_index);
+	});
+
+	// Concatenate the outputs in the order of the blocks
+	size_t number_of_triangles = 0;
+	for (block_indexed_output const& output : outputs)
+		number_of_triangles += output.triangles.size();
+	position.resize(number_of_vertex);
+	relative.resize(number_of_vertex);
+	triangles.resize(number_of_triangles);
+
+	size_t offset_triangle = 0;
+	for (block_indexed_output const& output : outputs) {
+		std::copy(output.position.begin(), output.position.end(), position.begin() + output.vertex_offset);
+		std::copy(output.relative.begin(), output.relative.end(), relative.begin() + output.vertex_offset);
+		std::copy(output.triangles.begin(), output.triangles.end(), triangles.begin() + offset_triangle);
+		offset_triangle += output.triangles.size();
+	}
+
+	return number_of_vertex;
+}
+
+
+// Surface stored per block
+// ********************************************** //
+
+namespace {
+	// Vertices or triangles extracted again for one block
+	struct block_extraction {
+		std::vector<int> edge_vertex;
+		std::vector<vec3> position;
+		std::vector<marching_cube_relative_coordinates> relative;
+		std::vector<uint3> triangles;
+	};
+}
+
+// Normal of the vertices in [begin, end[ from the gradients at the extremities of their edge
+static void block_mesh_normals(std::vector<vec3>& normal, std::vector<marching_cube_relative_coordinates> const& relative, grid_3D<vec3> const& gradient, size_t begin, size_t end)
+{
+	for (size_t k = begin; k < end; ++k) {
+		vec3 const& n0 = gradient.at_unsafe(relative[k].k0);
+		vec3 const& n1 = gradient.at_unsafe(relative[k].k1);
+		float const alpha = relative[k].alpha;
+		normal[k] = -normalize((1 - alpha) * n0 + alpha * n1, { 1,0,0 });
+	}
+}
+
+// Capacity of a slot for a given number of elements
+static size_t slot_capacity(size_t count)
+{
+	return count + count / 4 + 4;
+}
+
+void marching_cube_block_mesh_structure::build(grid_3D<float> const& field, grid_3D<vec3> const& gradient, spatial_domain_grid_3D const& domain,
+	field_block_summary_structure const& summary, float isovalue_arg, thread_pool_structure& thread_pool, size_t* visited_blocks)
+{
+	isovalue = isovalue_arg;
+	std::vector<int> const active = active_blocks(summary, isovalue, visited_blocks);
+
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	slots.assign(summary.size(), block_slot());
+	std::vector<block_extraction> outputs(active.size());
+	thread_pool.parallel_for(int(active.size()), 4, [&](int k_begin, int k_end) {
+		for (int k = k_begin; k < k_end; ++k)
+			extract_block_vertices(outputs[k].edge_vertex, outputs[k].position, outputs[k].relative, field, p0, step, summary, active[k], isovalue);
+	});
+
+	// Slots of vertices, and buffers with some free space for the blocks that will grow
+	vertex_end = 0;
+	for (size_t k = 0; k < active.size(); ++k) {
+		block_slot& slot = slots[active[k]];
+		slot.vertex_count = outputs[k].position.size();
+		if (slot.vertex_count == 0)
+			continue;
+		slot.edge_vertex = std::move(outputs[k].edge_vertex);
+		slot.vertex_capacity = slot_capacity(slot.vertex_count);
+		slot.vertex_offset = vertex_end;
+		vertex_end += slot.vertex_capacity;
+	}
+	size_t const vertex_buffer = vertex_end + vertex_end / 4 + 1024;
+	position.assign(vertex_buffer, vec3{ 0,0,0 });
+	normal.assign(vertex_buffer, vec3{ 0,0,1 });
+	relative.assign(vertex_buffer, marching_cube_relative_coordinates{ 0, 0, 0.0f });
+	for (size_t k = 0; k < active.size(); ++k) {
+		block_slot const& slot = slots[active[k]];
+		std::copy(outputs[k].position.begin(), outputs[k].position.end(), position.begin() + slot.vertex_offset);
+		std::copy(outputs[k].relative.begin(), outputs[k].relative.end(), relative.begin() + slot.vertex_offset);
+	}
+
+	// Triangles
+	auto const vertex_index = [this](int owner, size_t slot) {
+		block_slot const& owner_slot = slots[owner];
+		int const local = owner_slot.edge_vertex.empty() ? -1 : owner_slot.edge_vertex[slot];
+		return local == -1 ? -1 : int(owner_slot.vertex_offset) + local;
+	};
+	thread_pool.parallel_for(int(active.size()), 4, [&](int k_begin, int k_end) {
+		for (int k = k_begin; k < k_end; ++k) {
+			block_slot const& slot = slots[active[k]];
+			block_mesh_normals(normal, relative, gradient, slot.vertex_offset, slot.vertex_offset + slot.vertex_count);
+			extract_block_triangles(outputs[k].triangles, field, summary, active[k], isovalue, vertex_index);
+		}
+	});
+
+	triangle_end = 0;
+	for (size_t k = 0; k < active.size(); ++k) {
+		block_slot& slot = slots[active[k]];
+		slot.triangle_count = outputs[k].triangles.size();
+		if (slot.triangle_count == 0)
+			continue;
+		slot.triangle_capacity = slot_capacity(slot.triangle_count);
+		slot.triangle_offset = triangle_end;
+		triangle_end += slot.triangle_capacity;
+	}
+	triangles.assign(triangle_end + triangle_end / 4 + 1024, uint3{ 0,0,0 });
+	for (size_t k = 0; k < active.size(); ++k)
+		std::copy(outputs[k].triangles.begin(), outputs[k].triangles.end(), triangles.begin() + slots[active[k]].triangle_offset);
+
+	modified_vertices.clear();
+	modified_triangles.clear();
+	reallocated = true;
+}
+
+size_t marching_cube_block_mesh_structure::update(grid_3D<float> const& field, grid_3D<vec3> const& gradient, spatial_domain_grid_3D const& domain,
+	field_block_summary_structure const& summary, int3 const& k_begin, int3 const& k_end, thread_pool_structure& thread_pool)
+{
+	modified_vertices.clear();
+	modified_triangles.clear();
+	reallocated = false;
+	if (k_begin.x >= k_end.x || k_begin.y >= k_end.y || k_begin.z >= k_end.z)
+		return 0;
+
+	int3 const N = field.dimension;
+	int const B = summary.block_size;
+	int3 const blocks = summary.blocks;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	// The gradients are modified up to one sample around the field, and a vertex depends on the two samples of its edge:
+	//  the vertices are extracted again for the blocks owning the samples in [k_begin-2, k_end+1[.
+	//  The triangles are extracted again for these blocks and their lower neighbors (which refer to their vertices).
+	int3 const s_begin = { std::max(k_begin.x - 2, 0), std::max(k_begin.y - 2, 0), std::max(k_begin.z - 2, 0) };
+	int3 const s_end = { std::min(k_end.x + 1, N.x), std::min(k_end.y + 1, N.y), std::min(k_end.z + 1, N.z) };
+	int3 const v_begin = block_coordinates(blocks, owner_block(s_begin, B, blocks));
+	int3 const v_last = block_coordinates(blocks, owner_block({ s_end.x - 1, s_end.y - 1, s_end.z - 1 }, B, blocks));
+
+	std::vector<int> vertex_blocks, triangle_blocks;
+	for (int bz = std::max(v_begin.z - 1, 0); bz <= v_last.z; ++bz) {
+		for (int by = std::max(v_begin.y - 1, 0); by <= v_last.y; ++by) {
+			for (int bx = std::max(v_begin.x - 1, 0); bx <= v_last.x; ++bx) {
+				int const b = bx + blocks.x * (by + blocks.y * bz);
+				triangle_blocks.push_back(b);
+				if (bx >= v_begin.x && by >= v_begin.y && bz >= v_begin.z)
+					vertex_blocks.push_back(b);
+			}
+		}
+	}
+	auto const is_active = [&](int b) { return summary.value_min[b] <= isovalue && summary.value_max[b] > isovalue; };
+
+	// Vertices
+	std::vector<block_extraction> outputs(vertex_blocks.size());
+	thread_pool.parallel_for(int(vertex_blocks.size()), 4, [&](int k0, int k1) {
+		for (int k = k0; k < k1; ++k)
+			if (is_active(vertex_blocks[k]))
+				extract_block_vertices(outputs[k].edge_vertex, outputs[k].position, outputs[k].relative, field, p0, step, summary, vertex_blocks[k], isovalue);
+	});
+
+	for (size_t k = 0; k < vertex_blocks.size(); ++k) {
+		block_slot& slot = slots[vertex_blocks[k]];
+		size_t const count = outputs[k].position.size();
+		slot.vertex_count = count;
+		slot.edge_vertex.clear();
+		if (count == 0)
+			continue;
+
+		// Move the block to the end of the buffers if it doesn't fit in its slot
+		if (count > slot.vertex_capacity) {
+			slot.vertex_capacity = slot_capacity(count + count / 4);
+			slot.vertex_offset = vertex_end;
+			vertex_end += slot.vertex_capacity;
+			if (vertex_end > position.size()) {
+				size_t const vertex_buffer = vertex_end + vertex_end / 2 + 1024;
+				position.resize(vertex_buffer, vec3{ 0,0,0 });
+				normal.resize(vertex_buffer, vec3{ 0,0,1 });
+				relative.resize(vertex_buffer, marching_cube_relative_coordinates{ 0, 0, 0.0f });
+				reallocated = true;
+			}
+		}
+
+		slot.edge_vertex = std::move(outputs[k].edge_vertex);
+		std::copy(outputs[k].position.begin(), outputs[k].position.end(), position.begin() + slot.vertex_offset);
+		std::copy(outputs[k].relative.begin(), outputs[k].relative.end(), relative.begin() + slot.vertex_offset);
+		block_mesh_normals(normal, relative, gradient, slot.vertex_offset, slot.vertex_offset + count);
+		modified_vertices.push_back({ slot.vertex_offset, slot.vertex_offset + count });
+	}
+
+	// Triangles
+	auto const vertex_index = [this](int owner, size_t slot) {
+		block_slot const& owner_slot = slots[owner];
+		int const local = owner_slot.edge_vertex.empty() ? -1 : owner_slot.edge_vertex[slot];
+		return local == -1 ? -1 : int(owner_slot.vertex_offset) + local;
+	};
+	std::vector<std::vector<uint3>> triangle_outputs(triangle_blocks.size());
+	thread_pool.parallel_for(int(triangle_blocks.size()), 4, [&](int k0, int k1) {
+		for (int k = k0; k < k1; ++k)
+			if (is_active(triangle_blocks[k]))
+				extract_block_triangles(triangle_outputs[k], field, summary, triangle_blocks[k], isovalue, vertex_index);
+	});
+
+	for (size_t k = 0; k < triangle_blocks.size(); ++k) {
+		block_slot& slot = slots[triangle_blocks[k]];
+		std::vector<uint3> const& block_triangles = triangle_outputs[k];
+		size_t const count = block_triangles.size();
+		size_t const previous_count = slot.triangle_count;
+		if (count == 0 && previous_count == 0)
+			continue;
+
+		// Move the block to the end of the buffers if it doesn't fit in its slot (its previous triangles become degenerate)
+		size_t clear_end = previous_count;
+		if (count > slot.triangle_capacity) {
+			std::fill(triangles.begin() + slot.triangle_offset, triangles.begin() + slot.triangle_offset + previous_count, uint3{ 0,0,0 });
+			if (previous_count > 0)
+				modified_triangles.push_back({ slot.triangle_offset, slot.triangle_offset + previous_count });
+			clear_end = 0;
+
+			slot.triangle_capacity = slot_capacity(count + count / 4);
+			slot.triangle_offset = triangle_end;
+			triangle_end += slot.triangle_capacity;
+			if (triangle_end > triangles.size()) {
+				triangles.resize(triangle_end + triangle_end / 2 + 1024, uint3{ 0,0,0 });
+				reallocated = true;
+			}
+		}
+
+		std::copy(block_triangles.begin(), block_triangles.end(), triangles.begin() + slot.triangle_offset);
+		if (clear_end > count)
+			std::fill(triangles.begin() + slot.triangle_offset + count, triangles.begin() + slot.triangle_offset + clear_end, uint3{ 0,0,0 });
+		slot.triangle_count = count;
+		modified_triangles.push_back({ slot.triangle_offset, slot.triangle_offset + std::max(count, clear_end) });
+	}
+
+	return triangle_blocks.size();
+}
+
+size_t marching_cube_block_mesh_structure::number_of_vertices() const
+{
+	size_t count = 0;
+	for (block_slot const& slot : slots)
+		count += slot.vertex_count;
+	return count;
+}
+
+size_t marching_cube_block_mesh_structure::number_of_triangles() const
+{
+	size_t count = 0;
+	for (block_slot const& slot : slots)
+		count += slot.triangle_count;
+	return count;
+}
+
+void marching_cube_block_mesh_structure::export_compact(std::vector<vec3>& position_out, std::vector<vec3>& normal_out, std::vector<uint3>& triangles_out) const
+{
+	// New index of the vertices in use
+	std::vector<unsigned int> index(vertex_end, 0);
+	position_out.clear();
+	normal_out.clear();
+	for (block_slot const& slot : slots) {
+		for (size_t k = slot.vertex_offset; k < slot.vertex_offset + slot.vertex_count; ++k) {
+			index[k] = unsigned(position_out.size());
+			position_out.push_back(position[k]);
+			normal_out.push_back(normal[k]);
+		}
+	}
+
+	triangles_out.clear();
+	for (block_slot const& slot : slots)
+		for (size_t k = slot.triangle_offset; k < slot.triangle_offset + slot.triangle_count; ++k)
+			triangles_out.push_back({ index[triangles[k].x], index[triangles[k].y], index[triangles[k].z] });
+}
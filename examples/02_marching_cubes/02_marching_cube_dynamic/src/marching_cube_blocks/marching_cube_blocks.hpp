@@ -0,0 +1,102 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+
+// Marching cube restricted to the parts of the grid that can contain the isovalue
+// ********************************************** //
+//  The grid of cells is split in blocks of block_size^3 cells, and the range [min,max] of the field is stored for each block.
+//  For a given isovalue, only the blocks whose range contains the isovalue are visited: scrubbing the isovalue costs
+//  a pass over the block summary plus a time proportional to the size of the surface.
+
+// Range of the field values over each block of cells
+struct field_block_summary_structure {
+	int block_size = 8;                // Number of cells along each direction of a block
+	cgp::int3 blocks;                  // Number of blocks along each direction
+	std::vector<float> value_min;      // Minimal value of the samples of the block (including the samples shared with the next blocks)
+	std::vector<float> value_max;      // Maximal value of the samples of the block
+
+	// Compute the ranges of all the blocks of the field
+	void build(cgp::grid_3D<float> const& field, thread_pool_structure& thread_pool);
+	// Update the ranges of the blocks containing the samples k_begin <= k < k_end (after a local modification of the field)
+	void update(cgp::grid_3D<float> const& field, cgp::int3 const& k_begin, cgp::int3 const& k_end);
+
+	size_t size() const { return value_min.size(); }
+};
+
+// Extract the triangles of the isosurface of the field, only in the blocks whose range contains the isovalue
+//  The output follows the same convention as cgp::marching_cube: a triangle soup where each vertex is stored with its
+//  relative coordinates on the grid edge it comes from. The vectors are only grown, and the number of valid vertices is returned.
+//  The triangles are oriented such that their normal points toward the lower values of the field.
+//  visited_blocks (if not null) receives the number of blocks that have been visited.
+size_t marching_cube_blocks(std::vector<cgp::vec3>& position, std::vector<cgp::marching_cube_relative_coordinates>& relative,
+	cgp::grid_3D<float> const& field, cgp::spatial_domain_grid_3D const& domain, field_block_summary_structure const& summary,
+	float isovalue, thread_pool_structure& thread_pool, size_t* visited_blocks = nullptr);
+
+// Same extraction, but each crossed edge of the grid generates a single vertex shared by all its triangles (indexed mesh)
+//  The vertices of an edge are created by the block containing the lower sample of the edge, and the triangles refer to them
+//  through a per-block table of edges. The vectors are resized to the exact number of vertices and triangles.
+//  Return the number of vertices.
+size_t marching_cube_blocks_indexed(std::vector<cgp::vec3>& position, std::vector<cgp::marching_cube_relative_coordinates>& relative, std::vector<cgp::uint3>& triangles,
+	cgp::grid_3D<float> const& field, cgp::spatial_domain_grid_3D const& domain, field_block_summary_structure const& summary,
+	float isovalue, thread_pool_structure& thread_pool, size_t* visited_blocks = nullptr);
+
+
+// Indexed surface stored per block in slots of the vertex and triangle buffers
+// ********************************************** //
+//  Each block owns a slot of vertices (the vertices of its edges) and a slot of triangles (the triangles of its cells).
+//  After a local modification of the field, update() extracts again only the blocks around the modified samples and rewrites
+//  their slots: the modified ranges of the buffers are listed such that the GPU buffers can be patched in place.
+//  The slots keep some free space. A block that outgrows its slot moves to the end of the buffers, and the triangles of its
+//  previous slot become degenerate. When the buffers are full, they are reallocated and must be uploaded entirely.
+struct marching_cube_block_mesh_structure {
+
+	std::vector<cgp::vec3> position;      // Vertex buffer (including the free space of the slots)
+	std::vector<cgp::vec3> normal;        // Normals of the vertices (interpolated opposite gradient of the field)
+	std::vector<cgp::marching_cube_relative_coordinates> relative; // Relative coordinates of the vertices on the grid
+	std::vector<cgp::uint3> triangles;    // Triangle buffer (the unused triangles are degenerate)
+
+	// Ranges [first, second[ of the buffers modified by the last call to update()
+	std::vector<std::pair<size_t, size_t>> modified_vertices;
+	std::vector<std::pair<size_t, size_t>> modified_triangles;
+	bool reallocated = false;             // The buffers have been reallocated by the last call to build() or update()
+	float isovalue = 0.0f;                // Isovalue of the surface (set by build)
+
+	// Extract all the blocks whose range contains the isovalue
+	void build(cgp::grid_3D<float> const& field, cgp::grid_3D<cgp::vec3> const& gradient, cgp::spatial_domain_grid_3D const& domain,
+		field_block_summary_structure const& summary, float isovalue, thread_pool_structure& thread_pool, size_t* visited_blocks = nullptr);
+
+	// Extract again the blocks affected by a modification of the samples k_begin <= k < k_end (same isovalue as build)
+	//  The field, its gradient and the summary must already be updated. Return the number of blocks extracted again.
+	size_t update(cgp::grid_3D<float> const& field, cgp::grid_3D<cgp::vec3> const& gradient, cgp::spatial_domain_grid_3D const& domain,
+		field_block_summary_structure const& summary, cgp::int3 const& k_begin, cgp::int3 const& k_end, thread_pool_structure& thread_pool);
+
+	size_t number_of_vertices() const;    // Vertices in use (without the free space)
+	size_t number_of_triangles() const;   // Triangles in use (without the degenerate ones)
+
+	// Copy of the mesh without the free space and the degenerate triangles
+	void export_compact(std::vector<cgp::vec3>& position_out, std::vector<cgp::vec3>& normal_out, std::vector<cgp::uint3>& triangles_out) const;
+
+private:
+	struct block_slot {
+		std::vector<int> edge_vertex;     // Local index of the vertex of each edge owned by the block (empty if the block has no vertex)
+		size_t vertex_offset = 0, vertex_count = 0, vertex_capacity = 0;
+		size_t triangle_offset = 0, triangle_count = 0, triangle_capacity = 0;
+	};
+	std::vector<block_slot> slots;
+	size_t vertex_end = 0;                // Size of the allocated part of the buffers
+	size_t triangle_end = 0;
+};
+
+
+// Table of the triangles for each of the 256 configurations of a cube
+//  Corner c of a cube is at (c&1, (c>>1)&1, (c>>2)&1). A corner is inside when its value is above the isovalue.
+//  The edges 4*a to 4*a+3 are along the axis a, and corners[e][0] is the lower corner of the edge e.
+//  triangles[configuration] lists the edges of the vertices of each triangle, ended by -1.
+struct marching_cube_table_structure {
+	int corners[12][2];                // The two corners of each edge
+	signed char triangles[256][31];
+};
+
+// The table is generated once (on first use) from the configurations of the faces of the cube.
+marching_cube_table_structure const& marching_cube_table();
@@ -0,0 +1,245 @@
+#include "mesh_export.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace cgp;
+
+static uint32_t const mesh_raw_version = 1;
+
+std::string mesh_file_extension(mesh_file_format format)
+{
+	switch (format) {
+	case mesh_file_format::obj: return "obj";
+	case mesh_file_format::ply: return "ply";
+	default: return "raw";
+	}
+}
+
+std::string mesh_ply_header(size_t vertices, size_t triangles, bool has_normal, int count_width)
+{
+	std::ostringstream header;
+	header << "ply\n";
+	header << "format binary_little_endian 1.0\n";
+	header << "element vertex " << std::setw(count_width) << std::setfill('0') << vertices << "\n";
+	header << "property float x\n";
+	header << "property float y\n";
+	header << "property float z\n";
+	if (has_normal) {
+		header << "property float nx\n";
+		header << "property float ny\n";
+		header << "property float nz\n";
+	}
+	header << "element face " << std::setw(count_width) << std::setfill('0') << triangles << "\n";
+	header << "property list uchar uint vertex_indices\n";
+	header << "end_header\n";
+	return header.str();
+}
+
+
+// Formatting
+// ********************************************** //
+
+// Call format(begin, end, out) on the elements [0, count[ and write the outputs in order in the stream
+//  The grains of elements of a block are formatted in parallel, and the block is written by a separate thread while the
+//  next block is formatted (two blocks are in memory at a time).
+static void write_parallel(std::ofstream& stream, size_t count, thread_pool_structure& thread_pool, std::function<void(size_t, size_t, std::string&)> const& format)
+{
+	size_t const grain = 1 << 15;
+	int const grains_per_block = 4 * thread_pool.size();
+	size_t const block_size = grain * grains_per_block;
+
+	std::vector<std::string> blocks[2] = { std::vector<std::string>(grains_per_block), std::vector<std::string>(grains_per_block) };
+	std::thread writer;
+	int current = 0;
+	for (size_t begin = 0; begin < count; begin += block_size) {
+		size_t const end = std::min(count, begin + block_size);
+		int const grains = int((end - begin + grain - 1) / grain);
+		std::vector<std::string>& block = blocks[current];
+
+		thread_pool.parallel_for(grains, 1, [&](int g_begin, int g_end) {
+			for (int g = g_begin; g < g_end; ++g) {
+				block[g].clear();
+				format(begin + g * grain, std::min(end, begin + (g + 1) * grain), block[g]);
+			}
+		});
+
+		// The previous block must be written before this one (and before its buffers are formatted again)
+		if (writer.joinable())
+			writer.join();
+		writer = std::thread([&stream, &block, grains]() {
+			for (int g = 0; g < grains; ++g)
+				stream.write(block[g].data(), block[g].size());
+		});
+		current = 1 - current;
+	}
+	if (writer.joinable())
+		writer.join();
+}
+
+// Append the bytes of value to out
+template <typename T>
+static void append_bytes(std::string& out, T const& value)
+{
+	out.append(reinterpret_cast<char const*>(&value), sizeof(T));
+}
+
+static void save_obj(std::ofstream& stream, std::vector<vec3> const& position, std::vector<vec3> const& normal, std::vector<uint3> const& triangles, thread_pool_structure& thread_pool)
+{
+	bool const has_normal = !normal.empty();
+	write_parallel(stream, position.size(), thread_pool, [&](size_t begin, size_t end, std::string& out) {
+		char line[64];
+		for (size_t k = begin; k < end; ++k)
+			out.append(line, std::snprintf(line, sizeof(line), "v %g %g %g\n", position[k].x, position[k].y, position[k].z));
+	});
+	if (has_normal) {
+		write_parallel(stream, normal.size(), thread_pool, [&](size_t begin, size_t end, std::string& out) {
+			char line[64];
+			for (size_t k = begin; k < end; ++k)
+				out.append(line, std::snprintf(line, sizeof(line), "vn %g %g %g\n", normal[k].x, normal[k].y, normal[k].z));
+		});
+	}
+	write_parallel(stream, triangles.size(), thread_pool, [&](size_t begin, size_t end, std::string& out) {
+		char line[96];
+		for (size_t k = begin; k < end; ++k) {
+			unsigned long const a = triangles[k].x + 1ul, b = triangles[k].y + 1ul, c = triangles[k].z + 1ul;
+			if (has_normal)
+				out.append(line, std::snprintf(line, sizeof(line), "f %lu//%lu %lu//%lu %lu//%lu\n", a, a, b, b, c, c));
+			else
+				out.append(line, std::snprintf(line, sizeof(line), "f %lu %lu %lu\n", a, b, c));
+		}
+	});
+}
+
+static void save_ply(std::ofstream& stream, std::vector<vec3> const& position, std::vector<vec3> const& normal, std::vector<uint3> const& triangles, thread_pool_structure& thread_pool)
+{
+	static_assert(sizeof(vec3) == 3 * sizeof(float) && sizeof(uint3) == 3 * sizeof(uint32_t), "The vectors are written as packed values");
+	bool const has_normal = !normal.empty();
+
+	std::string const header = mesh_ply_header(position.size(), triangles.size(), has_normal);
+	stream.write(header.data(), header.size());
+
+	// The positions are interleaved with the normals
+	if (has_normal) {
+		write_parallel(stream, position.size(), thread_pool, [&](size_t begin, size_t end, std::string& out) {
+			out.reserve((end - begin) * 2 * sizeof(vec3));
+			for (size_t k = begin; k < end; ++k) {
+				append_bytes(out, position[k]);
+				append_bytes(out, normal[k]);
+			}
+		});
+	}
+	else
+		stream.write(reinterpret_cast<char const*>(position.data()), position.size() * sizeof(vec3));
+
+	// Each face is stored as its number of vertices (uchar) followed by the indices
+	write_parallel(stream, triangles.size(), thread_pool, [&](size_t begin, size_t end, std::string& out) {
+		out.reserve((end - begin) * (1 + sizeof(uint3)));
+		for (size_t k = begin; k < end; ++k) {
+			out.push_back(char(3));
+			append_bytes(out, triangles[k]);
+		}
+	});
+}
+
+static void save_raw(std::ofstream& stream, std::vector<vec3> const& position, std::vector<vec3> const& normal, std::vector<uint3> const& triangles)
+{
+	mesh_raw_header header;
+	std::memcpy(header.magic, "MRAW", 4);
+	header.version = mesh_raw_version;
+	header.vertices = position.size();
+	header.triangles = triangles.size();
+	header.has_normal = normal.empty() ? 0 : 1;
+	header.reserved = 0;
+
+	// The arrays are already in their final layout: no formatting
+	stream.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<char const*>(position.data()), position.size() * sizeof(vec3));
+	stream.write(reinterpret_cast<char const*>(normal.data()), normal.size() * sizeof(vec3));
+	stream.write(reinterpret_cast<char const*>(triangles.data()), triangles.size() * sizeof(uint3));
+}
+
+
+// Save and load
+// ********************************************** //
+
+bool mesh_save(std::string const& filename, std::vector<vec3> const& position, std::vector<vec3> const& normal, std::vector<uint3> const& triangles,
+	mesh_file_format format, thread_pool_structure& thread_pool)
+{
+	assert_cgp(normal.empty() || normal.size() == position.size(), "The normals must be empty or have the size of the positions");
+
+	auto const time_start = std::chrono::steady_clock::now();
+	std::ofstream stream(filename, std::ios::binary);
+	if (stream.good() == false) {
+		std::cout << "Cannot write the file " << filename << std::endl;
+		return false;
+	}
+
+	if (format == mesh_file_format::obj)
+		save_obj(stream, position, normal, triangles, thread_pool);
+	else if (format == mesh_file_format::ply)
+		save_ply(stream, position, normal, triangles, thread_pool);
+	else
+		save_raw(stream, position, normal, triangles);
+
+	size_t const size = size_t(stream.tellp());
+	stream.close();
+	if (stream.fail()) {
+		std::cout << "Error while writing the file " << filename << std::endl;
+		return false;
+	}
+
+	float const duration = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	std::cout << "Mesh saved in " << filename << " (" << position.size() << " vertices, " << triangles.size() << " triangles, "
+		<< size / (1024 * 1024.0f) << " MB in " << duration << " ms)" << std::endl;
+	return true;
+}
+
+bool mesh_save(std::string const& filename, mesh const& shape, mesh_file_format format, thread_pool_structure& thread_pool)
+{
+	return mesh_save(filename, shape.position.data, shape.normal.data, shape.connectivity.data, format, thread_pool);
+}
+
+bool mesh_load_raw(std::string const& filename, std::vector<vec3>& position, std::vector<vec3>& normal, std::vector<uint3>& triangles)
+{
+	std::ifstream stream(filename, std::ios::binary);
+	if (stream.good() == false)
+		return false;
+
+	mesh_raw_header header;
+	stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (stream.good() == false || std::memcmp(header.magic, "MRAW", 4) != 0 || header.version != mesh_raw_version) {
+		std::cout << "Invalid raw mesh file " << filename << std::endl;
+		return false;
+	}
+
+	// The counts must match the size of the file before anything is allocated (the divisions avoid overflows)
+	stream.seekg(0, std::ios::end);
+	uint64_t const data_size = uint64_t(stream.tellg()) - sizeof(header);
+	stream.seekg(sizeof(header), std::ios::beg);
+	uint64_t const vertex_size = header.has_normal ? 2 * sizeof(vec3) : sizeof(vec3);
+	bool const valid_size = header.vertices <= data_size / vertex_size
+		&& header.triangles == (data_size - header.vertices * vertex_size) / sizeof(uint3)
+		&& header.vertices * vertex_size + header.triangles * sizeof(uint3) == data_size;
+	if (stream.good() == false || !valid_size) {
+		std::cout << "Invalid size of raw mesh file " << filename << std::endl;
+		return false;
+	}
+
+	position.resize(header.vertices);
+	normal.resize(header.has_normal ? header.vertices : 0);
+	triangles.resize(header.triangles);
+	stream.read(reinterpret_cast<char*>(position.data()), position.size() * sizeof(vec3));
+	stream.read(reinterpret_cast<char*>(normal.data()), normal.size() * sizeof(vec3));
+	stream.read(reinterpret_cast<char*>(triangles.data()), triangles.size() * sizeof(uint3));
+	if (stream.fail()) {
+		std::cout << "Truncated raw mesh file " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
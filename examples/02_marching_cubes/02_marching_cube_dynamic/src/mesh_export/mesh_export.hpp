@@ -0,0 +1,42 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include <cstdint>
+
+// Export of indexed triangle meshes
+// ********************************************** //
+//  The elements are formatted in parallel by blocks, and each block is written (in a few large writes) by a separate
+//  thread while the next block is formatted.
+//  Formats:
+//   - obj: ASCII file (v, vn and f lines)
+//   - ply: binary little endian PLY with the positions, the normals (when there are some) and the triangles
+//   - raw: mesh_raw_header followed by the arrays as they are stored in memory (the fastest to write and read back)
+
+enum class mesh_file_format { obj, ply, raw };
+
+// Header of the raw format, followed by the positions (vec3), the normals (vec3, if has_normal) and the triangles (uint3)
+struct mesh_raw_header {
+	char magic[4];           // "MRAW"
+	uint32_t version;        // Format version (1)
+	uint64_t vertices;       // Number of vertices
+	uint64_t triangles;      // Number of triangles
+	uint32_t has_normal;     // 1 if the normals are stored after the positions
+	uint32_t reserved;
+};
+
+// Write the mesh in the file. normal can be empty (it must have the size of position otherwise).
+//  Return false if the file cannot be written.
+bool mesh_save(std::string const& filename, std::vector<cgp::vec3> const& position, std::vector<cgp::vec3> const& normal, std::vector<cgp::uint3> const& triangles,
+	mesh_file_format format, thread_pool_structure& thread_pool);
+bool mesh_save(std::string const& filename, cgp::mesh const& shape, mesh_file_format format, thread_pool_structure& thread_pool);
+
+// Read a mesh written in the raw format. Return false if the file doesn't exist or is not a valid raw mesh.
+bool mesh_load_raw(std::string const& filename, std::vector<cgp::vec3>& position, std::vector<cgp::vec3>& normal, std::vector<cgp::uint3>& triangles);
+
+// Header of a binary PLY file with the given number of vertices and triangles
+//  count_width > 0 writes the counts on a fixed number of digits, such that the header can be rewritten once they are known.
+std::string mesh_ply_header(size_t vertices, size_t triangles, bool has_normal, int count_width = 0);
+
+// Extension of the files of a format ("obj", "ply" or "raw")
+std::string mesh_file_extension(mesh_file_format format);
@@ -0,0 +1,323 @@
+#include "noise_cache.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+using namespace cgp;
+
+
+int noise_cache_size(float length, noise_cache_parameters const& parameters, int samples_per_cell)
+{
+	// The octave k has length*gain^k cells along the box
+	float const cells = length * std::pow(parameters.frequency_gain, float(parameters.octave - 1));
+	return int(std::ceil(cells * samples_per_cell)) + 1;
+}
+
+int noise_cache_octave_max(float length, int N, float frequency_gain, int samples_per_cell)
+{
+	int octave = 1;
+	while (length * std::pow(frequency_gain, float(octave)) * samples_per_cell + 1 <= N)
+		octave++;
+	return octave;
+}
+
+// Call task(begin,end) on the rows [0,N[, on the thread pool if there is one
+static void bake_rows(int N, thread_pool_structure* thread_pool, std::function<void(int, int)> const& task)
+{
+	if (thread_pool != nullptr)
+		thread_pool->parallel_for(N, 1, task);
+	else
+		task(0, N);
+}
+
+// Linear interpolation coordinate of x in N samples covering [corner, corner+length]: index k0 and weight a between k0 and k0+1
+static bool table_coordinate(float x, float corner, float length, int N, int& k0, float& a)
+{
+	float const u = (x - corner) / length * (N - 1);
+	if (!(u >= 0.0f && u <= float(N - 1)))
+		return false;
+	k0 = std::min(int(u), N - 2);
+	a = u - k0;
+	return true;
+}
+
+
+// Header of the cache files
+struct noise_cache_file_header {
+	char magic[4];           // "NOIS"
+	uint32_t version;
+	uint32_t dimension;      // 2 or 3
+	int32_t N[3];
+	int32_t octave;
+	float persistency;
+	float frequency_gain;
+	float corner[3];
+	float length[3];
+};
+static uint32_t const noise_cache_file_version = 2;
+
+static noise_cache_file_header noise_cache_file_header_build(int dimension, int3 const& N, noise_cache_parameters const& parameters, vec3 const& corner, vec3 const& length)
+{
+	noise_cache_file_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "NOIS", 4);
+	header.version = noise_cache_file_version;
+	header.dimension = uint32_t(dimension);
+	header.octave = parameters.octave;
+	header.persistency = parameters.persistency;
+	header.frequency_gain = parameters.frequency_gain;
+	for (int c = 0; c < 3; ++c) {
+		header.N[c] = N[c];
+		header.corner[c] = corner[c];
+		header.length[c] = length[c];
+	}
+	return header;
+}
+
+// Read the values if the file exists and matches the expected header
+static bool noise_cache_file_read(std::string const& filename, noise_cache_file_header const& expected, std::vector<float>& values)
+{
+	std::ifstream stream(filename, std::ios::binary);
+	if (stream.good() == false)
+		return false;
+
+	noise_cache_file_header header;
+	stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!stream || std::memcmp(&header, &expected, sizeof(header)) != 0)
+		return false;
+
+	stream.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(float));
+	return bool(stream);
+}
+
+static void noise_cache_file_write(std::string const& filename, noise_cache_file_header const& header, std::vector<float> const& values)
+{
+	std::ofstream stream(filename, std::ios::binary);
+	if (stream.good() == false) {
+		std::cout << "Cannot write noise cache file " << filename << std::endl;
+		return;
+	}
+	stream.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(float));
+}
+
+
+void noise_cache_2D::initialize(noise_cache_parameters const& parameters_arg, vec2 const& corner_arg, vec2 const& length_arg, int2 const& N_arg, thread_pool_structure* thread_pool)
+{
+	parameters = parameters_arg;
+	corner = corner_arg;
+	length = length_arg;
+	N = { std::max(N_arg.x, 2), std::max(N_arg.y, 2) };
+	values.resize(size_t(N.x) * size_t(N.y));
+
+	vec2 const step = { length.x / (N.x - 1), length.y / (N.y - 1) };
+	bake_rows(N.y, thread_pool, [&](int ky_begin, int ky_end) {
+		for (int ky = ky_begin; ky < ky_end; ++ky)
+			for (int kx = 0; kx < N.x; ++kx)
+				values[kx + size_t(N.x) * ky] = noise_perlin(vec2{ corner.x + kx * step.x, corner.y + ky * step.y }, parameters.octave, parameters.persistency, parameters.frequency_gain);
+	});
+}
+
+void noise_cache_2D::load_or_initialize(std::string const& filename, noise_cache_parameters const& parameters_arg, vec2 const& corner_arg, vec2 const& length_arg, int2 const& N_arg, thread_pool_structure* thread_pool)
+{
+	int2 const N_table = { std::max(N_arg.x, 2), std::max(N_arg.y, 2) };
+	noise_cache_file_header const header = noise_cache_file_header_build(2, { N_table.x, N_table.y, 1 }, parameters_arg, { corner_arg.x, corner_arg.y, 0 }, { length_arg.x, length_arg.y, 0 });
+
+	values.resize(size_t(N_table.x) * size_t(N_table.y));
+	if (noise_cache_file_read(filename, header, values)) {
+		parameters = parameters_arg;
+		corner = corner_arg;
+		length = length_arg;
+		N = N_table;
+		return;
+	}
+
+	initialize(parameters_arg, corner_arg, length_arg, N_table, thread_pool);
+	noise_cache_file_write(filename, header, values);
+}
+
+float noise_cache_2D::operator()(vec2 const& p) const
+{
+	int x0, y0;
+	float a, b;
+	if (!table_coordinate(p.x, corner.x, length.x, N.x, x0, a) || !table_coordinate(p.y, corner.y, length.y, N.y, y0, b))
+		return noise_perlin(p, parameters.octave, parameters.persistency, parameters.frequency_gain);
+
+	float const* row0 = &values[size_t(N.x) * y0];
+	float const* row1 = row0 + N.x;
+	float const v0 = row0[x0] + a * (row0[x0 + 1] - row0[x0]);
+	float const v1 = row1[x0] + a * (row1[x0 + 1] - row1[x0]);
+	return v0 + b * (v1 - v0);
+}
+
+void noise_cache_2D::initialize_texture_on_gpu()
+{
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, N.x, N.y, 0, GL_RED, GL_FLOAT, values.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void noise_cache_2D::clear()
+{
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	values.clear();
+	N = { 0, 0 };
+}
+
+
+void noise_cache_3D::initialize(noise_cache_parameters const& parameters_arg, vec3 const& corner_arg, vec3 const& length_arg, int3 const& N_arg, thread_pool_structure* thread_pool)
+{
+	parameters = parameters_arg;
+	corner = corner_arg;
+	length = length_arg;
+	N = { std::max(N_arg.x, 2), std::max(N_arg.y, 2), std::max(N_arg.z, 2) };
+	values.resize(size_t(N.x) * size_t(N.y) * size_t(N.z));
+
+	vec3 const step = { length.x / (N.x - 1), length.y / (N.y - 1), length.z / (N.z - 1) };
+	bake_rows(N.z, thread_pool, [&](int kz_begin, int kz_end) {
+		for (int kz = kz_begin; kz < kz_end; ++kz)
+			for (int ky = 0; ky < N.y; ++ky)
+				for (int kx = 0; kx < N.x; ++kx)
+					values[kx + size_t(N.x) * (ky + size_t(N.y) * kz)] = noise_perlin(corner + vec3{ kx * step.x, ky * step.y, kz * step.z }, parameters.octave, parameters.persistency, parameters.frequency_gain);
+	});
+}
+
+void noise_cache_3D::load_or_initialize(std::string const& filename, noise_cache_parameters const& parameters_arg, vec3 const& corner_arg, vec3 const& length_arg, int3 const& N_arg, thread_pool_structure* thread_pool)
+{
+	int3 const N_table = { std::max(N_arg.x, 2), std::max(N_arg.y, 2), std::max(N_arg.z, 2) };
+	noise_cache_file_header const header = noise_cache_file_header_build(3, N_table, parameters_arg, corner_arg, length_arg);
+
+	values.resize(size_t(N_table.x) * size_t(N_table.y) * size_t(N_table.z));
+	if (noise_cache_file_read(filename, header, values)) {
+		parameters = parameters_arg;
+		corner = corner_arg;
+		length = length_arg;
+		N = N_table;
+		return;
+	}
+
+	initialize(parameters_arg, corner_arg, length_arg, N_table, thread_pool);
+	noise_cache_file_write(filename, header, values);
+}
+
+float noise_cache_3D::operator()(vec3 const& p) const
+{
+	int x0, y0, z0;
+	float a, b, c;
+	if (!table_coordinate(p.x, corner.x, length.x, N.x, x0, a) || !table_coordinate(p.y, corner.y, length.y, N.y, y0, b) || !table_coordinate(p.z, corner.z, length.z, N.z, z0, c))
+		return noise_perlin(p, parameters.octave, parameters.persistency, parameters.frequency_gain);
+
+	size_t const NN = size_t(N.x) * size_t(N.y);
+	float const* r00 = &values[size_t(N.x) * y0 + NN * z0];
+	float const* r10 = r00 + N.x;
+	float const* r01 = r00 + NN;
+	float const* r11 = r01 + N.x;
+
+	float const v00 = r00[x0] + a * (r00[x0 + 1] - r00[x0]);
+	float const v10 = r10[x0] + a * (r10[x0 + 1] - r10[x0]);
+	float const v01 = r01[x0] + a * (r01[x0 + 1] - r01[x0]);
+	float const v11 = r11[x0] + a * (r11[x0 + 1] - r11[x0]);
+	float const v0 = v00 + b * (v10 - v00);
+	float const v1 = v01 + b * (v11 - v01);
+	return v0 + c * (v1 - v0);
+}
+
+void noise_cache_3D::initialize_texture_on_gpu()
+{
+	if (texture == 0)
+		glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_3D, texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, N.x, N.y, N.z, 0, GL_RED, GL_FLOAT, values.data());
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void noise_cache_3D::clear()
+{
+	if (texture != 0)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	values.clear();
+	N = { 0, 0, 0 };
+}
+
+
+// Accuracy and speed measurements
+// ********************************************** //
+
+// Receives the results of the timed loops so that they are not optimized out
+static volatile float measure_sink = 0.0f;
+
+// Average time (ns) of a call to f over all the positions
+template <typename POSITION, typename FUNCTION>
+static float measure_time(std::vector<POSITION> const& positions, FUNCTION const& f)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+	float sum = 0.0f;
+	for (POSITION const& p : positions)
+		sum += f(p);
+	auto const time_end = std::chrono::steady_clock::now();
+	measure_sink = sum;
+	return std::chrono::duration<float, std::nano>(time_end - time_start).count() / positions.size();
+}
+
+template <typename CACHE, typename POSITION>
+static noise_cache_measure_structure measure(CACHE const& cache, int octave_reference, std::vector<POSITION> const& positions)
+{
+	noise_cache_parameters const& parameters = cache.parameters;
+	int const octave = octave_reference > 0 ? octave_reference : parameters.octave;
+	noise_cache_measure_structure m;
+
+	double error2 = 0.0;
+	for (POSITION const& p : positions) {
+		float const error = std::abs(cache(p) - noise_perlin(p, octave, parameters.persistency, parameters.frequency_gain));
+		m.error_max = std::max(m.error_max, error);
+		error2 += error * error;
+	}
+	m.error_rms = float(std::sqrt(error2 / positions.size()));
+
+	m.time_cache = measure_time(positions, [&](POSITION const& p) { return cache(p); });
+	m.time_perlin = measure_time(positions, [&](POSITION const& p) { return noise_perlin(p, octave, parameters.persistency, parameters.frequency_gain); });
+	m.memory = cache.memory();
+
+	std::cout << "Noise cache " << cache.values.size() << " samples (" << m.memory / (1024 * 1024.0f) << " MB), " << parameters.octave << " of " << octave << " octaves: "
+		<< "error to noise_perlin max " << m.error_max << ", rms " << m.error_rms << " | "
+		<< "lookup " << m.time_cache << " ns, noise_perlin " << m.time_perlin << " ns" << std::endl;
+	return m;
+}
+
+noise_cache_measure_structure noise_cache_measure(noise_cache_2D const& cache, int octave_reference, int number_of_samples)
+{
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	std::vector<vec2> positions(number_of_samples);
+	for (vec2& p : positions)
+		p = { cache.corner.x + cache.length.x * distribution(generator), cache.corner.y + cache.length.y * distribution(generator) };
+	return measure(cache, octave_reference, positions);
+}
+
+noise_cache_measure_structure noise_cache_measure(noise_cache_3D const& cache, int octave_reference, int number_of_samples)
+{
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	std::vector<vec3> positions(number_of_samples);
+	for (vec3& p : positions)
+		p = { cache.corner.x + cache.length.x * distribution(generator), cache.corner.y + cache.length.y * distribution(generator), cache.corner.z + cache.length.z * distribution(generator) };
+	return measure(cache, octave_reference, positions);
+}
@@ -0,0 +1,265 @@
+#include "octree_surface.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+
+namespace {
+	// Cell waiting for the decision to be subdivided or not
+	struct octree_cell {
+		int node;
+		int3 origin;
+		int size;
+		int depth;
+	};
+}
+
+// Corner values of the cell and decision to subdivide it
+static bool subdivide_cell(octree_cell const& cell, float value[8], field_function_structure const& function, vec3 const& origin, float unit,
+	vec3 const& domain_min, vec3 const& domain_max, float isovalue, octree_surface_parameters const& parameters)
+{
+	float const h = unit * cell.size;
+	vec3 const p_min = origin + unit * vec3(float(cell.origin.x), float(cell.origin.y), float(cell.origin.z));
+	vec3 const p_max = p_min + vec3(h, h, h);
+	for (int c = 0; c < 8; ++c)
+		value[c] = function(p_min + h * vec3(float(c & 1), float((c >> 1) & 1), float((c >> 2) & 1)));
+
+	if (cell.depth >= parameters.max_depth)
+		return false;
+	for (int k = 0; k < 3; ++k)
+		if (p_min[k] > domain_max[k] || p_max[k] < domain_min[k])
+			return false;
+
+	float value_min, value_max;
+	function.bounds(p_min, p_max, value_min, value_max);
+	if (isovalue < value_min || isovalue > value_max)
+		return false;
+	if (cell.depth < parameters.surface_depth)
+		return true;
+
+	// Distance between the surface and its trilinear approximation, estimated at the center of the cell
+	float mean = 0.0f;
+	for (int c = 0; c < 8; ++c)
+		mean += value[c] / 8.0f;
+	vec3 gradient;
+	for (int k = 0; k < 3; ++k) {
+		float upper = 0.0f, lower = 0.0f;
+		for (int c = 0; c < 8; ++c)
+			((c >> k) & 1 ? upper : lower) += value[c];
+		gradient[k] = (upper - lower) / (4 * h);
+	}
+	float const error = std::abs(function((p_min + p_max) / 2.0f) - mean) / std::max(norm(gradient), 1e-6f);
+	return error > parameters.flatness * h;
+}
+
+void octree_surface_structure::build(field_function_structure const& function, vec3 const& p_min, vec3 const& p_max, float isovalue,
+	octree_surface_parameters const& parameters, thread_pool_structure& thread_pool)
+{
+	max_depth = parameters.max_depth;
+	domain_min = p_min;
+	domain_max = p_max;
+	origin = p_min;
+	unit = std::max(p_max.x - p_min.x, std::max(p_max.y - p_min.y, p_max.z - p_min.z)) / float(1 << max_depth);
+
+	nodes.assign(1, node());
+	leaves.clear();
+
+	// Breadth first: the cells of a level are evaluated in parallel, then linked to their children
+	std::vector<octree_cell> level = { { 0, { 0, 0, 0 }, 1 << max_depth, 0 } };
+	std::vector<octree_cell> next;
+	while (!level.empty()) {
+		std::vector<char> split(level.size());
+		std::vector<leaf> values(level.size());
+		thread_pool.parallel_for(int(level.size()), 64, [&](int k_begin, int k_end) {
+			for (int k = k_begin; k < k_end; ++k)
+				split[k] = subdivide_cell(level[k], values[k].value, function, origin, unit, domain_min, domain_max, isovalue, parameters);
+		});
+
+		next.clear();
+		for (size_t k = 0; k < level.size(); ++k) {
+			octree_cell const& cell = level[k];
+			if (split[k]) {
+				int const child = int(nodes.size());
+				int const size = cell.size / 2;
+				nodes[cell.node].child = child;
+				nodes.resize(nodes.size() + 8);
+				for (int c = 0; c < 8; ++c)
+					next.push_back({ child + c, int3{ cell.origin.x + size * (c & 1), cell.origin.y + size * ((c >> 1) & 1), cell.origin.z + size * ((c >> 2) & 1) }, size, cell.depth + 1 });
+			}
+			else {
+				nodes[cell.node].leaf_index = int(leaves.size());
+				values[k].origin = cell.origin;
+				values[k].size = cell.size;
+				leaves.push_back(values[k]);
+			}
+		}
+		level.swap(next);
+	}
+}
+
+int octree_surface_structure::locate(int3 const& q) const
+{
+	int const root_size = 1 << max_depth;
+	for (int k = 0; k < 3; ++k)
+		if (q[k] < 0 || q[k] >= 2 * root_size)
+			return -1;
+
+	int n = 0;
+	int3 o = { 0, 0, 0 };
+	int size = root_size;
+	while (nodes[n].child != -1) {
+		size /= 2;
+		int const cx = q.x >= 2 * (o.x + size), cy = q.y >= 2 * (o.y + size), cz = q.z >= 2 * (o.z + size);
+		o = { o.x + size * cx, o.y + size * cy, o.z + size * cz };
+		n = nodes[n].child + cx + 2 * cy + 4 * cz;
+	}
+	return nodes[n].leaf_index;
+}
+
+namespace {
+	// Polygon around a minimal edge crossed by the surface
+	struct octree_polygon {
+		int leaf[4];        // Leaves around the edge, counterclockwise around the orientation of the surface
+		vec3 crossing;      // Crossing point of the surface on the edge
+	};
+}
+
+void octree_surface_structure::extract(std::vector<vec3>& position, std::vector<vec3>& normal, std::vector<uint3>& triangles,
+	field_function_structure const& function, float isovalue, thread_pool_structure& thread_pool) const
+{
+	// Polygons of the minimal edges, each edge is handled by the first leaf of its size around it
+	int const group_size = 1024;
+	int const groups = int((leaves.size() + group_size - 1) / group_size);
+	std::vector<std::vector<octree_polygon>> outputs(groups);
+	thread_pool.parallel_for(groups, 1, [&](int g_begin, int g_end) {
+		for (int g = g_begin; g < g_end; ++g) {
+			int const l_end = std::min(int(leaves.size()), (g + 1) * group_size);
+			for (int l = g * group_size; l < l_end; ++l) {
+				leaf const& cell = leaves[l];
+				for (int axis = 0; axis < 3; ++axis) {
+					int const u = (axis + 1) % 3, v = (axis + 2) % 3;
+					for (int j = 0; j < 2; ++j) {
+						for (int i = 0; i < 2; ++i) {
+							int const c0 = (i << u) | (j << v);
+							int const c1 = c0 | (1 << axis);
+							float const v0 = cell.value[c0], v1 = cell.value[c1];
+							if ((v0 > isovalue) == (v1 > isovalue))
+								continue;
+
+							// Midpoint of the edge (in half units of the finest cells), and the 4 leaves around it
+							int3 start = cell.origin;
+							start[u] += i * cell.size;
+							start[v] += j * cell.size;
+							int3 mid = { 2 * start.x, 2 * start.y, 2 * start.z };
+							mid[axis] += cell.size;
+							vec3 const p_mid = origin + (0.5f * unit) * vec3(float(mid.x), float(mid.y), float(mid.z));
+							bool inside_domain = true;
+							for (int k = 0; k < 3; ++k)
+								inside_domain = inside_domain && p_mid[k] >= domain_min[k] && p_mid[k] <= domain_max[k];
+							if (!inside_domain)
+								continue;
+
+							int const quadrant[4][2] = { {-1,-1}, {1,-1}, {1,1}, {-1,1} }; // counterclockwise around the axis
+							octree_polygon polygon;
+							bool minimal = true;
+							int first = -1;
+							for (int q = 0; q < 4 && minimal; ++q) {
+								int3 p = mid;
+								p[u] += quadrant[q][0];
+								p[v] += quadrant[q][1];
+								int const neighbor = locate(p);
+								minimal = neighbor != -1 && leaves[neighbor].size >= cell.size;
+								polygon.leaf[q] = neighbor;
+								if (minimal && first == -1 && leaves[neighbor].size == cell.size)
+									first = neighbor;
+							}
+							if (!minimal || first != l)
+								continue;
+
+							// The polygon faces the lower values
+							if (v0 <= isovalue)
+								std::swap(polygon.leaf[1], polygon.leaf[3]);
+							float const alpha = (isovalue - v0) / (v1 - v0);
+							vec3 p0 = origin + unit * vec3(float(start.x), float(start.y), float(start.z));
+							vec3 p1 = p0;
+							p1[axis] += unit * cell.size;
+							polygon.crossing = p0 + alpha * (p1 - p0);
+							outputs[g].push_back(polygon);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	// Vertex of each leaf: mean of the crossing points of the polygons around it
+	std::vector<vec3> sum(leaves.size(), vec3{ 0,0,0 });
+	std::vector<int> count(leaves.size(), 0);
+	for (std::vector<octree_polygon> const& output : outputs) {
+		for (octree_polygon const& polygon : output) {
+			for (int q = 0; q < 4; ++q) {
+				if ((q > 0 && polygon.leaf[q] == polygon.leaf[q - 1]) || (q == 3 && polygon.leaf[q] == polygon.leaf[0]))
+					continue;
+				sum[polygon.leaf[q]] += polygon.crossing;
+				count[polygon.leaf[q]]++;
+			}
+		}
+	}
+
+	std::vector<int> vertex(leaves.size(), -1);
+	position.clear();
+	for (size_t l = 0; l < leaves.size(); ++l) {
+		if (count[l] == 0)
+			continue;
+		vertex[l] = int(position.size());
+		position.push_back(sum[l] / float(count[l]));
+	}
+
+	// Normals from the gradient of the function (central differences at the scale of the finest cells)
+	normal.resize(position.size());
+	float const h = 0.5f * unit;
+	thread_pool.parallel_for(int(position.size()), 1024, [&](int k_begin, int k_end) {
+		for (int k = k_begin; k < k_end; ++k) {
+			vec3 const& p = position[k];
+			vec3 const gradient = {
+				function(p + vec3(h, 0, 0)) - function(p - vec3(h, 0, 0)),
+				function(p + vec3(0, h, 0)) - function(p - vec3(0, h, 0)),
+				function(p + vec3(0, 0, h)) - function(p - vec3(0, 0, h)) };
+			normal[k] = -normalize(gradient, { 1,0,0 });
+		}
+	});
+
+	// Triangles of the polygons (a leaf larger than the others can appear twice around an edge)
+	triangles.clear();
+	for (std::vector<octree_polygon> const& output : outputs) {
+		for (octree_polygon const& polygon : output) {
+			unsigned int index[4];
+			int n = 0;
+			for (int q = 0; q < 4; ++q) {
+				unsigned int const k = unsigned(vertex[polygon.leaf[q]]);
+				if (n == 0 || (index[n - 1] != k && (q < 3 || index[0] != k)))
+					index[n++] = k;
+			}
+			if (n == 3)
+				triangles.push_back({ index[0], index[1], index[2] });
+			if (n == 4) {
+				// Split the quad along the diagonal giving the triangles that best agree with the normals
+				auto const agreement = [&](unsigned int a, unsigned int b, unsigned int c) {
+					vec3 const n_face = normalize(cross(position[b] - position[a], position[c] - position[a]), { 0,0,0 });
+					return std::min(dot(n_face, normal[a]), std::min(dot(n_face, normal[b]), dot(n_face, normal[c])));
+				};
+				float const diagonal_02 = std::min(agreement(index[0], index[1], index[2]), agreement(index[0], index[2], index[3]));
+				float const diagonal_13 = std::min(agreement(index[0], index[1], index[3]), agreement(index[1], index[2], index[3]));
+				if (diagonal_02 >= diagonal_13) {
+					triangles.push_back({ index[0], index[1], index[2] });
+					triangles.push_back({ index[0], index[2], index[3] });
+				}
+				else {
+					triangles.push_back({ index[0], index[1], index[3] });
+					triangles.push_back({ index[1], index[2], index[3] });
+				}
+			}
+		}
+	}
+}
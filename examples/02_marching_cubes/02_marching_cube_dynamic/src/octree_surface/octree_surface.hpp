@@ -0,0 +1,55 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include "../implicit_surface/field_function.hpp"
+
+// Adaptive octree surface
+// ********************************************** //
+//  The cells of an octree are subdivided only where they may contain the surface (bounds of the field function): down to
+//  surface_depth everywhere on the surface, and down to max_depth where the surface is not well approximated by the
+//  trilinear interpolation of the corners of the cell (high curvature).
+//  The surface is extracted as the dual of the octree (surface nets): each leaf next to the surface gives one vertex (mean
+//  of the crossing points around it), and each minimal edge crossed by the surface gives a quad, or a triangle, linking the
+//  vertices of the leaves around it. A minimal edge is an edge of a leaf that is not split by a finer neighbor: neighboring
+//  leaves of different sizes always share the same polygons, and the mesh has no crack between the levels.
+
+struct octree_surface_parameters {
+	int max_depth = 10;      // Depth of the finest cells (effective resolution 2^max_depth along the largest side of the domain)
+	int surface_depth = 6;   // All the cells that may contain the surface are subdivided down to this depth
+	float flatness = 0.02f;  // Cells are subdivided further when the distance of the surface to its trilinear approximation exceeds flatness x cell size
+};
+
+struct octree_surface_structure {
+
+	struct node {
+		int child = -1;      // Index of the first of the 8 children (-1 for a leaf)
+		int leaf_index = -1; // Index in leaves (-1 for an internal node)
+	};
+	struct leaf {
+		cgp::int3 origin;    // Lower corner in units of the finest cells
+		int size;            // Size in units of the finest cells
+		float value[8];      // Values of the function at the corners (corner c at (c&1, (c>>1)&1, (c>>2)&1))
+	};
+
+	std::vector<node> nodes;
+	std::vector<leaf> leaves;
+	cgp::vec3 origin;        // Lower corner of the root cell
+	float unit = 0;          // Size of the finest cells
+	int max_depth = 0;
+	cgp::vec3 domain_min;    // The surface is only extracted inside the domain [domain_min, domain_max]
+	cgp::vec3 domain_max;
+
+	// Subdivide the cube enclosing the domain [p_min, p_max] around the isosurface of the function
+	void build(field_function_structure const& function, cgp::vec3 const& p_min, cgp::vec3 const& p_max, float isovalue,
+		octree_surface_parameters const& parameters, thread_pool_structure& thread_pool);
+
+	// Extract the surface as an indexed mesh (normals from the gradient of the function)
+	void extract(std::vector<cgp::vec3>& position, std::vector<cgp::vec3>& normal, std::vector<cgp::uint3>& triangles,
+		field_function_structure const& function, float isovalue, thread_pool_structure& thread_pool) const;
+
+	// Leaf containing the point of coordinates q/2 (in units of the finest cells), -1 if q is outside the octree
+	int locate(cgp::int3 const& q) const;
+
+	size_t memory() const { return nodes.size() * sizeof(node) + leaves.size() * sizeof(leaf); }
+};
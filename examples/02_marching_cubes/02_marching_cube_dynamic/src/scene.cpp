@@ -17,10 +17,20 @@ void scene_structure::initialize()
 	// Initialization for the Implicit Surface
 	// ***************************************** //
 
+	// The threads are shared by the surface, its background computation and the other extractions
+	thread_pool.initialize();
+	implicit_surface.thread_pool = &thread_pool;
+	// The programs of the GPU extraction are compiled when it is enabled
+	backends.gpu_surface.shader_directory = project::path + "shaders/gpu_marching_cube/";
 	implicit_surface.set_domain(gui.domain.samples, gui.domain.length);
 	implicit_surface.update_field(field_function, gui.isovalue);
 }
 
+void scene_structure::clear()
+{
+	backends.clear();
+}
+
 
 
 void scene_structure::display_frame()
@@ -32,11 +42,8 @@ void scene_structure::display_frame()
 	if (gui.display.frame)
 		draw(global_frame, environment);
 
-	if (gui.display.surface)    // Display the implicit surface
-		draw(implicit_surface.drawable_param.shape, environment);
-
-	if (gui.display.wireframe) // Display the wireframe of the implicit surface
-		draw_wireframe(implicit_surface.drawable_param.shape, environment, { 0,0,0 });
+	// Display the implicit surface (or the one of the backends that replaces it)
+	backends.draw_surface(implicit_surface, environment, gui);
 
 	if (gui.display.domain)    // Display the boundary of the domain
 		draw(implicit_surface.drawable_param.domain_box, environment);
@@ -46,17 +53,53 @@ void scene_structure::display_frame()
 void scene_structure::display_gui()
 {
 	// Handle the gui values and the updates using the helper methods (*)
-	implicit_surface.gui_update(gui, field_function);
+	backends.gui_update(implicit_surface, gui, field_function);
+}
+
+// Compute a 3D position of a 2D position given by its screen coordinates for perspective projection
+static vec3 unproject(camera_projection_perspective const& P, mat4 const& camera_view_inverse, vec2 const& p_screen)
+{
+	vec4 const p_proj = camera_view_inverse * P.matrix_inverse() * vec4(p_screen, 0.5f, 1.0f);
+	return p_proj.xyz() / p_proj.w;
+}
+
+void scene_structure::sculpt_stroke(bool add)
+{
+	if (inputs.mouse.on_gui)
+		return;
+
+	vec3 const origin = camera_control.camera_model.position();
+	vec3 const target = unproject(camera_projection, camera_control.camera_model.matrix_frame(), inputs.mouse.position.current);
+	vec3 p;
+	if (!implicit_surface.intersect(origin, normalize(target - origin), gui.isovalue, p))
+		return;
+
+	// The successive Gaussians of a stroke are spaced by a fraction of the radius
+	float const magnitude = add ? gui.sculpt.strength : -gui.sculpt.strength;
+	if (!field_function.sculpt.empty()) {
+		field_gaussian_structure const& last = field_function.sculpt.back();
+		if (last.magnitude == magnitude && norm(last.center - p) < 0.3f * gui.sculpt.radius)
+			return;
+	}
+	field_function.sculpt.push_back({ p, magnitude, gui.sculpt.radius });
+	field_function.bake_sculpt();
+
+	// Only the blocks covered by the brush are updated (when the surface is not being computed in the background)
+	backends.request_update(implicit_surface, field_function, gui, true);
 }
 
 void scene_structure::mouse_move_event()
 {
 	if (!inputs.keyboard.shift)
 		camera_control.action_mouse_move(environment.camera_view);
+	else if (inputs.mouse.click.left || inputs.mouse.click.right)
+		sculpt_stroke(inputs.mouse.click.left);
 }
 void scene_structure::mouse_click_event()
 {
 	camera_control.action_mouse_click(environment.camera_view);
+	if (inputs.keyboard.shift && (inputs.mouse.click.left || inputs.mouse.click.right))
+		sculpt_stroke(inputs.mouse.click.left);
 }
 void scene_structure::keyboard_event()
 {
@@ -5,6 +5,7 @@
 #include "environment.hpp"
 
 #include "implicit_surface/implicit_surface.hpp"
+#include "implicit_surface/implicit_surface_backends.hpp"
 #include "implicit_surface/gui_helper.hpp"
 
 using cgp::mesh_drawable;
@@ -32,15 +33,21 @@ struct scene_structure : cgp::scene_inputs_generic {
 	implicit_surface_structure implicit_surface; // Structures used for the implicit surface (*)
 	field_function_structure field_function;     // A Parametric function used to generate the discrete field (*)
 
+	thread_pool_structure thread_pool;           // Threads shared by all the computations of the surface
+	implicit_surface_backends_structure backends; // Optional computations of the surface (octree, sparse volume, GPU, background, decimation, ...)
+
 	// ****************************** //
 	// Functions
 	// ****************************** //
 
 	void initialize();    // Standard initialization to be called before the animation loop
+	void clear();         // Delete the GPU data that is not released by cgp, to be called after the animation loop
 	void display_frame(); // The frame display to be called within the animation loop
 	void display_gui();   // The display of the GUI, also called within the animation loop
 
 
+	void sculpt_stroke(bool add); // Add (or remove) matter where the mouse ray hits the surface
+
 	void mouse_move_event();
 	void mouse_click_event();
 	void keyboard_event();
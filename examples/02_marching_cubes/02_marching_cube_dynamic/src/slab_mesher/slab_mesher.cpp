@@ -0,0 +1,577 @@
+#include "slab_mesher.hpp"
+#include "../marching_cube_blocks/marching_cube_blocks.hpp"
+#include "../mesh_export/mesh_export.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace cgp;
+
+
+// Raw volume file
+// ********************************************** //
+
+raw_volume_file_structure::~raw_volume_file_structure()
+{
+	close();
+}
+
+bool raw_volume_file_structure::is_open() const
+{
+	return data != nullptr;
+}
+
+bool raw_volume_file_structure::open(std::string const& filename, int3 const& samples_arg)
+{
+	close();
+
+	// Map the entire file in memory (read only)
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	data_size = size_t(size.QuadPart);
+	data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	file_descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0) {
+		close();
+		return false;
+	}
+	data_size = size_t(file_stat.st_size);
+	void* mapped = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	data = mapped == MAP_FAILED ? nullptr : static_cast<char const*>(mapped);
+#endif
+
+	if (data == nullptr) {
+		close();
+		return false;
+	}
+
+	size_t const expected_size = size_t(samples_arg.x) * size_t(samples_arg.y) * size_t(samples_arg.z) * sizeof(float);
+	if (data_size < expected_size) {
+		std::cout << "Raw volume file " << filename << " is too small for " << samples_arg.x << "x" << samples_arg.y << "x" << samples_arg.z << " samples" << std::endl;
+		close();
+		return false;
+	}
+	samples = samples_arg;
+
+#ifndef _WIN32
+	// Slices are read in increasing order
+	madvise(const_cast<char*>(data), data_size, MADV_SEQUENTIAL);
+#endif
+
+	return true;
+}
+
+void raw_volume_file_structure::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping_handle != nullptr)
+		CloseHandle(static_cast<HANDLE>(mapping_handle));
+	if (file_handle != nullptr)
+		CloseHandle(static_cast<HANDLE>(file_handle));
+#else
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), data_size);
+	if (file_descriptor >= 0)
+		::close(file_descriptor);
+#endif
+	data = nullptr;
+	data_size = 0;
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+	file_descriptor = -1;
+}
+
+float const* raw_volume_file_structure::slice(int kz) const
+{
+	assert_cgp(data != nullptr && kz >= 0 && kz < samples.z, "Invalid slice of the raw volume");
+	return reinterpret_cast<float const*>(data) + size_t(samples.x) * size_t(samples.y) * size_t(kz);
+}
+
+void raw_volume_file_structure::release(int kz_end) const
+{
+#ifndef _WIN32
+	// Only the whole pages before the slice kz_end are released
+	size_t const page = size_t(sysconf(_SC_PAGESIZE));
+	size_t const end = size_t(samples.x) * size_t(samples.y) * size_t(kz_end) * sizeof(float) / page * page;
+	if (end > 0)
+		madvise(const_cast<char*>(data), end, MADV_DONTNEED);
+#else
+	// The pages of a read-only mapping are trimmed from the working set by the OS when needed
+	(void)kz_end;
+#endif
+}
+
+bool raw_volume_file_write(std::string const& filename, spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool,
+	slab_mesher_progress* progress)
+{
+	std::ofstream stream(filename, std::ios::binary);
+	if (stream.good() == false) {
+		std::cout << "Cannot write raw volume file " << filename << std::endl;
+		return false;
+	}
+
+	slab_mesher_source const source = slab_mesher_source_function(func, domain, thread_pool);
+	std::vector<float> values(size_t(domain.samples.x) * domain.samples.y);
+	for (int kz = 0; kz < domain.samples.z && stream.good(); ++kz) {
+		if (progress != nullptr && progress->cancel) {
+			stream.close();
+			std::remove(filename.c_str());
+			std::cout << "Writing of " << filename << " cancelled" << std::endl;
+			return false;
+		}
+		source(kz, values.data());
+		stream.write(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(float));
+		if (progress != nullptr)
+			progress->slices = kz + 1;
+	}
+
+	return stream.good();
+}
+
+
+// Streaming writer
+// ********************************************** //
+
+streaming_mesh_writer_structure::~streaming_mesh_writer_structure()
+{
+	if (writer.joinable())
+		close();
+}
+
+bool streaming_mesh_writer_structure::open(std::string const& filename_arg)
+{
+	filename = filename_arg;
+	stream_vertices.open(filename, std::ios::binary);
+	stream_faces.open(filename + ".faces", std::ios::binary);
+	if (stream_vertices.good() == false || stream_faces.good() == false) {
+		std::cout << "Cannot write the file " << filename << std::endl;
+		stream_vertices.close();
+		stream_faces.close();
+		return false;
+	}
+
+	std::string const header = mesh_ply_header(0, 0, false, 20);
+	stream_vertices.write(header.data(), header.size());
+
+	queue.clear();
+	stop = false;
+	failed = false;
+	vertex_count = 0;
+	triangle_count = 0;
+	writer = std::thread(&streaming_mesh_writer_structure::writer_loop, this);
+	return true;
+}
+
+void streaming_mesh_writer_structure::push(std::vector<vec3>&& position, std::vector<uint3>&& triangles)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition_pop.wait(lock, [this] { return int(queue.size()) < max_queued_chunks; });
+		vertex_count += position.size();
+		triangle_count += triangles.size();
+		queue.push_back({ std::move(position), std::move(triangles) });
+	}
+	condition_push.notify_one();
+}
+
+void streaming_mesh_writer_structure::writer_loop()
+{
+	static_assert(sizeof(vec3) == 3 * sizeof(float), "The vertices are written as packed floats");
+	size_t const face_size = 1 + 3 * sizeof(uint32_t);
+	std::vector<char> faces;
+
+	while (true) {
+		chunk* current = nullptr;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition_push.wait(lock, [this] { return stop || !queue.empty(); });
+			if (queue.empty())
+				return;
+			current = &queue.front(); // Only the writer removes the chunks: the front stays valid while the next ones are pushed
+		}
+
+		stream_vertices.write(reinterpret_cast<char const*>(current->position.data()), current->position.size() * sizeof(vec3));
+
+		// Each face is stored as its number of vertices (uchar) followed by the indices
+		faces.resize(current->triangles.size() * face_size);
+		for (size_t k = 0; k < current->triangles.size(); ++k) {
+			char* face = &faces[k * face_size];
+			uint32_t const indices[3] = { current->triangles[k].x, current->triangles[k].y, current->triangles[k].z };
+			face[0] = 3;
+			std::memcpy(face + 1, indices, sizeof(indices));
+		}
+		stream_faces.write(faces.data(), faces.size());
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queue.pop_front();
+			if (stream_vertices.good() == false || stream_faces.good() == false)
+				failed = true;
+		}
+		condition_pop.notify_one();
+	}
+}
+
+bool streaming_mesh_writer_structure::close()
+{
+	if (writer.joinable() == false)
+		return false;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition_push.notify_one();
+	writer.join();
+
+	// Append the triangles after the vertices, and write the final counts in the header
+	std::string const filename_faces = filename + ".faces";
+	stream_faces.close();
+	{
+		std::ifstream stream_in(filename_faces, std::ios::binary);
+		if (triangle_count > 0)
+			stream_vertices << stream_in.rdbuf();
+	}
+	std::remove(filename_faces.c_str());
+
+	std::string const header = mesh_ply_header(vertex_count, triangle_count, false, 20);
+	stream_vertices.seekp(0);
+	stream_vertices.write(header.data(), header.size());
+	bool const success = !failed && stream_vertices.good();
+	stream_vertices.close();
+
+	if (success == false)
+		std::cout << "Error while writing the file " << filename << std::endl;
+	return success;
+}
+
+
+// Sources
+// ********************************************** //
+
+slab_mesher_source slab_mesher_source_function(field_function_structure const& func, spatial_domain_grid_3D const& domain, thread_pool_structure& thread_pool)
+{
+	int3 const N = domain.samples;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const p_last = domain.position({ N.x - 1, N.y - 1, N.z - 1 });
+	float const step_z = domain.position({ 0, 0, 1 }).z - p0.z;
+
+	return [&func, &thread_pool, N, p0, p_last, step_z](int kz, float* values) {
+		// Domain made of the slices kz and kz+1, with the same samples as the full domain
+		float const z = p0.z + kz * step_z;
+		vec3 const center = { (p0.x + p_last.x) / 2, (p0.y + p_last.y) / 2, z + step_z / 2 };
+		vec3 const length = { p_last.x - p0.x, p_last.y - p0.y, step_z };
+		spatial_domain_grid_3D const slab = spatial_domain_grid_3D::from_center_length(center, length, { N.x, N.y, 2 });
+
+		thread_pool.parallel_for(N.y, 8, [&](int ky_begin, int ky_end) {
+			func.evaluate_box(slab, { 0, ky_begin, 0 }, { N.x, ky_end, 1 }, values);
+		});
+	};
+}
+
+slab_mesher_source slab_mesher_source_raw(raw_volume_file_structure const& volume)
+{
+	return [&volume](int kz, float* values) {
+		size_t const Nxy = size_t(volume.samples.x) * volume.samples.y;
+		std::memcpy(values, volume.slice(kz), Nxy * sizeof(float));
+		// The slices up to kz are now copied in the buffers of the mesher
+		volume.release(kz + 1);
+	};
+}
+
+
+// Extraction
+// ********************************************** //
+
+static uint32_t const no_vertex = 0xffffffffu;
+
+// Vertices of the crossed edges of the row y
+//  edge_xy: edges along x and y starting on the samples of the slice z (values), stored as edge_xy[2*(kx+Nx*ky)+axis]
+//  edge_z (if not null): edges along z between the slices z-1 (values_lower) and z, stored as edge_z[kx+Nx*ky]
+//  The edge tables of the row receive the index of the vertex in position (relative to the row).
+static void extract_row_vertices(std::vector<vec3>& position, uint32_t* edge_xy, uint32_t* edge_z, float const* values, float const* values_lower,
+	int3 const& N, int y, int z, vec3 const& p0, vec3 const& step, float isovalue)
+{
+	position.clear();
+	for (int x = 0; x < N.x; ++x) {
+		size_t const k = x + size_t(N.x) * y;
+		float const v0 = values[k];
+		vec3 const q0 = p0 + step * vec3(float(x), float(y), float(z));
+
+		// Edges along x and y of the slice
+		for (int axis = 0; axis < 2; ++axis) {
+			edge_xy[2 * k + axis] = no_vertex;
+			if ((axis == 0 && x + 1 >= N.x) || (axis == 1 && y + 1 >= N.y))
+				continue;
+			float const v1 = values[axis == 0 ? k + 1 : k + N.x];
+			if ((v0 > isovalue) == (v1 > isovalue))
+				continue;
+
+			float const alpha = (isovalue - v0) / (v1 - v0);
+			vec3 q1 = q0;
+			q1[axis] += step[axis];
+			edge_xy[2 * k + axis] = uint32_t(position.size());
+			position.push_back(q0 + alpha * (q1 - q0));
+		}
+
+		// Edge along z from the lower slice
+		if (edge_z != nullptr) {
+			edge_z[k] = no_vertex;
+			float const v_lower = values_lower[k];
+			if ((v_lower > isovalue) == (v0 > isovalue))
+				continue;
+
+			float const alpha = (isovalue - v_lower) / (v0 - v_lower);
+			vec3 q_lower = q0;
+			q_lower.z -= step.z;
+			edge_z[k] = uint32_t(position.size());
+			position.push_back(q_lower + alpha * (q0 - q_lower));
+		}
+	}
+}
+
+// Triangles of the row of cells y between the slices lower and upper (the indices of the vertices are global)
+static void extract_row_triangles(std::vector<uint3>& triangles, float const* const values[2], uint32_t const* const edge_xy[2], uint32_t const* edge_z,
+	int3 const& N, int y, float isovalue)
+{
+	marching_cube_table_structure const& table = marching_cube_table();
+
+	size_t corner_offset[8];
+	for (int c = 0; c < 8; ++c)
+		corner_offset[c] = (c & 1) + size_t(N.x) * ((c >> 1) & 1);
+
+	triangles.clear();
+	for (int x = 0; x < N.x - 1; ++x) {
+		size_t const k = x + size_t(N.x) * y;
+
+		int configuration = 0;
+		for (int c = 0; c < 8; ++c)
+			configuration |= (values[c >> 2][k + corner_offset[c]] > isovalue) << c;
+		if (configuration == 0 || configuration == 255)
+			continue;
+
+		// Vertex of the edge e of the cell, stored in the table of the slice of its lower corner
+		auto vertex = [&](int e) {
+			int const c0 = table.corners[e][0];
+			size_t const s = k + corner_offset[c0];
+			int const axis = e / 4;
+			return axis == 2 ? edge_z[s] : edge_xy[c0 >> 2][2 * s + axis];
+		};
+		for (signed char const* e = table.triangles[configuration]; *e != -1; e += 3)
+			triangles.push_back({ vertex(e[0]), vertex(e[1]), vertex(e[2]) });
+	}
+}
+
+bool slab_mesher_run(std::string const& filename, spatial_domain_grid_3D const& domain, slab_mesher_source const& source, float isovalue,
+	thread_pool_structure& thread_pool, slab_mesher_statistics* statistics, slab_mesher_progress* progress)
+{
+	using clock = std::chrono::steady_clock;
+	auto const milliseconds = [](clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); };
+	auto const time_start = clock::now();
+
+	int3 const N = domain.samples;
+	if (N.x < 2 || N.y < 2 || N.z < 2) {
+		std::cout << "The streamed domain needs at least 2 samples along each direction" << std::endl;
+		return false;
+	}
+
+	streaming_mesh_writer_structure writer;
+	if (writer.open(filename) == false)
+		return false;
+
+	size_t const Nxy = size_t(N.x) * N.y;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	// Samples and edge tables of the lower (0) and upper (1) slices of the current layer of cells
+	std::vector<float> slice[2] = { std::vector<float>(Nxy), std::vector<float>(Nxy) };
+	std::vector<uint32_t> edge_xy[2] = { std::vector<uint32_t>(2 * Nxy), std::vector<uint32_t>(2 * Nxy) };
+	std::vector<uint32_t> edge_z(Nxy);
+	size_t const memory_slices = 2 * Nxy * sizeof(float) + 5 * Nxy * sizeof(uint32_t);
+
+	// Vertices and triangles of each row, gathered in the chunk sent to the writer
+	std::vector<std::vector<vec3>> row_position(N.y);
+	std::vector<std::vector<uint3>> row_triangles(N.y);
+	std::vector<size_t> row_offset(N.y + 1);
+	size_t vertex_count = 0;
+	size_t chunk_memory_max = 0;
+	bool overflow = false;
+	float time_source = 0.0f, time_mesh = 0.0f, time_wait = 0.0f;
+
+	// Concatenate the vertices of the rows in the chunk, and turn the indices of the edge tables of each row into global indices
+	auto gather_vertices = [&](std::vector<vec3>& position, uint32_t* edges_xy, uint32_t* edges_z) {
+		row_offset[0] = 0;
+		for (int y = 0; y < N.y; ++y)
+			row_offset[y + 1] = row_offset[y] + row_position[y].size();
+		if (vertex_count + row_offset[N.y] >= no_vertex) {
+			overflow = true;
+			return;
+		}
+		size_t const first = position.size();
+		position.resize(first + row_offset[N.y]);
+		thread_pool.parallel_for(N.y, 16, [&](int y_begin, int y_end) {
+			for (int y = y_begin; y < y_end; ++y) {
+				std::copy(row_position[y].begin(), row_position[y].end(), position.begin() + first + row_offset[y]);
+				uint32_t const offset = uint32_t(vertex_count + row_offset[y]);
+				for (size_t k = 2 * size_t(N.x) * y; k < 2 * size_t(N.x) * (y + 1); ++k)
+					if (edges_xy[k] != no_vertex)
+						edges_xy[k] += offset;
+				if (edges_z != nullptr)
+					for (size_t k = size_t(N.x) * y; k < size_t(N.x) * (y + 1); ++k)
+						if (edges_z[k] != no_vertex)
+							edges_z[k] += offset;
+			}
+		});
+		vertex_count += row_offset[N.y];
+	};
+
+	std::vector<vec3> position;
+	std::vector<uint3> triangles;
+
+	// Vertices of the first slice
+	auto time = clock::now();
+	source(0, slice[0].data());
+	time_source += milliseconds(clock::now() - time);
+	time = clock::now();
+	thread_pool.parallel_for(N.y, 8, [&](int y_begin, int y_end) {
+		for (int y = y_begin; y < y_end; ++y)
+			extract_row_vertices(row_position[y], edge_xy[0].data(), nullptr, slice[0].data(), nullptr, N, y, 0, p0, step, isovalue);
+	});
+	gather_vertices(position, edge_xy[0].data(), nullptr);
+	time_mesh += milliseconds(clock::now() - time);
+	if (progress != nullptr)
+		progress->slices = 1;
+
+	bool cancelled = false;
+	for (int kz = 0; kz < N.z - 1 && !overflow; ++kz) {
+		if (progress != nullptr && progress->cancel) {
+			cancelled = true;
+			break;
+		}
+
+		time = clock::now();
+		source(kz + 1, slice[1].data());
+		time_source += milliseconds(clock::now() - time);
+
+		// Vertices of the upper slice and of the edges between the two slices
+		time = clock::now();
+		thread_pool.parallel_for(N.y, 8, [&](int y_begin, int y_end) {
+			for (int y = y_begin; y < y_end; ++y)
+				extract_row_vertices(row_position[y], edge_xy[1].data(), edge_z.data(), slice[1].data(), slice[0].data(), N, y, kz + 1, p0, step, isovalue);
+		});
+		gather_vertices(position, edge_xy[1].data(), edge_z.data());
+		if (overflow)
+			break;
+
+		// Triangles of the cells of the layer
+		float const* const values[2] = { slice[0].data(), slice[1].data() };
+		uint32_t const* const edges[2] = { edge_xy[0].data(), edge_xy[1].data() };
+		thread_pool.parallel_for(N.y - 1, 8, [&](int y_begin, int y_end) {
+			for (int y = y_begin; y < y_end; ++y)
+				extract_row_triangles(row_triangles[y], values, edges, edge_z.data(), N, y, isovalue);
+		});
+		size_t triangle_count = 0;
+		for (int y = 0; y < N.y - 1; ++y)
+			triangle_count += row_triangles[y].size();
+		triangles.reserve(triangle_count);
+		for (int y = 0; y < N.y - 1; ++y)
+			triangles.insert(triangles.end(), row_triangles[y].begin(), row_triangles[y].end());
+		time_mesh += milliseconds(clock::now() - time);
+
+		// The writer takes the chunk while the next layer is computed
+		chunk_memory_max = std::max(chunk_memory_max, position.size() * sizeof(vec3) + triangles.size() * sizeof(uint3));
+		time = clock::now();
+		writer.push(std::move(position), std::move(triangles));
+		time_wait += milliseconds(clock::now() - time);
+		position = std::vector<vec3>();
+		triangles = std::vector<uint3>();
+
+		// The upper slice becomes the lower slice of the next layer (with the vertices of its edges)
+		std::swap(slice[0], slice[1]);
+		std::swap(edge_xy[0], edge_xy[1]);
+		if (progress != nullptr)
+			progress->slices = kz + 2;
+	}
+
+	if (overflow)
+		std::cout << "The streamed surface has more than " << no_vertex << " vertices" << std::endl;
+	if (cancelled)
+		std::cout << "Streaming of " << filename << " cancelled (the file contains the slices already processed)" << std::endl;
+
+	time = clock::now();
+	bool const success = writer.close() && !overflow && !cancelled;
+	time_wait += milliseconds(clock::now() - time);
+
+	if (statistics != nullptr) {
+		statistics->vertices = writer.number_of_vertices();
+		statistics->triangles = writer.number_of_triangles();
+		// Chunks held at the same time: in the rows, being built, being written and queued
+		statistics->memory = memory_slices + chunk_memory_max * (writer.max_queued_chunks + 2);
+		statistics->time_source = time_source;
+		statistics->time_mesh = time_mesh;
+		statistics->time_wait = time_wait;
+		statistics->time_total = milliseconds(clock::now() - time_start);
+	}
+	if (success)
+		std::cout << "Mesh streamed in " << filename << " (" << writer.number_of_vertices() << " vertices, " << writer.number_of_triangles() << " triangles)" << std::endl;
+	return success;
+}
+
+
+// Job
+// ********************************************** //
+
+slab_mesher_job_structure::~slab_mesher_job_structure()
+{
+	cancel();
+	if (thread.joinable())
+		thread.join();
+}
+
+bool slab_mesher_job_structure::start(int slices_arg, std::function<void()> const& task)
+{
+	if (running)
+		return false;
+	if (thread.joinable())
+		thread.join();
+
+	slices = slices_arg;
+	progress.slices = 0;
+	progress.cancel = false;
+	running = true;
+	thread = std::thread([this, task]() {
+		task();
+		running = false;
+	});
+	return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include "../implicit_surface/field_function.hpp"
+#include <fstream>
+#include <deque>
+
+// Out-of-core marching cube
+// ********************************************** //
+//  The volume is processed one layer of cells at a time along z: only the two z-slices of samples bounding the layer are
+//  stored, so that the memory doesn't depend on the number of slices (28 bytes per sample of a slice, plus the chunks of
+//  triangles waiting for the writer: about 120 MB for a 2048^3 volume).
+//  The slices are either evaluated from the field function, or read from a raw volume file through a memory mapping.
+//  Each crossed edge of the grid gives a single vertex: the vertices of the edges of the upper slice of a layer are kept
+//  and shared with the next layer. The vertices and triangles of each layer are sent to a writer thread that appends them
+//  to a binary PLY file while the next layer is computed.
+
+
+// Read-only access to a raw volume file using a memory mapping
+//  The file contains Nx*Ny*Nz float32 values stored as values[kx + Nx*(ky + Ny*kz)] (no header).
+//  The slices are read sequentially: the pages of the slices that are no longer needed can be released.
+struct raw_volume_file_structure {
+
+	cgp::int3 samples;       // Number of samples along each direction
+
+	raw_volume_file_structure() = default;
+	~raw_volume_file_structure();
+	raw_volume_file_structure(raw_volume_file_structure const&) = delete;
+	raw_volume_file_structure& operator=(raw_volume_file_structure const&) = delete;
+
+	// Open and map the file. Return false if the file doesn't exist or is smaller than the given number of samples.
+	bool open(std::string const& filename, cgp::int3 const& samples);
+	// Unmap and close the file
+	void close();
+	bool is_open() const;
+
+	// Values of the slice kz (Nx*Ny samples)
+	float const* slice(int kz) const;
+	// Give back to the OS the pages of the slices kz < kz_end (they are read again from the file if they are accessed later)
+	void release(int kz_end) const;
+
+private:
+	char const* data = nullptr;   // Beginning of the mapped file
+	size_t data_size = 0;         // Size of the mapping in bytes
+	void* file_handle = nullptr;  // Platform specific handles
+	void* mapping_handle = nullptr;
+	int file_descriptor = -1;
+};
+
+// Progress of an extraction or of the writing of a raw volume, shared with the thread that runs it
+struct slab_mesher_progress {
+	std::atomic<int> slices{ 0 };       // Number of slices processed
+	std::atomic<bool> cancel{ false };  // Set to true to stop after the current slice
+};
+
+// Write the samples of the field function on the domain in a raw volume file, one slice at a time
+//  Return false if the file cannot be written, or if it has been cancelled (the incomplete file is removed)
+bool raw_volume_file_write(std::string const& filename, cgp::spatial_domain_grid_3D const& domain, field_function_structure const& func, thread_pool_structure& thread_pool,
+	slab_mesher_progress* progress = nullptr);
+
+
+// Binary PLY file written progressively by a dedicated thread
+//  The number of vertices and triangles is only known at the end: the triangles are stored in a temporary file
+//  (filename.faces) and appended after the vertices when the file is closed. The counts of the header are fixed-width
+//  fields rewritten at the end.
+//  At most max_queued_chunks chunks wait for the writer: push() blocks when the writer is late, which bounds the memory.
+struct streaming_mesh_writer_structure {
+
+	int max_queued_chunks = 4;
+
+	streaming_mesh_writer_structure() = default;
+	~streaming_mesh_writer_structure();
+	streaming_mesh_writer_structure(streaming_mesh_writer_structure const&) = delete;
+	streaming_mesh_writer_structure& operator=(streaming_mesh_writer_structure const&) = delete;
+
+	// Create the files and start the writer thread. Return false if the files cannot be created.
+	bool open(std::string const& filename);
+	// Append a chunk of vertices and triangles (the indices refer to all the vertices pushed since open)
+	void push(std::vector<cgp::vec3>&& position, std::vector<cgp::uint3>&& triangles);
+	// Wait for the writer, then complete the file. Return false if a write failed.
+	bool close();
+
+	size_t number_of_vertices() const { return vertex_count; }
+	size_t number_of_triangles() const { return triangle_count; }
+
+private:
+	struct chunk {
+		std::vector<cgp::vec3> position;
+		std::vector<cgp::uint3> triangles;
+	};
+	void writer_loop();
+
+	std::string filename;
+	std::ofstream stream_vertices;
+	std::ofstream stream_faces;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable condition_push; // A chunk has been pushed (or the writer must stop)
+	std::condition_variable condition_pop;  // A chunk has been written
+	std::deque<chunk> queue;
+	bool stop = false;
+	bool failed = false;
+	size_t vertex_count = 0;
+	size_t triangle_count = 0;
+};
+
+
+// Source of the samples: fill values[kx + Nx*ky] with the Nx*Ny samples of the slice kz
+using slab_mesher_source = std::function<void(int kz, float* values)>;
+
+// Slices of the field function on the domain (each slice is evaluated in parallel)
+slab_mesher_source slab_mesher_source_function(field_function_structure const& func, cgp::spatial_domain_grid_3D const& domain, thread_pool_structure& thread_pool);
+// Slices of a raw volume file (the pages of the slices already meshed are released)
+slab_mesher_source slab_mesher_source_raw(raw_volume_file_structure const& volume);
+
+// Measures of a streamed extraction
+struct slab_mesher_statistics {
+	size_t vertices = 0;
+	size_t triangles = 0;
+	size_t memory = 0;           // Peak size of the slices, edge tables and chunks of the mesher (bytes)
+	float time_source = 0.0f;    // Time spent to evaluate or read the slices (ms)
+	float time_mesh = 0.0f;      // Time spent to extract the vertices and triangles (ms)
+	float time_wait = 0.0f;      // Time spent waiting for the writer (ms)
+	float time_total = 0.0f;     // Total duration, including the completion of the file (ms)
+};
+
+// Extract the isosurface of the samples given by source on the domain, and write it in the binary PLY file filename
+//  Same surface and orientation as marching_cube_blocks_indexed (the normals point toward the lower values).
+//  Return false if the file cannot be written, or if the surface has more than 2^32-1 vertices.
+//  When it is cancelled, the file only contains the surface of the slices processed, and false is returned.
+bool slab_mesher_run(std::string const& filename, cgp::spatial_domain_grid_3D const& domain, slab_mesher_source const& source, float isovalue,
+	thread_pool_structure& thread_pool, slab_mesher_statistics* statistics = nullptr, slab_mesher_progress* progress = nullptr);
+
+
+// Extraction (or writing of a raw volume) run on its own thread, such that the GUI stays responsive
+struct slab_mesher_job_structure {
+
+	slab_mesher_progress progress;
+	int slices = 0;                     // Number of slices of the current job
+	slab_mesher_statistics statistics;  // Measures of the last extraction (to be read when the job is not busy)
+
+	slab_mesher_job_structure() = default;
+	~slab_mesher_job_structure();       // Cancel the current job and wait for its thread
+	slab_mesher_job_structure(slab_mesher_job_structure const&) = delete;
+	slab_mesher_job_structure& operator=(slab_mesher_job_structure const&) = delete;
+
+	// Run task on the thread of the job, with slices to process. Return false (nothing is started) if a job is running.
+	bool start(int slices, std::function<void()> const& task);
+	void cancel() { progress.cancel = true; }
+	bool busy() const { return running; }
+
+private:
+	std::thread thread;
+	std::atomic<bool> running{ false };
+};
@@ -0,0 +1,277 @@
+#include "sparse_volume.hpp"
+#include "../marching_cube_blocks/marching_cube_blocks.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+
+void compute_sparse_field(sparse_volume_structure<float>& field, sparse_volume_structure<vec3>* gradient, spatial_domain_grid_3D const& domain,
+	field_function_structure const& function, float isovalue, thread_pool_structure& thread_pool)
+{
+	int const L = sparse_volume_structure<float>::leaf_size;
+	int const margin = 2;
+	int3 const N = domain.samples;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	field.resize(N, 0.0f);
+	int3 const S = field.slots_dimension;
+
+	// Bounds of the function over each slot extended by the margin: the tiles receive the bound on their side of the isovalue
+	std::vector<char> active(field.slots.size(), 0);
+	thread_pool.parallel_for(S.z, 1, [&](int sz_begin, int sz_end) {
+		for (int sz = sz_begin; sz < sz_end; ++sz) {
+			for (int sy = 0; sy < S.y; ++sy) {
+				for (int sx = 0; sx < S.x; ++sx) {
+					vec3 const p_min = p0 + step * vec3(float(sx * L - margin), float(sy * L - margin), float(sz * L - margin));
+					vec3 const p_max = p0 + step * vec3(float(sx * L + L - 1 + margin), float(sy * L + L - 1 + margin), float(sz * L + L - 1 + margin));
+					float value_min, value_max;
+					function.bounds(p_min, p_max, value_min, value_max);
+
+					size_t const index = sx + size_t(S.x) * (sy + size_t(S.y) * sz);
+					if (value_min <= isovalue && isovalue <= value_max)
+						active[index] = 1;
+					else
+						field.slots[index].value = value_max < isovalue ? value_max : value_min;
+				}
+			}
+		}
+	});
+
+	// Leaves allocated in the order of the slots (the pool only grows here), then evaluated in parallel
+	for (int sz = 0; sz < S.z; ++sz)
+		for (int sy = 0; sy < S.y; ++sy)
+			for (int sx = 0; sx < S.x; ++sx)
+				if (active[sx + size_t(S.x) * (sy + size_t(S.y) * sz)])
+					field.allocate(sx, sy, sz);
+
+	bool const use_analytic_gradient = gradient != nullptr && function.analytic_gradient();
+	if (gradient != nullptr) {
+		gradient->resize(N, vec3{ 0,0,0 });
+		if (use_analytic_gradient)
+			for (cgp::int3 const& origin : field.leaf_origin)
+				gradient->allocate(origin.x / L, origin.y / L, origin.z / L);
+	}
+
+	// Each leaf is the grid of L^3 samples starting at its origin: evaluate_box writes its samples in the order of the leaf
+	thread_pool.parallel_for(int(field.number_of_leaves()), 4, [&](int leaf_begin, int leaf_end) {
+		for (int index = leaf_begin; index < leaf_end; ++index) {
+			int3 const origin = field.leaf_origin[index];
+			float const half = 0.5f * float(L - 1);
+			vec3 const center = p0 + step * vec3(origin.x + half, origin.y + half, origin.z + half);
+			spatial_domain_grid_3D const leaf_domain = spatial_domain_grid_3D::from_center_length(center, step * float(L - 1), { L, L, L });
+			function.evaluate_box(leaf_domain, { 0, 0, 0 }, { L, L, L }, field.leaf(index), use_analytic_gradient ? gradient->leaf(index) : nullptr);
+		}
+	});
+}
+
+// Samples of the leaf and of the next layer of samples along x, y and z (the block of the cells of the leaf), in block[x + (L+1)*(y + (L+1)*z)]
+//  The samples beyond the grid are clamped to its last samples.
+static void gather_leaf_cells(float* block, sparse_volume_structure<float> const& field, int index)
+{
+	int const L = sparse_volume_structure<float>::leaf_size;
+	int const B = L + 1;
+	int3 const N = field.dimension;
+	int3 const origin = field.leaf_origin[index];
+	float const* leaf = field.leaf(index);
+	for (int z = 0; z < B; ++z) {
+		for (int y = 0; y < B; ++y) {
+			for (int x = 0; x < B; ++x) {
+				if (x < L && y < L && z < L)
+					block[x + B * (y + B * z)] = leaf[x + L * (y + L * z)];
+				else
+					block[x + B * (y + B * z)] = field.value(std::min(origin.x + x, N.x - 1), std::min(origin.y + y, N.y - 1), std::min(origin.z + z, N.z - 1));
+			}
+		}
+	}
+}
+
+void compute_sparse_gradient(sparse_volume_structure<vec3>& gradient, sparse_volume_structure<float> const& field, thread_pool_structure& thread_pool)
+{
+	int const L = sparse_volume_structure<float>::leaf_size;
+	int const B = L + 1;
+	int3 const N = field.dimension;
+
+	gradient.resize(N, vec3{ 0,0,0 });
+	for (cgp::int3 const& origin : field.leaf_origin)
+		gradient.allocate(origin.x / L, origin.y / L, origin.z / L);
+
+	// Same finite differences as compute_gradient, the next samples being read in the block of the cells of the leaf
+	thread_pool.parallel_for(int(gradient.number_of_leaves()), 4, [&](int leaf_begin, int leaf_end) {
+		std::vector<float> block(B * B * B);
+		for (int index = leaf_begin; index < leaf_end; ++index) {
+			gather_leaf_cells(block.data(), field, index);
+			int3 const origin = gradient.leaf_origin[index];
+			gradient.for_each_active(index, index + 1, [&](int3 const& k, vec3& g) {
+				float const* b = block.data() + (k.x - origin.x) + B * ((k.y - origin.y) + B * (k.z - origin.z));
+				float const f = b[0];
+				g.x = k.x != N.x - 1 ? b[1] - f : f - (k.x > origin.x ? b[-1] : field.value(k.x - 1, k.y, k.z));
+				g.y = k.y != N.y - 1 ? b[B] - f : f - (k.y > origin.y ? b[-B] : field.value(k.x, k.y - 1, k.z));
+				g.z = k.z != N.z - 1 ? b[B * B] - f : f - (k.z > origin.z ? b[-B * B] : field.value(k.x, k.y, k.z - 1));
+			});
+		}
+	});
+}
+
+
+namespace {
+	// Vertices found in a chunk of leaves
+	struct sparse_chunk_vertices {
+		std::vector<vec3> position;
+		std::vector<vec3> normal;
+	};
+}
+
+void sparse_marching_cube(std::vector<vec3>& position, std::vector<vec3>& normal, std::vector<uint3>& triangles,
+	sparse_volume_structure<float> const& field, sparse_volume_structure<vec3> const& gradient, spatial_domain_grid_3D const& domain,
+	float isovalue, thread_pool_structure& thread_pool)
+{
+	marching_cube_table_structure const& table = marching_cube_table();
+	int const L = sparse_volume_structure<float>::leaf_size;
+	int const B = L + 1;
+	int const edges_per_leaf = 3 * sparse_volume_structure<float>::leaf_samples;
+	int3 const N = field.dimension;
+	vec3 const p0 = domain.position({ 0, 0, 0 });
+	vec3 const step = domain.position({ 1, 1, 1 }) - p0;
+
+	// The samples of a cell crossed by the isovalue are all in leaves when the bounds are strict: the bounds of the slot of
+	//  each corner (extended by the margin) contain the values of the whole cell. A vertex is created by the leaf of the lower sample of its edge.
+	int const chunk_size = 16;
+	int const number_of_leaves = int(field.number_of_leaves());
+	int const number_of_chunks = (number_of_leaves + chunk_size - 1) / chunk_size;
+	std::vector<int> edge_vertex(size_t(number_of_leaves) * edges_per_leaf, -1); // Index of the vertex of each edge in its leaf
+	std::vector<int> leaf_vertices(number_of_leaves, 0);
+	std::vector<char> crossed(number_of_leaves, 0);
+	std::vector<sparse_chunk_vertices> chunk_vertices(number_of_chunks);
+	thread_pool.parallel_for(number_of_leaves, chunk_size, [&](int leaf_begin, int leaf_end) {
+		std::vector<float> block(B * B * B);
+		for (int index = leaf_begin; index < leaf_end; ++index) {
+			sparse_chunk_vertices& chunk = chunk_vertices[index / chunk_size];
+			int3 const origin = field.leaf_origin[index];
+			gather_leaf_cells(block.data(), field, index);
+
+			// Leaves of the band whose cells are all on the same side of the isovalue
+			auto const range = std::minmax_element(block.begin(), block.end());
+			crossed[index] = *range.first <= isovalue && *range.second > isovalue;
+			if (!crossed[index])
+				continue;
+
+			int* edges = edge_vertex.data() + size_t(index) * edges_per_leaf;
+			int count = 0;
+			for (int z = origin.z; z < std::min(origin.z + L, N.z); ++z) {
+				for (int y = origin.y; y < std::min(origin.y + L, N.y); ++y) {
+					for (int x = origin.x; x < std::min(origin.x + L, N.x); ++x) {
+						int const s[3] = { x, y, z };
+						int const local[3] = { x - origin.x, y - origin.y, z - origin.z };
+						int const local_index = local[0] + L * (local[1] + L * local[2]);
+						float const* b = block.data() + local[0] + B * (local[1] + B * local[2]);
+						float const v0 = b[0];
+						for (int axis = 0; axis < 3; ++axis) {
+							if (s[axis] + 1 >= N[axis])
+								continue;
+							int3 k1 = { x, y, z };
+							k1[axis] += 1;
+							float const v1 = b[axis == 0 ? 1 : (axis == 1 ? B : B * B)];
+							if ((v0 > isovalue) == (v1 > isovalue))
+								continue;
+
+							float const alpha = (isovalue - v0) / (v1 - v0);
+							vec3 const q0 = p0 + step * vec3(float(x), float(y), float(z));
+							vec3 q1 = q0;
+							q1[axis] += step[axis];
+							vec3 const n0 = gradient.value(x, y, z);
+							vec3 const n1 = gradient.value(k1.x, k1.y, k1.z);
+
+							edges[3 * local_index + axis] = count++;
+							chunk.position.push_back(q0 + alpha * (q1 - q0));
+							chunk.normal.push_back(-normalize((1 - alpha) * n0 + alpha * n1, { 1,0,0 }));
+						}
+					}
+				}
+			}
+			leaf_vertices[index] = count;
+		}
+	});
+
+	// Vertices ordered by leaf
+	std::vector<size_t> vertex_offset(number_of_leaves + 1, 0);
+	for (int index = 0; index < number_of_leaves; ++index)
+		vertex_offset[index + 1] = vertex_offset[index] + leaf_vertices[index];
+	position.clear();
+	normal.clear();
+	position.reserve(vertex_offset[number_of_leaves]);
+	normal.reserve(vertex_offset[number_of_leaves]);
+	for (sparse_chunk_vertices const& chunk : chunk_vertices) {
+		position.insert(position.end(), chunk.position.begin(), chunk.position.end());
+		normal.insert(normal.end(), chunk.normal.begin(), chunk.normal.end());
+	}
+
+	// Index of the vertex on the edge starting at the sample k along axis (false if the sample is in a tile)
+	//  The bounds of the noise are not strict: a cell of a leaf can have a corner in a tile whose value is on the other
+	//  side of the isovalue than its neighbors. Such an edge has no vertex, and its triangles are skipped.
+	auto vertex_index = [&](int3 const& k, int axis, unsigned& id) {
+		int const leaf = field.slots[k.x / L + size_t(field.slots_dimension.x) * (k.y / L + size_t(field.slots_dimension.y) * (k.z / L))].leaf;
+		if (leaf < 0)
+			return false;
+		int const local_index = k.x % L + L * (k.y % L + L * (k.z % L));
+		int const vertex = edge_vertex[size_t(leaf) * edges_per_leaf + 3 * local_index + axis];
+		assert_cgp(vertex >= 0, "A crossed edge whose lower sample is in a leaf must have a vertex");
+		id = unsigned(vertex_offset[leaf] + vertex);
+		return true;
+	};
+
+	// Triangles of the cells whose lower corner is in a leaf (the other cells have their 8 corners in tiles)
+	std::vector<std::vector<uint3>> chunk_triangles(number_of_chunks);
+	std::vector<int> chunk_skipped(number_of_chunks, 0);
+	thread_pool.parallel_for(number_of_leaves, chunk_size, [&](int leaf_begin, int leaf_end) {
+		std::vector<float> block(B * B * B);
+		for (int index = leaf_begin; index < leaf_end; ++index) {
+			if (!crossed[index])
+				continue;
+			std::vector<uint3>& output = chunk_triangles[index / chunk_size];
+			int3 const origin = field.leaf_origin[index];
+			gather_leaf_cells(block.data(), field, index);
+			for (int z = origin.z; z < std::min(origin.z + L, N.z - 1); ++z) {
+				for (int y = origin.y; y < std::min(origin.y + L, N.y - 1); ++y) {
+					for (int x = origin.x; x < std::min(origin.x + L, N.x - 1); ++x) {
+						float const* b = block.data() + (x - origin.x) + B * ((y - origin.y) + B * (z - origin.z));
+						float v[8];
+						for (int c = 0; c < 8; ++c)
+							v[c] = b[(c & 1) + B * (((c >> 1) & 1) + B * ((c >> 2) & 1))];
+
+						int configuration = 0;
+						for (int c = 0; c < 8; ++c)
+							configuration |= (v[c] > isovalue) << c;
+						if (configuration == 0 || configuration == 255)
+							continue;
+
+						signed char const* t = table.triangles[configuration];
+						for (int k = 0; t[k] != -1; k += 3) {
+							unsigned id[3];
+							bool valid = true;
+							for (int i = 0; i < 3; ++i) {
+								int const c0 = table.corners[t[k + i]][0];
+								valid = valid && vertex_index({ x + (c0 & 1), y + ((c0 >> 1) & 1), z + ((c0 >> 2) & 1) }, t[k + i] / 4, id[i]);
+							}
+							if (valid)
+								output.push_back({ id[0], id[1], id[2] });
+							else
+								chunk_skipped[index / chunk_size]++;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	triangles.clear();
+	for (std::vector<uint3> const& chunk : chunk_triangles)
+		triangles.insert(triangles.end(), chunk.begin(), chunk.end());
+
+	int skipped = 0;
+	for (int count : chunk_skipped)
+		skipped += count;
+	if (skipped > 0)
+		std::cout << "Sparse marching cube: " << skipped << " triangles skipped (the bounds of the function missed the isovalue in some tiles)" << std::endl;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "../thread_pool/thread_pool.hpp"
+#include "../implicit_surface/field_function.hpp"
+
+// Sparse volume: the samples are only stored in the leaves of 8^3 samples that are allocated
+// ********************************************** //
+//  Two levels: a dense array of slots covering the grid (one slot per 8^3 samples), and the leaves allocated on demand
+//  in a pool (contiguous array of 512 samples per leaf, along x, then y, then z in the leaf). A slot without a leaf is a
+//  tile of constant value, initially the background value.
+//  The field is only evaluated in a narrow band around the surface: the tiles inside and outside the surface keep a value
+//  on the correct side of the isovalue, and the memory is proportional to the area of the surface instead of the volume.
+
+template <typename T>
+struct sparse_volume_structure {
+	static int const leaf_size = 8;
+	static int const leaf_samples = leaf_size * leaf_size * leaf_size;
+
+	struct slot {
+		int32_t leaf = -1;  // Index of the leaf in the pool (-1: tile)
+		T value;            // Value of the samples of a tile
+	};
+
+	cgp::int3 dimension = { 0,0,0 };       // Number of samples along each axis
+	cgp::int3 slots_dimension = { 0,0,0 }; // Number of slots along each axis
+	std::vector<slot> slots;
+	std::vector<cgp::int3> leaf_origin;    // First sample of each leaf
+	std::vector<T> pool;                   // Samples of the leaves
+
+	// Release the leaves: all the slots become tiles of the background value
+	void resize(cgp::int3 const& dimension, T const& background);
+
+	// Leaf of the slot (sx, sy, sz), allocated if needed with the value of the tile
+	int allocate(int sx, int sy, int sz);
+
+	// Value at the sample (x, y, z): from its leaf, or the value of its tile
+	T value(int x, int y, int z) const;
+
+	T* leaf(int index) { return pool.data() + size_t(index) * leaf_samples; }
+	T const* leaf(int index) const { return pool.data() + size_t(index) * leaf_samples; }
+	size_t number_of_leaves() const { return leaf_origin.size(); }
+	size_t memory() const { return slots.size() * sizeof(slot) + leaf_origin.size() * sizeof(cgp::int3) + pool.size() * sizeof(T); }
+
+	// Call f(k, value) for the samples k of the leaves [leaf_begin, leaf_end[ that are inside the grid (the tiles are skipped)
+	template <typename F> void for_each_active(int leaf_begin, int leaf_end, F const& f);
+	template <typename F> void for_each_active(F const& f) { for_each_active(0, int(number_of_leaves()), f); }
+};
+
+
+// Narrow band of the function: a leaf is allocated where the bounds of the function over its samples and two samples
+//  around contain the isovalue, such that the cells crossed by the surface and their finite differences only use leaves.
+//  The other slots are tiles of the bound on the side of the isovalue. gradient (if not null, and when the function has
+//  an analytic gradient) receives the analytic gradient in the same leaves.
+void compute_sparse_field(sparse_volume_structure<float>& field, sparse_volume_structure<cgp::vec3>* gradient, cgp::spatial_domain_grid_3D const& domain,
+	field_function_structure const& function, float isovalue, thread_pool_structure& thread_pool);
+
+// Finite differences of the field (as compute_gradient) in the same leaves as the field
+void compute_sparse_gradient(sparse_volume_structure<cgp::vec3>& gradient, sparse_volume_structure<float> const& field, thread_pool_structure& thread_pool);
+
+// Marching cube over the cells of the leaves: an indexed mesh with a single vertex per crossed edge of the grid
+//  The triangles are the ones of marching_cube_table(), and the normals are interpolated from the gradient.
+void sparse_marching_cube(std::vector<cgp::vec3>& position, std::vector<cgp::vec3>& normal, std::vector<cgp::uint3>& triangles,
+	sparse_volume_structure<float> const& field, sparse_volume_structure<cgp::vec3> const& gradient, cgp::spatial_domain_grid_3D const& domain,
+	float isovalue, thread_pool_structure& thread_pool);
+
+
+
+
+template <typename T>
+void sparse_volume_structure<T>::resize(cgp::int3 const& dimension_arg, T const& background)
+{
+	dimension = dimension_arg;
+	slots_dimension = { (dimension.x + leaf_size - 1) / leaf_size, (dimension.y + leaf_size - 1) / leaf_size, (dimension.z + leaf_size - 1) / leaf_size };
+	slot tile;
+	tile.value = background;
+	slots.assign(size_t(slots_dimension.x) * slots_dimension.y * slots_dimension.z, tile);
+	leaf_origin.clear();
+	pool.clear();
+}
+
+template <typename T>
+int sparse_volume_structure<T>::allocate(int sx, int sy, int sz)
+{
+	slot& s = slots[sx + size_t(slots_dimension.x) * (sy + size_t(slots_dimension.y) * sz)];
+	if (s.leaf < 0) {
+		s.leaf = int32_t(leaf_origin.size());
+		leaf_origin.push_back({ sx * leaf_size, sy * leaf_size, sz * leaf_size });
+		pool.resize(pool.size() + leaf_samples, s.value);
+	}
+	return s.leaf;
+}
+
+template <typename T>
+T sparse_volume_structure<T>::value(int x, int y, int z) const
+{
+	slot const& s = slots[x / leaf_size + size_t(slots_dimension.x) * (y / leaf_size + size_t(slots_dimension.y) * (z / leaf_size))];
+	if (s.leaf < 0)
+		return s.value;
+	return leaf(s.leaf)[x % leaf_size + leaf_size * (y % leaf_size + leaf_size * (z % leaf_size))];
+}
+
+template <typename T>
+template <typename F>
+void sparse_volume_structure<T>::for_each_active(int leaf_begin, int leaf_end, F const& f)
+{
+	for (int index = leaf_begin; index < leaf_end; ++index) {
+		cgp::int3 const origin = leaf_origin[index];
+		T* values = leaf(index);
+		for (int z = 0; z < leaf_size && origin.z + z < dimension.z; ++z)
+			for (int y = 0; y < leaf_size && origin.y + y < dimension.y; ++y)
+				for (int x = 0; x < leaf_size && origin.x + x < dimension.x; ++x)
+					f(cgp::int3{ origin.x + x, origin.y + y, origin.z + z }, values[x + leaf_size * (y + leaf_size * z)]);
+	}
+}
@@ -0,0 +1,693 @@
+#include "obj_loader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cgp;
+
+
+namespace {
+	// Read-only mapping of a whole file
+	struct mapped_file {
+		char const* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int descriptor = -1;
+#endif
+		mapped_file() = default;
+		mapped_file(mapped_file const&) = delete;
+		mapped_file& operator=(mapped_file const&) = delete;
+		~mapped_file();
+		bool open(std::string const& filename);
+	};
+
+	// Elements of a chunk of lines
+	struct obj_chunk {
+		std::vector<vec3> position;
+		std::vector<vec2> uv;
+		std::vector<vec3> normal;
+		std::vector<int> corners;          // Position, uv and normal indices of the corners of the faces (0-based, -1 if absent)
+		std::vector<int> face_size;        // Number of corners of each face
+		std::vector<size_t> relative;      // Entries of corners counted from the first element of the chunk (negative indices in the file)
+		std::vector<size_t> part_face;     // Faces (index in the chunk) starting a new part (usemtl, o or g)
+		std::vector<std::string> part_material; // Material of the new part (empty for o and g: the material doesn't change)
+		std::vector<std::string> mtllib;
+		bool valid = true;
+	};
+
+	// Range of faces of a part
+	struct obj_part_range {
+		size_t face_begin, face_end;
+		std::string material;
+	};
+}
+
+#ifdef _WIN32
+bool mapped_file::open(std::string const& filename)
+{
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+		return false;
+	size = size_t(file_size.QuadPart);
+	if (size == 0)
+		return true;
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return false;
+	data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	return data != nullptr;
+}
+
+mapped_file::~mapped_file()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+#else
+bool mapped_file::open(std::string const& filename)
+{
+	descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+	struct stat status;
+	if (fstat(descriptor, &status) != 0)
+		return false;
+	size = size_t(status.st_size);
+	if (size == 0)
+		return true;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (mapping == MAP_FAILED)
+		return false;
+	data = static_cast<char const*>(mapping);
+	return true;
+}
+
+mapped_file::~mapped_file()
+{
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), size);
+	if (descriptor >= 0)
+		::close(descriptor);
+}
+#endif
+
+
+// Call task(k, thread) for k in [0, N[ on threads threads (including the calling one)
+template <typename F>
+static void parallel_for_threads(int N, int threads, F const& task)
+{
+	std::atomic<int> next(0);
+	auto const worker = [&](int thread) {
+		for (int k = next++; k < N; k = next++)
+			task(k, thread);
+	};
+	std::vector<std::thread> pool;
+	for (int thread = 1; thread < std::min(threads, N); ++thread)
+		pool.emplace_back(worker, thread);
+	worker(0);
+	for (std::thread& t : pool)
+		t.join();
+}
+
+static bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static char const* skip_blank(char const* p, char const* end)
+{
+	while (p < end && is_blank(*p))
+		++p;
+	return p;
+}
+
+// Decimal number (sign, digits, fraction, exponent) starting at p. Return the position after it (p if there is none).
+//  Up to 15 significant digits and a power of ten up to 22, the value is a single correctly rounded operation in double
+//  precision. The other numbers (and inf, nan) are read by strtod.
+static char const* parse_float(char const* p, char const* end, float& value)
+{
+	static double const power_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	char const* s = p;
+	bool const negative = s < end && *s == '-';
+	if (s < end && (*s == '-' || *s == '+'))
+		++s;
+
+	uint64_t mantissa = 0;
+	int significant = 0;   // Digits of the mantissa after the leading zeros
+	int exponent = 0;
+	bool digits = false;
+	for (; s < end && unsigned(*s - '0') < 10; ++s) {
+		digits = true;
+		if (significant < 19) {
+			mantissa = 10 * mantissa + unsigned(*s - '0');
+			significant += mantissa != 0;
+		}
+		else
+			++exponent;
+	}
+	if (s < end && *s == '.') {
+		for (++s; s < end && unsigned(*s - '0') < 10; ++s) {
+			digits = true;
+			if (significant < 19) {
+				mantissa = 10 * mantissa + unsigned(*s - '0');
+				significant += mantissa != 0;
+				--exponent;
+			}
+		}
+	}
+	if (digits && s < end && (*s == 'e' || *s == 'E')) {
+		char const* e = s + 1;
+		bool const negative_exponent = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+'))
+			++e;
+		if (e < end && unsigned(*e - '0') < 10) {
+			int n = 0;
+			for (; e < end && unsigned(*e - '0') < 10; ++e)
+				n = std::min(10 * n + (*e - '0'), 100000);
+			exponent += negative_exponent ? -n : n;
+			s = e;
+		}
+	}
+
+	if (digits && significant <= 15 && exponent >= -22 && exponent <= 22) {
+		double const magnitude = exponent < 0 ? double(mantissa) / power_of_ten[-exponent] : double(mantissa) * power_of_ten[exponent];
+		value = float(negative ? -magnitude : magnitude);
+		return s;
+	}
+
+	// Slow path on a null terminated copy of the token
+	char buffer[128];
+	size_t length = 0;
+	while (p + length < end && length < sizeof(buffer) - 1 && !is_blank(p[length]) && p[length] != '\n' && p[length] != '/')
+		++length;
+	std::memcpy(buffer, p, length);
+	buffer[length] = '\0';
+	char* token_end = nullptr;
+	double const number = std::strtod(buffer, &token_end);
+	if (token_end == buffer)
+		return p;
+	value = float(number);
+	return p + (token_end - buffer);
+}
+
+static char const* parse_int(char const* p, char const* end, int& value, bool& valid)
+{
+	bool const negative = p < end && *p == '-';
+	char const* s = negative ? p + 1 : p;
+	char const* const digits = s;
+	int n = 0;
+	for (; s < end && unsigned(*s - '0') < 10; ++s)
+		n = 10 * n + (*s - '0');
+	valid = s != digits;
+	value = negative ? -n : n;
+	return s;
+}
+
+// Line starting with the keyword followed by a blank
+static bool starts_with(char const* p, char const* end, char const* keyword, size_t length)
+{
+	return size_t(end - p) > length && std::memcmp(p, keyword, length) == 0 && is_blank(p[length]);
+}
+
+// Rest of the line (without the surrounding blanks)
+static std::string line_argument(char const* p, char const* end)
+{
+	p = skip_blank(p, end);
+	while (end > p && is_blank(end[-1]))
+		--end;
+	return std::string(p, end);
+}
+
+// Parse the lines of [begin, end[
+static void parse_chunk(obj_chunk& chunk, char const* begin, char const* end)
+{
+	char const* line = begin;
+	while (line < end) {
+		char const* line_end = static_cast<char const*>(std::memchr(line, '\n', size_t(end - line)));
+		if (line_end == nullptr)
+			line_end = end;
+		char const* p = skip_blank(line, line_end);
+
+		if (p + 1 < line_end && p[0] == 'v' && is_blank(p[1])) {
+			vec3 v = { 0,0,0 };
+			p = skip_blank(p + 2, line_end);
+			for (int k = 0; k < 3; ++k)
+				p = skip_blank(parse_float(p, line_end, v[k]), line_end);
+			chunk.position.push_back(v);
+		}
+		else if (starts_with(p, line_end, "vt", 2)) {
+			vec2 t = { 0,0 };
+			p = skip_blank(p + 3, line_end);
+			for (int k = 0; k < 2; ++k)
+				p = skip_blank(parse_float(p, line_end, t[k]), line_end);
+			chunk.uv.push_back(t);
+		}
+		else if (starts_with(p, line_end, "vn", 2)) {
+			vec3 n = { 0,0,0 };
+			p = skip_blank(p + 3, line_end);
+			for (int k = 0; k < 3; ++k)
+				p = skip_blank(parse_float(p, line_end, n[k]), line_end);
+			chunk.normal.push_back(n);
+		}
+		else if (p + 1 < line_end && p[0] == 'f' && is_blank(p[1])) {
+			int const count[3] = { int(chunk.position.size()), int(chunk.uv.size()), int(chunk.normal.size()) };
+			int corners = 0;
+			p = skip_blank(p + 2, line_end);
+			while (p < line_end) {
+				// Corner v, v/t, v//n or v/t/n
+				int index[3] = { 0, 0, 0 };
+				bool present[3] = { false, false, false };
+				p = parse_int(p, line_end, index[0], present[0]);
+				for (int k = 1; k < 3 && p < line_end && *p == '/'; ++k)
+					p = parse_int(p + 1, line_end, index[k], present[k]);
+				if (!present[0]) {
+					chunk.valid = false;
+					break;
+				}
+				for (int k = 0; k < 3; ++k) {
+					if (!present[k])
+						chunk.corners.push_back(-1);
+					else if (index[k] < 0) {
+						chunk.relative.push_back(chunk.corners.size());
+						chunk.corners.push_back(count[k] + index[k]);
+					}
+					else
+						chunk.corners.push_back(index[k] - 1);
+				}
+				++corners;
+				p = skip_blank(p, line_end);
+			}
+			chunk.face_size.push_back(corners);
+		}
+		else if (starts_with(p, line_end, "usemtl", 6)) {
+			chunk.part_face.push_back(chunk.face_size.size());
+			chunk.part_material.push_back(line_argument(p + 6, line_end));
+		}
+		else if (p + 1 < line_end && (p[0] == 'o' || p[0] == 'g') && is_blank(p[1])) {
+			chunk.part_face.push_back(chunk.face_size.size());
+			chunk.part_material.push_back("");
+		}
+		else if (starts_with(p, line_end, "mtllib", 6))
+			chunk.mtllib.push_back(line_argument(p + 6, line_end));
+
+		line = line_end + 1;
+	}
+}
+
+// Materials of an mtl file (the file is small: it is read sequentially)
+static void load_materials(std::vector<obj_material>& materials, std::string const& filename)
+{
+	std::ifstream stream(filename);
+	if (!stream.is_open()) {
+		std::cout << "Cannot open the material file " << filename << std::endl;
+		return;
+	}
+	std::string line;
+	while (std::getline(stream, line)) {
+		char const* begin = line.data();
+		char const* end = begin + line.size();
+		char const* p = skip_blank(begin, end);
+		if (starts_with(p, end, "newmtl", 6)) {
+			materials.push_back(obj_material());
+			materials.back().name = line_argument(p + 6, end);
+		}
+		else if (materials.empty())
+			continue;
+		else if (starts_with(p, end, "Kd", 2)) {
+			vec3& color = materials.back().color_diffuse;
+			p = skip_blank(p + 3, end);
+			for (int k = 0; k < 3; ++k)
+				p = skip_blank(parse_float(p, end, color[k]), end);
+		}
+		else if (starts_with(p, end, "map_Kd", 6)) {
+			// The file name is the last argument (after the options)
+			std::string const argument = line_argument(p + 6, end);
+			size_t const last = argument.find_last_of(" \t");
+			materials.back().texture_diffuse = last == std::string::npos ? argument : argument.substr(last + 1);
+		}
+	}
+}
+
+// Vertices (distinct triplets position/uv/normal in their order of first use) and fan triangles of the faces [face_begin, face_end[
+//  vertex_of_position and stamp are buffers of the calling thread (one entry per position of the model).
+static bool build_part_mesh(mesh& m, obj_chunk const& model, std::vector<size_t> const& face_corner, size_t face_begin, size_t face_end, int stamp_value,
+	std::vector<int>& vertex_of_position, std::vector<int>& stamp)
+{
+	int const number_of_positions = int(model.position.size());
+	int const number_of_uv = int(model.uv.size());
+	int const number_of_normals = int(model.normal.size());
+
+	std::vector<int> triplet;                       // Position, uv and normal indices of each vertex
+	std::map<std::tuple<int, int, int>, int> other; // Vertices sharing a position with the first one but with another uv or normal
+	std::vector<int> face_vertex;
+	m.connectivity.data.clear();
+	bool has_uv = false, has_normal = true;
+
+	for (size_t face = face_begin; face < face_end; ++face) {
+		int const* corners = model.corners.data() + 3 * face_corner[face];
+		face_vertex.clear();
+		for (int c = 0; c < model.face_size[face]; ++c) {
+			int const p = corners[3 * c], t = corners[3 * c + 1], n = corners[3 * c + 2];
+			if (p < 0 || p >= number_of_positions || t >= number_of_uv || n >= number_of_normals || t < -1 || n < -1)
+				return false;
+			has_uv = has_uv || t >= 0;
+			has_normal = has_normal && n >= 0;
+
+			int vertex;
+			if (stamp[p] != stamp_value) {
+				stamp[p] = stamp_value;
+				vertex = vertex_of_position[p] = int(triplet.size() / 3);
+				triplet.insert(triplet.end(), { p, t, n });
+			}
+			else if (triplet[3 * vertex_of_position[p] + 1] == t && triplet[3 * vertex_of_position[p] + 2] == n)
+				vertex = vertex_of_position[p];
+			else {
+				auto const it = other.insert({ std::make_tuple(p, t, n), int(triplet.size() / 3) });
+				vertex = it.first->second;
+				if (it.second)
+					triplet.insert(triplet.end(), { p, t, n });
+			}
+			face_vertex.push_back(vertex);
+		}
+		for (size_t k = 1; k + 1 < face_vertex.size(); ++k)
+			m.connectivity.data.push_back(uint3{ unsigned(face_vertex[0]), unsigned(face_vertex[k]), unsigned(face_vertex[k + 1]) });
+	}
+
+	size_t const N = triplet.size() / 3;
+	m.position.data.resize(N);
+	m.uv.data.resize(has_uv ? N : 0);
+	m.normal.data.resize(has_normal ? N : 0);
+	for (size_t k = 0; k < N; ++k) {
+		m.position.data[k] = model.position[triplet[3 * k]];
+		if (has_uv)
+			m.uv.data[k] = triplet[3 * k + 1] >= 0 ? model.uv[triplet[3 * k + 1]] : vec2{ 0,0 };
+		if (has_normal)
+			m.normal.data[k] = model.normal[triplet[3 * k + 2]];
+	}
+	// Missing normals are computed from the triangles
+	m.fill_empty_field();
+	return true;
+}
+
+// Load the model, split into parts or as a single part
+static bool obj_load(obj_model& model, std::string const& path, std::string const& filename, bool split_parts, int threads, obj_load_statistics* statistics)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+#ifdef __EMSCRIPTEN__
+	threads = 1;
+#else
+	if (threads <= 0)
+		threads = std::max(1, int(std::thread::hardware_concurrency()));
+#endif
+	model = obj_model();
+
+	mapped_file file;
+	if (!file.open(path + filename)) {
+		std::cout << "Cannot read the obj file " << path + filename << std::endl;
+		return false;
+	}
+
+	// Chunks of about 256 kB, ending after a line break
+	size_t const chunk_size = 256 * 1024;
+	int const number_of_chunks = int(std::max(size_t(1), std::min(file.size / chunk_size, size_t(64 * threads))));
+	std::vector<char const*> boundary(number_of_chunks + 1, file.data);
+	for (int k = 1; k < number_of_chunks; ++k) {
+		char const* p = file.data + file.size * k / number_of_chunks;
+		char const* line_end = static_cast<char const*>(std::memchr(p, '\n', size_t(file.data + file.size - p)));
+		boundary[k] = std::max(boundary[k - 1], line_end == nullptr ? file.data + file.size : line_end + 1);
+	}
+	boundary[number_of_chunks] = file.data + file.size;
+
+	std::vector<obj_chunk> chunks(number_of_chunks);
+	parallel_for_threads(number_of_chunks, threads, [&](int k, int) {
+		parse_chunk(chunks[k], boundary[k], boundary[k + 1]);
+	});
+	auto const time_parse = std::chrono::steady_clock::now();
+
+	// Offsets of the elements of each chunk (prefix sum), then copy at their final place
+	struct chunk_offset { size_t position = 0, uv = 0, normal = 0, corner = 0, face = 0; };
+	std::vector<chunk_offset> offset(number_of_chunks + 1);
+	for (int k = 0; k < number_of_chunks; ++k) {
+		if (!chunks[k].valid) {
+			std::cout << "Invalid face in the obj file " << path + filename << std::endl;
+			return false;
+		}
+		offset[k + 1].position = offset[k].position + chunks[k].position.size();
+		offset[k + 1].uv = offset[k].uv + chunks[k].uv.size();
+		offset[k + 1].normal = offset[k].normal + chunks[k].normal.size();
+		offset[k + 1].corner = offset[k].corner + chunks[k].corners.size() / 3;
+		offset[k + 1].face = offset[k].face + chunks[k].face_size.size();
+	}
+
+	obj_chunk all;
+	chunk_offset const& total = offset[number_of_chunks];
+	all.position.resize(total.position);
+	all.uv.resize(total.uv);
+	all.normal.resize(total.normal);
+	all.corners.resize(3 * total.corner);
+	all.face_size.resize(total.face);
+	std::vector<size_t> face_corner(total.face);   // First corner of each face
+	parallel_for_threads(number_of_chunks, threads, [&](int k, int) {
+		obj_chunk& chunk = chunks[k];
+		chunk_offset const& o = offset[k];
+		for (size_t e : chunk.relative)
+			chunk.corners[e] += int(e % 3 == 0 ? o.position : (e % 3 == 1 ? o.uv : o.normal));
+		std::copy(chunk.position.begin(), chunk.position.end(), all.position.begin() + o.position);
+		std::copy(chunk.uv.begin(), chunk.uv.end(), all.uv.begin() + o.uv);
+		std::copy(chunk.normal.begin(), chunk.normal.end(), all.normal.begin() + o.normal);
+		std::copy(chunk.corners.begin(), chunk.corners.end(), all.corners.begin() + 3 * o.corner);
+		std::copy(chunk.face_size.begin(), chunk.face_size.end(), all.face_size.begin() + o.face);
+		size_t corner = o.corner;
+		for (size_t f = 0; f < chunk.face_size.size(); ++f) {
+			face_corner[o.face + f] = corner;
+			corner += chunk.face_size[f];
+		}
+	});
+
+	// Parts between the usemtl, o and g lines (the empty ones are skipped)
+	std::vector<obj_part_range> ranges;
+	std::string material;
+	size_t part_begin = 0;
+	std::vector<std::string> mtllib;
+	for (int k = 0; k < number_of_chunks; ++k) {
+		obj_chunk const& chunk = chunks[k];
+		for (size_t e = 0; e < chunk.part_face.size(); ++e) {
+			size_t const face = offset[k].face + chunk.part_face[e];
+			if (face > part_begin)
+				ranges.push_back({ part_begin, face, material });
+			part_begin = face;
+			if (!chunk.part_material[e].empty())
+				material = chunk.part_material[e];
+		}
+		mtllib.insert(mtllib.end(), chunk.mtllib.begin(), chunk.mtllib.end());
+	}
+	if (total.face > part_begin)
+		ranges.push_back({ part_begin, total.face, material });
+	if (!split_parts)
+		ranges.assign(1, { 0, total.face, ranges.empty() ? std::string() : ranges[0].material });
+	chunks.clear();
+	auto const time_merge = std::chrono::steady_clock::now();
+
+	if (split_parts)
+		for (std::string const& library : mtllib)
+			load_materials(model.materials, path + library);
+
+	// Meshes of the parts (each thread has its own table from the positions to the vertices of the current part)
+	model.parts.resize(ranges.size());
+	std::vector<std::vector<int>> vertex_of_position(threads), stamp(threads);
+	std::atomic<bool> valid(true);
+	parallel_for_threads(int(ranges.size()), threads, [&](int k, int thread) {
+		if (stamp[thread].empty()) {
+			vertex_of_position[thread].resize(all.position.size());
+			stamp[thread].assign(all.position.size(), -1);
+		}
+		if (!build_part_mesh(model.parts[k].geometry, all, face_corner, ranges[k].face_begin, ranges[k].face_end, k, vertex_of_position[thread], stamp[thread]))
+			valid = false;
+		for (size_t m = 0; m < model.materials.size(); ++m)
+			if (model.materials[m].name == ranges[k].material)
+				model.parts[k].material = int(m);
+	});
+	if (!valid) {
+		std::cout << "Index out of range in the obj file " << path + filename << std::endl;
+		model = obj_model();
+		return false;
+	}
+	auto const time_mesh = std::chrono::steady_clock::now();
+
+	if (statistics != nullptr) {
+		statistics->bytes = file.size;
+		statistics->threads = threads;
+		statistics->time_parse = std::chrono::duration<float, std::milli>(time_parse - time_start).count();
+		statistics->time_merge = std::chrono::duration<float, std::milli>(time_merge - time_parse).count();
+		statistics->time_mesh = std::chrono::duration<float, std::milli>(time_mesh - time_merge).count();
+		statistics->time_total = std::chrono::duration<float, std::milli>(time_mesh - time_start).count();
+	}
+	return true;
+}
+
+bool obj_load_parallel(obj_model& model, std::string const& path, std::string const& filename, int threads, obj_load_statistics* statistics)
+{
+	return obj_load(model, path, filename, true, threads, statistics);
+}
+
+mesh obj_load_parallel_mesh(std::string const& filename, int threads)
+{
+	obj_model model;
+	if (!obj_load(model, "", filename, false, threads, nullptr) || model.parts.empty())
+		return mesh();
+	return model.parts[0].geometry;
+}
+
+obj_model obj_merge_by_material(obj_model const& model)
+{
+	// Order of the materials: by texture file, then by name (-1, without material, first)
+	std::vector<int> order;
+	for (int m = -1; m < int(model.materials.size()); ++m)
+		order.push_back(m);
+	auto const key = [&](int m) {
+		return m < 0 ? std::make_tuple(0, std::string(), std::string()) : std::make_tuple(1, model.materials[m].texture_diffuse, model.materials[m].name);
+	};
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return key(a) < key(b); });
+
+	std::vector<int> parts_of_material(model.materials.size() + 1, 0);
+	for (obj_part const& part : model.parts)
+		parts_of_material[part.material + 1]++;
+
+	obj_model merged;
+	merged.materials = model.materials;
+	for (int m : order) {
+		if (parts_of_material[m + 1] == 0)
+			continue;
+		obj_part batch;
+		batch.material = m;
+		for (obj_part const& part : model.parts)
+			if (part.material == m)
+				batch.geometry.push_back(part.geometry);
+		merged.parts.push_back(batch);
+	}
+	return merged;
+}
+
+std::vector<mesh_drawable> obj_convert_to_mesh_drawable(obj_model const& model, std::string const& path, obj_texture_cache* textures_arg)
+{
+	std::vector<mesh_drawable> drawables(model.parts.size());
+	obj_texture_cache textures_local;
+	obj_texture_cache& textures = textures_arg != nullptr ? *textures_arg : textures_local;
+	for (size_t k = 0; k < model.parts.size(); ++k) {
+		obj_part const& part = model.parts[k];
+		drawables[k].initialize_data_on_gpu(part.geometry);
+		if (part.material < 0)
+			continue;
+		obj_material const& material = model.materials[part.material];
+		drawables[k].name = material.name;
+		drawables[k].material.color = material.color_diffuse;
+		if (material.texture_diffuse.empty())
+			continue;
+
+		auto it = textures.find(material.texture_diffuse);
+		if (it == textures.end()) {
+			opengl_texture_image_structure texture;
+			if (std::ifstream(path + material.texture_diffuse).good())
+				texture.load_and_initialize_texture_2d_on_gpu(path + material.texture_diffuse, GL_REPEAT, GL_REPEAT);
+			it = textures.insert({ material.texture_diffuse, texture }).first;
+		}
+		if (it->second.id != 0) {
+			drawables[k].material.color = { 1,1,1 };
+			drawables[k].texture = it->second;
+		}
+	}
+	return drawables;
+}
+
+
+// Triangles as triplets of positions, starting with the smallest vertex (same orientation), sorted
+static std::vector<std::array<float, 9>> sorted_triangles(mesh const& m)
+{
+	std::vector<std::array<float, 9>> triangles;
+	for (uint3 const& f : m.connectivity) {
+		std::array<vec3, 3> const p = { m.position[f[0]], m.position[f[1]], m.position[f[2]] };
+		auto const less = [](vec3 const& a, vec3 const& b) { return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z); };
+		int first = 0;
+		for (int k = 1; k < 3; ++k)
+			if (less(p[k], p[first]))
+				first = k;
+		std::array<float, 9> t;
+		for (int k = 0; k < 3; ++k)
+			for (int c = 0; c < 3; ++c)
+				t[3 * k + c] = p[(first + k) % 3][c];
+		triangles.push_back(t);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+// Best time of a few runs (ms)
+template <typename F>
+static float best_time(F const& f)
+{
+	float best = 0.0f;
+	for (int run = 0; run < 3; ++run) {
+		auto const time_start = std::chrono::steady_clock::now();
+		f();
+		float const time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+		best = run == 0 ? time : std::min(best, time);
+	}
+	return best;
+}
+
+void obj_loader_benchmark(std::string const& path, std::string const& filename)
+{
+	std::string const file = path + filename;
+	float const time_advanced = best_time([&]() { mesh_load_file_obj_advanced(path, filename); });
+	mesh reference;
+	float const time_reference = best_time([&]() { reference = mesh_load_file_obj(file); });
+
+	obj_model model;
+	obj_load_statistics statistics_single, statistics;
+	float const time_single = best_time([&]() { obj_load_parallel(model, path, filename, 1, &statistics_single); });
+	float const time_parallel = best_time([&]() { obj_load_parallel(model, path, filename, 0, &statistics); });
+	mesh parallel_mesh;
+	float const time_mesh = best_time([&]() { parallel_mesh = obj_load_parallel_mesh(file); });
+
+	std::cout << "Loading of " << file << " (" << statistics.bytes / (1024 * 1024.0f) << " MB), best of 3 runs" << std::endl;
+	std::cout << "  mesh_load_file_obj_advanced:     " << time_advanced << " ms" << std::endl;
+	std::cout << "  mesh_load_file_obj:              " << time_reference << " ms" << std::endl;
+	std::cout << "  obj_load_parallel, 1 thread:     " << time_single << " ms (parse " << statistics_single.time_parse << ", merge " << statistics_single.time_merge << ", meshes " << statistics_single.time_mesh << ")" << std::endl;
+	std::cout << "  obj_load_parallel, " << statistics.threads << " threads:    " << time_parallel << " ms (parse " << statistics.time_parse << ", merge " << statistics.time_merge << ", meshes " << statistics.time_mesh << ")" << std::endl;
+	std::cout << "  obj_load_parallel_mesh:          " << time_mesh << " ms" << std::endl;
+	std::cout << "  speedup over mesh_load_file_obj_advanced: " << time_advanced / std::max(time_parallel, 1e-3f) << "x, over mesh_load_file_obj: " << time_reference / std::max(time_mesh, 1e-3f) << "x" << std::endl;
+
+	std::vector<std::array<float, 9>> const a = sorted_triangles(reference);
+	std::vector<std::array<float, 9>> const b = sorted_triangles(parallel_mesh);
+	std::cout << "  " << model.parts.size() << " parts, " << parallel_mesh.position.size() << " vertices, " << b.size() << " triangles (mesh_load_file_obj: "
+		<< reference.position.size() << " vertices, " << a.size() << " triangles): " << (a == b ? "same triangles" : "different triangles") << std::endl;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+#include <map>
+
+// Loader of obj files parsed in parallel from a memory mapped file
+// ********************************************** //
+//  The file is mapped in memory and split into chunks that end on a line break. Each thread parses its chunks (numbers
+//  read directly from the mapping, without iostream), then the counts of the chunks are accumulated (prefix sum) to
+//  copy their elements at their final place and to resolve the relative (negative) indices.
+//  The model is split into parts at each usemtl, o and g line. The vertices of a part are its distinct triplets
+//  position/uv/normal in their order of first use, and the polygons are triangulated as fans.
+//  The materials (diffuse color and texture) are read from the mtllib files.
+
+struct obj_material {
+	std::string name;
+	cgp::vec3 color_diffuse = { 1,1,1 }; // Kd
+	std::string texture_diffuse;         // map_Kd, relative to the directory of the obj file (empty if none)
+};
+
+struct obj_part {
+	cgp::mesh geometry;
+	int material = -1;                   // Index in obj_model::materials (-1 if none)
+};
+
+struct obj_model {
+	std::vector<obj_part> parts;
+	std::vector<obj_material> materials;
+};
+
+struct obj_load_statistics {
+	size_t bytes = 0;
+	int threads = 0;
+	float time_parse = 0.0f;             // Mapping of the file and parsing of the chunks (ms)
+	float time_merge = 0.0f;             // Prefix sum and copy of the elements at their final place (ms)
+	float time_mesh = 0.0f;              // Vertices, triangles and normals of the parts (ms)
+	float time_total = 0.0f;
+};
+
+// Load the model path + filename, using threads threads (0: all the hardware threads). Return false if the file cannot be read.
+bool obj_load_parallel(obj_model& model, std::string const& path, std::string const& filename, int threads = 0, obj_load_statistics* statistics = nullptr);
+
+// Whole model as a single mesh (same convention as the parts)
+cgp::mesh obj_load_parallel_mesh(std::string const& filename, int threads = 0);
+
+// Model with a single part per material: the parts sharing a material are merged into one mesh (one vertex and index
+//  buffer), and the parts are sorted by texture (then by material) such that consecutive draws use the same texture.
+obj_model obj_merge_by_material(obj_model const& model);
+
+// Textures already loaded, by file (relative to the directory of the obj file)
+using obj_texture_cache = std::map<std::string, cgp::opengl_texture_image_structure>;
+
+// One mesh_drawable per part, with the color and texture of its material. Each texture file is loaded once and shared,
+//  also with the previous conversions that used the same textures (if not null).
+std::vector<cgp::mesh_drawable> obj_convert_to_mesh_drawable(obj_model const& model, std::string const& path, obj_texture_cache* textures = nullptr);
+
+// Compare the load times of path + filename with the cgp loaders (mesh_load_file_obj_advanced and mesh_load_file_obj) and
+//  with the parallel loader on 1 thread and on all threads, and check that the triangles are the same as mesh_load_file_obj.
+//  The results are written on the command line.
+void obj_loader_benchmark(std::string const& path, std::string const& filename);
@@ -1,5 +1,7 @@
 #include "scene.hpp"
 
+#include <chrono>
+
 using namespace cgp;
 
 
@@ -21,9 +23,15 @@ void scene_structure::initialize()
 
 	
 	// Unzip the files in assets/ before runing the code
-	//auto struct_shape = mesh_load_file_obj_advanced(project::path + "assets/f1/", "F1GenV3Backup.obj");
-	auto struct_shape = mesh_load_file_obj_advanced(project::path + "assets/sponza/", "sponza.obj");
-	shapes = mesh_obj_advanced_loader::convert_to_mesh_drawable(struct_shape);
+	//  The obj file is parsed in parallel from a memory mapping (see obj_loader/)
+	obj_load_statistics statistics;
+	obj_load_parallel(sponza, project::path + "assets/sponza/", "sponza.obj", 0, &statistics);
+	std::cout << "sponza.obj loaded in " << statistics.time_total << " ms (" << sponza.parts.size() << " parts, " << statistics.threads << " threads)" << std::endl;
+
+	// The parts sharing a material are merged, and drawn in the order of their textures
+	//  The drawables of the individual parts are only built if the batching is disabled in the GUI (for the comparison)
+	shapes_batched = obj_convert_to_mesh_drawable(obj_merge_by_material(sponza), project::path + "assets/sponza/", &sponza_textures);
+	std::cout << "Batched by material: " << shapes_batched.size() << " draws instead of " << sponza.parts.size() << std::endl;
 
 }
 
@@ -40,13 +48,19 @@ void scene_structure::display_frame()
 		draw(global_frame, environment);
 
 
-	for (int k = 0; k < shapes.size(); ++k)
-		draw(shapes[k], environment);
+	// Time of the submission of the draw calls (averaged over the frames)
+	auto const time_start = std::chrono::steady_clock::now();
+	std::vector<mesh_drawable> const& model_shapes = gui.batch_by_material ? shapes_batched : shapes;
+	for (int k = 0; k < model_shapes.size(); ++k)
+		draw(model_shapes[k], environment);
 
 	if (gui.display_wireframe) {
-		for (int k = 0; k < shapes.size(); ++k)
-			draw_wireframe(shapes[k], environment);
+		for (int k = 0; k < model_shapes.size(); ++k)
+			draw_wireframe(model_shapes[k], environment);
 	}
+	draw_calls = int(model_shapes.size()) * (gui.display_wireframe ? 2 : 1);
+	float const time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	time_draw = 0.95f * time_draw + 0.05f * time;
 
 
 }
@@ -56,6 +70,14 @@ void scene_structure::display_gui()
 	ImGui::Checkbox("Frame", &gui.display_frame);
 	ImGui::Checkbox("Wireframe", &gui.display_wireframe);
 
+	if (ImGui::Checkbox("Batch by material", &gui.batch_by_material) && !gui.batch_by_material && shapes.empty())
+		shapes = obj_convert_to_mesh_drawable(sponza, project::path + "assets/sponza/", &sponza_textures);
+	ImGui::Text("%d draw calls, submission %.3f ms, frame %.2f ms", draw_calls, time_draw, 1000.0f / ImGui::GetIO().Framerate);
+
+	// Load times of the obj loaders (written on the command line)
+	if (ImGui::Button("Benchmark obj loading"))
+		obj_loader_benchmark(project::path + "assets/sponza/", "sponza.obj");
+
 }
 
 void scene_structure::mouse_move_event()
@@ -86,7 +108,7 @@ void scene_structure::display_info()
 
 	std::cout << "\nSCENE INFO:" << std::endl;
 	std::cout << "-----------------------------------------------" << std::endl;
-	std::cout << "This scene shows an example of load of more advanced obj models using the obj_advanced loader." << std::endl;
-	std::cout << "The advanced loader uses the tinyobj library and can load multiples objects associated to different textures." << std::endl;
+	std::cout << "This scene loads an obj model made of multiple parts with different textures (sponza) using obj_loader." << std::endl;
+	std::cout << "The file is parsed in parallel from a memory mapping, and the parts sharing a material are drawn together." << std::endl;
 	std::cout << "-----------------------------------------------\n" << std::endl;
 }
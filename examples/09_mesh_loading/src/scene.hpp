@@ -3,6 +3,7 @@
 
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
+#include "obj_loader/obj_loader.hpp"
 
 // This definitions allow to use the structures: mesh, mesh_drawable, etc. without mentionning explicitly cgp::
 using cgp::mesh;
@@ -18,6 +19,8 @@ struct gui_parameters {
 
 	int number_of_instances = 500;
 	float scaling_grass = 1.0f;
+
+	bool batch_by_material = true;   // Draw the parts merged by material (shapes_batched) instead of one draw per part (shapes)
 };
 
 // The structure of the custom scene
@@ -48,7 +51,13 @@ struct scene_structure : cgp::scene_inputs_generic {
 	mesh_drawable ground;
 	mesh_drawable grass;
 
-	std::vector<mesh_drawable> shapes;
+	obj_model sponza;                            // Parts of the obj file (kept to build the per-part drawables on demand)
+	obj_texture_cache sponza_textures;           // Textures of sponza, shared by the two sets of drawables
+	std::vector<mesh_drawable> shapes;           // One drawable per part of the obj file (built when the batching is first disabled)
+	std::vector<mesh_drawable> shapes_batched;   // One drawable per material, sorted by texture
+
+	int draw_calls = 0;                          // Number of draw calls of the model at the last frame
+	float time_draw = 0.0f;                      // Average time of the submission of the draw calls of the model (ms)
 
 
 	// ****************************** //
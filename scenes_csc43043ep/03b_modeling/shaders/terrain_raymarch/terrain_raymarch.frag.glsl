@@ -0,0 +1,196 @@
+#version 330 core
+
+// Fragment shader of the ray-marched terrain
+//
+// The terrain is a height field sampled on a N x N grid over [-L/2,L/2]^2, bilinearly interpolated in each cell.
+// A view ray is traced from the camera through the current fragment of the bounding box, and traverses the grid using
+//  a min/max pyramid: at level k, a texel stores the [min,max] heights of a block of 2^k x 2^k cells.
+//  - If the ray stays above the max of the block, the whole block is skipped and the traversal goes to a coarser level.
+//  - Otherwise the block is refined, until reaching a single cell where the exact intersection with the bilinear patch is computed.
+
+in vec3 fragment_position; // position on the bounding box in world space
+
+layout(location=0) out vec4 FragColor;
+
+uniform sampler2D height_texture;  // N x N heights (R32F), texel (i,j) is the height of the grid sample at (x_i, y_j)
+uniform sampler2D minmax_texture;  // [min,max] of the cells (RG32F) - mip level k covers blocks of 2^k x 2^k cells
+uniform sampler2D image_texture;   // Color texture of the terrain mesh
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 light;
+
+uniform int N;                 // Number of samples along each direction
+uniform int levels;            // Number of levels in the min/max pyramid
+uniform float terrain_length;  // Size of the terrain in the (x,y) directions
+uniform vec3 box_min;          // Bounding box of the terrain
+uniform vec3 box_max;
+uniform int max_steps;         // Maximal number of traversal steps for a ray
+
+// Same shading as the terrain mesh (shaders/mesh): Phong model, with the color of the texture at the uv of the mesh
+uniform vec3 color;            // Uniform color of the terrain
+uniform float ambient;
+uniform float diffuse;
+uniform float specular;
+uniform float specular_exponent;
+uniform bool use_texture;
+uniform bool texture_inverse_v;
+uniform float uv_scale;        // uv of the mesh: uv_scale * (x/terrain_length + 1/2, y/terrain_length + 1/2)
+
+float height_at(ivec2 k)
+{
+	return texelFetch(height_texture, clamp(k, ivec2(0), ivec2(N - 1)), 0).r;
+}
+
+// Avoid infinite values when dividing by a null direction
+vec3 safe_direction(vec3 d)
+{
+	return vec3(abs(d.x) < 1e-8 ? 1e-8 : d.x, abs(d.y) < 1e-8 ? 1e-8 : d.y, abs(d.z) < 1e-8 ? 1e-8 : d.z);
+}
+
+// Intersection between the ray O+tD (grid coordinates for x,y) and the bilinear patch of the cell, for t in [t0,t1]
+//  Along the ray, the height of the patch is a quadratic function of t: the first root is found analytically.
+//  Return the parameter t_hit, and the gradient of the height in grid coordinates.
+bool intersect_cell(ivec2 cell, vec3 O, vec3 D, float t0, float t1, out float t_hit, out vec2 gradient)
+{
+	float h00 = height_at(cell);
+	float h10 = height_at(cell + ivec2(1, 0));
+	float h01 = height_at(cell + ivec2(0, 1));
+	float h11 = height_at(cell + ivec2(1, 1));
+
+	vec3 P = O + t0 * D;
+	float u0 = P.x - float(cell.x);
+	float v0 = P.y - float(cell.y);
+
+	// h(u,v) = h00 + a u + b v + c u v
+	float a = h10 - h00;
+	float b = h01 - h00;
+	float c = h00 - h10 - h01 + h11;
+
+	// h(s) = A + B s + C s^2   along the ray (s = t-t0)
+	float A = h00 + a * u0 + b * v0 + c * u0 * v0;
+	float B = a * D.x + b * D.y + c * (u0 * D.y + v0 * D.x);
+	float C = c * D.x * D.y;
+
+	// f(s) = z(s) - h(s): the ray is above the surface while f>0
+	float qa = -C;
+	float qb = D.z - B;
+	float qc = P.z - A;
+	float s_max = t1 - t0;
+
+	float s = -1.0;
+	if (qc <= 0.0)
+		s = 0.0;
+	else if (abs(qa) < 1e-8) {
+		if (qb < 0.0)
+			s = -qc / qb;
+	}
+	else {
+		float delta = qb * qb - 4.0 * qa * qc;
+		if (delta >= 0.0) {
+			float sq = sqrt(delta);
+			float r1 = (-qb - sq) / (2.0 * qa);
+			float r2 = (-qb + sq) / (2.0 * qa);
+			float r_min = min(r1, r2);
+			float r_max = max(r1, r2);
+			s = r_min >= 0.0 ? r_min : r_max;
+		}
+	}
+
+	if (s < 0.0 || s > s_max)
+		return false;
+
+	t_hit = t0 + s;
+	float u = clamp(u0 + s * D.x, 0.0, 1.0);
+	float v = clamp(v0 + s * D.y, 0.0, 1.0);
+	gradient = vec2(a + c * v, b + c * u);
+	return true;
+}
+
+void main()
+{
+	// Compute the position of the center of the camera
+	mat3 O_view = transpose(mat3(view));
+	vec3 last_col = vec3(view * vec4(0.0, 0.0, 0.0, 1.0));
+	vec3 camera_position = -O_view * last_col;
+
+	vec3 dir = safe_direction(normalize(fragment_position - camera_position));
+
+	// Part of the ray inside the bounding box
+	vec3 ta = (box_min - camera_position) / dir;
+	vec3 tb = (box_max - camera_position) / dir;
+	vec3 t_near = min(ta, tb);
+	vec3 t_far = max(ta, tb);
+	float t_enter = max(max(max(t_near.x, t_near.y), t_near.z), 0.0);
+	float t_exit = min(min(t_far.x, t_far.y), t_far.z);
+	if (t_exit <= t_enter)
+		discard;
+
+	// Ray expressed in grid coordinates in (x,y) - the parameter t is unchanged
+	float scale = float(N - 1) / terrain_length;
+	vec3 O = vec3((camera_position.xy + 0.5 * terrain_length) * scale, camera_position.z);
+	vec3 D = safe_direction(vec3(dir.xy * scale, dir.z));
+	float epsilon = 1e-3 / scale;
+
+	int level = levels - 1;
+	float t = t_enter;
+	bool hit = false;
+	float t_hit = 0.0;
+	vec2 gradient = vec2(0.0);
+	for (int k_step = 0; k_step < max_steps && t < t_exit && !hit; ++k_step)
+	{
+		vec3 P = O + t * D;
+
+		// Block of the current level containing the point, and the parameter where the ray leaves it
+		float block_size = float(1 << level);
+		vec2 block = floor(P.xy / block_size);
+		vec2 exit_side = block * block_size + (step(0.0, D.xy) * block_size);
+		vec2 t_side = (exit_side - O.xy) / D.xy;
+		float t_block_exit = min(min(t_side.x, t_side.y), t_exit);
+
+		int level_size = max(1, textureSize(minmax_texture, level).x);
+		vec2 minmax = texelFetch(minmax_texture, clamp(ivec2(block), ivec2(0), ivec2(level_size - 1)), level).rg;
+		float z_lowest = min(P.z, O.z + t_block_exit * D.z);
+
+		if (z_lowest > minmax.y) {
+			// The ray passes above the block: skip it and try a coarser level
+			t = t_block_exit + epsilon;
+			level = min(level + 1, levels - 1);
+		}
+		else if (level > 0) {
+			level--;
+		}
+		else {
+			hit = intersect_cell(ivec2(block), O, D, t, t_block_exit, t_hit, gradient);
+			t = t_block_exit + epsilon;
+		}
+	}
+	if (!hit)
+		discard;
+
+	vec3 p = camera_position + t_hit * dir;
+	vec3 N_surface = normalize(vec3(-gradient * scale, 1.0));
+
+	// Phong shading
+	vec3 L = normalize(light - p);
+	float diffuse_component = max(dot(N_surface, L), 0.0);
+	float specular_component = 0.0;
+	if (diffuse_component > 0.0) {
+		vec3 R = reflect(-L, N_surface);
+		vec3 V = normalize(camera_position - p);
+		specular_component = pow(max(dot(R, V), 0.0), specular_exponent);
+	}
+
+	// Texture at the uv the mesh has at this position
+	vec2 uv_image = uv_scale * (p.xy / terrain_length + 0.5);
+	if (texture_inverse_v)
+		uv_image.y = 1.0 - uv_image.y;
+	vec4 color_image_texture = use_texture ? texture(image_texture, uv_image) : vec4(1.0);
+
+	vec3 color_object = color * color_image_texture.rgb;
+	FragColor = vec4((ambient + diffuse * diffuse_component) * color_object + specular * specular_component * vec3(1.0), 1.0);
+
+	// Depth of the intersection (and not of the bounding box)
+	vec4 p_proj = projection * view * vec4(p, 1.0);
+	gl_FragDepth = 0.5 * (p_proj.z / p_proj.w) + 0.5;
+}
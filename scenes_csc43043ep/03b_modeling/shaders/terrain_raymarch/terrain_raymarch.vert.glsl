@@ -0,0 +1,17 @@
+#version 330 core
+
+// Vertex shader of the bounding box used as a proxy for the ray-marched terrain
+//  The box is directly expressed in world space: the fragments only need their world position to build the view ray.
+
+layout (location = 0) in vec3 vertex_position;
+
+out vec3 fragment_position; // position on the box in world space
+
+uniform mat4 view;       // View matrix (rigid transform) of the camera
+uniform mat4 projection; // Projection (perspective or orthogonal) matrix of the camera
+
+void main()
+{
+	fragment_position = vertex_position;
+	gl_Position = projection * view * vec4(vertex_position, 1.0);
+}
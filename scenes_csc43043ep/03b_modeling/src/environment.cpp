@@ -18,6 +18,7 @@ float project::initial_window_size_height = 0.5f;
 
 // This path will be automatically filled when the program starts
 std::string project::path = ""; 
+std::string project::cache_path = "";
 
 
 
@@ -46,6 +46,8 @@ struct project {
 	// Global variable storing the relative path to the root of the project (access to shaders/, assets/, etc)
 	//  Accessible via project::path
 	static std::string path;
+	// Directory of the executable, where the generated caches are written (outside of the sources)
+	static std::string cache_path;
 
 	// ImGui Window Scale: change this value (default=1) for larger/smaller gui window
 	static float gui_scale;
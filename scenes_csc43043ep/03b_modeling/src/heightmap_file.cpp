@@ -0,0 +1,268 @@
+#include "heightmap_file.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace cgp;
+
+static uint32_t const heightmap_file_version = 1;
+
+// Size in bytes of the payload of one tile
+static size_t tile_payload_size(int tile_size, uint32_t compression)
+{
+	size_t const element_size = compression == uint32_t(heightmap_file_compression::quantized_16bits) ? sizeof(uint16_t) : sizeof(float);
+	return size_t(tile_size) * size_t(tile_size) * element_size;
+}
+
+
+heightmap_file_structure::~heightmap_file_structure()
+{
+	close();
+}
+
+bool heightmap_file_structure::is_open() const
+{
+	return data != nullptr;
+}
+
+bool heightmap_file_structure::open(std::string const& filename)
+{
+	close();
+
+	// Map the entire file in memory (read only)
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	data_size = size_t(size.QuadPart);
+	data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	file_descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (file_descriptor < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size == 0) {
+		close();
+		return false;
+	}
+	data_size = size_t(file_stat.st_size);
+	void* mapped = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	data = mapped == MAP_FAILED ? nullptr : static_cast<char const*>(mapped);
+#endif
+
+	if (data == nullptr || data_size < sizeof(heightmap_file_header)) {
+		close();
+		return false;
+	}
+
+	// Check the header
+	std::memcpy(&header, data, sizeof(heightmap_file_header));
+	bool const valid_magic = std::memcmp(header.magic, "HMAP", 4) == 0;
+	bool const valid_version = header.version == heightmap_file_version;
+	bool const valid_size = header.N > 1 && header.N <= (1u << 20) && header.tile_size > 0 && header.tile_size <= header.N; // Bounded such that the sizes below don't overflow
+	bool const valid_compression = header.compression == uint32_t(heightmap_file_compression::none) || header.compression == uint32_t(heightmap_file_compression::quantized_16bits);
+	if (!valid_magic || !valid_version || !valid_size || !valid_compression) {
+		std::cout << "Invalid heightmap file " << filename << std::endl;
+		close();
+		return false;
+	}
+
+	// Check that the file is large enough to contain all the tiles
+	size_t const T = size_t(tile_count());
+	size_t const expected_size = sizeof(heightmap_file_header) + T * T * (sizeof(heightmap_file_tile) + tile_payload_size(tile_size(), header.compression));
+	if (data_size < expected_size) {
+		std::cout << "Truncated heightmap file " << filename << std::endl;
+		close();
+		return false;
+	}
+
+	// Check that the payload of each tile is after the table of tiles and inside the file
+	size_t const payload_size = tile_payload_size(tile_size(), header.compression);
+	size_t const payload_start = sizeof(heightmap_file_header) + T * T * sizeof(heightmap_file_tile);
+	for (size_t k = 0; k < T * T; ++k) {
+		heightmap_file_tile t;
+		std::memcpy(&t, data + sizeof(heightmap_file_header) + k * sizeof(heightmap_file_tile), sizeof(heightmap_file_tile));
+		if (t.offset < payload_start || t.offset > data_size - payload_size) {
+			std::cout << "Invalid tile offset in heightmap file " << filename << std::endl;
+			close();
+			return false;
+		}
+	}
+
+#ifndef _WIN32
+	// Tiles are accessed in arbitrary order
+	madvise(const_cast<char*>(data), data_size, MADV_RANDOM);
+#endif
+
+	return true;
+}
+
+void heightmap_file_structure::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping_handle != nullptr)
+		CloseHandle(static_cast<HANDLE>(mapping_handle));
+	if (file_handle != nullptr)
+		CloseHandle(static_cast<HANDLE>(file_handle));
+#else
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), data_size);
+	if (file_descriptor >= 0)
+		::close(file_descriptor);
+#endif
+	data = nullptr;
+	data_size = 0;
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+	file_descriptor = -1;
+}
+
+heightmap_file_tile const& heightmap_file_structure::tile(int tile_u, int tile_v) const
+{
+	heightmap_file_tile const* tiles = reinterpret_cast<heightmap_file_tile const*>(data + sizeof(heightmap_file_header));
+	return tiles[tile_v + tile_count() * tile_u];
+}
+
+float heightmap_file_structure::height(int ku, int kv) const
+{
+	int const S = tile_size();
+	heightmap_file_tile const& t = tile(ku / S, kv / S);
+	size_t const offset = size_t(kv % S) + size_t(S) * size_t(ku % S);
+
+	if (header.compression == uint32_t(heightmap_file_compression::quantized_16bits)) {
+		uint16_t q;
+		std::memcpy(&q, data + t.offset + offset * sizeof(uint16_t), sizeof(uint16_t));
+		return t.height_min + (t.height_max - t.height_min) * (q / 65535.0f);
+	}
+
+	float h;
+	std::memcpy(&h, data + t.offset + offset * sizeof(float), sizeof(float));
+	return h;
+}
+
+void heightmap_file_structure::read_tile(int tile_u, int tile_v, float* buffer) const
+{
+	int const S = tile_size();
+	size_t const count = size_t(S) * size_t(S);
+	heightmap_file_tile const& t = tile(tile_u, tile_v);
+	char const* payload = data + t.offset;
+
+	if (header.compression == uint32_t(heightmap_file_compression::quantized_16bits)) {
+		float const scale = (t.height_max - t.height_min) / 65535.0f;
+		uint16_t const* q = reinterpret_cast<uint16_t const*>(payload);
+		for (size_t k = 0; k < count; ++k)
+			buffer[k] = t.height_min + scale * q[k];
+	}
+	else
+		std::memcpy(buffer, payload, count * sizeof(float));
+}
+
+void heightmap_file_structure::read_region(int ku0, int kv0, int size_u, int size_v, std::vector<float>& heights) const
+{
+	int const S = tile_size();
+	heights.resize(size_t(size_u) * size_t(size_v));
+	std::vector<float> buffer(size_t(S) * size_t(S));
+
+	// Loop over the tiles that overlap the region, and copy their relevant part
+	for (int tu = ku0 / S; tu <= (ku0 + size_u - 1) / S; ++tu) {
+		for (int tv = kv0 / S; tv <= (kv0 + size_v - 1) / S; ++tv) {
+			read_tile(tu, tv, buffer.data());
+
+			int const u_begin = std::max(ku0, tu * S), u_end = std::min(ku0 + size_u, (tu + 1) * S);
+			int const v_begin = std::max(kv0, tv * S), v_end = std::min(kv0 + size_v, (tv + 1) * S);
+			for (int ku = u_begin; ku < u_end; ++ku) {
+				float const* src = &buffer[size_t(v_begin - tv * S) + size_t(S) * size_t(ku - tu * S)];
+				float* dst = &heights[size_t(v_begin - kv0) + size_t(size_v) * size_t(ku - ku0)];
+				std::memcpy(dst, src, size_t(v_end - v_begin) * sizeof(float));
+			}
+		}
+	}
+}
+
+
+
+bool heightmap_file_write(std::string const& filename, std::vector<float> const& heights, int N, float terrain_length, uint64_t key, int tile_size, heightmap_file_compression compression)
+{
+	std::ofstream stream(filename, std::ios::binary);
+	if (stream.good() == false) {
+		std::cout << "Cannot write heightmap file " << filename << std::endl;
+		return false;
+	}
+
+	heightmap_file_header header;
+	std::memcpy(header.magic, "HMAP", 4);
+	header.version = heightmap_file_version;
+	header.N = uint32_t(N);
+	header.tile_size = uint32_t(tile_size);
+	header.compression = uint32_t(compression);
+	header.terrain_length = terrain_length;
+	header.key = key;
+
+	int const T = (N + tile_size - 1) / tile_size;
+	size_t const payload_size = tile_payload_size(tile_size, header.compression);
+	size_t const payload_start = sizeof(heightmap_file_header) + size_t(T) * size_t(T) * sizeof(heightmap_file_tile);
+
+	// Gather the values of each tile (border tiles are padded by repeating the last sample)
+	std::vector<heightmap_file_tile> tiles(size_t(T) * size_t(T));
+	std::vector<std::vector<float> > tile_values(tiles.size());
+	for (int tu = 0; tu < T; ++tu) {
+		for (int tv = 0; tv < T; ++tv) {
+			std::vector<float>& values = tile_values[tv + T * tu];
+			values.resize(size_t(tile_size) * size_t(tile_size));
+			for (int i = 0; i < tile_size; ++i) {
+				int const ku = std::min(tu * tile_size + i, N - 1);
+				for (int j = 0; j < tile_size; ++j) {
+					int const kv = std::min(tv * tile_size + j, N - 1);
+					values[j + tile_size * i] = heights[kv + N * ku];
+				}
+			}
+
+			heightmap_file_tile& t = tiles[tv + T * tu];
+			t.offset = payload_start + (tv + size_t(T) * tu) * payload_size;
+			t.height_min = *std::min_element(values.begin(), values.end());
+			t.height_max = *std::max_element(values.begin(), values.end());
+		}
+	}
+
+	stream.write(reinterpret_cast<char const*>(&header), sizeof(heightmap_file_header));
+	stream.write(reinterpret_cast<char const*>(tiles.data()), tiles.size() * sizeof(heightmap_file_tile));
+
+	std::vector<uint16_t> quantized(size_t(tile_size) * size_t(tile_size));
+	for (size_t k = 0; k < tiles.size(); ++k) {
+		std::vector<float> const& values = tile_values[k];
+		if (compression == heightmap_file_compression::quantized_16bits) {
+			float const range = tiles[k].height_max - tiles[k].height_min;
+			float const scale = range > 0 ? 65535.0f / range : 0.0f;
+			for (size_t i = 0; i < values.size(); ++i)
+				quantized[i] = uint16_t((values[i] - tiles[k].height_min) * scale + 0.5f);
+			stream.write(reinterpret_cast<char const*>(quantized.data()), quantized.size() * sizeof(uint16_t));
+		}
+		else
+			stream.write(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(float));
+	}
+
+	return stream.good();
+}
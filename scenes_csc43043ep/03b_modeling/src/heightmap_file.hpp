@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include <cstdint>
+
+// Tiled heightmap file format (.hmap)
+// ********************************************** //
+//  Binary layout:
+//   [heightmap_file_header] [heightmap_file_tile x tile_count] [tile payloads]
+//  The N x N grid of heights is split into square tiles of tile_size x tile_size samples (border tiles are padded).
+//  Each tile is stored either as raw float values, or quantized on 16 bits relatively to its own [min,max] range.
+//  Height of grid sample (ku,kv) follows the same convention as the terrain mesh: heights[kv + N*ku]
+//
+//  The file is read through a memory mapping: only the tiles that are accessed are actually loaded by the OS.
+
+struct heightmap_file_header {
+	char magic[4];           // "HMAP"
+	uint32_t version;        // Format version (see heightmap_file_version)
+	uint32_t N;              // Number of samples along each direction
+	uint32_t tile_size;      // Number of samples along each direction of a tile
+	uint32_t compression;    // 0: float32, 1: uint16 quantization per tile
+	float terrain_length;    // Spatial extent of the terrain
+	uint64_t key;            // User defined key used to check the validity of the file (ex. hash of the generation parameters)
+};
+
+// Description of one tile in the file
+struct heightmap_file_tile {
+	uint64_t offset;         // Offset of the tile payload from the beginning of the file
+	float height_min;        // Minimal height stored in the tile
+	float height_max;        // Maximal height stored in the tile
+};
+
+enum class heightmap_file_compression : uint32_t { none = 0, quantized_16bits = 1 };
+
+
+// Read-only access to a tiled heightmap file using a memory mapping
+struct heightmap_file_structure {
+
+	heightmap_file_header header;
+
+	heightmap_file_structure() = default;
+	~heightmap_file_structure();
+	heightmap_file_structure(heightmap_file_structure const&) = delete;
+	heightmap_file_structure& operator=(heightmap_file_structure const&) = delete;
+
+	// Open and map the file. Return false if the file doesn't exist or is not a valid heightmap file.
+	bool open(std::string const& filename);
+	// Unmap and close the file
+	void close();
+	bool is_open() const;
+
+	int N() const { return int(header.N); }
+	int tile_size() const { return int(header.tile_size); }
+	int tile_count() const { return (N() + tile_size() - 1) / tile_size(); } // number of tiles along each direction
+	heightmap_file_tile const& tile(int tile_u, int tile_v) const;
+
+	// Height of a single sample (only the tile containing the sample is touched)
+	float height(int ku, int kv) const;
+
+	// Decode the full tile (tile_u,tile_v) in a buffer of tile_size*tile_size values stored as [kv_local + tile_size*ku_local]
+	void read_tile(int tile_u, int tile_v, float* buffer) const;
+
+	// Fill heights[kv + size_v*ku] for the region [ku0, ku0+size_u[ x [kv0, kv0+size_v[ touching only the tiles that overlap it
+	void read_region(int ku0, int kv0, int size_u, int size_v, std::vector<float>& heights) const;
+
+private:
+	char const* data = nullptr;   // Beginning of the mapped file
+	size_t data_size = 0;         // Size of the mapping in bytes
+	void* file_handle = nullptr;  // Platform specific handles
+	void* mapping_handle = nullptr;
+	int file_descriptor = -1;
+};
+
+
+// Write the N x N heights (stored as heights[kv + N*ku]) into a tiled file
+//  Return false if the file cannot be written
+bool heightmap_file_write(std::string const& filename, std::vector<float> const& heights, int N, float terrain_length, uint64_t key, int tile_size = 64, heightmap_file_compression compression = heightmap_file_compression::quantized_16bits);
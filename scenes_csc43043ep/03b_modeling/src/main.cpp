@@ -47,6 +47,9 @@ int main(int, char* argv[])
 
 	// Initialize default path for assets
 	project::path = cgp::project_path_find(argv[0], "shaders/");
+	std::string const executable = argv[0];
+	size_t const separator = executable.find_last_of("/\\");
+	project::cache_path = separator == std::string::npos ? "" : executable.substr(0, separator + 1);
 
 	// Initialize default shaders
 	initialize_default_shaders();
@@ -89,6 +92,7 @@ int main(int, char* argv[])
 	std::cout << "\nAnimation loop stopped" << std::endl;
 
 	// Cleanup
+	scene.clear();
 	cgp::imgui_cleanup();
 	glfwDestroyWindow(scene.window.glfw_window);
 	glfwTerminate();
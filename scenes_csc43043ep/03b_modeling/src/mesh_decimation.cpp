@@ -0,0 +1,548 @@
+#include "mesh_decimation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+
+using namespace cgp;
+
+
+namespace {
+	// Symmetric quadric: error(p) = p^T A p + 2 b.p + c
+	struct quadric {
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+	};
+
+	// Collapse of the vertex removed into the vertex kept (the position is computed again when it is applied)
+	struct collapse_entry {
+		float cost;
+		uint32_t removed;
+		uint32_t kept;
+		bool operator<(collapse_entry const& other) const { return cost < other.cost; }
+	};
+
+	// Edge from a vertex to another one, in a triangle (sorted to find the boundary and non-manifold edges)
+	struct edge_entry {
+		uint32_t vertex;
+		uint32_t triangle;
+		bool operator<(edge_entry const& other) const { return vertex < other.vertex; }
+	};
+
+	uint8_t const vertex_boundary = 1;
+	uint8_t const vertex_locked = 2;  // Never moved nor removed
+	uint8_t const vertex_removed = 4;
+	uint8_t const vertex_modified = 8; // Involved in a collapse of the current pass
+	uint32_t const no_vertex = ~uint32_t(0);
+}
+
+static void quadric_add_plane(quadric& q, vec3 const& n, float d, double weight)
+{
+	q.a00 += weight * n.x * n.x; q.a01 += weight * n.x * n.y; q.a02 += weight * n.x * n.z;
+	q.a11 += weight * n.y * n.y; q.a12 += weight * n.y * n.z; q.a22 += weight * n.z * n.z;
+	q.b0 += weight * n.x * d; q.b1 += weight * n.y * d; q.b2 += weight * n.z * d;
+	q.c += weight * d * d;
+}
+
+static quadric quadric_sum(quadric const& q0, quadric const& q1)
+{
+	quadric q;
+	q.a00 = q0.a00 + q1.a00; q.a01 = q0.a01 + q1.a01; q.a02 = q0.a02 + q1.a02;
+	q.a11 = q0.a11 + q1.a11; q.a12 = q0.a12 + q1.a12; q.a22 = q0.a22 + q1.a22;
+	q.b0 = q0.b0 + q1.b0; q.b1 = q0.b1 + q1.b1; q.b2 = q0.b2 + q1.b2;
+	q.c = q0.c + q1.c;
+	return q;
+}
+
+static double quadric_error(quadric const& q, vec3 const& p)
+{
+	double const x = p.x, y = p.y, z = p.z;
+	double const e = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+		+ 2 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+	return std::max(e, 0.0);
+}
+
+// Position minimizing the error. Return false when the minimum is not unique (planes of a flat or cylindrical region).
+static bool quadric_minimum(quadric const& q, vec3& p)
+{
+	double const c00 = q.a11 * q.a22 - q.a12 * q.a12;
+	double const c01 = q.a02 * q.a12 - q.a01 * q.a22;
+	double const c02 = q.a01 * q.a12 - q.a02 * q.a11;
+	double const det = q.a00 * c00 + q.a01 * c01 + q.a02 * c02;
+	double const trace = q.a00 + q.a11 + q.a22;
+	if (std::abs(det) <= 1e-6 * trace * trace * trace)
+		return false;
+
+	double const c11 = q.a00 * q.a22 - q.a02 * q.a02;
+	double const c12 = q.a01 * q.a02 - q.a00 * q.a12;
+	double const c22 = q.a00 * q.a11 - q.a01 * q.a01;
+	p.x = float(-(c00 * q.b0 + c01 * q.b1 + c02 * q.b2) / det);
+	p.y = float(-(c01 * q.b0 + c11 * q.b1 + c12 * q.b2) / det);
+	p.z = float(-(c02 * q.b0 + c12 * q.b1 + c22 * q.b2) / det);
+	return true;
+}
+
+
+namespace {
+	struct decimation_structure {
+		std::vector<vec3> position;
+		std::vector<vec2> uv;
+		std::vector<vec3> color;
+		std::vector<quadric> quadrics;
+		std::vector<float> area;                // Area of the triangles of the quadric (the error is normalized to a squared distance)
+		std::vector<uint8_t> flags;
+		float boundary_weight = 10.0f;
+
+		std::vector<uint3> triangles;           // Triangles at the beginning of the pass
+		std::vector<uint8_t> triangle_removed;
+		size_t active_triangles = 0;
+		std::vector<uint32_t> adjacency_offset; // Triangles of the vertex v: adjacency[adjacency_offset[v] .. adjacency_offset[v+1]]
+		std::vector<uint32_t> adjacency;
+		std::vector<uint32_t> parent;           // Vertex replacing a vertex removed during the pass (itself otherwise)
+
+		// Temporary buffers of collapse
+		std::vector<uint32_t> triangles_removed, triangles_kept, neighbors_removed, neighbors_kept;
+
+		void initialize(mesh const& shape);
+		void start_pass();
+		void sorted_collapses(float max_cost, thread_pool_structure& thread_pool, std::vector<collapse_entry>& collapses) const;
+		float collapse_target(uint32_t a, uint32_t b, uint32_t& removed, uint32_t& kept, vec3& p) const;
+		bool collapse(uint32_t r, uint32_t k);
+		mesh export_mesh(bool has_normal) const;
+
+		// A vertex is replaced at most once per pass (the vertices modified during a pass are not collapsed again)
+		uint3 current_triangle(uint32_t t) const {
+			uint3 const& f = triangles[t];
+			return { parent[f.x], parent[f.y], parent[f.z] };
+		}
+		void gather_triangles(uint32_t v, std::vector<uint32_t>& out) const {
+			out.clear();
+			for (uint32_t k = adjacency_offset[v]; k < adjacency_offset[v + 1]; ++k)
+				if (triangle_removed[adjacency[k]] == 0)
+					out.push_back(adjacency[k]);
+		}
+	};
+}
+
+void decimation_structure::initialize(mesh const& shape)
+{
+	size_t const N = shape.position.size();
+	position = shape.position.data;
+	if (shape.uv.size() == N)
+		uv = shape.uv.data;
+	if (shape.color.size() == N)
+		color = shape.color.data;
+	flags.assign(N, 0);
+
+	// Degenerated triangles are ignored
+	triangles.clear();
+	triangles.reserve(shape.connectivity.size());
+	for (uint3 const& f : shape.connectivity)
+		if (f.x != f.y && f.y != f.z && f.z != f.x)
+			triangles.push_back(f);
+	size_t const T = triangles.size();
+
+	// Planes of the triangles
+	quadrics.assign(N, quadric());
+	area.assign(N, 0.0f);
+	std::vector<vec3> triangle_normal(T);
+	for (size_t t = 0; t < T; ++t) {
+		uint3 const& f = triangles[t];
+		vec3 const n = cross(position[f.y] - position[f.x], position[f.z] - position[f.x]);
+		float const a = 0.5f * norm(n);
+		triangle_normal[t] = normalize(n, { 0,0,0 });
+		for (int c = 0; c < 3; ++c) {
+			quadric_add_plane(quadrics[f[c]], triangle_normal[t], -dot(triangle_normal[t], position[f.x]), a);
+			area[f[c]] += a;
+		}
+	}
+
+	triangle_removed.assign(T, 0);
+	parent.resize(N);
+	std::iota(parent.begin(), parent.end(), 0u);
+	start_pass();
+
+	// Edges (a,b) with a < b found in the triangles around a: the boundary edges appear once, and the non-manifold edges
+	//  more than twice
+	std::vector<edge_entry> edges;
+	std::vector<uint32_t> boundary_vertices;
+	for (uint32_t a = 0; a < N; ++a) {
+		edges.clear();
+		for (uint32_t k = adjacency_offset[a]; k < adjacency_offset[a + 1]; ++k) {
+			uint3 const& f = triangles[adjacency[k]];
+			for (int c = 0; c < 3; ++c)
+				if (f[c] > a)
+					edges.push_back({ f[c], adjacency[k] });
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t k = 0; k < edges.size();) {
+			size_t end = k + 1;
+			while (end < edges.size() && edges[end].vertex == edges[k].vertex)
+				++end;
+			uint32_t const b = edges[k].vertex;
+			if (end - k == 1) {
+				// Plane containing the edge and orthogonal to its triangle
+				vec3 const e = position[b] - position[a];
+				vec3 const n = normalize(cross(e, triangle_normal[edges[k].triangle]), { 0,0,0 });
+				double const weight = boundary_weight * dot(e, e);
+				quadric_add_plane(quadrics[a], n, -dot(n, position[a]), weight);
+				quadric_add_plane(quadrics[b], n, -dot(n, position[a]), weight);
+				for (uint32_t v : { a, b }) {
+					if ((flags[v] & vertex_boundary) == 0)
+						boundary_vertices.push_back(v);
+					flags[v] |= vertex_boundary;
+				}
+			}
+			else if (end - k > 2) {
+				flags[a] |= vertex_locked;
+				flags[b] |= vertex_locked;
+			}
+			k = end;
+		}
+	}
+
+	// Boundary vertices sharing their position with another one are on a seam
+	std::sort(boundary_vertices.begin(), boundary_vertices.end(), [this](uint32_t a, uint32_t b) {
+		vec3 const& pa = position[a];
+		vec3 const& pb = position[b];
+		return pa.x < pb.x || (pa.x == pb.x && (pa.y < pb.y || (pa.y == pb.y && pa.z < pb.z)));
+	});
+	for (size_t k = 1; k < boundary_vertices.size(); ++k) {
+		uint32_t const a = boundary_vertices[k - 1], b = boundary_vertices[k];
+		if (position[a].x == position[b].x && position[a].y == position[b].y && position[a].z == position[b].z) {
+			flags[a] |= vertex_locked;
+			flags[b] |= vertex_locked;
+		}
+	}
+
+}
+
+// Remove the collapsed triangles of the previous pass, and compute the adjacency of the remaining ones
+void decimation_structure::start_pass()
+{
+	size_t const N = position.size();
+	size_t count = 0;
+	for (size_t t = 0; t < triangles.size(); ++t)
+		if (triangle_removed[t] == 0)
+			triangles[count++] = current_triangle(t);
+	triangles.resize(count);
+	triangle_removed.assign(count, 0);
+	active_triangles = count;
+
+	std::iota(parent.begin(), parent.end(), 0u);
+	for (uint8_t& f : flags)
+		f &= ~vertex_modified;
+
+	// Compressed rows of the triangles around each vertex
+	adjacency_offset.assign(N + 1, 0);
+	for (uint3 const& f : triangles)
+		for (int c = 0; c < 3; ++c)
+			adjacency_offset[f[c] + 1]++;
+	for (size_t v = 0; v < N; ++v)
+		adjacency_offset[v + 1] += adjacency_offset[v];
+	adjacency.resize(adjacency_offset[N]);
+	std::vector<uint32_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+	for (size_t t = 0; t < count; ++t)
+		for (int c = 0; c < 3; ++c)
+			adjacency[fill[triangles[t][c]]++] = uint32_t(t);
+}
+
+// Cheapest collapse of each vertex (only the costs up to max_cost). The cheapest half of the collapses is sorted by
+//  increasing cost at the beginning of the array.
+void decimation_structure::sorted_collapses(float max_cost, thread_pool_structure& thread_pool, std::vector<collapse_entry>& collapses) const
+{
+	size_t const N = position.size();
+	size_t const T = triangles.size();
+
+	// Cost of the edge (c, c+1) of each triangle, computed in parallel
+	//  direction: 0 (no collapse), 1 (the first vertex is removed), 2 (the second one is removed), 3 (both are possible)
+	std::vector<float> edge_cost(3 * T);
+	std::vector<uint8_t> edge_direction(3 * T);
+	thread_pool.parallel_for(int(T), 4096, [&](int t_begin, int t_end) {
+		for (int t = t_begin; t < t_end; ++t) {
+			for (int c = 0; c < 3; ++c) {
+				uint32_t const a = triangles[t][c], b = triangles[t][(c + 1) % 3];
+				uint8_t& direction = edge_direction[3 * t + c];
+				direction = 0;
+				// The edges that are not on the boundary are found in both of their triangles
+				if (a > b && (flags[a] & flags[b] & vertex_boundary) == 0)
+					continue;
+				uint32_t removed, kept;
+				vec3 p;
+				float const cost = collapse_target(a, b, removed, kept, p);
+				if (cost < 0 || cost > max_cost)
+					continue;
+				edge_cost[3 * t + c] = cost;
+				direction = removed == a ? 1 : 2;
+				// Same position when neither vertex is fixed: the edge can be collapsed in both directions
+				if (((flags[a] | flags[b]) & vertex_locked) == 0 && (flags[a] & vertex_boundary) == (flags[b] & vertex_boundary))
+					direction = 3;
+			}
+		}
+	});
+
+	std::vector<float> best_cost(N, std::numeric_limits<float>::max());
+	std::vector<uint32_t> best_kept(N, no_vertex);
+	auto const candidate = [&](uint32_t removed, uint32_t kept, float cost) {
+		if (cost < best_cost[removed]) {
+			best_cost[removed] = cost;
+			best_kept[removed] = kept;
+		}
+	};
+	for (size_t t = 0; t < T; ++t) {
+		for (int c = 0; c < 3; ++c) {
+			uint8_t const direction = edge_direction[3 * t + c];
+			uint32_t const a = triangles[t][c], b = triangles[t][(c + 1) % 3];
+			if (direction & 1)
+				candidate(a, b, edge_cost[3 * t + c]);
+			if (direction & 2)
+				candidate(b, a, edge_cost[3 * t + c]);
+		}
+	}
+
+	collapses.clear();
+	for (size_t v = 0; v < N; ++v)
+		if (best_kept[v] != no_vertex)
+			collapses.push_back({ best_cost[v], uint32_t(v), best_kept[v] });
+	auto const middle = collapses.begin() + (collapses.size() + 1) / 2;
+	std::nth_element(collapses.begin(), middle, collapses.end());
+	std::sort(collapses.begin(), middle);
+}
+
+// Cost (squared distance) of the collapse of the edge (a,b), and the vertex removed, the one kept and its new position
+//  Return a negative cost when the edge cannot be collapsed.
+float decimation_structure::collapse_target(uint32_t a, uint32_t b, uint32_t& removed, uint32_t& kept, vec3& p) const
+{
+	uint8_t const fa = flags[a], fb = flags[b];
+	if ((fa & vertex_locked) && (fb & vertex_locked))
+		return -1.0f;
+
+	// A fixed or boundary vertex is kept in place when the other one is free to move
+	quadric const q = quadric_sum(quadrics[a], quadrics[b]);
+	bool const fixed_a = (fa & vertex_locked) || ((fa & vertex_boundary) && !(fb & vertex_boundary));
+	bool const fixed_b = (fb & vertex_locked) || ((fb & vertex_boundary) && !(fa & vertex_boundary));
+	double cost = 0;
+	if (fixed_a || fixed_b) {
+		kept = fixed_a ? a : b;
+		removed = fixed_a ? b : a;
+		p = position[kept];
+		cost = quadric_error(q, p);
+	}
+	else {
+		kept = b;
+		removed = a;
+		if (quadric_minimum(q, p))
+			cost = quadric_error(q, p);
+		else {
+			// Best of the extremities and the middle of the edge
+			vec3 const candidates[3] = { position[a], position[b], 0.5f * (position[a] + position[b]) };
+			cost = std::numeric_limits<double>::max();
+			for (vec3 const& candidate : candidates) {
+				double const cost_candidate = quadric_error(q, candidate);
+				if (cost_candidate < cost) {
+					cost = cost_candidate;
+					p = candidate;
+				}
+			}
+		}
+	}
+	return float(cost / std::max(area[a] + area[b], 1e-20f));
+}
+
+// Vertices of the triangles around v (except v), sorted and unique
+static void triangle_neighbors(std::vector<uint32_t> const& triangles_around, uint32_t v, decimation_structure const& decimation, std::vector<uint32_t>& neighbors)
+{
+	neighbors.clear();
+	for (uint32_t t : triangles_around) {
+		uint3 const f = decimation.current_triangle(t);
+		for (int c = 0; c < 3; ++c)
+			if (f[c] != v)
+				neighbors.push_back(f[c]);
+	}
+	std::sort(neighbors.begin(), neighbors.end());
+	neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+}
+
+// The triangles around v (except those containing other) keep their orientation when v moves to p
+static bool preserve_orientation(std::vector<uint32_t> const& triangles_around, uint32_t v, uint32_t other, vec3 const& p, decimation_structure const& decimation)
+{
+	for (uint32_t t : triangles_around) {
+		uint3 const f = decimation.current_triangle(t);
+		if (f.x == other || f.y == other || f.z == other)
+			continue;
+		vec3 corners[3] = { decimation.position[f.x], decimation.position[f.y], decimation.position[f.z] };
+		vec3 const n_before = cross(corners[1] - corners[0], corners[2] - corners[0]);
+		for (int c = 0; c < 3; ++c)
+			if (f[c] == v)
+				corners[c] = p;
+		vec3 const n_after = cross(corners[1] - corners[0], corners[2] - corners[0]);
+		// Reject the flipped triangles, and the ones rotated by more than ~85 degrees (almost degenerated)
+		if (dot(n_before, n_after) <= 0.1f * norm(n_before) * norm(n_after))
+			return false;
+	}
+	return true;
+}
+
+bool decimation_structure::collapse(uint32_t r, uint32_t k)
+{
+	uint32_t removed, kept;
+	vec3 p;
+	collapse_target(r, k, removed, kept, p);
+
+	gather_triangles(r, triangles_removed);
+	gather_triangles(k, triangles_kept);
+
+	// Triangles of the edge: one on the boundary, two otherwise
+	int shared = 0;
+	for (uint32_t t : triangles_removed) {
+		uint3 const f = current_triangle(t);
+		shared += (f.x == k || f.y == k || f.z == k) ? 1 : 0;
+	}
+	if (shared == 0 || shared > 2 || ((flags[r] & vertex_boundary) && shared != 1))
+		return false;
+
+	// Link condition: the only common neighbors are the opposite vertices of the triangles of the edge
+	triangle_neighbors(triangles_removed, r, *this, neighbors_removed);
+	triangle_neighbors(triangles_kept, k, *this, neighbors_kept);
+	size_t common = 0;
+	for (size_t a = 0, b = 0; a < neighbors_removed.size() && b < neighbors_kept.size();) {
+		if (neighbors_removed[a] < neighbors_kept[b]) ++a;
+		else if (neighbors_kept[b] < neighbors_removed[a]) ++b;
+		else { ++common; ++a; ++b; }
+	}
+	if (common != size_t(shared))
+		return false;
+
+	if (!preserve_orientation(triangles_removed, r, k, p, *this) || !preserve_orientation(triangles_kept, k, r, p, *this))
+		return false;
+
+	// The triangles of the edge disappear, the other triangles of r now use k
+	for (uint32_t t : triangles_removed) {
+		uint3 const f = current_triangle(t);
+		if (f.x == k || f.y == k || f.z == k) {
+			triangle_removed[t] = 1;
+			active_triangles--;
+		}
+	}
+	parent[r] = k;
+	flags[r] |= vertex_removed;
+
+	// Attributes interpolated at the projection of the new position on the edge
+	vec3 const e = position[r] - position[k];
+	float const s = std::min(std::max(dot(p - position[k], e) / std::max(dot(e, e), 1e-20f), 0.0f), 1.0f);
+	if (!uv.empty())
+		uv[k] = (1 - s) * uv[k] + s * uv[r];
+	if (!color.empty())
+		color[k] = (1 - s) * color[k] + s * color[r];
+
+	position[k] = p;
+	quadrics[k] = quadric_sum(quadrics[k], quadrics[r]);
+	area[k] += area[r];
+
+	return true;
+}
+
+// Mesh of the remaining triangles (called at the beginning of a pass)
+mesh decimation_structure::export_mesh(bool has_normal) const
+{
+	std::vector<uint32_t> index(position.size(), no_vertex);
+	mesh shape;
+	shape.connectivity.resize(triangles.size());
+	for (size_t t = 0; t < triangles.size(); ++t) {
+		for (int c = 0; c < 3; ++c) {
+			uint32_t const v = triangles[t][c];
+			if (index[v] == no_vertex) {
+				index[v] = uint32_t(shape.position.size());
+				shape.position.push_back(position[v]);
+				if (!uv.empty())
+					shape.uv.push_back(uv[v]);
+				if (!color.empty())
+					shape.color.push_back(color[v]);
+			}
+			shape.connectivity[t][c] = index[v];
+		}
+	}
+	if (has_normal)
+		shape.normal_update();
+	shape.fill_empty_field();
+	return shape;
+}
+
+
+mesh mesh_decimate(mesh const& shape, mesh_decimation_parameters const& parameters, thread_pool_structure& thread_pool, mesh_decimation_statistics* statistics)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+
+	decimation_structure decimation;
+	decimation.boundary_weight = parameters.boundary_weight;
+	decimation.initialize(shape);
+
+	// The costs are squared distances
+	float const max_cost = parameters.max_error > 0 ? parameters.max_error * parameters.max_error : std::numeric_limits<float>::max();
+	size_t collapses = 0;
+	float cost_max = 0.0f;
+	std::vector<collapse_entry> candidates, selected;
+	while (decimation.active_triangles > parameters.target_triangles) {
+		decimation.sorted_collapses(max_cost, thread_pool, candidates);
+
+		// The collapses are selected by increasing cost, such that a vertex is modified at most once per pass (the vertices
+		//  around a collapse get their new cost in the next pass). Each pass only considers the cheapest half of the
+		//  collapses: the expensive ones are evaluated again after the cheap ones are done.
+		size_t const pass_candidates = (candidates.size() + 1) / 2;
+		size_t const triangles_to_remove = decimation.active_triangles - parameters.target_triangles;
+		selected.clear();
+		for (size_t k = 0; k < pass_candidates && selected.size() < triangles_to_remove; ++k) {
+			collapse_entry const& entry = candidates[k];
+			if ((decimation.flags[entry.removed] | decimation.flags[entry.kept]) & vertex_modified)
+				continue;
+			decimation.flags[entry.removed] |= vertex_modified;
+			decimation.flags[entry.kept] |= vertex_modified;
+			selected.push_back(entry);
+		}
+
+		// The selected collapses are applied in the order of the vertices (memory locality). Their validity is tested on
+		//  the current mesh, including the collapses already applied around them.
+		std::sort(selected.begin(), selected.end(), [](collapse_entry const& a, collapse_entry const& b) { return a.removed < b.removed; });
+		size_t pass_collapses = 0;
+		for (collapse_entry const& entry : selected) {
+			if (decimation.active_triangles <= parameters.target_triangles)
+				break;
+			if (decimation.collapse(entry.removed, entry.kept)) {
+				pass_collapses++;
+				cost_max = std::max(cost_max, entry.cost);
+			}
+		}
+		decimation.start_pass();
+		collapses += pass_collapses;
+		if (pass_collapses == 0)
+			break;
+	}
+
+	mesh decimated = decimation.export_mesh(shape.normal.size() > 0);
+	if (statistics != nullptr) {
+		statistics->collapses = collapses;
+		statistics->error = std::sqrt(cost_max);
+		statistics->time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	}
+	return decimated;
+}
+
+std::vector<mesh> mesh_decimate_lod_chain(mesh const& shape, int levels, thread_pool_structure& thread_pool, float ratio)
+{
+	std::vector<mesh> chain = { shape };
+	for (int level = 1; level < levels; ++level) {
+		mesh_decimation_parameters parameters;
+		parameters.target_triangles = size_t(ratio * chain.back().connectivity.size());
+		mesh_decimation_statistics statistics;
+		mesh decimated = mesh_decimate(chain.back(), parameters, thread_pool, &statistics);
+		if (statistics.collapses == 0)
+			break;
+		chain.push_back(decimated);
+	}
+	return chain;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "thread_pool.hpp"
+
+// Simplification of triangle meshes by edge collapses (quadric error metric)
+// ********************************************** //
+//  Each vertex stores the quadric of the planes of its triangles (weighted by their area): the error of a position is the
+//  squared distance to these planes. The collapses are applied in passes instead of a single heap: each pass evaluates
+//  all the edges (in parallel), sorts the cheapest half of the candidates, and collapses them in order as long as they do
+//  not touch a vertex already modified in the pass. The triangles and their adjacency (compact arrays indexed by vertex)
+//  are rebuilt between the passes.
+//  Constraints:
+//   - The boundary edges add planes orthogonal to their triangle, such that the boundary keeps its shape. A boundary
+//     vertex is only collapsed along the boundary.
+//   - The boundary vertices duplicated at the same position (UV seams, split normals) and the vertices of non-manifold
+//     edges are never moved, such that the seams stay closed.
+//   - A collapse that would flip a triangle or make the mesh non-manifold is rejected.
+//  The uv and colors of a collapsed edge are interpolated at the new position, the normals are recomputed.
+
+struct mesh_decimation_parameters {
+	size_t target_triangles = 0;   // Stop when the mesh has at most this number of triangles (0: no target)
+	float max_error = 0.0f;        // Stop before a collapse moving the surface by more than this distance (0: no limit)
+	float boundary_weight = 10.0f; // Weight of the planes constraining the boundaries, relative to the planes of the triangles
+};
+
+struct mesh_decimation_statistics {
+	size_t collapses = 0;
+	float error = 0.0f;            // Largest error of the collapses (distance)
+	float time = 0.0f;             // Duration (ms)
+};
+
+// Decimated copy of the mesh. At least one of target_triangles or max_error should be set.
+cgp::mesh mesh_decimate(cgp::mesh const& shape, mesh_decimation_parameters const& parameters, thread_pool_structure& thread_pool, mesh_decimation_statistics* statistics = nullptr);
+
+// Levels of detail: level 0 is the mesh itself, and each level is decimated from the previous one down to ratio times its
+//  number of triangles. The chain stops early when a level cannot be decimated further.
+std::vector<cgp::mesh> mesh_decimate_lod_chain(cgp::mesh const& shape, int levels, thread_pool_structure& thread_pool, float ratio = 0.5f);
@@ -65,28 +65,38 @@ void scene_structure::initialize()
 
 	global_frame.initialize_data_on_gpu(mesh_primitive_frame());
 
-	int N_terrain_samples = 1000;
-	float terrain_length = 20.0f;
-	terrain_mesh = create_terrain_mesh(N_terrain_samples, terrain_length, parameters);
+	// The cache is written next to the executable
+	terrain_mesh = create_terrain_mesh_cached(project::cache_path + "terrain_cache.hmap", terrain_samples, terrain_length, parameters);
 	terrain.initialize_data_on_gpu(terrain_mesh);
 	terrain.material.color = { 0.6f,0.85f,0.5f };
 	terrain.material.phong.specular = 0.0f; // non-specular terrain material
 
+	// The objects are placed on the heights of the mesh, which is also displayed using ray-marching
+	terrain_heights.resize(terrain_mesh.position.size());
+	for (size_t k = 0; k < terrain_heights.size(); ++k)
+		terrain_heights[k] = terrain_mesh.position[k].z;
+	opengl_shader_structure shader_raymarch;
+	shader_raymarch.load(project::path + "shaders/terrain_raymarch/terrain_raymarch.vert.glsl", project::path + "shaders/terrain_raymarch/terrain_raymarch.frag.glsl");
+	terrain_raymarch.initialize_data_on_gpu(terrain_heights, terrain_samples, terrain_length, shader_raymarch);
+
 	// update_terrain(terrain_mesh, terrain, parameters);
+	thread_pool.initialize();
 
 	mesh const tree_mesh = create_tree();
 	tree.initialize_data_on_gpu(tree_mesh);
-	tree_positions = generate_positions_on_terrain(30, terrain_length, parameters);
+	tree_positions = generate_positions_on_terrain(30, terrain_length, terrain_heights, terrain_samples);
 
 	mesh quad_mesh = mesh_primitive_quadrangle({ -0.5f,0,0 }, { 0.5f,0,0 }, { 0.5f,0,1 }, { -0.5f,0,1 });
 	quad.initialize_data_on_gpu(quad_mesh);
 	quad.texture.load_and_initialize_texture_2d_on_gpu(project::path+"assets/grass.png");
 	quad.material.phong = { 0.4f, 0.6f,0,1 };
-	grass_positions = generate_positions_on_terrain(50, terrain_length, parameters);
+	grass_positions = generate_positions_on_terrain(50, terrain_length, terrain_heights, terrain_samples);
 
 	terrain.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/texture_grass.jpg",
 		GL_REPEAT,
 		GL_REPEAT);
+	terrain_raymarch.material = terrain.material;
+	terrain_raymarch.texture = terrain.texture.id;
 
 	// Oiseau
 	mesh_drawable corps_base;
@@ -136,7 +146,7 @@ void scene_structure::initialize()
 	timer.t = timer.t_min;
 
 	int N_spheres = 20;
-	float z = evaluate_terrain_height(0, 0, terrain_length, parameters);
+	float z = terrain_height(0, 0);
 	points.push_back( {0, 0, z} );
 	speeds.push_back( {0, 0, 0} );
 	L0s.push_back(0.05f);
@@ -155,6 +165,11 @@ void scene_structure::initialize()
 
 }
 
+void scene_structure::clear()
+{
+	terrain_raymarch.clear();
+}
+
 void scene_structure::display_frame()
 {
 	// Set the light to the current position of the camera
@@ -184,14 +199,34 @@ void scene_structure::display_frame()
 	// Update the current time
 	timer.update();
 
-	draw(terrain, environment);
+	// Erode progressively the terrain: a few iterations per frame
+	if (gui.erosion) {
+		erosion.step(erosion_parameters, gui.erosion_iterations_per_frame);
+		erosion.update_terrain(terrain_mesh, terrain);
+		for (vec3& position : tree_positions)
+			position.z = erosion.height_at(position.x, position.y);
+		for (vec3& position : grass_positions)
+			position.z = erosion.height_at(position.x, position.y);
+		if (gui.terrain_raymarch)
+			terrain_raymarch.update(erosion.height);
+		gui.terrain_decimated = false; // The decimated terrain no longer matches the eroded heights
+	}
+
+	// The decimated terrain replaces the full resolution one when it is displayed
+	bool const display_decimated = gui.terrain_decimated && terrain_decimated.vbo_position.id != 0;
+	mesh_drawable const& terrain_displayed = display_decimated ? terrain_decimated : terrain;
+	if (gui.terrain_raymarch)
+		draw(terrain_raymarch, environment);
+	else
+		draw(terrain_displayed, environment);
 	
 	for (auto pos: tree_positions) {
 		tree.model.translation = pos;
 		draw(tree, environment);
 	}
 	if (gui.display_wireframe) {
-		draw_wireframe(terrain, environment);
+		if (!gui.terrain_raymarch)
+			draw_wireframe(terrain_displayed, environment);
 		draw_wireframe(tree, environment);
 		draw_wireframe(quad, environment);
 	}
@@ -217,9 +252,9 @@ void scene_structure::display_frame()
 		simulation_step(timer_b.scale * 0.001f);
 
 	for (int i = 0 ; i < points.size(); i++) {
-		if (points[i].z < evaluate_terrain_height(points[i].x, points[i].y, 20.0f, parameters)) {
-			points[i].z = evaluate_terrain_height(points[i].x, points[i].y, 20.0f, parameters);
-		}
+		float const ground = terrain_height(points[i].x, points[i].y);
+		if (points[i].z < ground)
+			points[i].z = ground;
 		particle_sphere.model.translation = points[i];
 		particle_sphere.material.color = { 1,0,0 };
 		draw(particle_sphere, environment);	
@@ -297,6 +332,69 @@ void scene_structure::display_gui()
 {
 	ImGui::Checkbox("Frame", &gui.display_frame);
 	ImGui::Checkbox("Wireframe", &gui.display_wireframe);
+
+	ImGui::Spacing();
+	if (ImGui::Checkbox("Ray-marched terrain", &gui.terrain_raymarch) && gui.terrain_raymarch && erosion.N > 0)
+		terrain_raymarch.update(erosion.height);
+	int const N_terrain = int(std::sqrt(terrain_mesh.position.size()));
+	std::string const memory_info = "GPU memory: mesh " + str(terrain_mesh_memory_gpu(N_terrain) / (1024 * 1024)) + " MB, ray-march " + str(terrain_raymarch.memory_gpu() / (1024 * 1024)) + " MB";
+	ImGui::Text("%s", memory_info.c_str());
+	if (ImGui::Button("Rendering benchmark"))
+		terrain_rendering_benchmark(environment, terrain, terrain_raymarch, parameters, terrain_length);
+
+	ImGui::Spacing();
+	ImGui::SliderFloat("Triangles kept", &gui.decimation_ratio, 0.01f, 1.0f);
+	if (ImGui::Button("Decimate terrain"))
+		decimate_terrain();
+	ImGui::Checkbox("Display decimated terrain", &gui.terrain_decimated);
+	if (decimation.time > 0)
+		ImGui::Text("Decimation: %d collapses in %.0f ms, error %.4f", int(decimation.collapses), decimation.time, decimation.error);
+
+	ImGui::Spacing();
+	bool const erosion_start = ImGui::Checkbox("Erosion", &gui.erosion);
+	if (erosion_start && gui.erosion && erosion.N == 0) {
+		// Start the erosion from the current terrain heights
+		erosion.initialize(terrain_heights, terrain_samples, terrain_length, thread_pool);
+	}
+	ImGui::SliderInt("Iterations per frame", &gui.erosion_iterations_per_frame, 1, 20);
+	ImGui::SliderFloat("Rain", &erosion_parameters.rain, 0.0f, 0.05f);
+	ImGui::SliderFloat("Talus slope", &erosion_parameters.talus_slope, 0.1f, 2.0f);
+	std::string const erosion_info = str(erosion.iterations) + " iterations (" + str(erosion.iterations_per_second) + " iterations/s)";
+	ImGui::Text("%s", erosion_info.c_str());
+
+	// The benchmark runs on its own thread: the loops of the frames run sequentially while it uses the workers
+	bool const benchmark_running = erosion_benchmark.valid() && erosion_benchmark.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+	if (erosion_benchmark.valid() && !benchmark_running)
+		erosion_benchmark_result = erosion_benchmark.get();
+	if (benchmark_running)
+		ImGui::Text("Erosion benchmark 2048x2048 running ...");
+	else if (ImGui::Button("Erosion benchmark 2048x2048"))
+		erosion_benchmark = std::async(std::launch::async, [this]() { return terrain_erosion_benchmark(2048, 50, thread_pool); });
+	if (erosion_benchmark_result > 0)
+		ImGui::Text("Erosion benchmark: %.1f iterations/s", erosion_benchmark_result);
+}
+
+float scene_structure::terrain_height(float x, float y) const
+{
+	if (erosion.N > 0)
+		return erosion.height_at(x, y);
+	return terrain_height_interpolate(terrain_heights, terrain_samples, terrain_length, x, y);
+}
+
+void scene_structure::decimate_terrain()
+{
+	mesh_decimation_parameters parameters;
+	parameters.target_triangles = size_t(gui.decimation_ratio * terrain_mesh.connectivity.size());
+	mesh const decimated = mesh_decimate(terrain_mesh, parameters, thread_pool, &decimation);
+
+	// The texture of the terrain is detached before clearing the previous decimation, such that it is not deleted
+	terrain_decimated.texture = opengl_texture_image_structure();
+	terrain_decimated.clear();
+	terrain_decimated.initialize_data_on_gpu(decimated);
+	terrain_decimated.material = terrain.material;
+	terrain_decimated.texture = terrain.texture;
+	gui.terrain_decimated = true;
+	std::cout << "Terrain decimated from " << terrain_mesh.connectivity.size() << " to " << decimated.connectivity.size() << " triangles in " << decimation.time << " ms" << std::endl;
 }
 
 void scene_structure::mouse_move_event()
@@ -4,7 +4,11 @@
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
 #include "terrain.hpp"
+#include "terrain_erosion.hpp"
+#include "terrain_raymarch.hpp"
+#include "mesh_decimation.hpp"
 #include "key_positions_structure.hpp"
+#include <future>
 
 // This definitions allow to use the structures: mesh, mesh_drawable, etc. without mentionning explicitly cgp::
 using cgp::mesh;
@@ -17,6 +21,13 @@ using cgp::timer_basic;
 struct gui_parameters {
 	bool display_frame = true;
 	bool display_wireframe = false;
+
+	bool terrain_raymarch = false;   // Display the terrain using ray-marching instead of the mesh
+	bool erosion = false;            // Run the erosion progressively on the terrain
+	int erosion_iterations_per_frame = 2;
+
+	bool terrain_decimated = false;  // Display the decimated terrain instead of the full resolution one
+	float decimation_ratio = 0.1f;   // Ratio of the triangles kept by the decimation
 };
 
 // The structure of the custom scene
@@ -38,13 +49,30 @@ struct scene_structure : cgp::scene_inputs_generic {
 	// Elements and shapes of the scene
 	// ****************************** //
 
+	float terrain_length = 20.0f;        // Extent of the terrain along x and y
+	int terrain_samples = 1000;          // Number of samples of the terrain grid along x and y
+	std::vector<float> terrain_heights;  // Heights of the grid read from the cache (the ones of the mesh): terrain_heights[kv+N*ku]
 	cgp::mesh terrain_mesh;
 	cgp::mesh_drawable terrain;
+	terrain_raymarch_drawable terrain_raymarch;
 	cgp::mesh_drawable tree;
 	cgp::mesh_drawable quad;
 	std::vector<cgp::vec3> tree_positions;
 	std::vector<cgp::vec3> grass_positions;
 	perlin_noise_parameters parameters;
+	terrain_erosion_structure erosion;
+	terrain_erosion_parameters erosion_parameters;
+
+	cgp::mesh_drawable terrain_decimated;     // Last decimation of the terrain mesh (shares the texture of the terrain)
+	mesh_decimation_statistics decimation;    // Measures of the last decimation
+	thread_pool_structure thread_pool;        // Workers used by the decimation and the erosion
+	void decimate_terrain();
+
+	std::future<float> erosion_benchmark;     // Erosion benchmark running in the background (iterations per second)
+	float erosion_benchmark_result = 0.0f;
+
+	// Height of the ground at (x,y): the cached heights of the mesh, or the eroded heights once the erosion has started
+	float terrain_height(float x, float y) const;
 
 	cgp::hierarchy_mesh_drawable hierarchy;
 	cgp::timer_interval timer;
@@ -66,6 +94,7 @@ struct scene_structure : cgp::scene_inputs_generic {
 	// ****************************** //
 
 	void initialize();    // Standard initialization to be called before the animation loop
+	void clear();         // Delete the GPU data that is not released by cgp, to be called after the animation loop
 	void display_frame(); // The frame display to be called within the animation loop
 	void display_gui();   // The display of the GUI, also called within the animation loop
 	void display_semiTransparent();
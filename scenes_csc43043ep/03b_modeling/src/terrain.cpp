@@ -24,7 +24,46 @@ float evaluate_terrain_height(float x, float y, float terrain_length, perlin_noi
 }
 
 
+std::vector<float> compute_terrain_heights(int N, float terrain_length, perlin_noise_parameters const& parameters)
+{
+    std::vector<float> heights(N*N);
+    for(int ku=0; ku<N; ++ku)
+    {
+        for(int kv=0; kv<N; ++kv)
+        {
+            // Compute the real coordinates (x,y) of the terrain in [-terrain_length/2, +terrain_length/2]
+            float x = (ku/(N-1.0f) - 0.5f) * terrain_length;
+            float y = (kv/(N-1.0f) - 0.5f) * terrain_length;
+
+            heights[kv+N*ku] = evaluate_terrain_height(x,y, terrain_length, parameters);
+        }
+    }
+    return heights;
+}
+
+float terrain_height_interpolate(std::vector<float> const& heights, int N, float terrain_length, float x, float y)
+{
+    // Continuous grid coordinates of (x,y), clamped to the grid
+    float const u = std::min(std::max((x / terrain_length + 0.5f) * (N - 1), 0.0f), N - 1.0f);
+    float const v = std::min(std::max((y / terrain_length + 0.5f) * (N - 1), 0.0f), N - 1.0f);
+    int const ku = std::min(int(u), N - 2);
+    int const kv = std::min(int(v), N - 2);
+    float const a = u - ku;
+    float const b = v - kv;
+
+    float const h00 = heights[kv + N * ku];
+    float const h10 = heights[kv + N * (ku + 1)];
+    float const h01 = heights[kv + 1 + N * ku];
+    float const h11 = heights[kv + 1 + N * (ku + 1)];
+    return (1 - a) * ((1 - b) * h00 + b * h01) + a * ((1 - b) * h10 + b * h11);
+}
+
 mesh create_terrain_mesh(int N, float terrain_length, perlin_noise_parameters const& parameters)
+{
+    return create_terrain_mesh(N, terrain_length, compute_terrain_heights(N, terrain_length, parameters));
+}
+
+mesh create_terrain_mesh(int N, float terrain_length, std::vector<float> const& heights)
 {
 
     mesh terrain; // temporary terrain storage (CPU only)
@@ -44,8 +83,8 @@ mesh create_terrain_mesh(int N, float terrain_length, perlin_noise_parameters co
             float x = (u - 0.5f) * terrain_length;
             float y = (v - 0.5f) * terrain_length;
 
-            // Compute the surface height function at the given sampled coordinate
-            float z = evaluate_terrain_height(x,y, terrain_length, parameters);
+            // The surface height at the given sampled coordinate is precomputed
+            float z = heights[kv+N*ku];
 
             // Store vertex coordinates
             terrain.position[kv+N*ku] = {x,y,z};
@@ -55,6 +94,7 @@ mesh create_terrain_mesh(int N, float terrain_length, perlin_noise_parameters co
 
     // Generate triangle organization
     //  Parametric surface with uniform grid sampling: generate 2 triangles for each grid cell
+    terrain.connectivity.resize(2*(N-1)*(N-1));
     for(int ku=0; ku<N-1; ++ku)
     {
         for(int kv=0; kv<N-1; ++kv)
@@ -64,8 +104,8 @@ mesh create_terrain_mesh(int N, float terrain_length, perlin_noise_parameters co
             uint3 triangle_1 = {idx, idx+1+N, idx+1};
             uint3 triangle_2 = {idx, idx+N, idx+1+N};
 
-            terrain.connectivity.push_back(triangle_1);
-            terrain.connectivity.push_back(triangle_2);
+            terrain.connectivity[2*(kv+(N-1)*ku)] = triangle_1;
+            terrain.connectivity[2*(kv+(N-1)*ku)+1] = triangle_2;
         }
     }
 
@@ -75,13 +115,55 @@ mesh create_terrain_mesh(int N, float terrain_length, perlin_noise_parameters co
     return terrain;
 }
 
-std::vector<cgp::vec3> generate_positions_on_terrain(int N_tree, float terrain_length, perlin_noise_parameters const& parameters) {
+// Changed when the generation of the heights or the layout of the cache changes, such that older files are regenerated
+static uint32_t const terrain_cache_version = 2;
+
+uint64_t terrain_parameters_key(int N, float terrain_length, perlin_noise_parameters const& parameters, heightmap_file_compression compression)
+{
+    // FNV-1a hash of all the values used to generate and store the heights
+    float const values[] = { float(terrain_cache_version), float(uint32_t(compression)), float(N), terrain_length, parameters.persistency, parameters.frequency_gain, float(parameters.octave), parameters.terrain_height };
+    unsigned char const* bytes = reinterpret_cast<unsigned char const*>(values);
+    uint64_t key = 14695981039346656037ull;
+    for (size_t k = 0; k < sizeof(values); ++k)
+        key = (key ^ bytes[k]) * 1099511628211ull;
+    return key;
+}
+
+// Read the heights of the file if it has been generated with this key
+//  The whole grid is read, as the whole terrain is meshed and displayed: the tiles are not paged in and out.
+static bool terrain_heights_read(std::string const& filename, int N, uint64_t key, heightmap_file_compression compression, std::vector<float>& heights)
+{
+    heightmap_file_structure file;
+    if (!file.open(filename) || file.header.key != key || file.N() != N || file.header.compression != uint32_t(compression))
+        return false;
+    file.read_region(0, 0, N, N, heights);
+    return true;
+}
+
+mesh create_terrain_mesh_cached(std::string const& filename, int N, float terrain_length, perlin_noise_parameters const& parameters)
+{
+    heightmap_file_compression const compression = heightmap_file_compression::quantized_16bits;
+    uint64_t const key = terrain_parameters_key(N, terrain_length, parameters, compression);
+
+    // Reuse the heights stored in the file when they were generated with the same parameters
+    std::vector<float> heights;
+    if (terrain_heights_read(filename, N, key, compression, heights))
+        return create_terrain_mesh(N, terrain_length, heights);
+
+    // Otherwise compute the heights and store them for the next run.
+    //  The mesh is built from the values read back from the file (quantized), such that all the runs give the same terrain.
+    heights = compute_terrain_heights(N, terrain_length, parameters);
+    if (heightmap_file_write(filename, heights, N, terrain_length, key, 64, compression))
+        terrain_heights_read(filename, N, key, compression, heights);
+    return create_terrain_mesh(N, terrain_length, heights);
+}
+
+std::vector<cgp::vec3> generate_positions_on_terrain(int N_tree, float terrain_length, std::vector<float> const& heights, int N) {
     std::vector<cgp::vec3> ret;
     for (int i = 0; i < N_tree; i++) {
         float x = rand_uniform(-terrain_length/2, terrain_length/2);
         float y = rand_uniform(-terrain_length/2, terrain_length/2);
-        float z = evaluate_terrain_height(x, y, terrain_length, parameters);
-        // float z = evaluate_terrainmesh_height(terrain, x, y, N_terrain, terrain_length);
+        float z = terrain_height_interpolate(heights, N, terrain_length, x, y);
         ret.push_back(vec3{x, y, z});
     }
     return ret;
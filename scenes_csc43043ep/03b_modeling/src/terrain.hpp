@@ -1,6 +1,7 @@
 #pragma once
 
 #include "cgp/cgp.hpp"
+#include "heightmap_file.hpp"
 
 struct perlin_noise_parameters
 {
@@ -19,5 +20,20 @@ float evaluate_terrain_height(float x, float y, float terrain_length, perlin_noi
 	The vertices are sampled along a regular grid structure in (x,y) directions. 
 	The total number of vertices is N*N (N along each direction x/y) 	*/
 cgp::mesh create_terrain_mesh(int N, float length, perlin_noise_parameters const& parameters);
-std::vector<cgp::vec3> generate_positions_on_terrain(int N_tree, float terrain_length, perlin_noise_parameters const& parameters);
+
+// Compute the N*N heights of the terrain grid - the height of sample (ku,kv) is stored at heights[kv+N*ku]
+std::vector<float> compute_terrain_heights(int N, float length, perlin_noise_parameters const& parameters);
+// Build the terrain mesh from precomputed heights (ex. read from a file, or eroded)
+cgp::mesh create_terrain_mesh(int N, float length, std::vector<float> const& heights);
+// Height at (x,y) interpolated bilinearly in the grid of heights (same convention as compute_terrain_heights, clamped to the terrain)
+float terrain_height_interpolate(std::vector<float> const& heights, int N, float length, float x, float y);
+
+// Key identifying the heights generated by a set of parameters and stored with this compression
+uint64_t terrain_parameters_key(int N, float length, perlin_noise_parameters const& parameters, heightmap_file_compression compression);
+/** Same as create_terrain_mesh, but the heights are read from a tiled heightmap file when it has been generated with the same parameters.
+	Otherwise the heights are computed and the file is (re)written for the next call.
+	The heights are always the ones stored in the file (16-bit quantized), on the first call as well as on the next ones. */
+cgp::mesh create_terrain_mesh_cached(std::string const& filename, int N, float length, perlin_noise_parameters const& parameters);
+// Random positions on the terrain, at the height interpolated in the N*N grid of heights
+std::vector<cgp::vec3> generate_positions_on_terrain(int N_tree, float terrain_length, std::vector<float> const& heights, int N);
 // void update_terrain(cgp::mesh& terrain, cgp::mesh_drawable& terrain_visual, perlin_noise_parameters const& parameters);
@@ -0,0 +1,258 @@
+#include "terrain_erosion.hpp"
+#include "terrain.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+using namespace cgp;
+
+// Number of rows of the grid processed by a thread at once
+static int const tile_rows = 16;
+
+
+void terrain_erosion_structure::initialize(std::vector<float> const& heights, int N_arg, float terrain_length, thread_pool_structure& thread_pool_arg)
+{
+	N = N_arg;
+	cell_length = terrain_length / (N - 1.0f);
+	size_t const size = size_t(N) * size_t(N);
+
+	height = heights;
+	water.assign(size, 0.0f);
+	sediment.assign(size, 0.0f);
+	flux_left.assign(size, 0.0f);
+	flux_right.assign(size, 0.0f);
+	flux_down.assign(size, 0.0f);
+	flux_up.assign(size, 0.0f);
+	velocity_u.assign(size, 0.0f);
+	velocity_v.assign(size, 0.0f);
+	buffer.assign(size, 0.0f);
+
+	iterations = 0;
+	thread_pool = &thread_pool_arg;
+}
+
+void terrain_erosion_structure::step(terrain_erosion_parameters const& parameters, int number_of_iterations)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+
+	for (int k = 0; k < number_of_iterations; ++k) {
+		pass_flux(parameters);
+		pass_water_velocity(parameters);
+		pass_erosion_deposition(parameters);
+		pass_sediment_transport(parameters);
+		pass_thermal(parameters);
+	}
+	iterations += number_of_iterations;
+
+	auto const time_end = std::chrono::steady_clock::now();
+	float const duration = std::chrono::duration<float>(time_end - time_start).count();
+	if (duration > 0)
+		iterations_per_second = number_of_iterations / duration;
+}
+
+
+// Outflow of water toward the 4 neighbors (rain is added on the fly: it is uniform and doesn't depend on the neighbors)
+void terrain_erosion_structure::pass_flux(terrain_erosion_parameters const& parameters)
+{
+	float const dt = parameters.dt;
+	float const rain = dt * parameters.rain;
+	float const flux_gain = dt * parameters.gravity * cell_length; // pipe section (l^2) divided by pipe length (l)
+	float const cell_area = cell_length * cell_length;
+
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+				float const d = water[idx] + rain;
+				float const H = height[idx] + d;
+
+				float const fl = ku > 0     ? std::max(0.0f, flux_left[idx]  + flux_gain * (H - height[idx - N] - water[idx - N] - rain)) : 0.0f;
+				float const fr = ku < N - 1 ? std::max(0.0f, flux_right[idx] + flux_gain * (H - height[idx + N] - water[idx + N] - rain)) : 0.0f;
+				float const fd = kv > 0     ? std::max(0.0f, flux_down[idx]  + flux_gain * (H - height[idx - 1] - water[idx - 1] - rain)) : 0.0f;
+				float const fu = kv < N - 1 ? std::max(0.0f, flux_up[idx]    + flux_gain * (H - height[idx + 1] - water[idx + 1] - rain)) : 0.0f;
+
+				// Scale the outflow such that it doesn't exceed the available water
+				float const outflow = (fl + fr + fd + fu) * dt;
+				float const K = outflow > 0 ? std::min(1.0f, d * cell_area / outflow) : 1.0f;
+
+				flux_left[idx] = K * fl;
+				flux_right[idx] = K * fr;
+				flux_down[idx] = K * fd;
+				flux_up[idx] = K * fu;
+			}
+		}
+	});
+}
+
+// Update the water height from the fluxes and deduce the velocity field
+void terrain_erosion_structure::pass_water_velocity(terrain_erosion_parameters const& parameters)
+{
+	float const dt = parameters.dt;
+	float const rain = dt * parameters.rain;
+	float const cell_area = cell_length * cell_length;
+
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+
+				float const in_left  = ku > 0     ? flux_right[idx - N] : 0.0f;
+				float const in_right = ku < N - 1 ? flux_left[idx + N]  : 0.0f;
+				float const in_down  = kv > 0     ? flux_up[idx - 1]    : 0.0f;
+				float const in_up    = kv < N - 1 ? flux_down[idx + 1]  : 0.0f;
+
+				float const inflow = in_left + in_right + in_down + in_up;
+				float const outflow = flux_left[idx] + flux_right[idx] + flux_down[idx] + flux_up[idx];
+
+				float const d1 = water[idx] + rain;
+				float const d2 = std::max(0.0f, d1 + dt * (inflow - outflow) / cell_area);
+				water[idx] = d2;
+
+				// Mean amount of water passing through the cell in each direction
+				float const wu = 0.5f * (in_left - flux_left[idx] + flux_right[idx] - in_right);
+				float const wv = 0.5f * (in_down - flux_down[idx] + flux_up[idx] - in_up);
+				float const d_mean = 0.5f * (d1 + d2);
+				float const scale = d_mean > 1e-4f ? 1.0f / (cell_length * d_mean) : 0.0f;
+				velocity_u[idx] = wu * scale;
+				velocity_v[idx] = wv * scale;
+			}
+		}
+	});
+}
+
+// Dissolve the ground in the water, or deposit the sediments, depending on the capacity of the flow
+void terrain_erosion_structure::pass_erosion_deposition(terrain_erosion_parameters const& parameters)
+{
+	float const inv_2l = 0.5f / cell_length;
+
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+
+				// Local slope of the ground
+				float const gu = (height[ku < N - 1 ? idx + N : idx] - height[ku > 0 ? idx - N : idx]) * inv_2l;
+				float const gv = (height[kv < N - 1 ? idx + 1 : idx] - height[kv > 0 ? idx - 1 : idx]) * inv_2l;
+				float const g2 = gu * gu + gv * gv;
+				float const sin_tilt = std::max(parameters.minimal_tilt, std::sqrt(g2 / (1.0f + g2)));
+
+				float const speed = std::sqrt(velocity_u[idx] * velocity_u[idx] + velocity_v[idx] * velocity_v[idx]);
+				// The capacity vanishes with the water height (no erosion on dry ground)
+				float const depth_factor = parameters.erosion_depth > 0 ? std::min(1.0f, water[idx] / parameters.erosion_depth) : 1.0f;
+				float const capacity = parameters.sediment_capacity * sin_tilt * speed * depth_factor;
+
+				float const s = sediment[idx];
+				float const delta = capacity > s ? parameters.dissolving * (capacity - s) : parameters.deposition * (capacity - s);
+				buffer[idx] = height[idx] - delta;
+				sediment[idx] = s + delta;
+			}
+		}
+	});
+	std::swap(height, buffer);
+}
+
+// Advect the sediments with the water velocity (semi-Lagrangian), and evaporate the water
+void terrain_erosion_structure::pass_sediment_transport(terrain_erosion_parameters const& parameters)
+{
+	float const dt_grid = parameters.dt / cell_length;
+	float const evaporation = std::max(0.0f, 1.0f - parameters.evaporation * parameters.dt);
+
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+
+				// Position (in grid coordinates) where the sediment comes from
+				float const u = std::min(std::max(ku - velocity_u[idx] * dt_grid, 0.0f), N - 1.001f);
+				float const v = std::min(std::max(kv - velocity_v[idx] * dt_grid, 0.0f), N - 1.001f);
+				int const u0 = int(u), v0 = int(v);
+				float const a = u - u0, b = v - v0;
+				size_t const k0 = v0 + size_t(N) * u0;
+
+				buffer[idx] = (1 - a) * ((1 - b) * sediment[k0] + b * sediment[k0 + 1]) + a * ((1 - b) * sediment[k0 + N] + b * sediment[k0 + N + 1]);
+				water[idx] *= evaporation;
+			}
+		}
+	});
+	std::swap(sediment, buffer);
+}
+
+// Move material toward the lower neighbors where the slope exceeds the talus angle
+//  The exchange between two cells is antisymmetric: the total amount of material is preserved.
+void terrain_erosion_structure::pass_thermal(terrain_erosion_parameters const& parameters)
+{
+	float const talus = parameters.talus_slope * cell_length;
+	float const rate = 0.25f * parameters.thermal_rate;
+
+	auto exchange = [=](float h, float h_neighbor) {
+		float const dh = h - h_neighbor;
+		return rate * (std::max(0.0f, dh - talus) - std::max(0.0f, -dh - talus));
+	};
+
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+				float const h = height[idx];
+
+				float out = 0.0f;
+				if (ku > 0)     out += exchange(h, height[idx - N]);
+				if (ku < N - 1) out += exchange(h, height[idx + N]);
+				if (kv > 0)     out += exchange(h, height[idx - 1]);
+				if (kv < N - 1) out += exchange(h, height[idx + 1]);
+				buffer[idx] = h - out;
+			}
+		}
+	});
+	std::swap(height, buffer);
+}
+
+
+void terrain_erosion_structure::update_terrain(mesh& terrain, mesh_drawable& terrain_drawable)
+{
+	float const inv_2l = 0.5f / cell_length;
+
+	// Normals are computed directly from the height grid (cheaper than a generic normal_update on the mesh)
+	thread_pool->parallel_for(N, tile_rows, [&](int ku_begin, int ku_end) {
+		for (int ku = ku_begin; ku < ku_end; ++ku) {
+			for (int kv = 0; kv < N; ++kv) {
+				size_t const idx = kv + size_t(N) * ku;
+				float const gu = (height[ku < N - 1 ? idx + N : idx] - height[ku > 0 ? idx - N : idx]) * inv_2l;
+				float const gv = (height[kv < N - 1 ? idx + 1 : idx] - height[kv > 0 ? idx - 1 : idx]) * inv_2l;
+
+				terrain.position[idx].z = height[idx];
+				terrain.normal[idx] = normalize(vec3{ -gu, -gv, 1.0f });
+			}
+		}
+	});
+
+	terrain_drawable.vbo_position.update(terrain.position);
+	terrain_drawable.vbo_normal.update(terrain.normal);
+}
+
+float terrain_erosion_structure::height_at(float x, float y) const
+{
+	return terrain_height_interpolate(height, N, cell_length * (N - 1), x, y);
+}
+
+
+float terrain_erosion_benchmark(int N, int number_of_iterations, thread_pool_structure& thread_pool)
+{
+	// Synthetic hilly ground
+	float const terrain_length = 20.0f;
+	std::vector<float> heights(size_t(N) * size_t(N));
+	for (int ku = 0; ku < N; ++ku) {
+		for (int kv = 0; kv < N; ++kv) {
+			float const x = ku * terrain_length / (N - 1.0f);
+			float const y = kv * terrain_length / (N - 1.0f);
+			heights[kv + size_t(N) * ku] = 2.0f * std::sin(0.7f * x) * std::cos(0.5f * y) + 0.5f * std::sin(3.1f * x + 1.7f * y);
+		}
+	}
+
+	terrain_erosion_structure erosion;
+	erosion.initialize(heights, N, terrain_length, thread_pool);
+	erosion.step(terrain_erosion_parameters(), number_of_iterations);
+
+	std::cout << "Erosion benchmark on " << N << "x" << N << " grid: " << erosion.iterations_per_second << " iterations/s (" << erosion.iterations << " iterations)" << std::endl;
+	return erosion.iterations_per_second;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "thread_pool.hpp"
+
+// Parameters of the erosion (hydraulic and thermal)
+struct terrain_erosion_parameters {
+	float dt = 0.02f;                // Time step of one iteration
+	float rain = 0.012f;             // Water added on every cell at each iteration (per time unit)
+	float gravity = 9.81f;
+	float sediment_capacity = 0.1f;  // Amount of sediment that can be carried by the water
+	float dissolving = 0.1f;         // Rate at which the ground is dissolved in the water
+	float deposition = 0.1f;         // Rate at which sediments are deposited
+	float evaporation = 0.015f;      // Rate of water evaporation
+	float minimal_tilt = 0.05f;      // Minimal slope considered for the sediment capacity (erosion on flat areas)
+	float erosion_depth = 0.1f;      // Water height below which the sediment capacity decreases linearly to 0
+
+	float talus_slope = 0.8f;        // Maximal stable slope (tan of the talus angle) for the thermal erosion
+	float thermal_rate = 0.15f;      // Fraction of the excess material moved at each iteration
+};
+
+// Grid based hydraulic erosion (virtual pipes model) and thermal erosion on a height field
+//  All the quantities are stored as separated N*N arrays (SoA), with the same convention as the terrain: value[kv + N*ku]
+//  The grid is split in horizontal tiles processed in parallel on the thread pool given at the initialization. Each pass only writes in its own tile and reads the neighboring
+//  cells (halo) of the adjacent tiles from the result of the previous pass, so that the tiles are synchronized between passes.
+struct terrain_erosion_structure {
+
+	int N = 0;                  // Number of samples along each direction
+	float cell_length = 1.0f;   // Spatial distance between two samples
+
+	std::vector<float> height;     // Ground height
+	std::vector<float> water;      // Water height
+	std::vector<float> sediment;   // Suspended sediment
+	std::vector<float> flux_left, flux_right, flux_down, flux_up; // Outflow of water toward the 4 neighbors (-u, +u, -v, +v)
+	std::vector<float> velocity_u, velocity_v; // Velocity of the water
+
+	int iterations = 0;            // Total number of iterations computed since the initialization
+	float iterations_per_second = 0.0f; // Speed measured during the last call to step()
+
+	// Set the initial ground (heights[kv + N*ku]) and remove all the water and sediment
+	//  The thread pool is used by the next calls (it must outlive them).
+	void initialize(std::vector<float> const& heights, int N, float terrain_length, thread_pool_structure& thread_pool);
+
+	// Compute a given number of iterations of hydraulic and thermal erosion
+	void step(terrain_erosion_parameters const& parameters, int number_of_iterations = 1);
+
+	// Update the z coordinates and normals of the terrain mesh from the current heights, and upload them on the GPU
+	void update_terrain(cgp::mesh& terrain, cgp::mesh_drawable& terrain_drawable);
+
+	// Current ground height at (x,y) (the terrain covers [-terrain_length/2, terrain_length/2]^2)
+	float height_at(float x, float y) const;
+
+private:
+	void pass_flux(terrain_erosion_parameters const& parameters);
+	void pass_water_velocity(terrain_erosion_parameters const& parameters);
+	void pass_erosion_deposition(terrain_erosion_parameters const& parameters);
+	void pass_sediment_transport(terrain_erosion_parameters const& parameters);
+	void pass_thermal(terrain_erosion_parameters const& parameters);
+
+	std::vector<float> buffer;   // Temporary storage for the passes that cannot be done in place
+	thread_pool_structure* thread_pool = nullptr;
+};
+
+// Measure the number of erosion iterations per second on a N x N terrain
+float terrain_erosion_benchmark(int N, int number_of_iterations, thread_pool_structure& thread_pool);
@@ -0,0 +1,376 @@
+#include "terrain_raymarch.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+using namespace cgp;
+
+namespace {
+	// Rectangle of texels [i_min,i_max[ x [j_min,j_max[
+	struct texel_region {
+		int i_min = 0, i_max = 0, j_min = 0, j_max = 0;
+
+		bool empty() const { return i_min >= i_max || j_min >= j_max; }
+		void add(int i, int j)
+		{
+			if (empty()) {
+				i_min = i; i_max = i + 1; j_min = j; j_max = j + 1;
+				return;
+			}
+			i_min = std::min(i_min, i); i_max = std::max(i_max, i + 1);
+			j_min = std::min(j_min, j); j_max = std::max(j_max, j + 1);
+		}
+	};
+}
+
+// Upload the region of a texture level from the full level stored on the CPU (width texels per row)
+static void texture_upload_region(int level, int width, texel_region const& region, GLenum format, int components, std::vector<float> const& values)
+{
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+	glTexSubImage2D(GL_TEXTURE_2D, level, region.i_min, region.j_min, region.i_max - region.i_min, region.j_max - region.j_min, format, GL_FLOAT,
+		values.data() + components * (region.i_min + size_t(width) * region.j_min));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// [min,max] of the cell (i,j) of the grid, from the heights stored as texels (i + N*j)
+//  The padding cells (outside the N-1 cells) have an empty range (min>max) and are always skipped.
+static vec2 cell_minmax(std::vector<float> const& heights_xy, int N, int i, int j)
+{
+	if (i >= N - 1 || j >= N - 1)
+		return { 1e30f, -1e30f };
+	float const h00 = heights_xy[i + size_t(N) * j];
+	float const h10 = heights_xy[i + 1 + size_t(N) * j];
+	float const h01 = heights_xy[i + size_t(N) * (j + 1)];
+	float const h11 = heights_xy[i + 1 + size_t(N) * (j + 1)];
+	return { std::min(std::min(h00, h10), std::min(h01, h11)), std::max(std::max(h00, h10), std::max(h01, h11)) };
+}
+
+// [min,max] of the 2x2 texels of the previous level (of size 2*size) covered by the texel (i,j)
+static vec2 texel_minmax(std::vector<float> const& previous, int size, int i, int j)
+{
+	size_t const a = 2 * (2 * i + size_t(2 * size) * (2 * j));
+	size_t const b = a + 2;
+	size_t const c = a + 2 * size_t(2 * size);
+	size_t const d = c + 2;
+	return { std::min(std::min(previous[a], previous[b]), std::min(previous[c], previous[d])),
+		std::max(std::max(previous[a + 1], previous[b + 1]), std::max(previous[c + 1], previous[d + 1])) };
+}
+
+// Triangles of the box [p_min,p_max] with counter-clockwise orientation seen from outside
+static std::vector<vec3> box_triangles(vec3 const& p_min, vec3 const& p_max)
+{
+	std::vector<vec3> triangles;
+	vec3 const center = (p_min + p_max) / 2.0f;
+	for (int axis = 0; axis < 3; ++axis) {
+		for (int side = 0; side < 2; ++side) {
+			int const a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+			vec3 q[4];
+			for (int k = 0; k < 4; ++k) {
+				q[k][axis] = side == 0 ? p_min[axis] : p_max[axis];
+				q[k][a1] = (k == 1 || k == 2) ? p_max[a1] : p_min[a1];
+				q[k][a2] = (k >= 2) ? p_max[a2] : p_min[a2];
+			}
+			// Flip the quad if its normal points inward
+			if (dot(cross(q[1] - q[0], q[2] - q[0]), q[0] - center) < 0)
+				std::swap(q[1], q[3]);
+			vec3 const quad[6] = { q[0], q[1], q[2], q[0], q[2], q[3] };
+			triangles.insert(triangles.end(), quad, quad + 6);
+		}
+	}
+	return triangles;
+}
+
+
+void terrain_raymarch_drawable::initialize_data_on_gpu(std::vector<float> const& heights, int N_arg, float terrain_length_arg, opengl_shader_structure const& shader_arg)
+{
+	clear_data();
+	N = N_arg;
+	terrain_length = terrain_length_arg;
+	shader = shader_arg;
+
+	// The pyramid is built over the N-1 cells padded to a power of two size P: minmax[k] stores the level k as
+	//  (P>>k)^2 pairs of (min,max) with texel (i,j) at index 2*(i + (P>>k)*j)
+	int P = 1;
+	levels = 1;
+	while (P < N - 1) {
+		P *= 2;
+		levels++;
+	}
+	minmax.resize(levels);
+	for (int level = 0; level < levels; ++level)
+		minmax[level].resize(2 * size_t(P >> level) * size_t(P >> level));
+	heights_xy.clear();
+
+	// Storage of the textures and of the proxy, filled by update
+	glGenTextures(1, &height_texture);
+	glBindTexture(GL_TEXTURE_2D, height_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, N, N, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// Min/max pyramid stored in the mipmap levels
+	glGenTextures(1, &minmax_texture);
+	glBindTexture(GL_TEXTURE_2D, minmax_texture);
+	for (int level = 0; level < levels; ++level)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RG32F, P >> level, P >> level, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo_position);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_position);
+	glBufferData(GL_ARRAY_BUFFER, 36 * sizeof(vec3), nullptr, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	update(heights);
+}
+
+void terrain_raymarch_drawable::update(std::vector<float> const& heights)
+{
+	bool const first = heights_xy.empty();
+	int const P = 1 << (levels - 1);
+
+	// Heights texture: texel (i,j) is the sample at (x_i,y_j). Only the region of the samples that changed is uploaded.
+	if (first)
+		heights_xy.resize(size_t(N) * size_t(N));
+	texel_region changed;
+	for (int j = 0; j < N; ++j) {
+		for (int i = 0; i < N; ++i) {
+			float const h = heights[j + size_t(N) * i];
+			float& texel = heights_xy[i + size_t(N) * j];
+			if (first || texel != h) {
+				texel = h;
+				changed.add(i, j);
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, height_texture);
+	if (!changed.empty())
+		texture_upload_region(0, N, changed, GL_RED, 1, heights_xy);
+
+	// Min/max pyramid: the cells around the changed samples are recomputed, then at each level the texels covering the
+	//  ones that changed in the level below. The levels above a level without change are not touched.
+	texel_region region;
+	if (first)
+		region = { 0, P, 0, P };
+	else if (!changed.empty())
+		region = { std::max(0, changed.i_min - 1), std::min(N - 1, changed.i_max), std::max(0, changed.j_min - 1), std::min(N - 1, changed.j_max) };
+	glBindTexture(GL_TEXTURE_2D, minmax_texture);
+	for (int level = 0; level < levels && !region.empty(); ++level) {
+		int const size = P >> level;
+		std::vector<float>& current = minmax[level];
+		texel_region changed_level;
+		for (int j = region.j_min; j < region.j_max; ++j) {
+			for (int i = region.i_min; i < region.i_max; ++i) {
+				vec2 const value = level == 0 ? cell_minmax(heights_xy, N, i, j) : texel_minmax(minmax[level - 1], size, i, j);
+				size_t const idx = 2 * (i + size_t(size) * j);
+				if (first || current[idx] != value.x || current[idx + 1] != value.y) {
+					current[idx] = value.x;
+					current[idx + 1] = value.y;
+					changed_level.add(i, j);
+				}
+			}
+		}
+		if (!changed_level.empty())
+			texture_upload_region(level, size, changed_level, GL_RG, 2, current);
+		region = changed_level;
+		region.i_min /= 2; region.j_min /= 2;
+		region.i_max = (region.i_max + 1) / 2; region.j_max = (region.j_max + 1) / 2;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Bounding box proxy: it only changes with the global min/max (top level of the pyramid)
+	float const margin = 1e-3f * terrain_length;
+	float const z_min = minmax.back()[0] - margin;
+	float const z_max = minmax.back()[1] + margin;
+	if (first || z_min != box_min.z || z_max != box_max.z) {
+		box_min = { -terrain_length / 2, -terrain_length / 2, z_min };
+		box_max = { terrain_length / 2, terrain_length / 2, z_max };
+		std::vector<vec3> const box = box_triangles(box_min, box_max);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo_position);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, box.size() * sizeof(vec3), box.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void terrain_raymarch_drawable::clear_data()
+{
+	if (height_texture != 0)
+		glDeleteTextures(1, &height_texture);
+	if (minmax_texture != 0)
+		glDeleteTextures(1, &minmax_texture);
+	if (vbo_position != 0)
+		glDeleteBuffers(1, &vbo_position);
+	if (vao != 0)
+		glDeleteVertexArrays(1, &vao);
+	height_texture = 0;
+	minmax_texture = 0;
+	vbo_position = 0;
+	vao = 0;
+	heights_xy.clear();
+	minmax.clear();
+}
+
+void terrain_raymarch_drawable::clear()
+{
+	clear_data();
+	if (shader.id != 0)
+		glDeleteProgram(shader.id);
+	shader = opengl_shader_structure();
+	levels = 0;
+}
+
+size_t terrain_raymarch_drawable::memory_gpu() const
+{
+	if (levels == 0)
+		return 0;
+	size_t memory = size_t(N) * size_t(N) * sizeof(float);
+	size_t const P = size_t(1) << (levels - 1);
+	for (int level = 0; level < levels; ++level)
+		memory += (P >> level) * (P >> level) * 2 * sizeof(float);
+	memory += 36 * sizeof(vec3);
+	return memory;
+}
+
+
+void draw(terrain_raymarch_drawable const& drawable, environment_generic_structure const& environment)
+{
+	opengl_shader_structure const& shader = drawable.shader;
+	glUseProgram(shader.id);
+
+	// Camera and light from the environment
+	environment.send_opengl_uniform(shader, true);
+
+	opengl_uniform(shader, "N", drawable.N);
+	opengl_uniform(shader, "levels", drawable.levels);
+	opengl_uniform(shader, "terrain_length", drawable.terrain_length);
+	opengl_uniform(shader, "box_min", drawable.box_min);
+	opengl_uniform(shader, "box_max", drawable.box_max);
+	opengl_uniform(shader, "max_steps", drawable.max_steps);
+	opengl_uniform(shader, "color", drawable.material.color);
+	opengl_uniform(shader, "ambient", drawable.material.phong.ambient);
+	opengl_uniform(shader, "diffuse", drawable.material.phong.diffuse);
+	opengl_uniform(shader, "specular", drawable.material.phong.specular);
+	opengl_uniform(shader, "specular_exponent", drawable.material.phong.specular_exponent);
+	opengl_uniform(shader, "use_texture", drawable.texture != 0 && drawable.material.texture_settings.use_texture);
+	opengl_uniform(shader, "texture_inverse_v", drawable.material.texture_settings.texture_inverse_v);
+	opengl_uniform(shader, "uv_scale", drawable.uv_scale);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, drawable.height_texture);
+	opengl_uniform(shader, "height_texture", 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, drawable.minmax_texture);
+	opengl_uniform(shader, "minmax_texture", 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, drawable.texture);
+	opengl_uniform(shader, "image_texture", 2);
+
+	// Only the back faces of the box are rasterized: one fragment per pixel, even when the camera is inside the box
+	glEnable(GL_CULL_FACE);
+	glCullFace(GL_FRONT);
+	glBindVertexArray(drawable.vao);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glBindVertexArray(0);
+	glCullFace(GL_BACK);
+	glDisable(GL_CULL_FACE);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
+
+
+size_t terrain_mesh_memory_gpu(int N)
+{
+	size_t const vertices = size_t(N) * size_t(N);
+	size_t const triangles = 2 * size_t(N - 1) * size_t(N - 1);
+	return vertices * (3 * sizeof(vec3) + sizeof(vec2)) + triangles * sizeof(uint3);
+}
+
+// Average time (ms) of a draw call, measured on the CPU after waiting for the GPU to finish
+template <typename DRAW_FUNCTION>
+static float average_draw_time(DRAW_FUNCTION const& draw_call, int repetitions)
+{
+	draw_call(); // warm-up
+	glFinish();
+	auto const time_start = std::chrono::steady_clock::now();
+	for (int k = 0; k < repetitions; ++k)
+		draw_call();
+	glFinish();
+	auto const time_end = std::chrono::steady_clock::now();
+	return std::chrono::duration<float, std::milli>(time_end - time_start).count() / repetitions;
+}
+
+void terrain_rendering_benchmark(environment_generic_structure const& environment, mesh_drawable const& terrain, terrain_raymarch_drawable const& terrain_raymarch_displayed, perlin_noise_parameters const& parameters, float terrain_length)
+{
+	int const resolutions[] = { 128, 256, 512, 1024, 2048 };
+	int const repetitions = 20;
+
+	// Off-screen framebuffer of the size of the viewport: the benchmark draws are not part of the displayed frame
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	GLint framebuffer_previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer_previous);
+	GLuint framebuffer = 0, renderbuffers[2] = { 0, 0 };
+	glGenFramebuffers(1, &framebuffer);
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, viewport[2], viewport[3]);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, viewport[2], viewport[3]);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "The off-screen framebuffer of the benchmark is incomplete" << std::endl;
+	else {
+		glViewport(0, 0, viewport[2], viewport[3]);
+
+		std::cout << "\nTerrain rendering benchmark (average over " << repetitions << " draws of " << viewport[2] << "x" << viewport[3] << " pixels)" << std::endl;
+		std::cout << "     N | mesh (ms) | ray-march (ms) | mesh (MB) | ray-march (MB)" << std::endl;
+		for (int N : resolutions) {
+			std::vector<float> const heights = compute_terrain_heights(N, terrain_length, parameters);
+
+			mesh_drawable terrain_mesh;
+			terrain_mesh.initialize_data_on_gpu(create_terrain_mesh(N, terrain_length, heights), terrain.shader, terrain.texture);
+			terrain_mesh.material = terrain.material;
+			terrain_raymarch_drawable terrain_raymarch;
+			terrain_raymarch.initialize_data_on_gpu(heights, N, terrain_length, terrain_raymarch_displayed.shader);
+			terrain_raymarch.material = terrain_raymarch_displayed.material;
+			terrain_raymarch.texture = terrain_raymarch_displayed.texture;
+			terrain_raymarch.uv_scale = terrain_raymarch_displayed.uv_scale;
+
+			// Each draw starts from a cleared depth buffer, such that the repeated draws of the mesh are not discarded by the depth test
+			float const time_mesh = average_draw_time([&]() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); draw(terrain_mesh, environment); }, repetitions);
+			float const time_raymarch = average_draw_time([&]() { glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); draw(terrain_raymarch, environment); }, repetitions);
+
+			std::cout << "  " << N << " | " << time_mesh << " | " << time_raymarch << " | "
+				<< terrain_mesh_memory_gpu(N) / (1024.0f * 1024.0f) << " | " << terrain_raymarch.memory_gpu() / (1024.0f * 1024.0f) << std::endl;
+
+			// The shaders and the texture belong to the displayed terrain
+			terrain_mesh.texture = opengl_texture_image_structure();
+			terrain_mesh.clear();
+			terrain_raymarch.shader = opengl_shader_structure();
+			terrain_raymarch.clear();
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, GLuint(framebuffer_previous));
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteRenderbuffers(2, renderbuffers);
+	glDeleteFramebuffers(1, &framebuffer);
+}
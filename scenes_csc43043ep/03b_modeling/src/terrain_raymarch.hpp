@@ -0,0 +1,55 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "terrain.hpp"
+
+// Terrain displayed by ray-marching its height field in the fragment shader
+//  Instead of a mesh of 2(N-1)^2 triangles, only a bounding box is drawn. The heights are stored in a texture,
+//  together with a min/max pyramid over the grid cells used to take large steps above the terrain.
+//  The shader is expected to be shaders/terrain_raymarch/terrain_raymarch.[vert/frag].glsl
+struct terrain_raymarch_drawable {
+
+	cgp::opengl_shader_structure shader;
+	cgp::material_mesh_drawable material;  // Shading of the terrain mesh (color, phong coefficients and texture settings)
+	GLuint texture = 0;     // Color texture of the terrain mesh (not owned, 0: uniform color)
+	float uv_scale = 5.0f;  // The uv of the terrain mesh go from 0 to uv_scale along x and y
+	int max_steps = 512;    // Maximal number of steps of the traversal for each pixel
+
+	int N = 0;              // Number of samples along each direction
+	float terrain_length = 0.0f;
+	int levels = 0;         // Number of levels in the min/max pyramid
+	cgp::vec3 box_min;      // Bounding box of the terrain (the ray-marching proxy)
+	cgp::vec3 box_max;
+
+	GLuint vao = 0;             // Bounding box geometry
+	GLuint vbo_position = 0;
+	GLuint height_texture = 0;  // N x N heights (R32F)
+	GLuint minmax_texture = 0;  // [min,max] pyramid over the cells (RG32F)
+
+	// Heights are given with the same convention than the terrain mesh: heights[kv + N*ku]
+	void initialize_data_on_gpu(std::vector<float> const& heights, int N, float terrain_length, cgp::opengl_shader_structure const& shader);
+	// Update the textures with new heights for the same grid size (ex. after erosion)
+	//  Only the texels that changed are uploaded, and only the pyramid levels above them are recomputed.
+	void update(std::vector<float> const& heights);
+	// Delete the textures, the proxy and the shader program (to be called before the OpenGL context is destroyed)
+	void clear();
+
+	// Memory used on the GPU by the textures and the proxy, in bytes
+	size_t memory_gpu() const;
+
+private:
+	void clear_data();
+
+	// Copies of the textures, used to find the texels that changed at each update
+	std::vector<float> heights_xy;                 // Height of the sample (x_i,y_j) at index i + N*j
+	std::vector<std::vector<float> > minmax;       // Level k of the pyramid: (P>>k)^2 pairs of (min,max)
+};
+
+void draw(terrain_raymarch_drawable const& drawable, cgp::environment_generic_structure const& environment);
+
+// Memory used on the GPU by the terrain mesh of N x N vertices, in bytes (positions, normals, colors, uv, and triangle indices)
+size_t terrain_mesh_memory_gpu(int N);
+
+// Compare the frame time and memory of the mesh and the ray-marched terrains for several grid resolutions (displayed on the command line)
+//  Both terrains use the shaders, material and texture of the displayed ones, and are drawn in an off-screen framebuffer.
+void terrain_rendering_benchmark(cgp::environment_generic_structure const& environment, cgp::mesh_drawable const& terrain, terrain_raymarch_drawable const& terrain_raymarch, perlin_noise_parameters const& parameters, float terrain_length);
@@ -0,0 +1,171 @@
+#include "asset_loader.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+
+template <typename T>
+static bool future_ready(std::shared_future<T> const& f)
+{
+	return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+static float milliseconds_since(std::chrono::steady_clock::time_point const& t)
+{
+	return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+
+void asset_loader_structure::initialize(int number_of_threads)
+{
+	time_start = std::chrono::steady_clock::now();
+#ifndef __EMSCRIPTEN__
+	if (number_of_threads <= 0)
+		number_of_threads = std::min(8, std::max(1, int(std::thread::hardware_concurrency())));
+	for (int k = 0; k < number_of_threads; ++k)
+		workers.push_back(std::thread([this]() { worker_loop(); }));
+#else
+	(void)number_of_threads;
+#endif
+}
+
+asset_loader_structure::~asset_loader_structure()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition.notify_all();
+#ifndef __EMSCRIPTEN__
+	for (std::thread& t : workers)
+		t.join();
+#endif
+}
+
+void asset_loader_structure::worker_loop()
+{
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this]() { return stop || !tasks.empty(); });
+			if (tasks.empty()) // The queue is drained before stopping: every future returned by a load receives its result
+				return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+template <typename T>
+std::shared_future<T> asset_loader_structure::submit(std::function<T()> const& function)
+{
+	// The task measures its own time, then stores the result in the future
+	auto task = std::make_shared<std::packaged_task<T()>>([this, function]() {
+		auto const time_load_start = std::chrono::steady_clock::now();
+		T result = function();
+		float const time = milliseconds_since(time_load_start);
+		std::lock_guard<std::mutex> lock(mutex);
+		time_sum += time;
+		time_slowest = std::max(time_slowest, time);
+		return result;
+	});
+	std::shared_future<T> result = task->get_future().share();
+
+#ifndef __EMSCRIPTEN__
+	if (!workers.empty()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back([task]() { (*task)(); });
+		}
+		condition.notify_one();
+		return result;
+	}
+#endif
+	(*task)();
+	return result;
+}
+
+std::shared_future<mesh> asset_loader_structure::load_mesh(std::function<mesh()> const& function)
+{
+	return submit<mesh>(function);
+}
+
+std::shared_future<image_structure> asset_loader_structure::load_image(std::string const& filename)
+{
+	return submit<image_structure>([filename]() { return image_load_file(filename); });
+}
+
+void asset_loader_structure::add_drawable(mesh_drawable& drawable, std::shared_future<mesh> const& geometry, std::shared_future<image_structure> const& image,
+	GLint wrap_s, GLint wrap_t, std::function<void(mesh_drawable&)> const& on_ready)
+{
+	pending.push_back({ &drawable, geometry, image, wrap_s, wrap_t, on_ready, std::string() });
+	statistics.requested++;
+}
+
+void asset_loader_structure::add_drawable(mesh_drawable& drawable, std::shared_future<mesh> const& geometry, std::string const& image_filename,
+	GLint wrap_s, GLint wrap_t, std::function<void(mesh_drawable&)> const& on_ready)
+{
+	// The texture of a file already in the registry is shared without decoding the file
+	std::shared_future<image_structure> image;
+	if (texture_registry == nullptr || !texture_registry->contains(image_filename, wrap_s, wrap_t)) {
+		auto it = images.find(image_filename);
+		if (it == images.end())
+			it = images.insert({ image_filename, load_image(image_filename) }).first;
+		image = it->second;
+	}
+	pending.push_back({ &drawable, geometry, image, wrap_s, wrap_t, on_ready, image_filename });
+	statistics.requested++;
+}
+
+void asset_loader_structure::update(float budget_ms)
+{
+	if (pending.empty())
+		return;
+
+	auto const time_update_start = std::chrono::steady_clock::now();
+	bool first_upload = true;
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (!first_upload && milliseconds_since(time_update_start) >= budget_ms)
+			break;
+		if (!future_ready(it->geometry) || (it->image.valid() && !future_ready(it->image))) {
+			++it;
+			continue;
+		}
+
+		// The mesh is uploaded first: initialize_data_on_gpu resets the texture to the default one
+		auto const time_upload_start = std::chrono::steady_clock::now();
+		mesh_drawable& drawable = *it->drawable;
+		drawable.initialize_data_on_gpu(it->geometry.get());
+		if (texture_registry != nullptr && !it->image_filename.empty()) {
+			opengl_texture_image_structure const texture = it->image.valid() ? texture_registry->load(it->image_filename, it->image.get(), it->wrap_s, it->wrap_t) : texture_registry->load(it->image_filename, it->wrap_s, it->wrap_t);
+			if (texture.id != 0) // Otherwise the file cannot be decoded, and the drawable keeps its default texture
+				drawable.texture = texture;
+		}
+		else if (it->image.valid() && it->image.get().width > 0)
+			drawable.texture.initialize_texture_2d_on_gpu(it->image.get(), it->wrap_s, it->wrap_t);
+		statistics.time_upload += milliseconds_since(time_upload_start);
+
+		uploaded_drawables.insert(&drawable);
+		statistics.uploaded++;
+		if (it->on_ready)
+			it->on_ready(drawable);
+		it = pending.erase(it);
+		first_upload = false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		statistics.time_sum = time_sum;
+		statistics.time_slowest = time_slowest;
+	}
+	statistics.time_total = milliseconds_since(time_start);
+
+	if (pending.empty()) {
+		images.clear(); // The decoded images are no longer needed once uploaded
+		std::cout << "Assets: " << statistics.uploaded << " drawables loaded in " << statistics.time_total << " ms (sequential loads: " << statistics.time_sum
+			<< " ms, slowest load: " << statistics.time_slowest << " ms, uploads: " << statistics.time_upload << " ms)" << std::endl;
+	}
+}
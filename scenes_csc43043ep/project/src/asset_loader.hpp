@@ -0,0 +1,97 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "texture_registry.hpp"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+// Asynchronous loading of the assets of a scene
+// ********************************************** //
+//  The images are decoded and the meshes are parsed (or built) on worker threads, and each load returns a future.
+//  The OpenGL calls remain on the main thread: a drawable requested with add_drawable is uploaded by update(),
+//  called once per frame, as soon as its mesh and its image are ready. update() stops after a budget of time,
+//  such that the frames keep being displayed while the assets arrive, and the total time of the loading is close
+//  to the slowest asset instead of the sum of all of them.
+//  When compiled with emscripten, the loads are run on the calling thread and the uploads are still spread over the frames.
+
+struct asset_loader_statistics {
+	int requested = 0;          // Number of drawables requested
+	int uploaded = 0;           // Number of drawables uploaded on the GPU
+	float time_total = 0.0f;    // Time between the first request and the last upload (ms)
+	float time_sum = 0.0f;      // Sum of the times of the loads on the workers (ms): time of a sequential loading
+	float time_slowest = 0.0f;  // Time of the slowest load (ms)
+	float time_upload = 0.0f;   // Time spent in the uploads on the main thread (ms)
+};
+
+struct asset_loader_structure {
+
+	// Start the worker threads (0: use the number of hardware threads, with at most 8 threads)
+	void initialize(int number_of_threads = 0);
+	// Wait for the loads already submitted, then stop the workers
+	~asset_loader_structure();
+
+	// Run the function on a worker, and return its result as a future
+	std::shared_future<cgp::mesh> load_mesh(std::function<cgp::mesh()> const& function);
+	// Decode the image file (png or jpg)
+	std::shared_future<cgp::image_structure> load_image(std::string const& filename);
+
+	// Upload of the drawable once its mesh (and its image if valid) are ready, followed by the call of on_ready (on the main thread).
+	//  The drawable must remain at the same address until it is uploaded.
+	void add_drawable(cgp::mesh_drawable& drawable, std::shared_future<cgp::mesh> const& geometry, std::shared_future<cgp::image_structure> const& image = {},
+		GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE, std::function<void(cgp::mesh_drawable&)> const& on_ready = nullptr);
+
+	// Same with the image of a file: the file is decoded once for all the drawables using it, and the texture is shared
+	//  through texture_registry when it is set
+	void add_drawable(cgp::mesh_drawable& drawable, std::shared_future<cgp::mesh> const& geometry, std::string const& image_filename,
+		GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE, std::function<void(cgp::mesh_drawable&)> const& on_ready = nullptr);
+
+	// Upload the ready drawables during at most budget_ms (at least one upload if one is ready). To be called on the main thread at each frame.
+	void update(float budget_ms = 4.0f);
+
+	bool ready(cgp::mesh_drawable const& drawable) const { return uploaded_drawables.count(&drawable) > 0; }
+	bool done() const { return pending.empty(); }
+
+	asset_loader_statistics statistics;
+	texture_registry_structure* texture_registry = nullptr;  // Optional registry of the textures of the files
+
+private:
+	struct upload_request {
+		cgp::mesh_drawable* drawable;
+		std::shared_future<cgp::mesh> geometry;
+		std::shared_future<cgp::image_structure> image;
+		GLint wrap_s, wrap_t;
+		std::function<void(cgp::mesh_drawable&)> on_ready;
+		std::string image_filename;  // Empty if the image doesn't come from add_drawable with a file
+	};
+
+	// Run the function on a worker and add its time to the statistics
+	template <typename T> std::shared_future<T> submit(std::function<T()> const& function);
+	void worker_loop();
+
+	std::deque<upload_request> pending;
+	std::set<cgp::mesh_drawable const*> uploaded_drawables;
+	std::map<std::string, std::shared_future<cgp::image_structure>> images; // Images of the files being loaded
+	std::chrono::steady_clock::time_point time_start;
+
+	float time_sum = 0.0f;      // Times of the loads, written by the workers (protected by the mutex)
+	float time_slowest = 0.0f;
+
+#ifndef __EMSCRIPTEN__
+	std::vector<std::thread> workers;
+#endif
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stop = false;
+};
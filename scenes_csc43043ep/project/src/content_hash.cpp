@@ -0,0 +1,22 @@
+#include "content_hash.hpp"
+
+#include <cstring>
+
+
+uint64_t content_hash(void const* data_arg, size_t size)
+{
+	char const* data = static_cast<char const*>(data_arg);
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+	size_t k = 0;
+	for (; k + 8 <= size; k += 8) {
+		uint64_t word;
+		std::memcpy(&word, data + k, 8);
+		h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+	}
+	for (; k < size; ++k)
+		h = (h ^ uint64_t(static_cast<unsigned char>(data[k]))) * 0x100000001B3ull;
+	h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
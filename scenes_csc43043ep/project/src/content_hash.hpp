@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Hash of a block of memory, read by words of 8 bytes (used to detect the changes of the content of the files,
+//  and the images with the same pixels)
+uint64_t content_hash(void const* data, size_t size);
@@ -0,0 +1,250 @@
+#include "mesh_cache.hpp"
+#include "content_hash.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cgp;
+
+
+namespace {
+	// Read-only mapping of a whole file
+	struct mapped_file {
+		char const* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int descriptor = -1;
+#endif
+		mapped_file() = default;
+		mapped_file(mapped_file const&) = delete;
+		mapped_file& operator=(mapped_file const&) = delete;
+		~mapped_file();
+		bool open(std::string const& filename);
+	};
+
+	// Header of the cache files, followed by the arrays position, normal, color, uv and connectivity
+	struct mesh_cache_file_header {
+		char magic[4];           // "MESH"
+		uint32_t version;
+		uint64_t source_size;    // Size of the obj file
+		uint64_t source_hash;    // Hash of the content of the obj file
+		float time_parse;        // Time of mesh_load_file_obj when the cache was written (ms)
+		uint32_t count[5];       // Number of elements of each array
+	};
+}
+static uint32_t const mesh_cache_file_version = 1;
+
+static_assert(sizeof(vec3) == 3 * sizeof(float) && sizeof(vec2) == 2 * sizeof(float) && sizeof(uint3) == 3 * sizeof(unsigned int),
+	"The arrays of the mesh are copied as blocks of floats and integers");
+
+#ifdef _WIN32
+bool mapped_file::open(std::string const& filename)
+{
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+		return false;
+	size = size_t(file_size.QuadPart);
+	if (size == 0)
+		return true;
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return false;
+	data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	return data != nullptr;
+}
+
+mapped_file::~mapped_file()
+{
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+#else
+bool mapped_file::open(std::string const& filename)
+{
+	descriptor = ::open(filename.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+	struct stat status;
+	if (fstat(descriptor, &status) != 0)
+		return false;
+	size = size_t(status.st_size);
+	if (size == 0)
+		return true;
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (mapping == MAP_FAILED)
+		return false;
+	data = static_cast<char const*>(mapping);
+	return true;
+}
+
+mapped_file::~mapped_file()
+{
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), size);
+	if (descriptor >= 0)
+		::close(descriptor);
+}
+#endif
+
+
+template <typename T>
+static size_t array_bytes(numarray<T> const& a)
+{
+	return a.size() * sizeof(T);
+}
+
+// Copy count elements from the mapping in a single block
+template <typename T>
+static void array_read(numarray<T>& a, char const*& cursor, uint32_t count)
+{
+	a.resize(count);
+	if (count > 0)
+		std::memcpy(a.data.data(), cursor, size_t(count) * sizeof(T));
+	cursor += size_t(count) * sizeof(T);
+}
+
+template <typename T>
+static void array_write(std::ofstream& stream, numarray<T> const& a)
+{
+	if (a.size() > 0)
+		stream.write(reinterpret_cast<char const*>(a.data.data()), array_bytes(a));
+}
+
+// Read the mesh if the cache file exists and corresponds to the content of the obj file
+static bool mesh_cache_file_read(std::string const& filename, uint64_t source_size, uint64_t source_hash, mesh& m, mesh_cache_statistics& statistics)
+{
+	mapped_file file;
+	if (!file.open(filename) || file.size < sizeof(mesh_cache_file_header))
+		return false;
+
+	mesh_cache_file_header header;
+	std::memcpy(&header, file.data, sizeof(header));
+	if (std::memcmp(header.magic, "MESH", 4) != 0 || header.version != mesh_cache_file_version || header.source_size != source_size || header.source_hash != source_hash)
+		return false;
+
+	size_t const element_size[5] = { sizeof(vec3), sizeof(vec3), sizeof(vec3), sizeof(vec2), sizeof(uint3) };
+	size_t expected_size = sizeof(header);
+	for (int k = 0; k < 5; ++k)
+		expected_size += size_t(header.count[k]) * element_size[k];
+	if (file.size != expected_size)
+		return false;
+
+	char const* cursor = file.data + sizeof(header);
+	array_read(m.position, cursor, header.count[0]);
+	array_read(m.normal, cursor, header.count[1]);
+	array_read(m.color, cursor, header.count[2]);
+	array_read(m.uv, cursor, header.count[3]);
+	array_read(m.connectivity, cursor, header.count[4]);
+
+	statistics.time_parse = header.time_parse;
+	statistics.bytes = file.size;
+	return true;
+}
+
+// Write the cache in a temporary file renamed at the end, such that an interrupted write never leaves a partial cache
+static void mesh_cache_file_write(std::string const& filename, uint64_t source_size, uint64_t source_hash, mesh const& m, mesh_cache_statistics& statistics)
+{
+	mesh_cache_file_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "MESH", 4);
+	header.version = mesh_cache_file_version;
+	header.source_size = source_size;
+	header.source_hash = source_hash;
+	header.time_parse = statistics.time_parse;
+	header.count[0] = uint32_t(m.position.size());
+	header.count[1] = uint32_t(m.normal.size());
+	header.count[2] = uint32_t(m.color.size());
+	header.count[3] = uint32_t(m.uv.size());
+	header.count[4] = uint32_t(m.connectivity.size());
+
+	std::string const filename_temporary = filename + ".tmp";
+	{
+		std::ofstream stream(filename_temporary, std::ios::binary);
+		if (stream.good() == false) {
+			std::cout << "Cannot write mesh cache file " << filename << std::endl;
+			return;
+		}
+		stream.write(reinterpret_cast<char const*>(&header), sizeof(header));
+		array_write(stream, m.position);
+		array_write(stream, m.normal);
+		array_write(stream, m.color);
+		array_write(stream, m.uv);
+		array_write(stream, m.connectivity);
+		if (!stream) {
+			std::cout << "Cannot write mesh cache file " << filename << std::endl;
+			return;
+		}
+	}
+	std::remove(filename.c_str());
+	if (std::rename(filename_temporary.c_str(), filename.c_str()) != 0) {
+		std::cout << "Cannot write mesh cache file " << filename << std::endl;
+		std::remove(filename_temporary.c_str());
+		return;
+	}
+	statistics.bytes = sizeof(header) + array_bytes(m.position) + array_bytes(m.normal) + array_bytes(m.color) + array_bytes(m.uv) + array_bytes(m.connectivity);
+}
+
+
+mesh mesh_load_file_obj_cached(std::string const& filename, mesh_cache_statistics* statistics_arg)
+{
+	auto const time_start = std::chrono::steady_clock::now();
+	mesh_cache_statistics statistics;
+	std::string const filename_cache = filename + ".meshcache";
+
+	uint64_t source_size = 0, source_hash = 0;
+	{
+		mapped_file source;
+		if (source.open(filename)) {
+			source_size = source.size;
+			source_hash = content_hash(source.data, source.size);
+		}
+	}
+
+	mesh m;
+	if (source_size > 0 && mesh_cache_file_read(filename_cache, source_size, source_hash, m, statistics)) {
+		statistics.hit = true;
+	}
+	else {
+		auto const time_parse_start = std::chrono::steady_clock::now();
+		m = mesh_load_file_obj(filename);
+		statistics.time_parse = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_parse_start).count();
+		if (source_size > 0 && m.position.size() > 0)
+			mesh_cache_file_write(filename_cache, source_size, source_hash, m, statistics);
+	}
+
+	statistics.time_load = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+	if (statistics_arg != nullptr)
+		*statistics_arg = statistics;
+	return m;
+}
+
+void mesh_cache_report(std::string const& filename, mesh_cache_statistics const& statistics)
+{
+	if (statistics.hit)
+		std::cout << "Mesh cache " << filename << ": loaded in " << statistics.time_load << " ms instead of " << statistics.time_parse << " ms (saved "
+			<< statistics.time_parse - statistics.time_load << " ms, " << statistics.bytes / 1024 << " kB)" << std::endl;
+	else
+		std::cout << "Mesh cache " << filename << ": parsed in " << statistics.time_parse << " ms, cache written (" << statistics.bytes / 1024 << " kB)" << std::endl;
+}
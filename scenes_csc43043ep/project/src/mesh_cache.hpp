@@ -0,0 +1,26 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+// Binary cache of the meshes loaded from obj files
+// ********************************************** //
+//  The first load of an obj file parses it with mesh_load_file_obj, and writes the resulting mesh next to it
+//  (filename + ".meshcache"): a header followed by the raw arrays position, normal, color, uv and connectivity.
+//  The next loads map the cache file in memory and copy each array in one block, without parsing the text.
+//  The header stores the size and a hash of the content of the obj file: the cache is rebuilt when the obj file
+//  changes, or when the version of the format changes.
+//  The cache belongs to this scene: the other scenes are standalone builds, and keep loading their obj files
+//  with mesh_load_file_obj.
+
+struct mesh_cache_statistics {
+	bool hit = false;           // The mesh has been read from a valid cache file
+	float time_load = 0.0f;     // Time of this load, including the hash of the obj file (ms)
+	float time_parse = 0.0f;    // Time of the parsing of the obj file (ms), measured when the cache file was written
+	size_t bytes = 0;           // Size of the cache file
+};
+
+// Same mesh as mesh_load_file_obj(filename), read from its cache file when it is valid
+cgp::mesh mesh_load_file_obj_cached(std::string const& filename, mesh_cache_statistics* statistics = nullptr);
+
+// Startup time saved by the cache (time_parse - time_load on a hit), written on the command line
+void mesh_cache_report(std::string const& filename, mesh_cache_statistics const& statistics);
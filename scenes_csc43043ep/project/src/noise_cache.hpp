@@ -0,0 +1,86 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "thread_pool.hpp"
+
+// Precomputed noise
+// ********************************************** //
+//  noise_perlin is baked once in a table covering the box where it is evaluated, and then read with a bilinear (2D) or
+//  trilinear (3D) interpolation instead of the sum of octaves of gradient noise. The samples of the table are the values
+//  of noise_perlin itself: the cached noise only differs from it by the interpolation between the samples.
+//  The positions outside of the box are evaluated with noise_perlin.
+//  The same table can be uploaded as a texture to be sampled in a shader:  texture(noise_texture, (p - corner) / length).r
+
+// Parameters of the noise (same meaning as the arguments of noise_perlin)
+struct noise_cache_parameters {
+	int octave = 6;
+	float persistency = 0.4f;
+	float frequency_gain = 2.0f;
+};
+
+// Number of samples along a length (in noise coordinates) with samples_per_cell samples along each lattice cell of the finest octave.
+//  With fewer samples per cell the finest octaves are lost: with one sample per cell, every sample is on the lattice where the gradient noise is 0.
+int noise_cache_size(float length, noise_cache_parameters const& parameters, int samples_per_cell = 2);
+// Largest number of octaves that N samples along the length can represent with samples_per_cell samples per cell of the finest octave
+int noise_cache_octave_max(float length, int N, float frequency_gain = 2.0f, int samples_per_cell = 2);
+
+
+// 2D noise table covering the box [corner, corner + length]
+struct noise_cache_2D {
+
+	noise_cache_parameters parameters;
+	cgp::vec2 corner;
+	cgp::vec2 length;
+	cgp::int2 N;                // Number of samples along each direction (the samples include both ends of the box)
+	std::vector<float> values;  // Samples stored as values[kx + N.x*ky]
+	GLuint texture = 0;         // Optional GL texture of the table (R32F)
+
+	// Bake the table (in parallel on the thread pool if it is not null)
+	void initialize(noise_cache_parameters const& parameters, cgp::vec2 const& corner, cgp::vec2 const& length, cgp::int2 const& N, thread_pool_structure* thread_pool = nullptr);
+	// Read the table from a file if it has been baked with the same parameters and box, otherwise bake it and store it in the file
+	void load_or_initialize(std::string const& filename, noise_cache_parameters const& parameters, cgp::vec2 const& corner, cgp::vec2 const& length, cgp::int2 const& N, thread_pool_structure* thread_pool = nullptr);
+
+	// Interpolated value of noise_perlin at position p (noise_perlin itself outside of the box)
+	float operator()(cgp::vec2 const& p) const;
+
+	void initialize_texture_on_gpu();
+	void clear();
+	size_t memory() const { return values.size() * sizeof(float); }
+};
+
+// 3D noise table covering the box [corner, corner + length]
+struct noise_cache_3D {
+
+	noise_cache_parameters parameters;
+	cgp::vec3 corner;
+	cgp::vec3 length;
+	cgp::int3 N;                // Number of samples along each direction (the samples include both ends of the box)
+	std::vector<float> values;  // Samples stored as values[kx + N.x*(ky + N.y*kz)]
+	GLuint texture = 0;         // Optional GL 3D texture of the table (R32F)
+
+	void initialize(noise_cache_parameters const& parameters, cgp::vec3 const& corner, cgp::vec3 const& length, cgp::int3 const& N, thread_pool_structure* thread_pool = nullptr);
+	void load_or_initialize(std::string const& filename, noise_cache_parameters const& parameters, cgp::vec3 const& corner, cgp::vec3 const& length, cgp::int3 const& N, thread_pool_structure* thread_pool = nullptr);
+
+	// Interpolated value of noise_perlin at position p (noise_perlin itself outside of the box)
+	float operator()(cgp::vec3 const& p) const;
+
+	void initialize_texture_on_gpu();
+	void clear();
+	size_t memory() const { return values.size() * sizeof(float); }
+};
+
+
+// Accuracy and speed of a cache compared to the noise it replaces
+struct noise_cache_measure_structure {
+	float error_max = 0.0f;     // Maximal absolute difference with noise_perlin
+	float error_rms = 0.0f;     // Root mean square difference with noise_perlin
+	float time_cache = 0.0f;    // Average time of one lookup in the cache (ns)
+	float time_perlin = 0.0f;   // Average time of one evaluation of noise_perlin (ns)
+	size_t memory = 0;          // Size of the table (bytes)
+};
+
+// Compare the cache with noise_perlin on random positions of its box (the result is also displayed on the command line)
+//  The reference noise has octave_reference octaves (0: the octaves of the table). It differs from the octaves of the table when
+//  they have been clamped to fit in the table, and the missing octaves are then part of the error.
+noise_cache_measure_structure noise_cache_measure(noise_cache_2D const& cache, int octave_reference = 0, int number_of_samples = 100000);
+noise_cache_measure_structure noise_cache_measure(noise_cache_3D const& cache, int octave_reference = 0, int number_of_samples = 100000);
@@ -3,7 +3,8 @@
 
 using namespace cgp;
 
-void deform_terrain(mesh& m)
+// The noise is either computed with noise_perlin, or read from a precomputed table (if noise_cache is not null)
+void deform_terrain(mesh& m, noise_cache_2D const* noise_cache = nullptr)
 {
 	// Set the terrain to have a gaussian shape
 	for (int k = 0; k < m.position.size(); ++k)
@@ -12,7 +13,8 @@ void deform_terrain(mesh& m)
 		float d2 = p.x*p.x + p.y * p.y;
 		float z = exp(-d2 / 4)-1;
 
-		z = z + 0.05f*noise_perlin({ p.x,p.y });
+		float const noise = noise_cache != nullptr ? (*noise_cache)({ p.x,p.y }) : noise_perlin({ p.x,p.y });
+		z = z + 0.05f*noise;
 
 		p = { p.x, p.y, z };
 	}
@@ -45,28 +47,57 @@ void scene_structure::initialize()
 	// Create the shapes seen in the 3D scene
 	// ********************************************** //
 
-	float L = 5.0f;
-	mesh terrain_mesh = mesh_primitive_grid({ -L,-L,0 }, { L,-L,0 }, { L,L,0 }, { -L,L,0 }, 100, 100);
-	deform_terrain(terrain_mesh);
-	terrain.initialize_data_on_gpu(terrain_mesh);
-	terrain.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/sand.jpg");
+	// The images are decoded and the meshes are built on the workers of the asset loader, and uploaded at the
+	//  next frames as soon as they are ready (see display_frame). The window appears before the end of the loading.
+	//  The textures are shared through the registry: each file is decoded and uploaded once.
+	assets.initialize();
+	assets.texture_registry = &textures;
+	thread_pool.initialize();
+
+	// The noise table and the terrain are only used by the main thread once the terrain is uploaded.
+	//  The noise table is only baked when it is used (here, or when the GUI option is checked).
+	bool const use_noise_cache = gui.noise_cache;
+	assets.add_drawable(terrain, assets.load_mesh([this, use_noise_cache]() {
+		if (use_noise_cache)
+			update_noise_cache();
+
+		float L = 5.0f;
+		mesh terrain_mesh = mesh_primitive_grid({ -L,-L,0 }, { L,-L,0 }, { L,L,0 }, { -L,L,0 }, 100, 100);
+		deform_terrain(terrain_mesh, use_noise_cache ? &noise_cache : nullptr);
+		return terrain_mesh;
+	}), project::path + "assets/sand.jpg");
 
 	float sea_w = 8.0;
 	float sea_z = -0.8f;
-	water.initialize_data_on_gpu(mesh_primitive_grid({ -sea_w,-sea_w,sea_z }, { sea_w,-sea_w,sea_z }, { sea_w,sea_w,sea_z }, { -sea_w,sea_w,sea_z }));
-	water.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/sea.png");
-
-	tree.initialize_data_on_gpu(mesh_load_file_obj(project::path + "assets/palm_tree/palm_tree.obj"));
-	tree.model.rotation = rotation_transform::from_axis_angle({ 1,0,0 }, Pi / 2.0f);
-	tree.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/palm_tree/palm_tree.jpg", GL_REPEAT, GL_REPEAT);
+	assets.add_drawable(water, assets.load_mesh([=]() {
+		return mesh_primitive_grid({ -sea_w,-sea_w,sea_z }, { sea_w,-sea_w,sea_z }, { sea_w,sea_w,sea_z }, { -sea_w,sea_w,sea_z });
+	}), project::path + "assets/sea.png");
+
+	// The parsed palm tree is stored in a binary cache next to the obj file, and read back at the next launches
+	std::string const palm_tree_file = project::path + "assets/palm_tree/palm_tree.obj";
+	assets.add_drawable(tree, assets.load_mesh([this, palm_tree_file]() {
+		mesh tree_mesh = mesh_load_file_obj_cached(palm_tree_file, &tree_cache);
+		mesh_cache_report("palm_tree.obj", tree_cache);
+		return tree_mesh;
+	}), project::path + "assets/palm_tree/palm_tree.jpg", GL_REPEAT, GL_REPEAT, [](mesh_drawable& drawable) {
+		drawable.model.rotation = rotation_transform::from_axis_angle({ 1,0,0 }, Pi / 2.0f);
+	});
+
+	assets.add_drawable(cube1, assets.load_mesh([]() { return mesh_primitive_cube({ 0,0,0 }, 0.5f); }), project::path + "assets/wood.jpg", GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, [this](mesh_drawable& drawable) {
+		drawable.model.rotation = rotation_transform::from_axis_angle({ -1,1,0 }, Pi / 7.0f);
+		drawable.model.translation = { 1.0f,1.0f,-0.1f };
+		cube2 = drawable;
+		textures.acquire(cube2.texture); // cube2 shares the texture of cube1
+	});
 
-	cube1.initialize_data_on_gpu(mesh_primitive_cube({ 0,0,0 }, 0.5f));
-	cube1.model.rotation = rotation_transform::from_axis_angle({ -1,1,0 }, Pi / 7.0f);
-	cube1.model.translation = { 1.0f,1.0f,-0.1f };
-	cube1.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/wood.jpg");
-
-	cube2 = cube1;
+}
 
+void scene_structure::clear()
+{
+	// Each drawable holds one reference to its texture in the registry (cube2 holds the one acquired from cube1)
+	for (mesh_drawable* drawable : { &terrain, &water, &tree, &cube1, &cube2 })
+		textures.release(drawable->texture);
+	textures.report();
 }
 
 
@@ -86,23 +117,39 @@ void scene_structure::display_frame()
 		draw(global_frame, environment);
 	
 
-	// Draw all the shapes
-	draw(terrain, environment);
-	draw(water, environment);
-	draw(tree, environment);
-	draw(cube1, environment);
-
-	// Animate the second cube in the water
-	cube2.model.translation = { -1.0f, 6.0f+0.1*sin(0.5f*timer.t), -0.8f + 0.1f * cos(0.5f * timer.t)};
-	cube2.model.rotation = rotation_transform::from_axis_angle({1,-0.2,0},Pi/12.0f*sin(0.5f*timer.t));
-	draw(cube2, environment);
+	// Upload the assets that are ready, and draw the shapes that are already loaded
+	bool const loading = !assets.done();
+	assets.update();
+	if (loading && assets.done())
+		textures.report();
+
+	if (assets.ready(terrain))
+		draw(terrain, environment);
+	if (assets.ready(water))
+		draw(water, environment);
+	if (assets.ready(tree))
+		draw(tree, environment);
+
+	if (assets.ready(cube1)) {
+		draw(cube1, environment);
+
+		// Animate the second cube in the water
+		cube2.model.translation = { -1.0f, 6.0f+0.1*sin(0.5f*timer.t), -0.8f + 0.1f * cos(0.5f * timer.t)};
+		cube2.model.rotation = rotation_transform::from_axis_angle({1,-0.2,0},Pi/12.0f*sin(0.5f*timer.t));
+		draw(cube2, environment);
+	}
 
 	if (gui.display_wireframe) {
-		draw_wireframe(terrain, environment);
-		draw_wireframe(water, environment);
-		draw_wireframe(tree, environment);
-		draw_wireframe(cube1, environment);
-		draw_wireframe(cube2, environment);
+		if (assets.ready(terrain))
+			draw_wireframe(terrain, environment);
+		if (assets.ready(water))
+			draw_wireframe(water, environment);
+		if (assets.ready(tree))
+			draw_wireframe(tree, environment);
+		if (assets.ready(cube1)) {
+			draw_wireframe(cube1, environment);
+			draw_wireframe(cube2, environment);
+		}
 	}
 	
 
@@ -119,6 +166,47 @@ void scene_structure::display_gui()
 	ImGui::Checkbox("Frame", &gui.display_frame);
 	ImGui::Checkbox("Wireframe", &gui.display_wireframe);
 
+	// The noise table and the statistics of the caches are written by the workers until their drawable is uploaded
+	if (assets.ready(terrain)) {
+		if (ImGui::Checkbox("Noise cache", &gui.noise_cache)) {
+			if (gui.noise_cache)
+				update_noise_cache();
+			update_terrain();
+		}
+		if (noise_cache.values.size() > 0)
+			ImGui::Text("Noise cache: error %.4f (max %.4f), %.0f ns vs %.0f ns (noise_perlin)", noise_measure.error_rms, noise_measure.error_max, noise_measure.time_cache, noise_measure.time_perlin);
+	}
+	if (assets.ready(tree))
+		ImGui::Text("Mesh cache (palm tree): %s, %.1f ms vs %.1f ms (parsing)", tree_cache.hit ? "hit" : "written", tree_cache.time_load, tree_cache.time_parse);
+
+	asset_loader_statistics const& loading = assets.statistics;
+	ImGui::Text("Assets: %d/%d loaded in %.0f ms (sequential loads %.0f ms, slowest %.0f ms)", loading.uploaded, loading.requested, loading.time_total, loading.time_sum, loading.time_slowest);
+
+	texture_registry_statistics const texture_statistics = textures.statistics();
+	ImGui::Text("Textures: %d (%d references), ~%.1f MB on the GPU (estimated as RGBA8 with mipmaps), %.1f MB shared", texture_statistics.textures, texture_statistics.references,
+		texture_statistics.memory / (1024 * 1024.0f), texture_statistics.memory_shared / (1024 * 1024.0f));
+}
+
+void scene_structure::update_noise_cache()
+{
+	if (noise_cache.values.size() > 0)
+		return;
+
+	// Table of the default noise_perlin (6 octaves, persistency 0.4) over the terrain [-5,5]^2
+	noise_cache_parameters noise_parameters;
+	float const L = 5.0f;
+	int const N = noise_cache_size(2 * L, noise_parameters);
+	noise_cache.load_or_initialize(project::path + "noise_cache_2d.bin", noise_parameters, { -L,-L }, { 2 * L,2 * L }, { N,N }, &thread_pool);
+	noise_measure = noise_cache_measure(noise_cache);
+}
+
+void scene_structure::update_terrain()
+{
+	float L = 5.0f;
+	mesh terrain_mesh = mesh_primitive_grid({ -L,-L,0 }, { L,-L,0 }, { L,L,0 }, { -L,L,0 }, 100, 100);
+	deform_terrain(terrain_mesh, gui.noise_cache ? &noise_cache : nullptr);
+	terrain.vbo_position.update(terrain_mesh.position);
+	terrain.vbo_normal.update(terrain_mesh.normal);
 }
 
 void scene_structure::mouse_move_event()
@@ -3,6 +3,10 @@
 
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
+#include "noise_cache.hpp"
+#include "mesh_cache.hpp"
+#include "asset_loader.hpp"
+#include "texture_registry.hpp"
 
 // This definitions allow to use the structures: mesh, mesh_drawable, etc. without mentionning explicitly cgp::
 using cgp::mesh;
@@ -15,6 +19,7 @@ using cgp::timer_basic;
 struct gui_parameters {
 	bool display_frame = true;
 	bool display_wireframe = false;
+	bool noise_cache = false;     // Use the precomputed noise table for the terrain
 };
 
 // The structure of the custom scene
@@ -44,12 +49,25 @@ struct scene_structure : cgp::scene_inputs_generic {
 	mesh_drawable cube1;
 	mesh_drawable cube2;
 
+	noise_cache_2D noise_cache;                    // Precomputed noise used by the terrain
+	noise_cache_measure_structure noise_measure;   // Accuracy and speed of the noise cache
+	void update_noise_cache();                     // Bake (or read) the noise table and measure it, if not done yet
+	void update_terrain();                         // Recompute the terrain deformation (after changing the noise source)
+
+	thread_pool_structure thread_pool;             // Threads baking the noise table
+
+	mesh_cache_statistics tree_cache;              // Load of the palm tree through the binary mesh cache
+
+	texture_registry_structure textures;           // Textures shared between the drawables, with their references
+	asset_loader_structure assets;                 // Loading of the images and meshes on worker threads (declared last: its threads stop first)
+
 
 	// ****************************** //
 	// Functions
 	// ****************************** //
 
 	void initialize();    // Standard initialization to be called before the animation loop
+	void clear();         // Release the shared textures, to be called after the animation loop (before the OpenGL context is destroyed)
 	void display_frame(); // The frame display to be called within the animation loop
 	void display_gui();   // The display of the GUI, also called within the animation loop
 
@@ -0,0 +1,122 @@
+#include "texture_registry.hpp"
+#include "content_hash.hpp"
+
+using namespace cgp;
+
+
+// Size of a texture uploaded as RGBA8, with its mipmaps (1/3 more)
+static size_t texture_memory(int width, int height)
+{
+	return size_t(width) * size_t(height) * 4 * 4 / 3;
+}
+
+opengl_texture_image_structure texture_registry_structure::share(GLuint id)
+{
+	entry& e = entries[id];
+	e.references++;
+	hits++;
+	memory_shared += e.memory;
+	return e.texture;
+}
+
+opengl_texture_image_structure texture_registry_structure::load(std::string const& filename, GLint wrap_s, GLint wrap_t)
+{
+	auto const it = by_file.find(key_file{ filename, wrap_s, wrap_t });
+	if (it != by_file.end()) {
+		requests++;
+		return share(it->second);
+	}
+	return load(filename, image_load_file(filename), wrap_s, wrap_t);
+}
+
+opengl_texture_image_structure texture_registry_structure::load(std::string const& filename, image_structure const& image, GLint wrap_s, GLint wrap_t)
+{
+	requests++;
+	key_file const file = { filename, wrap_s, wrap_t };
+	auto const it_file = by_file.find(file);
+	if (it_file != by_file.end())
+		return share(it_file->second);
+
+	if (image.width == 0 || image.height == 0) {
+		std::cout << "Cannot load the texture " << filename << std::endl;
+		return opengl_texture_image_structure();
+	}
+
+	// Same pixels already uploaded from another file
+	key_content const content = { content_hash(image.data.data.data(), image.data.size()), image.width, image.height, wrap_s, wrap_t };
+	auto const it_content = by_content.find(content);
+	if (it_content != by_content.end()) {
+		by_file[file] = it_content->second;
+		return share(it_content->second);
+	}
+
+	entry e;
+	e.texture.initialize_texture_2d_on_gpu(image, wrap_s, wrap_t);
+	e.references = 1;
+	e.memory = texture_memory(image.width, image.height);
+	e.filename = filename;
+	GLuint const id = e.texture.id;
+	entries[id] = e;
+	by_file[file] = id;
+	by_content[content] = id;
+	return e.texture;
+}
+
+void texture_registry_structure::acquire(opengl_texture_image_structure const& texture)
+{
+	auto const it = entries.find(texture.id);
+	if (it == entries.end())
+		return;
+	it->second.references++;
+}
+
+void texture_registry_structure::release(opengl_texture_image_structure& texture)
+{
+	auto const it = entries.find(texture.id);
+	if (it == entries.end())
+		return;
+	texture = opengl_texture_image_structure();
+	if (--it->second.references > 0)
+		return;
+
+	GLuint const id = it->first;
+	it->second.texture.clear();
+	entries.erase(it);
+	for (auto k = by_file.begin(); k != by_file.end();)
+		k = k->second == id ? by_file.erase(k) : std::next(k);
+	for (auto k = by_content.begin(); k != by_content.end();)
+		k = k->second == id ? by_content.erase(k) : std::next(k);
+}
+
+void texture_registry_structure::clear()
+{
+	for (auto& it : entries)
+		it.second.texture.clear();
+	entries.clear();
+	by_file.clear();
+	by_content.clear();
+}
+
+texture_registry_statistics texture_registry_structure::statistics() const
+{
+	texture_registry_statistics s;
+	for (auto const& it : entries) {
+		s.textures++;
+		s.references += it.second.references;
+		s.memory += it.second.memory;
+	}
+	s.requests = requests;
+	s.hits = hits;
+	s.memory_shared = memory_shared;
+	return s;
+}
+
+void texture_registry_structure::report() const
+{
+	texture_registry_statistics const s = statistics();
+	std::cout << "Texture registry: " << s.textures << " textures, " << s.references << " references (" << s.hits << " of " << s.requests << " requests without upload), "
+		<< s.memory / (1024 * 1024.0f) << " MB on the GPU (estimated), " << s.memory_shared / (1024 * 1024.0f) << " MB saved by the sharing" << std::endl;
+	for (auto const& it : entries)
+		std::cout << "  " << it.second.filename << ": " << it.second.texture.width << "x" << it.second.texture.height << ", "
+			<< it.second.references << " references, " << it.second.memory / 1024 << " kB" << std::endl;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+#include <map>
+#include <tuple>
+
+// Registry of the textures shared between drawables
+// ********************************************** //
+//  A texture is identified by its file and its wrap modes: the first request decodes and uploads the image, and the
+//  next requests return the same GL texture without reading the file. Two files with the same pixels (hash of the
+//  decoded image) also share the same texture.
+//  Each request adds a reference to the texture, and a copy of a drawable can add one with acquire. The texture is
+//  deleted from the GPU when its last reference is released.
+
+struct texture_registry_statistics {
+	int textures = 0;            // Textures on the GPU
+	int references = 0;          // References to these textures
+	int requests = 0;            // Calls to load
+	int hits = 0;                // Requests served by a texture already on the GPU
+	size_t memory = 0;           // Estimated size of the textures on the GPU (RGBA8 with mipmaps)
+	size_t memory_shared = 0;    // Size of the uploads avoided by the sharing
+};
+
+struct texture_registry_structure {
+
+	// Shared texture of the file with these wrap modes (one more reference)
+	cgp::opengl_texture_image_structure load(std::string const& filename, GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE);
+	// Same when the image of the file is already decoded (for instance on a worker thread)
+	cgp::opengl_texture_image_structure load(std::string const& filename, cgp::image_structure const& image, GLint wrap_s = GL_CLAMP_TO_EDGE, GLint wrap_t = GL_CLAMP_TO_EDGE);
+
+	// The texture of the file with these wrap modes is on the GPU (a load doesn't read the file)
+	bool contains(std::string const& filename, GLint wrap_s, GLint wrap_t) const { return by_file.count(key_file{ filename, wrap_s, wrap_t }) > 0; }
+
+	// One more reference to a texture of the registry (e.g. a copy of a drawable)
+	void acquire(cgp::opengl_texture_image_structure const& texture);
+	// One less reference: the texture is deleted from the GPU with its last reference, and texture is reset
+	void release(cgp::opengl_texture_image_structure& texture);
+	// Delete all the textures
+	void clear();
+
+	texture_registry_statistics statistics() const;
+	// Textures, references and memory, written on the command line
+	void report() const;
+
+private:
+	struct entry {
+		cgp::opengl_texture_image_structure texture;
+		int references = 0;
+		size_t memory = 0;
+		std::string filename;
+	};
+	using key_file = std::tuple<std::string, GLint, GLint>;       // File and wrap modes
+	using key_content = std::tuple<uint64_t, int, int, GLint, GLint>; // Hash of the pixels, dimensions and wrap modes
+
+	// Add a reference to the texture id, counted as a request served without upload
+	cgp::opengl_texture_image_structure share(GLuint id);
+
+	std::map<GLuint, entry> entries;
+	std::map<key_file, GLuint> by_file;
+	std::map<key_content, GLuint> by_content;
+	int requests = 0;
+	int hits = 0;
+	size_t memory_shared = 0;
+};
@@ -0,0 +1,90 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+void thread_pool_structure::initialize(int number_of_threads)
+{
+#ifndef __EMSCRIPTEN__
+	if (!workers.empty())
+		return;
+	if (number_of_threads <= 0)
+		number_of_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	// The calling thread is used as one of the workers
+	for (int k = 0; k < number_of_threads - 1; ++k)
+		workers.push_back(std::thread(&thread_pool_structure::worker_loop, this));
+#else
+	(void)number_of_threads;
+#endif
+}
+
+thread_pool_structure::~thread_pool_structure()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	condition_start.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void thread_pool_structure::run_chunks()
+{
+	int const number_of_chunks = (current_N + current_chunk_size - 1) / current_chunk_size;
+	for (int chunk = next_chunk++; chunk < number_of_chunks; chunk = next_chunk++) {
+		int const begin = chunk * current_chunk_size;
+		int const end = std::min(begin + current_chunk_size, current_N);
+		(*current_task)(begin, end);
+	}
+}
+
+void thread_pool_structure::worker_loop()
+{
+	unsigned int last_generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition_start.wait(lock, [&] { return stop || generation != last_generation; });
+			if (stop)
+				return;
+			last_generation = generation;
+		}
+
+		run_chunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			active_workers--;
+		}
+		condition_end.notify_one();
+	}
+}
+
+void thread_pool_structure::parallel_for(int N, int chunk_size, std::function<void(int, int)> const& task)
+{
+	if (N <= 0)
+		return;
+	if (workers.empty() || N <= chunk_size) {
+		task(0, N);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current_task = &task;
+		current_N = N;
+		current_chunk_size = std::max(1, chunk_size);
+		next_chunk = 0;
+		active_workers = int(workers.size());
+		generation++;
+	}
+	condition_start.notify_all();
+
+	run_chunks();
+
+	// Wait for the workers to finish their last chunk
+	std::unique_lock<std::mutex> lock(mutex);
+	condition_end.wait(lock, [&] { return active_workers == 0; });
+	current_task = nullptr;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+// Persistent set of worker threads used to run parallel loops
+//  The threads are created once and wait for new work between two calls (no thread creation per loop).
+//  When compiled with emscripten, the loops are run sequentially on the calling thread.
+struct thread_pool_structure {
+
+	// Start the worker threads (0: use the number of hardware threads)
+	void initialize(int number_of_threads = 0);
+	~thread_pool_structure();
+
+	// Call task(begin, end) on sub-ranges of [0, N[ of size at most chunk_size, in parallel.
+	//  The calling thread also works on the chunks, and the function returns once all the chunks are processed.
+	void parallel_for(int N, int chunk_size, std::function<void(int, int)> const& task);
+
+	int size() const { return int(workers.size()) + 1; }
+
+private:
+	void worker_loop();
+	void run_chunks();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable condition_start;
+	std::condition_variable condition_end;
+
+	std::function<void(int, int)> const* current_task = nullptr;
+	int current_N = 0;
+	int current_chunk_size = 1;
+	std::atomic<int> next_chunk{ 0 };
+	int active_workers = 0;
+	unsigned int generation = 0;
+	bool stop = false;
+};